@@ -29,7 +29,23 @@ namespace Camera {
     frameinfo{
       .index{0},
       .currentframe{0}
-    }
+    },
+    status_cache(
+      [this](const std::string &cmd, std::string &reply) -> long {
+        if (!this->archon.isconnected()) return ERROR;
+        // A FETCH holds archon_busy until read_frame() is done with it. Look
+        // under archon_mutex, which send_cmd() sets the flag under too, so
+        // that no command is turned away by this look alone.
+        {
+        std::lock_guard<std::mutex> lock(this->archon_mutex);
+        if (this->archon_busy.test_and_set()) return BUSY;
+        this->archon_busy.clear();
+        }
+        return this->send_cmd(cmd, reply);
+      },
+      [this]() {
+        return this->interface && this->interface->exposure_progress.start_ns.load() != 0;
+      } )
   {
     // pre-size the modtype and modversion vectors to hold the max number of modules
     this->modtype.resize(MAXNMODS);
@@ -66,6 +82,7 @@ namespace Camera {
    * @brief      ArchonController destructor
    */
   ArchonController::~ArchonController() {
+    this->status_cache.stop();
     delete[] framebuf;
   }
   /***** Camera::ArchonController::~ArchonController **************************/
@@ -98,6 +115,14 @@ namespace Camera {
 
     if (this->interface->configfile.n_rows < 1) throw std::runtime_error("empty configuration");
 
+    ArchonStatusConfig status_config;
+    const std::map<std::string, unsigned*> status_keys = {
+      { "ARCHON_STATUS_MS",          &status_config.status_ms },
+      { "ARCHON_SYSTEM_MS",          &status_config.system_ms },
+      { "ARCHON_FRAME_MS",           &status_config.frame_ms },
+      { "ARCHON_STATUS_EXPOSING_MS", &status_config.exposing_ms }
+    };
+
     // iterate through each row in config file
     for (int row=0; row < this->interface->configfile.n_rows; row++) {
 
@@ -152,6 +177,22 @@ namespace Camera {
         this->expose_param = this->interface->configfile.arg[row];
         numapplied++;
       }
+      else
+      // ARCHON_STATUS_MS, ARCHON_SYSTEM_MS, ARCHON_FRAME_MS, ARCHON_STATUS_EXPOSING_MS
+      if (auto it=status_keys.find(this->interface->configfile.param[row]); it!=status_keys.end()) {
+        try {
+          const int ms = std::stoi(this->interface->configfile.arg[row]);
+          if (ms < 0) throw std::out_of_range("must be >= 0");
+          *it->second = static_cast<unsigned>(ms);
+          numapplied++;
+        }
+        catch (const std::exception &e) {
+          std::ostringstream oss;
+          oss << "parsing " << this->interface->configfile.param[row]
+                            << "=" << this->interface->configfile.arg[row] << ": " << e.what();
+          throw std::runtime_error(oss.str());
+        }
+      }
 
       // publish and/or log applied configuration
       if (numapplied > lastapplied) {
@@ -161,6 +202,8 @@ namespace Camera {
         logwrite(function, oss.str());  // TODO publish?
       }
     }
+
+    this->status_cache.configure(status_config);
   }
   /***** Camera::ArchonController::configure_controller ***********************/
 
@@ -223,6 +266,7 @@ namespace Camera {
     if (this->send_cmd(SYSTEM, reply) != NO_ERROR) {   // first the whole reply in one string
       throw std::runtime_error("getting SYSTEM information");
     }
+    this->status_cache.update(ArchonStatusCache::Query::System, reply);
 
     std::vector<std::string> lines, tokens;
     Tokenize( reply, lines, " " );              // then each line in a separate token "lines"
@@ -506,6 +550,7 @@ namespace Camera {
       if (error==ERROR) logwrite(function, "ERROR sending FRAME command");  // don't log here if BUSY
       return error;
     }
+    this->status_cache.update(ArchonStatusCache::Query::Frame, reply);
 
     // use direct pointer indexing for speed
     //
@@ -1716,37 +1761,22 @@ namespace Camera {
   /***** Camera::ArchonController::get_status_key *****************************/
   /**
    * @brief      get value for the indicated key from the Archon "STATUS" string
-   * @param[in]  key    key to extract from STATUS
-   * @param[out] value  value of key
-   * @return     ERROR | NO_ERROR
+   * @details    Served from status_cache, which sends STATUS only if its
+   *             snapshot is older than max_age_ms.
+   * @param[in]  key         key to extract from STATUS
+   * @param[out] value       value of key, unchanged if STATUS has no such key
+   * @param[in]  max_age_ms  oldest STATUS reply acceptable, 0 to always ask Archon
+   * @return     ERROR | BUSY | NO_ERROR
    *
    */
-  long ArchonController::get_status_key(const std::string &key, std::string &value) {
-    const std::string function("Camera::ArchonController::get_status_key");
-    std::stringstream message;
-    std::string reply;
-
-    long error = this->send_cmd( STATUS, reply );  // first the whole reply in one string
+  long ArchonController::get_status_key(const std::string &key, std::string &value, unsigned max_age_ms) {
+    long error = this->status_cache.refresh( ArchonStatusCache::Query::Status, max_age_ms );
 
     if ( error != NO_ERROR ) return error;
 
-    std::vector<std::string> lines, tokens;
-    Tokenize( reply, lines, " " );                 // then each line in a separate token "lines"
-
-    for ( auto line : lines ) {
-      Tokenize( line, tokens, "=" );               // break each line into tokens to get KEY=value
-      if ( tokens.size() != 2 ) continue;          // need 2 tokens
-      try {
-        if ( tokens.at(0) == key ) {               // looking for the KEY
-          value = tokens.at(1);                    // found the KEY= status here
-          break;                                   // done looking
-        } else continue;
-      }
-      catch (const std::exception &e) {            // should be impossible
-        logwrite(function, "ERROR: "+std::string(e.what()));
-        return ERROR;
-      }
-    }
+    const auto status = this->status_cache.status();
+    auto it = status.keys.find(key);
+    if ( it != status.keys.end() ) value = it->second;
     return NO_ERROR;
   }
   /***** Camera::ArchonController::get_status_key *****************************/
@@ -1790,17 +1820,17 @@ namespace Camera {
   /***** Camera::ArchonController::get_power **********************************/
   /**
    * @brief      get Archon power status
-   * @param[in]  power  reference to string to return the power_status
+   * @param[in]  max_age_ms  oldest STATUS reply acceptable, 0 to always ask Archon
    * @return     string  Archon power status
    * @throws     std::runtime_error
    *
    */
-  std::string ArchonController::get_power() {
+  std::string ArchonController::get_power(unsigned max_age_ms) {
 
-    // Read the Archon power state directly from Archon,
+    // Read the Archon power state from a STATUS reply,
     // which will be a string representation of an integer.
     std::string power_status_key;
-    if (this->get_status_key("POWER", power_status_key) != NO_ERROR) {
+    if (this->get_status_key("POWER", power_status_key, max_age_ms) != NO_ERROR) {
       throw std::runtime_error("reading status key: POWER");
     }
 
@@ -2105,6 +2135,14 @@ namespace Camera {
       }
       else busycount=0;
 
+      // line progress of the buffer being written, for async job progress
+      //
+      int wbuf = this->frameinfo.wbuf - 1;
+      if ( wbuf >= 0 && wbuf < static_cast<int>(this->frameinfo.buflines.size()) ) {
+        this->interface->exposure_progress.readout_lines = this->frameinfo.buflines[wbuf];
+        this->interface->exposure_progress.readout_total = this->frameinfo.bufheight[wbuf];
+      }
+
 //    SNPRINTF(message, "previous_frame=%d latest_completed_frame=%d newframe=%d bufcomplete[%d]=%s",
 //             previous_frame, latest_completed_frame, newframe, index, frameinfo.bufcomplete[index]?"T":"F");
 //    logwrite(function, std::string(message));
@@ -16,6 +16,7 @@
 #include "network.h"
 #include "camera_interface.h"
 #include "camera_information.h"
+#include "archon_status.h"
 
 /**
  * Archon constants
@@ -336,9 +337,9 @@ namespace Camera {
       long lock_buffer(int buffernumber);
       long unlock_buffer();
       template <class T> void get_configmap_value(const std::string &key_in, T &value_out);
-      long get_status_key(const std::string &key, std::string &value);
+      long get_status_key(const std::string &key, std::string &value, unsigned max_age_ms=0);
       std::string set_power(int state);
-      std::string get_power();
+      std::string get_power(unsigned max_age_ms=0);
 
       long allocate_framebuf(uint32_t reqsz);
       long read_frame(frametype_t type, char* &imagebufferptr);
@@ -357,6 +358,13 @@ namespace Camera {
       uint64_t lasttimestamp;
 
       long parse_system_configuration(const std::string &message);
+
+      /** @var      ArchonStatusCache status_cache
+       *  @details  last STATUS, SYSTEM and FRAME replies, refreshed in the
+       *            background once connected. Declared last so that it stops
+       *            before anything it sends through is destroyed.
+       */
+      ArchonStatusCache status_cache;
   };
   /***** Camera::ArchonInterface::Controller **********************************/
 }
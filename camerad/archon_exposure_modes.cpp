@@ -7,7 +7,9 @@
 #include "archon_exposure_modes.h"
 #include "archon_interface.h"
 
+#include <chrono>
 #include <cstdlib>
+#include <sstream>
 
 namespace Camera {
 
@@ -71,42 +73,107 @@ namespace Camera {
     long error=NO_ERROR;
 
     uint64_t bufferbytes = (uint64_t)camera_info->image_data_bytes * camera_info->cubedepth;
+    const auto &backpressure = this->interface->acquire_backpressure;
+    this->frames_held=0;
+    this->frames_dropped=0;
+    this->frames_refused=0;
 
     while (error==NO_ERROR && !this->interface->is_aborted() && nexp > 0) {
-      // prepare an ImageBuffer object for the exposure
-      auto imagebuffer = std::make_shared<ArchonImageBuffer>();
-
-      try { imagebuffer->rawpixels = std::shared_ptr<char[]>(new char[bufferbytes]);
-      }
-      catch (const std::exception &e) {
-        SNPRINTF(message, "memory allocation failed: %s", e.what());
+      // Hold off reading the next frame while the queues are full. The
+      // controller keeps exposing into its own buffers meanwhile, so if
+      // they do not drain in time stop now, before frames are overwritten.
+      if (this->wait_for_room() != NO_ERROR) {
+        if (this->interface->is_aborted()) break;
+        SNPRINTF(message, "frame queues full for %u ms, stopping exposure before frames are lost",
+                 backpressure.block_ms);
         logwrite(function, "ERROR "+std::string(message));
+        this->interface->controller->abort();
+        this->is_producer_error=true;
         error=ERROR;
         break;
       }
 
+      // prepare an ImageBuffer object for the exposure
+      auto imagebuffer = std::make_shared<ArchonImageBuffer>();
+
       // wait for frame readout into Archon buffer
       if ( (error=this->interface->controller->wait_for_readout()) == ERROR ) break;
 
-      // read frame from Archon into memory pointed to by p_imagebuffer
-      char* p_imagebuffer = imagebuffer->rawpixels.get();
-      this->interface->controller->read_frame(ArchonController::FRAME_IMAGE, p_imagebuffer);
+      // When an output can lend its own storage (an SHM ring slot) the frame
+      // is fetched straight into it, saving a full-frame copy out of the heap
+      // buffer, and the other outputs are fed from there on this thread since
+      // the slot is only stable until the ring wraps.
+      char* p_frame = nullptr;
+      FrameOutput* direct = this->interface->reserve_frame(bufferbytes, p_frame);
+
+      if (!direct) {
+        auto &pool = this->interface->framebuffer_pool;
+        if (pool && pool->buffer_bytes() >= bufferbytes) imagebuffer->rawpixels = pool->acquire();
+
+        if (!imagebuffer->rawpixels) {
+          try { imagebuffer->rawpixels = std::shared_ptr<char[]>(new char[bufferbytes]);
+          }
+          catch (const std::exception &e) {
+            SNPRINTF(message, "memory allocation failed: %s", e.what());
+            logwrite(function, "ERROR "+std::string(message));
+            error=ERROR;
+            break;
+          }
+        }
+        p_frame = imagebuffer->rawpixels.get();
+      }
+
+      // read frame from Archon into memory pointed to by p_imagebuffer,
+      // which read_frame() advances
+      char* p_imagebuffer = p_frame;
+      long readerror = this->interface->controller->read_frame(ArchonController::FRAME_IMAGE, p_imagebuffer);
+      imagebuffer->hosttime_slice.push_back( get_clock_time_nsec() );
 
       // frame metadata
       auto index = this->interface->controller->frameinfo.index.load();
       imagebuffer->bufframen_slice.push_back( this->interface->controller->frameinfo.bufframen[index] );
       imagebuffer->buftimestamp_slice.push_back( this->interface->controller->frameinfo.buftimestamp[index] );
 
-      // push frame into queue
+      if (direct) {
+        if (readerror != NO_ERROR) {
+          direct->abandon();
+          logwrite(function, "ERROR reading frame into reserved output buffer");
+          error=ERROR;
+          break;
+        }
+        auto meta = this->frame_metadata(*imagebuffer);
+        if (direct->commit(bufferbytes, meta) != NO_ERROR) this->frames_refused++;
+        this->frames_refused += this->interface->dispatch_frame(p_frame, bufferbytes, meta, direct);
+        nexp--;
+        continue;
+      }
+
+      // push frame into queue; under Block wait_for_room() made space, so
+      // only the drop policies find it full here
       {
       std::lock_guard<std::mutex> lock(this->queue_mutex);
-      this->imagebuf_queue.push(imagebuffer);
+      if (backpressure.queue_depth > 0 && this->imagebuf_queue.size() >= backpressure.queue_depth) {
+        this->frames_dropped++;
+        if (backpressure.overflow == OverflowPolicy::DropOldest) this->imagebuf_queue.pop();
+        else imagebuffer.reset();
+      }
+      if (imagebuffer) this->imagebuf_queue.push(imagebuffer);
       this->queue_cv.notify_one();
       }
       nexp--;
     }  // end loop over number of frames
 
-    logwrite(function, "complete");
+    // account for every frame that waited or was lost, here and in the outputs
+    std::ostringstream oss;
+    oss << "complete: held=" << this->frames_held << " dropped=" << this->frames_dropped
+        << " refused=" << this->frames_refused.load();
+    const auto queues = this->interface->output_queues();
+    for (size_t i=0; i < queues.size(); i++) {
+      if (queues[i].capacity == 0) continue;
+      oss << " output" << i << "{dropped=" << queues[i].dropped << " blocked=" << queues[i].blocked
+          << " spilled=" << queues[i].spilled << "}";
+    }
+    logwrite(function, oss.str());
   }
   /***** Camera::ExposureModeSingle::image_acquisition_thread *****************/
 
@@ -121,12 +188,7 @@ namespace Camera {
     logwrite(function, "enter");
 
     auto* camera_info = &this->interface->camera_info;
-    auto* controller  = this->interface->controller;
-    auto* mode        = &controller->modemap[controller->selectedmode];
-    const size_t   bufferbytes = static_cast<size_t>(camera_info->image_data_bytes) * camera_info->cubedepth;
-    const uint32_t bpp         = (mode->samplemode == 1) ? 4 : 2;
-    const uint32_t width       = static_cast<uint32_t>(mode->geometry.pixelcount);
-    const uint32_t height      = static_cast<uint32_t>(mode->geometry.linecount);
+    const size_t bufferbytes = static_cast<size_t>(camera_info->image_data_bytes) * camera_info->cubedepth;
 
     while (!this->interface->is_aborted()) {
       std::shared_ptr<ArchonImageBuffer> buf;
@@ -146,14 +208,9 @@ namespace Camera {
         buf = this->imagebuf_queue.front();
         this->imagebuf_queue.pop();
       }
+      this->space_cv.notify_one();
 
-      Camera::FrameMetadata meta;
-      meta.frame_number    = buf->bufframen_slice.empty()    ? 0 : static_cast<uint64_t>(buf->bufframen_slice[0]);
-      meta.timestamp       = buf->buftimestamp_slice.empty() ? 0 : buf->buftimestamp_slice[0];
-      meta.width           = width;
-      meta.height          = height;
-      meta.bytes_per_pixel = bpp;
-      this->interface->dispatch_frame(buf->rawpixels.get(), bufferbytes, meta);
+      this->frames_refused += this->interface->dispatch_shared(buf->rawpixels, bufferbytes, this->frame_metadata(*buf));
     }
 
     logwrite(function, "exit");
@@ -161,6 +218,62 @@ namespace Camera {
   /***** Camera::ExposureModeSingle::image_processing_thread ******************/
 
 
+  /***** Camera::ExposureModeSingle::wait_for_room ****************************/
+  /**
+   * @brief      applies acquisition backpressure before the next frame is read
+   * @details    Only the Block policy waits here: while the acquisition queue
+   *             is full, or any output queue is at high water, up to block_ms.
+   * @return     NO_ERROR when there is room, ERROR on timeout or abort
+   *
+   */
+  long ExposureModeSingle::wait_for_room() {
+    const auto &bp = this->interface->acquire_backpressure;
+    if (bp.overflow != OverflowPolicy::Block) return NO_ERROR;
+
+    const auto full = [&]() {
+      return (bp.queue_depth > 0 && this->imagebuf_queue.size() >= bp.queue_depth) ||
+             this->interface->output_pressure() >= bp.high_water;
+    };
+
+    std::unique_lock<std::mutex> lock(this->queue_mutex);
+    if (!full()) return NO_ERROR;
+    this->frames_held++;
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(bp.block_ms);
+    while (full()) {
+      if (this->interface->is_aborted()) return ERROR;
+      if (bp.block_ms > 0 && std::chrono::steady_clock::now() >= deadline) return ERROR;
+      // outputs drain on their own threads without signalling here, so look again shortly
+      this->space_cv.wait_for(lock, std::chrono::milliseconds(1));
+    }
+    return NO_ERROR;
+  }
+  /***** Camera::ExposureModeSingle::wait_for_room ****************************/
+
+
+  /***** Camera::ExposureModeSingle::frame_metadata ***************************/
+  /**
+   * @brief      builds the FrameOutput metadata for an image buffer
+   * @param[in]  buf  image buffer with its per-slice Archon metadata filled in
+   * @return     FrameMetadata for the first slice
+   *
+   */
+  Camera::FrameMetadata ExposureModeSingle::frame_metadata(const ArchonImageBuffer &buf) {
+    auto* controller = this->interface->controller;
+    auto* mode       = &controller->modemap[controller->selectedmode];
+
+    Camera::FrameMetadata meta;
+    meta.frame_number    = buf.bufframen_slice.empty()    ? 0 : static_cast<uint64_t>(buf.bufframen_slice[0]);
+    meta.timestamp       = buf.buftimestamp_slice.empty() ? 0 : buf.buftimestamp_slice[0];
+    meta.width           = static_cast<uint32_t>(mode->geometry.pixelcount);
+    meta.height          = static_cast<uint32_t>(mode->geometry.linecount);
+    meta.bytes_per_pixel = (mode->samplemode == 1) ? 4 : 2;
+    meta.host_time_ns    = buf.hosttime_slice.empty()     ? 0 : buf.hosttime_slice[0];
+    return meta;
+  }
+  /***** Camera::ExposureModeSingle::frame_metadata ***************************/
+
+
   /***** Camera::ExposureModeSingle::process *********************************/
   /**
    * @brief      image process a Single image
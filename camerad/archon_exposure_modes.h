@@ -36,6 +36,7 @@ namespace Camera {
   struct ArchonImageBuffer : public ImageBuffer<char> {
     std::vector<int> bufframen_slice;          ///< Archon frame number(s) for all slices in this image
     std::vector<uint64_t> buftimestamp_slice;  ///< Archon timestamp(s) for all slices in this image
+    std::vector<uint64_t> hosttime_slice;      ///< host CLOCK_MONOTONIC ns when each slice was read
   };
 
   class ArchonInterface;     // forward declaration
@@ -76,6 +77,15 @@ namespace Camera {
       void image_processing_thread() override;
       long expose() override;
       void process_image(std::shared_ptr<ArchonImageBuffer> &imagebuffer);
+
+    private:
+      Camera::FrameMetadata frame_metadata(const ArchonImageBuffer &buf);
+      long wait_for_room();
+
+      // acquisition backpressure, only touched on the acquisition thread
+      uint64_t frames_held=0;      ///< times readout waited for the queues to drain
+      uint64_t frames_dropped=0;   ///< frames shed from a full acquisition queue
+      std::atomic<uint64_t> frames_refused{0};   ///< output writes that failed, from either thread
   };
   /***** Camera::ExposureModeSingle *******************************************/
 
@@ -28,6 +28,35 @@ namespace Camera {
   /***** Camera::ArchonInterface::ArchonInterface *****************************/
 
 
+  /***** Camera::ArchonInterface::register_commands ***************************/
+  /**
+   * @brief      adds the Archon controller commands to the server's table
+   * @details    Each is routed through controller_cmd.
+   * @param[in]  table  the server's command table
+   *
+   */
+  void ArchonInterface::register_commands(Network::CommandTable &table) {
+    const std::vector<std::pair<std::string, unsigned>> commands = {
+      { CAMERAD_LOADTIMING, Network::CMD_SLOW },
+      { CAMERAD_READACF,    Network::CMD_NONE },
+      { "getp",             Network::CMD_NONE },
+      { "inreg",            Network::CMD_NONE },
+      { "setp",             Network::CMD_NONE },
+      { CAMERAD_MODE,       Network::CMD_NONE },
+      { "autofetch_mode",   Network::CMD_NONE },
+      { CAMERAD_STATUS,     Network::CMD_QUIET }
+    };
+    for ( const auto &[cmd, flags] : commands ) {
+      table.add( cmd,
+                 [this, cmd=cmd](const std::string &args, std::string &retstring, uint64_t) {
+                   return this->controller_cmd(cmd, args, retstring);
+                 },
+                 flags, camerad_syntax(cmd) );
+    }
+  }
+  /***** Camera::ArchonInterface::register_commands ***************************/
+
+
   /***** Camera::ArchonInterface::controller_cmd ******************************/
   /**
    * @brief      dispatcher for Archon-specific commands
@@ -71,6 +100,10 @@ namespace Camera {
     if ( cmd == "autofetch_mode" ) {
       return this->autofetch_mode(args, retstring);
     }
+    else
+    if ( cmd == CAMERAD_STATUS ) {
+      return this->status(args, retstring);
+    }
     else {
       retstring="unrecognized command";
       return ERROR;
@@ -88,6 +121,8 @@ namespace Camera {
   void ArchonInterface::configure_interface() {
     const std::string function("Camera::ArchonInterface::configure_interface");
     logwrite(function, "");
+    this->configure_backpressure();
+    this->configure_framebuffer_pool();
   }
   /***** Camera::ArchonInterface::configure_interface *************************/
 
@@ -276,6 +311,8 @@ namespace Camera {
 
     logwrite(function, "connected");
 
+    this->controller->status_cache.start();
+
     return NO_ERROR;
   }
   /***** Camera::ArchonInterface::connect_controller **************************/
@@ -311,6 +348,7 @@ namespace Camera {
    */
   long ArchonInterface::disconnect_controller() {
     const std::string function("Camera::ArchonInterface::disconnect_controller");
+    controller->status_cache.stop();
     long error = controller->archon.Close();
     if (error == NO_ERROR) {
       logwrite(function, "Archon connection terminated");
@@ -432,11 +470,17 @@ namespace Camera {
       }
     }
 
-    int nseq_remaining = nseq;
+    auto &progress = this->exposure_progress;
+    progress.sequences = nseq;
+    progress.exptime_s = this->controller->get_exptime();
 
-    while (nseq_remaining-- > 0) {
+    for (int seq=1; seq <= nseq; ++seq) {
+      progress.sequence      = seq;
+      progress.readout_lines = 0;
+      progress.start_ns      = get_clock_time_nsec();
       do_expose();
     }
+    progress.start_ns = 0;
 
     return NO_ERROR;
   }
@@ -1001,7 +1045,8 @@ namespace Camera {
     // no arg returns state
     if (args.empty()) {
       try {
-        retstring = this->controller->get_power();
+        retstring = this->controller->get_power(
+                      this->controller->status_cache.max_age_ms(ArchonStatusCache::Query::Status) );
         return NO_ERROR;
       }
       catch (const std::exception &e) {
@@ -1245,4 +1290,56 @@ namespace Camera {
   }
   /***** Camera::ArchonInterface::autofetch_mode *****************************/
 
+  /***** Camera::ArchonInterface::status **************************************/
+  /**
+   * @brief      controller STATUS, SYSTEM and FRAME as JSON
+   * @details    Served from the controller's status cache, which is queried
+   *             only when its snapshot is older than the background refresh
+   *             keeps it. Each snapshot carries its age_s. When Archon can't
+   *             be asked, e.g. while busy, the last snapshot is returned.
+   * @param[in]  args       empty for all three, else status|system|frame
+   * @param[out] retstring  JSON message terminated by JEOF
+   * @return     ERROR | HELP | JSON
+   *
+   */
+  long ArchonInterface::status(const std::string &args, std::string &retstring) {
+    if (args=="?" || args=="help") {
+      retstring = CAMERAD_STATUS;
+      retstring.append( " [ status | system | frame ]\n" );
+      retstring.append( "  returns the last Archon STATUS, SYSTEM and FRAME replies as JSON,\n" );
+      retstring.append( "  each with its age_s. Supply one to return only that.\n" );
+      return HELP;
+    }
+
+    using Query = ArchonStatusCache::Query;
+    const std::map<std::string, Query> queries = {
+      { "status", Query::Status }, { "system", Query::System }, { "frame", Query::Frame }
+    };
+
+    std::vector<std::pair<std::string, Query>> wanted;
+    if (args.empty()) wanted.assign(queries.begin(), queries.end());
+    else {
+      auto it = queries.find(args);
+      if (it == queries.end()) {
+        retstring = "invalid_argument";
+        return ERROR;
+      }
+      wanted.push_back(*it);
+    }
+
+    auto &cache = this->controller->status_cache;
+    for ( const auto &[name, query] : wanted ) cache.refresh( query, cache.max_age_ms(query) );
+
+    nlohmann::json all = cache.to_json();
+    nlohmann::json j;
+    j["messagetype"] = "archonstatus";
+    for ( const auto &[name, query] : wanted ) j[name] = all[name];
+    j["cache"] = all["cache"];
+
+    retstring = j.dump();
+    retstring.append( JEOF );
+    return JSON;
+  }
+  /***** Camera::ArchonInterface::status **************************************/
+
 }
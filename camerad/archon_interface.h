@@ -47,8 +47,9 @@ namespace Camera {
 
       long do_expose() override;
 
-      // Archon controller command dispatcher
+      // Archon controller command dispatcher, and its commands for the server's table
       //
+      void register_commands(Network::CommandTable &table) override;
       long controller_cmd(const std::string &cmd,
                           const std::string &args,
                           std::string &retstring) override;
@@ -67,6 +68,7 @@ namespace Camera {
       long set_camera_mode(std::string modeselect);
       long set_vcpu_inreg(const std::string &args, std::string &retstring);
       long autofetch_mode(const std::string &args, std::string &retstring);
+      long status(const std::string &args, std::string &retstring);
 
       // Fallback for set_camera_mode when the camera-mode name is unknown
       virtual std::string default_exposure_mode_name() const { return "SINGLE"; }
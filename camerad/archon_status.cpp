@@ -0,0 +1,377 @@
+/**
+ * @file    archon_status.cpp
+ * @brief   cached Archon STATUS, SYSTEM and FRAME replies, refreshed in the background
+ */
+
+#include "archon_status.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+
+namespace {
+
+  nlohmann::json age_s(uint64_t taken_ns, uint64_t now) {
+    if (taken_ns == 0) return nullptr;
+    return (now > taken_ns ? now - taken_ns : 0) / 1.0e9;
+  }
+
+  bool to_number(const std::string &s, double &value) {
+    if (s.empty()) return false;
+    char* end = nullptr;
+    value = std::strtod(s.c_str(), &end);
+    return end && *end == '\0';
+  }
+
+  int to_int(const std::map<std::string, std::string> &keys, const std::string &key, int fallback = 0) {
+    auto it = keys.find(key);
+    return (it == keys.end()) ? fallback : std::atoi(it->second.c_str());
+  }
+
+  /// key ends in tag, optionally followed by digits, e.g. "_V" matches P5V_V and MOD2/LVLC_V12
+  bool ends_with_tag(const std::string &key, const char* tag) {
+    size_t end = key.size();
+    while (end > 0 && std::isdigit(static_cast<unsigned char>(key[end-1]))) --end;
+    const size_t n = std::char_traits<char>::length(tag);
+    return end >= n && key.compare(end - n, n, tag) == 0;
+  }
+
+}
+
+namespace Camera {
+
+  std::map<std::string, std::string> parse_archon_keys(const std::string &reply) {
+    std::map<std::string, std::string> keys;
+    size_t pos = 0;
+    while (pos < reply.size()) {
+      while (pos < reply.size() && std::isspace(static_cast<unsigned char>(reply[pos]))) ++pos;
+      size_t end = pos;
+      while (end < reply.size() && !std::isspace(static_cast<unsigned char>(reply[end]))) ++end;
+      const size_t eq = reply.find('=', pos);
+      if (eq != std::string::npos && eq < end && eq > pos) {
+        keys[reply.substr(pos, eq - pos)] = reply.substr(eq + 1, end - eq - 1);
+      }
+      pos = end;
+    }
+    return keys;
+  }
+
+
+  ArchonStatusSnapshot ArchonStatusSnapshot::parse(const std::string &reply, uint64_t now_ns) {
+    ArchonStatusSnapshot s;
+    s.taken_ns  = now_ns;
+    s.keys      = parse_archon_keys(reply);
+    s.power     = to_int(s.keys, "POWER", -1);
+    s.powergood = to_int(s.keys, "POWERGOOD") != 0;
+    s.overheat  = to_int(s.keys, "OVERHEAT") != 0;
+
+    for (const auto &[key, text] : s.keys) {
+      double value;
+      if (!to_number(text, value)) continue;
+      const std::string name = key.substr(key.find('/') + 1);   // past MODn/
+      if (name.find("TEMP") != std::string::npos) s.temperatures[key] = value;
+      else
+      if (ends_with_tag(name, "_V")) s.voltages[key] = value;
+      else
+      if (ends_with_tag(name, "_I")) s.currents[key] = value;
+    }
+    return s;
+  }
+
+  nlohmann::json ArchonStatusSnapshot::to_json(uint64_t now_ns) const {
+    nlohmann::json j;
+    j["age_s"]        = age_s(taken_ns, now_ns);
+    j["power"]        = power;
+    j["powergood"]    = powergood;
+    j["overheat"]     = overheat;
+    j["temperatures"] = temperatures;
+    j["voltages"]     = voltages;
+    j["currents"]     = currents;
+    return j;
+  }
+
+
+  ArchonSystemSnapshot ArchonSystemSnapshot::parse(const std::string &reply, uint64_t now_ns) {
+    ArchonSystemSnapshot s;
+    s.taken_ns = now_ns;
+    s.keys     = parse_archon_keys(reply);
+
+    auto it = s.keys.find("BACKPLANE_VERSION");
+    if (it != s.keys.end()) s.backplane_version = it->second;
+
+    // MODn_TYPE is 0 for an empty slot
+    for (int slot = 1; ; ++slot) {
+      const std::string mod = "MOD" + std::to_string(slot);
+      auto type = s.keys.find(mod + "_TYPE");
+      if (type == s.keys.end()) break;
+      Module m;
+      m.slot = slot;
+      m.type = std::atoi(type->second.c_str());
+      if (m.type == 0) continue;
+      auto version = s.keys.find(mod + "_VERSION");
+      if (version != s.keys.end()) m.version = version->second;
+      s.modules.push_back(m);
+    }
+    return s;
+  }
+
+  nlohmann::json ArchonSystemSnapshot::to_json(uint64_t now_ns) const {
+    nlohmann::json j;
+    j["age_s"]             = age_s(taken_ns, now_ns);
+    j["backplane_version"] = backplane_version;
+    nlohmann::json mods = nlohmann::json::array();
+    for (const auto &m : modules) {
+      nlohmann::json mod;
+      mod["slot"]    = m.slot;
+      mod["type"]    = m.type;
+      mod["version"] = m.version;
+      mods.push_back(mod);
+    }
+    j["modules"] = mods;
+    return j;
+  }
+
+
+  ArchonFrameSnapshot ArchonFrameSnapshot::parse(const std::string &reply, uint64_t now_ns) {
+    ArchonFrameSnapshot s;
+    s.taken_ns = now_ns;
+    s.keys     = parse_archon_keys(reply);
+
+    auto it = s.keys.find("TIMER");
+    if (it != s.keys.end()) s.timer = std::strtoull(it->second.c_str(), nullptr, 16);
+    s.rbuf = to_int(s.keys, "RBUF");
+    s.wbuf = to_int(s.keys, "WBUF");
+
+    for (int n = 1; s.keys.count("BUF" + std::to_string(n) + "FRAME"); ++n) {
+      const std::string buf = "BUF" + std::to_string(n);
+      Buffer b;
+      b.complete = to_int(s.keys, buf + "COMPLETE");
+      b.frame    = to_int(s.keys, buf + "FRAME");
+      b.width    = to_int(s.keys, buf + "WIDTH");
+      b.height   = to_int(s.keys, buf + "HEIGHT");
+      b.lines    = to_int(s.keys, buf + "LINES");
+      b.pixels   = to_int(s.keys, buf + "PIXELS");
+      b.sample   = to_int(s.keys, buf + "SAMPLE");
+      auto ts = s.keys.find(buf + "TIMESTAMP");
+      if (ts != s.keys.end()) b.timestamp = std::strtoull(ts->second.c_str(), nullptr, 16);
+      s.buffers.push_back(b);
+    }
+    return s;
+  }
+
+  nlohmann::json ArchonFrameSnapshot::to_json(uint64_t now_ns) const {
+    nlohmann::json j;
+    j["age_s"] = age_s(taken_ns, now_ns);
+    j["timer"] = timer;
+    j["rbuf"]  = rbuf;
+    j["wbuf"]  = wbuf;
+    nlohmann::json bufs = nlohmann::json::array();
+    for (const auto &b : buffers) {
+      nlohmann::json buf;
+      buf["complete"]  = b.complete;
+      buf["frame"]     = b.frame;
+      buf["width"]     = b.width;
+      buf["height"]    = b.height;
+      buf["lines"]     = b.lines;
+      buf["pixels"]    = b.pixels;
+      buf["sample"]    = b.sample;
+      buf["timestamp"] = b.timestamp;
+      bufs.push_back(buf);
+    }
+    j["buffers"] = bufs;
+    return j;
+  }
+
+
+  ArchonStatusCache::ArchonStatusCache(Send send, Busy busy)
+    : send_(std::move(send)), busy_(std::move(busy)) {
+  }
+
+  ArchonStatusCache::~ArchonStatusCache() {
+    this->stop();
+  }
+
+  void ArchonStatusCache::configure(const ArchonStatusConfig &cfg) {
+    {
+      std::lock_guard lock(mtx_);
+      cfg_ = cfg;
+    }
+    cv_.notify_all();
+  }
+
+  void ArchonStatusCache::start() {
+    std::lock_guard lock(mtx_);
+    if (running_) return;
+    stop_    = false;
+    running_ = true;
+    thread_ = std::thread(&ArchonStatusCache::poll_loop, this);
+  }
+
+  void ArchonStatusCache::stop() {
+    {
+      std::lock_guard lock(mtx_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    std::lock_guard lock(mtx_);
+    running_ = false;
+  }
+
+  const std::string& ArchonStatusCache::command(Query query) {
+    static const std::string status("STATUS"), system("SYSTEM"), frame("FRAME");
+    switch (query) {
+      case Query::System: return system;
+      case Query::Frame:  return frame;
+      default:            return status;
+    }
+  }
+
+  unsigned ArchonStatusCache::interval_ms(Query query, bool exposing) const {
+    unsigned ms = (query == Query::Status) ? cfg_.status_ms
+                : (query == Query::System) ? cfg_.system_ms
+                :                            cfg_.frame_ms;
+    if (ms == 0 || !exposing) return ms;
+    return (cfg_.exposing_ms == 0) ? 0 : std::max(ms, cfg_.exposing_ms);
+  }
+
+  unsigned ArchonStatusCache::max_age_ms(Query query) const {
+    const bool exposing = busy_ && busy_();
+    std::lock_guard lock(mtx_);
+    if (!running_ || stop_) return 0;
+    const unsigned ms = this->interval_ms(query, exposing);
+    if (ms > 0) return ms + ms / 2;            // slack for the poll in progress
+    // paused for an exposure: serve what is cached rather than query
+    return (exposing && this->interval_ms(query, false) > 0) ? UINT_MAX : 0;
+  }
+
+  // Parses outside the lock, so readers wait only for the copy
+  void ArchonStatusCache::store(Query query, const std::string &reply, uint64_t now) {
+    switch (query) {
+      case Query::Status: { auto s = ArchonStatusSnapshot::parse(reply, now);
+                            std::lock_guard lock(mtx_); status_ = std::move(s); break; }
+      case Query::System: { auto s = ArchonSystemSnapshot::parse(reply, now);
+                            std::lock_guard lock(mtx_); system_ = std::move(s); break; }
+      case Query::Frame:  { auto s = ArchonFrameSnapshot::parse(reply, now);
+                            std::lock_guard lock(mtx_); frame_ = std::move(s); break; }
+    }
+  }
+
+  void ArchonStatusCache::update(Query query, const std::string &reply) {
+    const uint64_t now = get_clock_time_nsec();
+    this->store(query, reply, now);
+    {
+      std::lock_guard lock(mtx_);
+      Slot &slot = slots_[static_cast<int>(query)];
+      slot.taken_ns = std::max(slot.taken_ns, now);
+      ++n_updates_;
+    }
+    cv_.notify_all();
+  }
+
+  long ArchonStatusCache::refresh(Query query, unsigned max_age_ms) {
+    const uint64_t requested = get_clock_time_nsec();
+    const uint64_t max_age_ns = static_cast<uint64_t>(max_age_ms) * 1000000ULL;
+    std::unique_lock lock(mtx_);
+    Slot &slot = slots_[static_cast<int>(query)];
+    auto young = [&]() { return slot.taken_ns > 0 && slot.taken_ns + max_age_ns >= requested; };
+
+    if (young()) { ++n_cached_; return NO_ERROR; }
+
+    if (slot.in_flight) {
+      ++n_coalesced_;
+      cv_.wait(lock, [&]() { return !slot.in_flight || stop_; });
+      return young() ? NO_ERROR : ERROR;
+    }
+
+    slot.in_flight = true;
+    lock.unlock();
+    std::string reply;
+    const long error = send_(command(query), reply);
+    const uint64_t now = get_clock_time_nsec();
+    if (error == NO_ERROR) this->store(query, reply, now);
+    lock.lock();
+
+    slot.in_flight = false;
+    if (error == BUSY) ++n_busy_;
+    else ++n_sent_;
+    if (error == NO_ERROR) slot.taken_ns = std::max(slot.taken_ns, now);
+    else if (error != BUSY) ++n_failed_;
+    lock.unlock();
+    cv_.notify_all();
+    return error;
+  }
+
+  ArchonStatusSnapshot ArchonStatusCache::status() const {
+    std::lock_guard lock(mtx_);
+    return status_;
+  }
+
+  ArchonSystemSnapshot ArchonStatusCache::system() const {
+    std::lock_guard lock(mtx_);
+    return system_;
+  }
+
+  ArchonFrameSnapshot ArchonStatusCache::frame() const {
+    std::lock_guard lock(mtx_);
+    return frame_;
+  }
+
+  nlohmann::json ArchonStatusCache::to_json() const {
+    const uint64_t now = get_clock_time_nsec();
+    nlohmann::json j;
+    std::lock_guard lock(mtx_);
+    j["status"] = status_.to_json(now);
+    j["system"] = system_.to_json(now);
+    j["frame"]  = frame_.to_json(now);
+    nlohmann::json cache;
+    cache["polling"]   = running_ && !stop_;
+    cache["sent"]      = n_sent_;
+    cache["failed"]    = n_failed_;
+    cache["busy"]      = n_busy_;
+    cache["coalesced"] = n_coalesced_;
+    cache["cached"]    = n_cached_;
+    cache["updates"]   = n_updates_;
+    j["cache"] = cache;
+    return j;
+  }
+
+  // Refreshes each query when its interval has passed since the last reply
+  // or attempt, re-reading the exposure state at least once a second
+  void ArchonStatusCache::poll_loop() {
+    constexpr uint64_t RECHECK_NS = 1000000000ULL;
+    uint64_t attempted[3] = { 0, 0, 0 };
+    std::unique_lock lock(mtx_);
+    while (!stop_) {
+      lock.unlock();
+      const bool exposing = busy_ && busy_();
+      lock.lock();
+
+      uint64_t now  = get_clock_time_nsec();
+      uint64_t next = now + RECHECK_NS;
+      for (Query query : { Query::Status, Query::System, Query::Frame }) {
+        const int i = static_cast<int>(query);
+        const unsigned ms = this->interval_ms(query, exposing);
+        if (ms == 0) continue;
+        const uint64_t interval = static_cast<uint64_t>(ms) * 1000000ULL;
+        uint64_t due = std::max(slots_[i].taken_ns, attempted[i]) + interval;
+        if (due <= now && !slots_[i].in_flight) {
+          attempted[i] = now;
+          lock.unlock();
+          // a reply exactly one interval old is due, so ask for one younger
+          this->refresh(query, ms - 1);
+          lock.lock();
+          if (stop_) return;
+          now = get_clock_time_nsec();
+          due = std::max(slots_[i].taken_ns, attempted[i]) + interval;
+        }
+        next = std::min(next, std::max(due, now));
+      }
+      cv_.wait_for(lock, std::chrono::nanoseconds(next - now), [this]() { return stop_; });
+    }
+  }
+
+}
@@ -0,0 +1,169 @@
+/**
+ * @file    archon_status.h
+ * @brief   cached Archon STATUS, SYSTEM and FRAME replies, refreshed in the background
+ *
+ * The Archon answers one command at a time, so every client asking for
+ * controller status used to cost a command on the same socket that reads
+ * out frames. ArchonStatusCache keeps the last reply to each of STATUS,
+ * SYSTEM and FRAME, parsed once into a typed snapshot, and a thread of
+ * its own refreshes each at its configured rate, slower while an exposure
+ * is in progress. Clients are served from the snapshots, which say how
+ * old they are. A caller that needs a newer snapshot than the cache holds
+ * sends the query itself, and callers arriving while it is in flight wait
+ * for that reply instead of sending their own. Replies got elsewhere,
+ * e.g. FRAME while waiting for readout, are stored too.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace Camera {
+
+  /// "KEY=value KEY=value ..." as the Archon replies to STATUS, SYSTEM and FRAME
+  std::map<std::string, std::string> parse_archon_keys(const std::string &reply);
+
+  /// STATUS: power, temperatures, supply voltages and currents
+  struct ArchonStatusSnapshot {
+    uint64_t taken_ns{0};                         ///< CLOCK_MONOTONIC of the reply, 0 if never read
+    int      power{-1};                           ///< POWER, 0..5; -1 if absent
+    bool     powergood{false};
+    bool     overheat{false};
+    std::map<std::string, double> temperatures;   ///< BACKPLANE_TEMP, MODn/TEMP, MODn/TEMPA, ...
+    std::map<std::string, double> voltages;       ///< P5V_V, MODn/LVLC_V1, ...
+    std::map<std::string, double> currents;       ///< P5V_I, MODn/LVLC_I1, ...
+    std::map<std::string, std::string> keys;      ///< the whole reply
+
+    static ArchonStatusSnapshot parse(const std::string &reply, uint64_t now_ns);
+    nlohmann::json to_json(uint64_t now_ns) const;
+  };
+
+  /// SYSTEM: backplane and installed modules
+  struct ArchonSystemSnapshot {
+    struct Module {
+      int         slot{0};                        ///< from 1
+      int         type{0};                        ///< MODTYPE_*
+      std::string version;
+    };
+    uint64_t taken_ns{0};
+    std::string backplane_version;
+    std::vector<Module> modules;                  ///< those present, by slot
+    std::map<std::string, std::string> keys;
+
+    static ArchonSystemSnapshot parse(const std::string &reply, uint64_t now_ns);
+    nlohmann::json to_json(uint64_t now_ns) const;
+  };
+
+  /// FRAME: timer and the state of each frame buffer
+  struct ArchonFrameSnapshot {
+    struct Buffer {
+      int      complete{0};
+      int      frame{0};
+      int      width{0};
+      int      height{0};
+      int      lines{0};                          ///< lines written so far
+      int      pixels{0};
+      int      sample{0};                         ///< 0=16 bit, 1=32 bit
+      uint64_t timestamp{0};
+    };
+    uint64_t taken_ns{0};
+    uint64_t timer{0};
+    int      rbuf{0};
+    int      wbuf{0};
+    std::vector<Buffer> buffers;                  ///< buffers[0] is BUF1
+    std::map<std::string, std::string> keys;
+
+    static ArchonFrameSnapshot parse(const std::string &reply, uint64_t now_ns);
+    nlohmann::json to_json(uint64_t now_ns) const;
+  };
+
+  struct ArchonStatusConfig {
+    unsigned status_ms{1000};                     ///< ARCHON_STATUS_MS, 0 to query only on demand
+    unsigned system_ms{30000};                    ///< ARCHON_SYSTEM_MS
+    unsigned frame_ms{1000};                      ///< ARCHON_FRAME_MS
+    unsigned exposing_ms{0};                      ///< ARCHON_STATUS_EXPOSING_MS, least interval while exposing, 0 to pause
+  };
+
+  class ArchonStatusCache {
+    public:
+      enum class Query { Status, System, Frame };
+
+      /// sends an Archon command and returns its reply; ERROR | BUSY | NO_ERROR
+      using Send = std::function<long(const std::string &cmd, std::string &reply)>;
+      /// true while an exposure is in progress
+      using Busy = std::function<bool()>;
+
+      ArchonStatusCache(Send send, Busy busy);
+      ~ArchonStatusCache();
+
+      ArchonStatusCache(const ArchonStatusCache&) = delete;
+      ArchonStatusCache& operator=(const ArchonStatusCache&) = delete;
+
+      /// takes effect at the next refresh; may be called while running
+      void configure(const ArchonStatusConfig &cfg);
+
+      void start();
+      void stop();
+
+      /// stores a reply to query obtained elsewhere
+      void update(Query query, const std::string &reply);
+
+      /**
+       * Makes the snapshot for query at most max_age_ms old, sending the
+       * query unless one is already in flight, in which case it waits for
+       * that reply. NO_ERROR if the snapshot is now young enough.
+       */
+      long refresh(Query query, unsigned max_age_ms);
+
+      /// age the background refresh keeps query within right now, 0 if it does not
+      unsigned max_age_ms(Query query) const;
+
+      ArchonStatusSnapshot status() const;
+      ArchonSystemSnapshot system() const;
+      ArchonFrameSnapshot  frame() const;
+
+      /// {"status": {...}, "system": {...}, "frame": {...}, "cache": {...}}, each with age_s
+      nlohmann::json to_json() const;
+
+    private:
+      struct Slot {
+        uint64_t taken_ns{0};
+        bool     in_flight{false};
+      };
+
+      static const std::string& command(Query query);
+      unsigned interval_ms(Query query, bool exposing) const;
+      void store(Query query, const std::string &reply, uint64_t now);
+      void poll_loop();
+
+      Send send_;
+      Busy busy_;
+
+      mutable std::mutex mtx_;
+      std::condition_variable cv_;                ///< a reply stored, or stopping
+      ArchonStatusConfig cfg_;
+      Slot slots_[3];
+      ArchonStatusSnapshot status_;
+      ArchonSystemSnapshot system_;
+      ArchonFrameSnapshot  frame_;
+      uint64_t n_sent_{0};                        ///< queries sent to the controller
+      uint64_t n_failed_{0};
+      uint64_t n_busy_{0};                        ///< queries not sent, Archon busy with a FETCH
+      uint64_t n_coalesced_{0};                   ///< callers that waited on another's query
+      uint64_t n_cached_{0};                      ///< refreshes served from the cache
+      uint64_t n_updates_{0};                     ///< replies stored from elsewhere
+
+      bool stop_{false};
+      bool running_{false};                       ///< start()ed and not yet stop()ped
+      std::thread thread_;
+  };
+
+}
@@ -1,4 +1,11 @@
 #include "camera_interface.h"
+#include "camera_server.h"
+#include "roi_output.h"
+#include "centroider.h"
+#include "trigger_ring.h"
+#include "output_metrics.h"
+
+#include <iomanip>
 
 namespace Camera {
 
@@ -25,4 +32,278 @@ namespace Camera {
     this->disconnect_controller("", retstring);
   }
   /***** Camera::Interface::disconnect_controller *****************************/
+
+
+  /***** Camera::Interface::configure_backpressure ****************************/
+  /**
+   * @brief      applies the ACQUIRE_* keys from the config file
+   * @details    ACQUIRE_QUEUE_DEPTH, ACQUIRE_OVERFLOW (block | drop_newest |
+   *             drop_oldest), ACQUIRE_BLOCK_MS and ACQUIRE_HIGH_WATER (output
+   *             queue fill, 0 to 1) set this->acquire_backpressure
+   * @throws     std::runtime_error
+   *
+   */
+  void Interface::configure_backpressure() {
+    const std::string function("Camera::Interface::configure_backpressure");
+    auto &bp = this->acquire_backpressure;
+
+    for (int row=0; row < this->configfile.n_rows; row++) {
+      const std::string &key = this->configfile.param[row];
+      const std::string &val = this->configfile.arg[row];
+      if (key.compare(0, 8, "ACQUIRE_") != 0) continue;
+
+      try {
+        if (key=="ACQUIRE_QUEUE_DEPTH") bp.queue_depth = std::stoul(val);
+        else
+        if (key=="ACQUIRE_OVERFLOW") {
+          bp.overflow = parse_overflow_policy(val);
+          if (bp.overflow == OverflowPolicy::Spill) throw std::invalid_argument("spill applies to outputs only");
+        }
+        else
+        if (key=="ACQUIRE_BLOCK_MS") bp.block_ms = static_cast<uint32_t>(std::stoul(val));
+        else
+        if (key=="ACQUIRE_HIGH_WATER") {
+          bp.high_water = std::stod(val);
+          if (bp.high_water <= 0 || bp.high_water > 1) throw std::out_of_range("expected 0 < fill <= 1");
+        }
+        else continue;
+      }
+      catch (const std::exception &e) {
+        std::ostringstream oss;
+        oss << "parsing " << key << "=" << val << ": " << e.what();
+        throw std::runtime_error(oss.str());
+      }
+      logwrite(function, "config:"+key+"="+val);
+    }
+  }
+  /***** Camera::Interface::configure_backpressure ****************************/
+
+
+  /***** Camera::Interface::configure_framebuffer_pool ************************/
+  /**
+   * @brief      builds this->framebuffer_pool from the FRAMEPOOL_* keys
+   * @details    FRAMEPOOL_BUFFERS=0 (the default) leaves frames on the heap.
+   *             FRAMEPOOL_BUFFER_BYTES is the largest frame the pool holds;
+   *             larger frames also go to the heap. A pool that cannot be
+   *             mapped is logged and skipped rather than failing startup.
+   * @throws     std::runtime_error
+   *
+   */
+  void Interface::configure_framebuffer_pool() {
+    const std::string function("Camera::Interface::configure_framebuffer_pool");
+
+    FrameBufferPoolConfig cfg;
+    apply_config_overrides(cfg, this->configfile);
+
+    this->framebuffer_pool.reset();
+    if (cfg.num_buffers == 0) return;
+    if (cfg.buffer_bytes == 0) throw std::runtime_error("FRAMEPOOL_BUFFERS requires FRAMEPOOL_BUFFER_BYTES");
+
+    auto pool = std::make_shared<FrameBufferPool>(cfg);
+    if (pool->open() != NO_ERROR) {
+      logwrite(function, "WARNING frame buffer pool unavailable, frames will use the heap");
+      return;
+    }
+    this->framebuffer_pool = std::move(pool);
+  }
+  /***** Camera::Interface::configure_framebuffer_pool ************************/
+
+
+  /***** Camera::Interface::metrics *******************************************/
+  /**
+   * @brief      JSON snapshot of the frame output metrics
+   * @details    Frames in, written, dropped and failed, bytes, latency
+   *             percentiles and queue depth of every link of every output
+   *             chain, and which output looks like the bottleneck, plus
+   *             the command server's connections and per-command latencies.
+   *             Also answers the common TELEMREQUEST and SNAPSHOT commands.
+   * @param[in]  args       none, or ? for help
+   * @param[out] retstring  JSON message terminated by JEOF
+   * @return     JSON | HELP
+   *
+   */
+  long Interface::metrics(const std::string &args, std::string &retstring) {
+    if (args=="?" || args=="help") {
+      retstring = CAMERAD_METRICS;
+      retstring.append( "\n" );
+      retstring.append( "  returns a JSON snapshot of the counters, latencies and queues\n" );
+      retstring.append( "  of every frame output, outermost decorator first, and of the\n" );
+      retstring.append( "  command server connections.\n" );
+      return HELP;
+    }
+
+    nlohmann::json jmessage = metrics_snapshot(this->frame_outputs);
+    jmessage["output_pressure"] = this->output_pressure();
+    if (this->server) jmessage["server"] = this->server->server_metrics();
+
+    retstring = jmessage.dump();
+    retstring.append( JEOF );
+    return JSON;
+  }
+  /***** Camera::Interface::metrics *******************************************/
+
+
+  /***** Camera::Interface::progress ******************************************/
+  /**
+   * @brief      progress of the current exposure, for async job notifications
+   * @return     JSON object with exposure elapsed, readout and frames written
+   *
+   */
+  nlohmann::json Interface::progress() {
+    nlohmann::json j;
+    const auto &p = this->exposure_progress;
+    const uint64_t start = p.start_ns.load();
+    j["exposing"]        = ( start != 0 );
+    j["exptime_s"]       = p.exptime_s.load();
+    j["elapsed_s"]       = ( start != 0 ? ( get_clock_time_nsec() - start ) / 1.0e9 : 0.0 );
+    j["sequence"]        = p.sequence.load();
+    j["sequences"]       = p.sequences.load();
+    j["readout_lines"]   = p.readout_lines.load();
+    j["readout_total"]   = p.readout_total.load();
+
+    uint64_t written = 0;
+    for ( const auto &output : this->frame_outputs ) written += output->metrics().frames_written;
+    j["frames_written"]  = written;
+    return j;
+  }
+  /***** Camera::Interface::progress ******************************************/
+
+
+  /***** Camera::Interface::roi ***********************************************/
+  /**
+   * @brief      set or get the region-of-interest windows
+   * @details    Windows are defined in the config file (ROI_WINDOW); this
+   *             moves or resizes one of them while frames are flowing.
+   *             A window cannot grow beyond its configured pixel count.
+   * @param[in]  args       <id> <x0> <y0> [ <width> <height> ]
+   * @param[out] retstring  current windows as "<id>:<x0>,<y0>,<width>,<height> ..."
+   * @return     ERROR | NO_ERROR | HELP
+   *
+   */
+  long Interface::roi(const std::string &args, std::string &retstring) {
+    const std::string function("Camera::Interface::roi");
+
+    if (args=="?" || args=="help") {
+      retstring = CAMERAD_ROI;
+      retstring.append( " [ <id> <x0> <y0> [ <width> <height> ] ]\n" );
+      retstring.append( "  set or get region-of-interest window <id>.\n" );
+      retstring.append( "  Omit <width> <height> to move the window without resizing.\n" );
+      return HELP;
+    }
+
+    // the ROI and centroid outputs share one table, either one will do
+    std::shared_ptr<RoiTable> table;
+    if (auto* roi_output = this->find_frame_output<RoiOutput>()) table = roi_output->table();
+    else
+    if (auto* centroid = this->find_frame_output<CentroidOutput>()) table = centroid->table();
+
+    if (!table) {
+      logwrite(function, "ERROR no ROI output configured");
+      retstring="not_configured";
+      return ERROR;
+    }
+
+    long error=NO_ERROR;
+
+    if (!args.empty()) {
+      std::vector<std::string> tokens;
+      Tokenize(args, tokens, " ");
+      try {
+        if (tokens.size() != 3 && tokens.size() != 5) throw std::invalid_argument("expected 3 or 5 arguments");
+        const size_t id = std::stoul(tokens[0]);
+        if (id >= table->size()) throw std::out_of_range("no window "+tokens[0]);
+        RoiWindow window = table->snapshot()[id];
+        window.x0 = static_cast<uint32_t>(std::stoul(tokens[1]));
+        window.y0 = static_cast<uint32_t>(std::stoul(tokens[2]));
+        if (tokens.size() == 5) {
+          window.width  = static_cast<uint32_t>(std::stoul(tokens[3]));
+          window.height = static_cast<uint32_t>(std::stoul(tokens[4]));
+        }
+        std::string errstring;
+        if (table->set(id, window, errstring) != NO_ERROR) {
+          logwrite(function, "ERROR "+errstring);
+          error=ERROR;
+        }
+      }
+      catch (const std::exception &e) {
+        logwrite(function, "ERROR parsing \""+args+"\": "+std::string(e.what()));
+        error=ERROR;
+      }
+    }
+
+    std::ostringstream oss;
+    const auto windows = table->snapshot();
+    for (size_t id=0; id < windows.size(); ++id) {
+      const auto &w = windows[id];
+      oss << (id>0 ? " " : "") << id << ":" << w.x0 << "," << w.y0 << "," << w.width << "," << w.height;
+    }
+    retstring = oss.str();
+
+    return error;
+  }
+  /***** Camera::Interface::roi ***********************************************/
+
+
+  /***** Camera::Interface::trigger *******************************************/
+  /**
+   * @brief      dump the pre-trigger ring, or report on it
+   * @details    The ring keeps the last TRIGGER_SECONDS of frames in RAM.
+   *             "dump" writes them, and TRIGGER_POST_FRAMES more, through
+   *             the FITS or raw writer in the background; acquisition
+   *             carries on. Only one dump runs at a time.
+   * @param[in]  args       dump [ <reason> ] | status
+   * @param[out] retstring  basename of the dump, or the ring's counters
+   * @return     ERROR | NO_ERROR | HELP
+   *
+   */
+  long Interface::trigger(const std::string &args, std::string &retstring) {
+    const std::string function("Camera::Interface::trigger");
+
+    if (args=="?" || args=="help") {
+      retstring = CAMERAD_TRIGGER;
+      retstring.append( " [ dump [ <reason> ] | status ]\n" );
+      retstring.append( "  dump writes the frames held in the pre-trigger ring, plus any\n" );
+      retstring.append( "  configured post-trigger frames, without pausing acquisition.\n" );
+      retstring.append( "  status (the default) reports the ring's counters.\n" );
+      return HELP;
+    }
+
+    auto* ring = this->find_frame_output<TriggerRing>();
+    if (!ring) {
+      logwrite(function, "ERROR no pre-trigger ring configured");
+      retstring="not_configured";
+      return ERROR;
+    }
+
+    std::vector<std::string> tokens;
+    Tokenize(args, tokens, " ");
+
+    if (!tokens.empty() && tokens[0] == "dump") {
+      // the reason is the rest of the line as typed
+      const size_t at = args.find_first_not_of(' ', args.find("dump") + 4);
+      const std::string reason = (at == std::string::npos) ? "trigger command" : args.substr(at);
+      if (ring->dump(reason, retstring) != NO_ERROR) {
+        retstring = ring->dumping() ? "busy" : "error";
+        return ERROR;
+      }
+      return NO_ERROR;
+    }
+    else
+    if (!tokens.empty() && (tokens[0] != "status" || tokens.size() > 1)) {
+      logwrite(function, "ERROR unrecognized argument \""+args+"\"");
+      retstring="invalid_argument";
+      return ERROR;
+    }
+
+    const auto s = ring->stats();
+    std::ostringstream oss;
+    oss << "frames=" << s.slots << " held=" << std::fixed << std::setprecision(1) << s.seconds_held << "s"
+        << " recorded=" << s.frames_recorded << " dumping=" << (ring->dumping() ? "yes" : "no")
+        << " dumps=" << s.dumps << " triggers=" << s.triggers
+        << " dumped=" << s.frames_dumped << " lost=" << s.frames_lost;
+    retstring = oss.str();
+
+    return NO_ERROR;
+  }
+  /***** Camera::Interface::trigger *******************************************/
 }
@@ -13,7 +13,11 @@
 #include "camerad_commands.h"
 #include "exposure_modes.h"
 #include "frame_output.h"
+#include "frame_buffer_pool.h"
+#include "command_table.h"
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -21,6 +25,36 @@ namespace Camera {
 
   class Server;  // forward declaration for Interface class
 
+  /** @struct   AcquireBackpressure
+   *  @brief    bounds the frames read from the controller but not yet
+   *            handed to the outputs
+   *  @details  Under Block the acquisition thread holds off reading the
+   *            next frame while that queue is full or any output queue is
+   *            at high_water, and stops the exposure if it lasts block_ms,
+   *            while the frames already read are still safe. DropNewest
+   *            and DropOldest shed a frame from a full queue instead.
+   */
+  struct AcquireBackpressure {
+    size_t         queue_depth{16};                   ///< 0 for no limit
+    OverflowPolicy overflow{OverflowPolicy::Block};
+    uint32_t       block_ms{2000};                    ///< 0 waits without limit
+    double         high_water{0.9};                   ///< output fill that counts as full
+  };
+
+  /** @struct   ExposureProgress
+   *  @brief    where the current exposure sequence has got to
+   *  @details  Written by the exposing thread and read by the async job
+   *            notifier while an expose job runs.
+   */
+  struct ExposureProgress {
+    std::atomic<uint64_t> start_ns{0};        ///< current exposure began (get_clock_time_nsec), 0 when idle
+    std::atomic<double>   exptime_s{0};
+    std::atomic<int>      sequence{0};        ///< exposure number within the sequence, from 1
+    std::atomic<int>      sequences{0};
+    std::atomic<int>      readout_lines{0};   ///< lines of the frame read out so far
+    std::atomic<int>      readout_total{0};
+  };
+
   /** @struct   ImageBuffer
    *  @brief    holds one or more frames of type T from the controller
    *  @details  A single ImageBuffer object can contain multiple frames,
@@ -62,11 +96,85 @@ namespace Camera {
       // Frame output destinations populated by Camera::make_frame_outputs()
       std::vector<std::unique_ptr<FrameOutput>> frame_outputs;
 
-      // Fan a frame out to every configured FrameOutput
-      void dispatch_frame(const char* data, size_t size, const FrameMetadata &meta) {
+      // Optional huge-page, NUMA-local buffers for frames read from the
+      // controller, built by configure_framebuffer_pool(); acquisition falls
+      // back to the heap when unset, empty, or the frame is too large
+      std::shared_ptr<FrameBufferPool> framebuffer_pool;
+
+      // Set from the ACQUIRE_* keys by configure_backpressure()
+      AcquireBackpressure acquire_backpressure;
+
+      ExposureProgress exposure_progress;
+
+      // Fan a frame out to every configured FrameOutput except skip,
+      // which is the one the frame was read into with reserve_frame().
+      // That storage is only stable until skip reuses it, so the frame is
+      // copied once into a buffer the other outputs share. Returns how many
+      // outputs refused the frame, such as a Block output still full.
+      size_t dispatch_frame(const char* data, size_t size, const FrameMetadata &meta,
+                            const FrameOutput* skip=nullptr) {
+        if (this->frame_outputs.size() < (skip ? 2u : 1u)) return 0;
+
+        std::shared_ptr<char[]> buffer;
+        auto &pool = this->framebuffer_pool;
+        if (pool && pool->buffer_bytes() >= size) buffer = pool->acquire();
+        if (!buffer) buffer = std::shared_ptr<char[]>(new char[size]);
+        std::memcpy(buffer.get(), data, size);
+
+        size_t refused = 0;
+        for (auto &output : this->frame_outputs) {
+          if (output.get() != skip && output->write_shared(buffer, size, meta) != NO_ERROR) refused++;
+        }
+        return refused;
+      }
+
+      // As dispatch_frame(), but every output that queues frames, including
+      // each one run by an AsyncOutput, keeps a reference to buffer rather
+      // than copying it. The cost here is one enqueue per output, whatever
+      // the outputs do with the frame.
+      size_t dispatch_shared(const std::shared_ptr<char[]> &buffer, size_t size, const FrameMetadata &meta) {
+        size_t refused = 0;
         for (auto &output : this->frame_outputs) {
-          output->write(data, size, meta);
+          if (output->write_shared(buffer, size, meta) != NO_ERROR) refused++;
         }
+        return refused;
+      }
+
+      // Asks each output in turn for size bytes of its own storage to read
+      // the next frame into. Returns the output that granted it, with the
+      // buffer in buffer, or nullptr if none can.
+      FrameOutput* reserve_frame(size_t size, char* &buffer) {
+        for (auto &output : this->frame_outputs) {
+          if ((buffer = output->reserve(size)) != nullptr) return output.get();
+        }
+        return nullptr;
+      }
+
+      // Queue state of each output, in frame_outputs order
+      std::vector<QueueStatus> output_queues() const {
+        std::vector<QueueStatus> queues;
+        for (const auto &output : this->frame_outputs) queues.push_back(output->queue_status());
+        return queues;
+      }
+
+      // Fill of the fullest output queue that would hold up a write, 0 when
+      // none would; queues that drop frames when full are not counted
+      double output_pressure() const {
+        double pressure = 0;
+        for (const auto &output : this->frame_outputs) pressure = std::max(pressure, output->queue_status().pressure);
+        return pressure;
+      }
+
+      // Returns the first configured output of type T, looking through
+      // decorators such as AsyncOutput and CadenceGate, or nullptr
+      template <class T>
+      T* find_frame_output() {
+        for (auto &output : this->frame_outputs) {
+          for (FrameOutput* link = output.get(); link; link = link->decorated()) {
+            if (auto* found = dynamic_cast<T*>(link)) return found;
+          }
+        }
+        return nullptr;
       }
 //    Common::FitsKeys systemkeys;  move to Camera::Information?
 
@@ -76,6 +184,12 @@ namespace Camera {
       void set_server(Camera::Server* s);
       void func_shared();
       void disconnect_controller();
+      void configure_backpressure();
+      void configure_framebuffer_pool();
+      long metrics(const std::string &args, std::string &retstring);
+      nlohmann::json progress();
+      long roi(const std::string &args, std::string &retstring);
+      long trigger(const std::string &args, std::string &retstring);
       bool is_exposuremode_set() { return ( this->exposuremode && !this->exposuremode->get_type().empty() ); }
 
       void set_abortstate()   { this->abortstate.store(true, std::memory_order_seq_cst); }
@@ -121,6 +235,12 @@ namespace Camera {
 	return ERROR;
       }
 
+      /** @brief  adds interface and instrument commands to the server's
+       *          command table; an entry of the same name replaces the
+       *          server's own. Called once, before serving starts.
+       */
+      virtual void register_commands(Network::CommandTable &table) { }
+
       /** @brief  returns error if not overridden
        */
       virtual long controller_cmd(const std::string &cmd,
@@ -16,11 +16,15 @@ namespace Camera {
    */
   Server::Server() :
     blkport(-1),
-    id_pool(N_THREADS),
-    cmd_num(0)
+    workers(SERVER_WORKERS),
+    asyncport(-1),
+    async_progress_ms(ASYNC_PROGRESS_MS)
   {
     interface=Camera::Interface::create();  // factory funcion creates the appropriate interface type
     interface->set_server(this);            // pointer back to this Server instance
+
+    this->register_commands();
+    this->slow_commands = this->commands.with_flags( Network::CMD_SLOW );
   }
   /***** Camera::Server::Server ***********************************************/
 
@@ -28,13 +32,129 @@ namespace Camera {
   /***** Camera::Server::~Server **********************************************/
   /**
    * @brief      Server destructor
+   * @details    Stops the job table first so that any wait still blocked on
+   *             a job returns, before the command server gives its threads
+   *             a moment to finish.
    *
    */
   Server::~Server() {
+    this->jobs.stop();
+    this->command_server.reset();
   }
   /***** Camera::Server::~Server **********************************************/
 
 
+  /***** Camera::Server::register_commands ************************************/
+  /**
+   * @brief      fill the command table
+   * @details    The server's own commands and those common to every
+   *             interface first, then the interface adds its controller and
+   *             instrument commands, replacing any of the same name.
+   *
+   */
+  void Server::register_commands() {
+    using Network::CMD_NONE;
+    using Network::CMD_SLOW;
+    using Network::CMD_BLOCKING;
+    using Network::CMD_QUIET;
+
+    // commands taking (args, retstring) on the interface
+    //
+    auto add = [this]( const std::string &name, long (Interface::*method)(std::string, std::string&), unsigned flags ) {
+      this->commands.add( name,
+                          [this, method](const std::string &args, std::string &retstring, uint64_t) {
+                            return (this->interface.get()->*method)(args, retstring);
+                          },
+                          flags, camerad_syntax(name) );
+    };
+    add( CAMERAD_ABORT,        &Interface::abort,                 CMD_NONE );
+    add( CAMERAD_AUTODIR,      &Interface::autodir,               CMD_NONE );
+    add( CAMERAD_BASENAME,     &Interface::basename,              CMD_NONE );
+    add( CAMERAD_BIAS,         &Interface::bias,                  CMD_NONE );
+    add( CAMERAD_BIN,          &Interface::bin,                   CMD_NONE );
+    add( CAMERAD_CLOSE,        &Interface::disconnect_controller, CMD_NONE );
+    add( CAMERAD_EXPTIME,      &Interface::exptime,               CMD_NONE );
+    add( CAMERAD_EXPOSE,       &Interface::expose,                CMD_SLOW );
+    add( CAMERAD_EXPOSUREMODE, &Interface::exposure_mode,         CMD_NONE );
+    add( CAMERAD_OPEN,         &Interface::connect_controller,    CMD_SLOW );
+    add( CAMERAD_NATIVE,       &Interface::native,                CMD_NONE );
+    add( CAMERAD_POWER,        &Interface::power,                 CMD_SLOW );
+    add( CAMERAD_TEST,         &Interface::test,                  CMD_NONE );
+
+    this->commands.add( CAMERAD_LOAD,
+                        [this](const std::string &args, std::string &retstring, uint64_t) {
+                          return this->interface->load_firmware(args, retstring);
+                        },
+                        CMD_SLOW, camerad_syntax(CAMERAD_LOAD) );
+
+    // metrics also answers the common telemetry requests, which are polled
+    //
+    for ( const std::string &name : { CAMERAD_METRICS, TELEMREQUEST, SNAPSHOT } ) {
+      this->commands.add( name,
+                          [this](const std::string &args, std::string &retstring, uint64_t) {
+                            return this->interface->metrics(args, retstring);
+                          },
+                          CMD_QUIET, camerad_syntax(name) );
+    }
+    this->commands.add( CAMERAD_ROI,
+                        [this](const std::string &args, std::string &retstring, uint64_t) {
+                          return this->interface->roi(args, retstring);
+                        },
+                        CMD_NONE, camerad_syntax(CAMERAD_ROI) );
+    this->commands.add( CAMERAD_TRIGGER,
+                        [this](const std::string &args, std::string &retstring, uint64_t) {
+                          return this->interface->trigger(args, retstring);
+                        },
+                        CMD_NONE, camerad_syntax(CAMERAD_TRIGGER) );
+
+    this->commands.add( CAMERAD_ASYNC,
+                        [this](const std::string &args, std::string &retstring, uint64_t conn_id) {
+                          return this->async(args, retstring, conn_id);
+                        },
+                        CMD_NONE, camerad_syntax(CAMERAD_ASYNC) );
+    this->commands.add( CAMERAD_WAIT,
+                        [this](const std::string &args, std::string &retstring, uint64_t) {
+                          return this->wait(args, retstring);
+                        },
+                        CMD_BLOCKING, camerad_syntax(CAMERAD_WAIT) );
+    this->commands.add( CAMERAD_STATS,
+                        [this](const std::string &args, std::string &retstring, uint64_t) {
+                          return this->stats(args, retstring);
+                        },
+                        CMD_QUIET, camerad_syntax(CAMERAD_STATS) );
+    this->commands.add( CAMERAD_EXIT,
+                        [this](const std::string &, std::string &, uint64_t) {
+                          this->exit_cleanly();
+                          return NO_ERROR;
+                        },
+                        CMD_NONE, camerad_syntax(CAMERAD_EXIT) );
+
+    this->interface->register_commands( this->commands );
+
+    // help and instrument-specific commands come first, as they always have
+    //
+    auto is_help = [](const std::string &name) {
+      return name == "-h" || name == "--help" || name == "help" || name == "?";
+    };
+    this->commands.set_override(
+      [this, is_help](const std::string &name) {
+        return is_help(name) || this->interface->is_instrument_command(name);
+      },
+      [this, is_help](const std::string &name, const std::string &args, std::string &retstring, uint64_t) {
+        if ( is_help(name) ) {
+          retstring="camera { <CMD> } [<ARG>...]\n";
+          retstring.append( "  where <CMD> is one of:\n" );
+          for ( const auto &s : this->commands.syntax() ) {
+            retstring.append("  "); retstring.append( s ); retstring.append( "\n" );
+          }
+          return HELP;
+        }
+        return this->interface->instrument_cmd(name, args, retstring);
+      } );
+  }
+  /***** Camera::Server::register_commands ************************************/
+
+
   /***** Camera::Server::configure_server *************************************/
   /**
    * @brief      parse the configuration file for server-related parameters
@@ -65,6 +185,44 @@ namespace Camera {
         }
       }
 
+      if (interface->configfile.param[row]=="SERVER_WORKERS") {
+        try {
+          this->workers = static_cast<unsigned>( std::stoul( interface->configfile.arg[row] ) );
+          if (this->workers < 1) throw std::out_of_range("must be at least 1");
+        }
+        catch (const std::exception &e) {
+          throw std::runtime_error("parsing SERVER_WORKERS="+interface->configfile.arg[row]+": "+e.what());
+        }
+      }
+
+      // replaces the default list of commands run one at a time on the executor
+      if (interface->configfile.param[row]=="SERVER_SLOW_COMMANDS") {
+        std::vector<std::string> tokens;
+        Tokenize(interface->configfile.arg[row], tokens, " ");
+        this->slow_commands = std::set<std::string>(tokens.begin(), tokens.end());
+      }
+
+      if (interface->configfile.param[row]=="ASYNCGROUP")
+        this->asyncgroup = interface->configfile.arg[row];
+
+      if (interface->configfile.param[row]=="ASYNCPORT") {
+        try {
+          this->asyncport = std::stoi( interface->configfile.arg[row] );
+        }
+        catch (const std::exception &e) {
+          throw std::runtime_error("parsing ASYNCPORT="+interface->configfile.arg[row]+": "+e.what());
+        }
+      }
+
+      if (interface->configfile.param[row]=="ASYNC_PROGRESS_MS") {
+        try {
+          this->async_progress_ms = static_cast<unsigned>( std::stoul( interface->configfile.arg[row] ) );
+        }
+        catch (const std::exception &e) {
+          throw std::runtime_error("parsing ASYNC_PROGRESS_MS="+interface->configfile.arg[row]+": "+e.what());
+        }
+      }
+
       if (interface->configfile.param[row]=="LOGPATH")
         logpath = interface->configfile.arg[row];
 
@@ -99,272 +257,223 @@ namespace Camera {
   /***** Camera::Server::exit_cleanly *****************************************/
 
 
-  /***** Camera::Server::block_main *******************************************/
+  /***** Camera::Server::serve ************************************************/
   /**
-   * @brief      main function for blocking connection thread
-   * @param[in]  sock  shared pointer to Network::TcpSocket socket object
-   *
-   * accepts a socket connection and processes the request by
-   * calling function doit()
+   * @brief      listen for connections and serve commands until exit
+   * @details    One I/O thread (this one) multiplexes every connection with
+   *             epoll. Commands run on SERVER_WORKERS worker threads, those
+   *             in SERVER_SLOW_COMMANDS one at a time on an executor thread,
+   *             so an exposure never blocks status requests. Async job
+   *             messages go to the ASYNCGROUP multicast group, if set.
+   * @return     ERROR if the port cannot be opened, else does not return
    *
    */
-  void Server::block_main( std::shared_ptr<Network::TcpSocket> sock ) {
-    this->threads_active.fetch_add(1);  // atomically increment threads_busy counter
-    this->doit(*sock);
-    sock->Close();
-    this->threads_active.fetch_sub(1);  // atomically increment threads_busy counter
-    this->id_pool.release_number( sock->id );
-    return;
+  long Server::serve() {
+    const std::string function("Camera::Server::serve");
+
+    if (!this->asyncgroup.empty()) {
+      this->async_udp = std::make_unique<Network::UdpSocket>(this->asyncport, this->asyncgroup);
+      if (this->async_udp->Create() != 0) {
+        this->async_udp.reset();      // disabled by ASYNCGROUP=none, or logged
+      }
+      else {
+        logwrite(function, "async job messages to "+this->asyncgroup+":"+std::to_string(this->asyncport));
+        this->jobs.set_notify( [this](const nlohmann::json &message) { this->async_udp->Send(message.dump()); } );
+        this->jobs.start_progress( [this]() { return this->interface->progress(); }, this->async_progress_ms );
+      }
+    }
+
+    Network::CommandServerConfig cfg;
+    cfg.port              = this->blkport;
+    cfg.workers           = this->workers;
+    cfg.slow_commands     = this->slow_commands;
+    cfg.blocking_commands = this->commands.with_flags( Network::CMD_BLOCKING );
+
+    this->command_server = std::make_unique<Network::CommandServer>(
+      cfg, [this](const std::string &line, uint64_t conn_id) { return this->handle_command(line, conn_id); });
+
+    if (this->command_server->start() != NO_ERROR) return ERROR;
+    this->command_server->run();
+    return NO_ERROR;
   }
-  /***** Camera::Server::block_main *******************************************/
+  /***** Camera::Server::serve ************************************************/
 
 
-  /***** Camera::Server::doit *************************************************/
+  /***** Camera::Server::server_metrics ***************************************/
   /**
-   * @brief      the workhorse of each thread connection
-   * @details    incoming commands are parsed here and acted upon
-   * @param[in]  sock  Network::TcpSocket socket object
+   * @brief      connection and per-command latency metrics of the server
+   * @return     JSON object, empty before serve()
    *
    */
-  void Server::doit( Network::TcpSocket &sock ) {
-    const std::string function("Camera::Server::doit");
-    std::stringstream message;
-    std::string cmd, args;
-    bool connection_open=true;
-    long ret;
-
-    while (connection_open) {
-
-      // wait (poll) connected socket for incomming data
-      //
-      int pollret;
-      if ( ( pollret=sock.Poll() ) <= 0 ) {
-        if (pollret==0) {
-          message.str(""); message << "Poll timeout on fd " << sock.getfd() << " thread " << sock.id;
-          logwrite(function, message.str());
-        }
-        if (pollret <0) {
-          message.str(""); message << "Poll error on fd " << sock.getfd() << " thread " << sock.id << ": " << strerror(errno);
-          logwrite(function, message.str());
-        }
-        break;                      // this will close the connection
-      }
-
-      // Data available, now read from connected socket...
-      //
-      std::string sbuf;
-      char delim='\n';
-      if ( ( ret=sock.Read( sbuf, delim ) ) <= 0 ) {
-        if (ret<0) {                // could be an actual read error
-          message.str(""); message << "Read error on fd " << sock.getfd() << ": " << strerror(errno);
-          logwrite(function, message.str());
-        }
-        if (ret==-2) {
-          message.str(""); message << "timeout reading from fd " << sock.getfd();
-          logwrite( function, message.str() );
-         }
-        break;                      // Breaking out of the while loop will close the connection.
-                                    // This probably means that the client has terminated abruptly, 
-                                    // having sent FIN but not stuck around long enough
-                                    // to accept CLOSE and give the LAST_ACK.
-      }
+  nlohmann::json Server::server_metrics() const {
+    if (!this->command_server) return nlohmann::json::object();
+    return this->command_server->metrics();
+  }
+  /***** Camera::Server::server_metrics ***************************************/
 
-      // convert the input buffer into a string and remove any trailing linefeed
-      // and carriage return
-      //
-      sbuf.erase(std::remove(sbuf.begin(), sbuf.end(), '\r' ), sbuf.end());
-      sbuf.erase(std::remove(sbuf.begin(), sbuf.end(), '\n' ), sbuf.end());
 
-      if (sbuf.empty()) {sock.Write("\n"); continue;}  // acknowledge empty command so client doesn't time out
+  /***** Camera::Server::async **********************************************/
+  /**
+   * @brief      run a command in the background, returning a job ID at once
+   * @details    The command is queued exactly as if it had been sent on its
+   *             own, so an async expose still waits its turn on the
+   *             executor. Its state changes and, while it runs, exposure
+   *             progress go to the ASYNCGROUP multicast group.
+   * @param[in]  args       command line to run, or empty to list the jobs
+   * @param[out] retstring  job ID, or JSON list of jobs
+   * @param[in]  conn_id    connection that submitted it
+   * @return     ERROR | NO_ERROR | HELP | JSON
+   *
+   */
+  long Server::async( const std::string &args, std::string &retstring, uint64_t conn_id ) {
+    const std::string function("Camera::Server::async");
+
+    if (args=="?" || args=="help") {
+      retstring = CAMERAD_ASYNC;
+      retstring.append( " [ <command> [ <args> ] ]\n" );
+      retstring.append( "  runs <command> in the background and returns its job ID at once.\n" );
+      retstring.append( "  Progress and completion are sent to the ASYNCGROUP multicast group;\n" );
+      retstring.append( "  use \"" ).append( CAMERAD_WAIT ).append( " <jobid>\" to block until it finishes.\n" );
+      retstring.append( "  With no command, returns a JSON list of recent jobs.\n" );
+      return HELP;
+    }
 
-      try {
-        std::size_t cmd_sep = sbuf.find_first_of(" "); // find the first space, which separates command from argument list
+    if (args.empty()) {
+      retstring = this->jobs.list().dump();
+      retstring.append( JEOF );
+      return JSON;
+    }
 
-        cmd = sbuf.substr(0, cmd_sep);                 // cmd is everything up until that space
+    std::string cmd = args.substr( 0, args.find(' ') );
+    if ( cmd == CAMERAD_ASYNC || cmd == CAMERAD_WAIT || cmd == CAMERAD_EXIT ) {
+      logwrite(function, "ERROR "+cmd+" cannot run as a job");
+      return ERROR;
+    }
+    if (!this->command_server) {
+      logwrite(function, "ERROR command server not running");
+      return ERROR;
+    }
 
-        if (cmd.empty()) {sock.Write("\n"); continue;} // acknowledge empty command so client doesn't time out
+    uint64_t id = this->jobs.create(args);
+    this->command_server->submit( args, conn_id,
+                                  [this, id]() { this->jobs.started(id); },
+                                  [this, id](std::string reply) { this->jobs.finished(id, reply); } );
+    logwrite(function, "job "+std::to_string(id)+" queued: "+args);
 
-        if (cmd_sep == std::string::npos) {            // If no space was found,
-          args.clear();                                // then the arg list is empty,
-        }
-        else {
-          args= sbuf.substr(cmd_sep+1);                // otherwise args is everything after that space.
-        }
+    retstring = std::to_string(id);
+    return NO_ERROR;
+  }
+  /***** Camera::Server::async **********************************************/
 
-        if ( ++this->cmd_num == INT_MAX ) this->cmd_num = 0;
 
-        message.str(""); message << "thread " << sock.id << " received command on fd " << sock.getfd()
-                                 << " (" << this->cmd_num << ") : " << cmd << " " << args;
-        logwrite(function, message.str());
-      }
-      catch (const std::exception &e) {
-        message.str(""); message << "ERROR parsing command from thread " << sock.id << " fd " << sock.getfd()
-                                 << " (" << this->cmd_num << ") \"" << cmd << " " << args << "\" : "
-                                 << e.what();
-        logwrite(function, message.str());
-        cmd = "_EXCEPTION_";         // skips command processing below
-      }
+  /***** Camera::Server::wait ***********************************************/
+  /**
+   * @brief      block until an async job finishes
+   * @details    Runs on a thread of its own (a blocking command), so clients
+   *             can wait without holding up the others; past the server's
+   *             max_blocking waits at once, further ones queue for a thread.
+   * @param[in]  args       <jobid> [ <timeout_s> ]
+   * @param[out] retstring  the job's own reply, as if it had been run directly
+   * @return     the job's ERROR | NO_ERROR, ERROR on timeout or unknown job, or HELP
+   *
+   */
+  long Server::wait( const std::string &args, std::string &retstring ) {
+    const std::string function("Camera::Server::wait");
+
+    if (args.empty() || args=="?" || args=="help") {
+      retstring = CAMERAD_WAIT;
+      retstring.append( " <jobid> [ <timeout_s> ]\n" );
+      retstring.append( "  waits for async job <jobid> to finish, without limit unless\n" );
+      retstring.append( "  <timeout_s> is given, and returns the job's reply.\n" );
+      return HELP;
+    }
 
-      //
-      // Process commands here
-      //
+    uint64_t id;
+    int timeout_ms = -1;
+    try {
+      std::vector<std::string> tokens;
+      Tokenize(args, tokens, " ");
+      if (tokens.empty() || tokens.size() > 2) throw std::invalid_argument("expected <jobid> [ <timeout_s> ]");
+      id = std::stoull(tokens[0]);
+      if (tokens.size() == 2) timeout_ms = static_cast<int>( std::stod(tokens[1]) * 1000 );
+    }
+    catch (const std::exception &e) {
+      logwrite(function, "ERROR parsing \""+args+"\": "+e.what());
+      return ERROR;
+    }
 
-      ret = NOTHING;
-      std::string retstring;
+    JobInfo info;
+    long ret = this->jobs.wait(id, timeout_ms, info);
+    if (ret == ERROR) {
+      logwrite(function, "ERROR no job "+std::to_string(id));
+      retstring = "unknown";
+      return ERROR;
+    }
+    if (ret == TIMEOUT) {
+      logwrite(function, "ERROR timeout waiting for job "+std::to_string(id));
+      retstring = info.state;
+      return ERROR;
+    }
 
-      if ( cmd == "_EXCEPTION_" ) {  // skips checking commands
-      }
-      else
-      if ( cmd == "-h" || cmd == "--help" || cmd == "help" || cmd == "?" ) {
-        retstring="camera { <CMD> } [<ARG>...]\n";
-        retstring.append( "  where <CMD> is one of:\n" );
-        for ( const auto &s : CAMERAD_SYNTAX ) {
-          retstring.append("  "); retstring.append( s ); retstring.append( "\n" );
-        }
-        ret = HELP;
-      }
-      /**
-       * instrument-specific commands
-       */
-      else
-      if (interface->is_instrument_command(cmd))
-      {
-        ret = interface->instrument_cmd(cmd, args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_ABORT ) {
-        ret = interface->abort(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_AUTODIR ) {
-        ret = interface->autodir(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_BASENAME ) {
-        ret = interface->basename(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_BIAS ) {
-        ret = interface->bias(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_BIN ) {
-        ret = interface->bias(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_CLOSE ) {
-        ret = interface->disconnect_controller(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_EXIT ) {
-        ret = NO_ERROR;
-        exit_cleanly();
-      }
-      else
-      if ( cmd == CAMERAD_EXPTIME ) {
-        ret = interface->exptime(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_EXPOSE ) {
-        ret = interface->expose(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_EXPOSUREMODE ) {
-        ret = interface->exposure_mode(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_LOAD ) {
-        ret = interface->load_firmware(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_OPEN ) {
-        ret = interface->connect_controller(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_NATIVE ) {
-        ret = interface->native(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_POWER ) {
-        ret = interface->power(args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_TEST ) {
-        ret = interface->test(args, retstring);
+    // hand back the job's reply; handle_command appends DONE or ERROR again
+    //
+    retstring = info.reply;
+    if ( retstring.size() >= JEOF.size() && retstring.compare(retstring.size()-JEOF.size(), JEOF.size(), JEOF) == 0 ) return JSON;
+    retstring.erase( retstring.find_last_not_of(" \r\n") + 1 );
+    for ( const std::string suffix : { "DONE", "ERROR" } ) {
+      if ( retstring.size() >= suffix.size() && retstring.compare(retstring.size()-suffix.size(), suffix.size(), suffix) == 0 ) {
+        retstring.erase( retstring.size()-suffix.size() );
+        break;
       }
+    }
+    retstring.erase( retstring.find_last_not_of(' ') + 1 );
+    return ( info.state == "error" ? ERROR : NO_ERROR );
+  }
+  /***** Camera::Server::wait ***********************************************/
 
-      /**
-       * controller-specific commands
-       */
-      else
-      if ( cmd == CAMERAD_LOADTIMING ) {
-        ret = interface->controller_cmd(cmd, args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_READACF ) {
-        ret = interface->controller_cmd(cmd, args, retstring);
-      }
-      else
-      if ( cmd == "getp" ) {
-        ret = interface->controller_cmd(cmd, args, retstring);
-      }
-      else
-      if ( cmd == "inreg" ) {
-        ret = interface->controller_cmd(cmd, args, retstring);
-      }
-      else
-      if ( cmd == "setp" ) {
-        ret = interface->controller_cmd(cmd, args, retstring);
-      }
-      else
-      if ( cmd == CAMERAD_MODE ) {
-        ret = interface->controller_cmd(cmd, args, retstring);
-      }
-      else
-      if ( cmd == "bob" ) {
-        ret = interface->controller_cmd(cmd, args, retstring);
-      }
-      else
-      if ( cmd == "autofetch_mode" ) {
-        ret = interface->controller_cmd(cmd, args, retstring);
-      }
 
-      // unknown commands generate an error
-      //
-      else {
-        message.str(""); message << "ERROR unknown command: " << cmd;
-        logwrite(function, message.str());
-        ret = ERROR;
-      }
+  /***** Camera::Server::stats ************************************************/
+  /**
+   * @brief      call counts and handler latencies of each command
+   * @param[in]  args       none, or ? for help
+   * @param[out] retstring  JSON message terminated by JEOF
+   * @return     JSON | HELP
+   *
+   */
+  long Server::stats( const std::string &args, std::string &retstring ) {
+    if (args=="?" || args=="help") {
+      retstring = CAMERAD_STATS;
+      retstring.append( "\n" );
+      retstring.append( "  returns a JSON object of the calls, errors and handler latency\n" );
+      retstring.append( "  percentiles of each command called since the server started.\n" );
+      return HELP;
+    }
 
-      // If retstring not empty then append "DONE" or "ERROR" depending on value of ret,
-      // and log the reply along with the command number. Write the reply back to the socket.
-      //
-      // Don't append anything nor log the reply if the command was just requesting help.
-      //
-      if (ret != NOTHING) {
-        if ( ret != HELP && !retstring.empty() ) retstring.append( " " );
-        if ( ret != HELP && ret != JSON ) retstring.append( ret == NO_ERROR ? "DONE" : "ERROR" );
-
-        if ( ret == JSON ) {
-          message.str(""); message << "command (" << this->cmd_num << ") reply with JSON message";
-          logwrite( function, message.str() );
-        }
-        else
-        if ( ! retstring.empty() && ret != HELP ) {
-          retstring.append( "\n" );
-          message.str(""); message << "command (" << this->cmd_num << ") reply: " << retstring;
-          logwrite( function, message.str() );
-        }
+    nlohmann::json j;
+    j["messagetype"] = "commandstats";
+    j["commands"]    = this->commands.stats();
+    j["unknown"]     = this->commands.unknown();
+    retstring = j.dump();
+    retstring.append( JEOF );
+    return JSON;
+  }
+  /***** Camera::Server::stats ************************************************/
 
-      if ( sock.Write( retstring ) < 0 ) connection_open=false;
-      }
 
-      if (!sock.isblocking()) break;       // Non-blocking connection exits immediately.
-                                           // Keep blocking connection open for interactive session.
-    }
-    return;
+  /***** Camera::Server::handle_command ***************************************/
+  /**
+   * @brief      the workhorse of the command server
+   * @details    incoming commands are parsed and acted upon by the command
+   *             table, help and instrument-specific commands first. Called
+   *             on a worker or executor thread, possibly several at once.
+   * @param[in]  line     one command line as received, without its newline
+   * @param[in]  conn_id  connection it came from, for the log
+   * @return     reply to write back, empty for none
+   *
+   */
+  std::string Server::handle_command( const std::string &line, uint64_t conn_id ) {
+    return this->commands.dispatch( line, conn_id );
   }
-  /***** Camera::Server::doit *************************************************/
+  /***** Camera::Server::handle_command ***************************************/
 
 }
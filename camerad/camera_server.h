@@ -18,11 +18,15 @@
 #include "camera_interface.h"
 #include "utilities.h"
 #include "network.h"
+#include "command_server.h"
+#include "command_table.h"
+#include "job_table.h"
 #include "camerad_commands.h"
 
 namespace Camera {
 
-  const int N_THREADS=10;
+  const unsigned SERVER_WORKERS=4;   ///< default threads for quick commands
+  const unsigned ASYNC_PROGRESS_MS=1000;  ///< default interval of async job progress messages
 
   class Server {
     public:
@@ -32,17 +36,28 @@ namespace Camera {
       std::unique_ptr<Interface> interface;
 
       int blkport;
+      unsigned workers;                        ///< SERVER_WORKERS
+      std::set<std::string> slow_commands;     ///< SERVER_SLOW_COMMANDS, run on the executor; default those flagged CMD_SLOW
 
-      NumberPool id_pool;
-      std::map<int, std::shared_ptr<Network::TcpSocket>> socklist;
-      std::mutex sock_block_mutex;
-      std::atomic<int> threads_active;
-      std::atomic<int> cmd_num;
+      std::string asyncgroup;                  ///< ASYNCGROUP, UDP multicast group for job messages
+      int asyncport;                           ///< ASYNCPORT
+      unsigned async_progress_ms;              ///< ASYNC_PROGRESS_MS, 0 for no progress messages
 
+      // jobs report through async_udp from command_server threads, so both outlive it
+      std::unique_ptr<Network::UdpSocket> async_udp;
+      Camera::JobTable jobs;
+      Network::CommandTable commands;          ///< every command, filled before serving
+      std::unique_ptr<Network::CommandServer> command_server;
+
+      void register_commands();
       void configure_server();
       void exit_cleanly();
-      void block_main(std::shared_ptr<Network::TcpSocket> socket);
-      void doit(Network::TcpSocket &sock);
+      long serve();
+      std::string handle_command(const std::string &line, uint64_t conn_id);
+      nlohmann::json server_metrics() const;
+      long async(const std::string &args, std::string &retstring, uint64_t conn_id);
+      long wait(const std::string &args, std::string &retstring);
+      long stats(const std::string &args, std::string &retstring);
   };
 }
 
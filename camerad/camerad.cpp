@@ -54,31 +54,14 @@ int main( int argc, char** argv ) {
     exit(1);
   }
 
-  // dynamically create a new listening socket and thread
-  // to handle each connection request
+  // serve commands on the blocking port; the I/O loop runs on this thread
+  // and hands commands to a small worker pool
   //
-  Network::TcpSocket sock_block(camerad.blkport, true, -1, 0);  // instantiate a TcpSocket with blocking port
-  if ( sock_block.Listen() < 0 ) {
+  if ( camerad.serve() != NO_ERROR ) {
     std::cerr << "ERROR could not create listening socket\n";
     exit(1);
   }
 
-  while ( true ) {
-    auto newid = camerad.id_pool.get_next_number();  // get next available number from the pool
-    {
-    std::lock_guard<std::mutex> lock(camerad.sock_block_mutex);
-    camerad.socklist[newid] = std::make_shared<Network::TcpSocket>(sock_block);  // create a new socket
-    camerad.socklist[newid]->id = newid;             // update the id of the copied socket
-    camerad.socklist[newid]->Accept();               // accept connections on the new socket
-    }
-
-    // Create a new thread to handle the connection
-    //
-    std::thread( &Camera::Server::block_main, &camerad, camerad.socklist[newid] ).detach();
-  }
-
-  for (;;) pause();                                  // main thread suspends
-
   return 0;
 }
 
@@ -32,6 +32,7 @@ namespace Camera {
     public:
       std::mutex queue_mutex;            ///< mutex protects access to the queue
       std::condition_variable queue_cv;  ///< notify when the queue has new data
+      std::condition_variable space_cv;  ///< notify when a frame leaves the queue
 
       std::atomic<bool> is_producer_finished;
       std::atomic<bool> is_producer_error;
@@ -9,6 +9,7 @@
 #pragma once
 
 const std::string CAMERAD_ABORT("abort");
+const std::string CAMERAD_ASYNC("async");
 const std::string CAMERAD_AUTODIR("autodir");
 const std::string CAMERAD_BASENAME("basename");
 const std::string CAMERAD_BIAS("bias");
@@ -35,6 +36,7 @@ const std::string CAMERAD_KEY("key");
 const std::string CAMERAD_LOAD("load");
 const std::string CAMERAD_LOADTIMING("loadtiming");
 const std::string CAMERAD_LONGERROR("longerror");
+const std::string CAMERAD_METRICS("metrics");
 const std::string CAMERAD_MEX("mex");
 const std::string CAMERAD_MEXAMPS("mexamps");
 const std::string CAMERAD_MODE("mode");
@@ -47,13 +49,19 @@ const std::string CAMERAD_PREEXPOSURES("preexposures");
 const std::string CAMERAD_READACF("readacf");
 const std::string CAMERAD_READOUT("readout");
 const std::string CAMERAD_RESUME("resume");
+const std::string CAMERAD_ROI("roi");
 const std::string CAMERAD_SHUTTER("shutter");
+const std::string CAMERAD_STATS("stats");
+const std::string CAMERAD_STATUS("status");
 const std::string CAMERAD_STOP("stop");
 const std::string CAMERAD_TEST("test");
+const std::string CAMERAD_TRIGGER("trigger");
 const std::string CAMERAD_USEFRAMES("useframes");
+const std::string CAMERAD_WAIT("wait");
 const std::string CAMERAD_WRITEKEYS("writekeys");
 const std::vector<std::string> CAMERAD_SYNTAX = {
                                                   CAMERAD_ABORT,
+                                                  CAMERAD_ASYNC+" [ ? | <command> [ <args> ] ]",
                                                   CAMERAD_AUTODIR,
                                                   CAMERAD_BASENAME,
                                                   CAMERAD_BIAS,
@@ -80,6 +88,7 @@ const std::vector<std::string> CAMERAD_SYNTAX = {
                                                   CAMERAD_LOAD+" [ ? | <acffile> ]",
                                                   CAMERAD_LOADTIMING,
                                                   CAMERAD_LONGERROR,
+                                                  CAMERAD_METRICS+" [ ? ]",
                                                   CAMERAD_MEX,
                                                   CAMERAD_MEXAMPS,
                                                   CAMERAD_MODE+" [ ? | <mode> ]",
@@ -91,9 +100,22 @@ const std::vector<std::string> CAMERAD_SYNTAX = {
                                                   CAMERAD_READACF+" [ ? | <acffile> ]",
                                                   CAMERAD_READOUT+" [ ? ] | [ <dev#> | <chan> [ <amp> ] ]",
                                                   CAMERAD_RESUME,
+                                                  CAMERAD_ROI+" [ ? | <id> <x0> <y0> [ <width> <height> ] ]",
                                                   CAMERAD_SHUTTER+" [ ? | enable | 1 | disable | 0 ]",
+                                                  CAMERAD_STATS+" [ ? ]",
+                                                  CAMERAD_STATUS+" [ ? | status | system | frame ]",
                                                   CAMERAD_STOP,
                                                   CAMERAD_TEST+" ? | <testname> ...",
+                                                  CAMERAD_TRIGGER+" [ ? | dump [ <reason> ] | status ]",
                                                   CAMERAD_USEFRAMES,
+                                                  CAMERAD_WAIT+" ? | <jobid> [ <timeout_s> ]",
                                                   CAMERAD_WRITEKEYS
                                                 };
+
+/** @brief  the CAMERAD_SYNTAX line of cmd, or cmd alone if it has none */
+inline std::string camerad_syntax(const std::string &cmd) {
+  for ( const auto &line : CAMERAD_SYNTAX ) {
+    if ( line.compare(0, cmd.size(), cmd) == 0 && ( line.size() == cmd.size() || line[cmd.size()] == ' ' ) ) return line;
+  }
+  return cmd;
+}
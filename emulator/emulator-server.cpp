@@ -159,7 +159,6 @@ void block_main(Network::TcpSocket sock) {
  */
 void doit(Network::TcpSocket sock) {
   std::string function = "(Emulator::doit) ";
-  char  buf[Emulator::BUFSIZE+1];
   long  ret;
   std::stringstream message;
   std::stringstream retstream;
@@ -169,8 +168,6 @@ void doit(Network::TcpSocket sock) {
   bool connection_open=true;
 
   while (connection_open) {
-    memset(buf,  '\0', Emulator::BUFSIZE);  // init buffers
-
     retstream.str("");            // empty the return message stream
 
     // Wait (poll) connected socket for incoming data...
@@ -186,9 +183,10 @@ void doit(Network::TcpSocket sock) {
       break;                      // this will close the connection
     }
 
-    // Data available, now read from connected socket...
+    // Data available, now read one command line from connected socket...
     //
-    if ( ( ret=sock.Read( buf, static_cast<size_t>(Emulator::BUFSIZE) ) ) <= 0 ) {
+    std::string sbuf;
+    if ( ( ret=sock.Read( sbuf, '\n' ) ) <= 0 ) {
       if (ret<0) {                // could be an actual read error
         std::cerr << function << "Read error: " << strerror(errno) << "\n";
       }
@@ -198,10 +196,8 @@ void doit(Network::TcpSocket sock) {
                                   // to accept CLOSE and give the LAST_ACK.
     }
 
-    // convert the input buffer into a string and remove any trailing linefeed
-    // and carriage return
+    // remove any trailing linefeed and carriage return
     //
-    std::string sbuf = buf;
     sbuf.erase(std::remove(sbuf.begin(), sbuf.end(), '\r' ), sbuf.end());
     sbuf.erase(std::remove(sbuf.begin(), sbuf.end(), '\n' ), sbuf.end());
 
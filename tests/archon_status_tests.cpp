@@ -0,0 +1,237 @@
+#include "gtest/gtest.h"
+#include "../camerad/archon_status.h"
+#include "../common/common.h"
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Camera::ArchonStatusCache;
+using Camera::ArchonStatusConfig;
+using Query = Camera::ArchonStatusCache::Query;
+
+namespace {
+
+    /// a controller that answers each query with a canned reply, counting them
+    class Controller {
+      public:
+        ArchonStatusCache::Send send() {
+            return [this](const std::string &cmd, std::string &reply) {
+                std::unique_lock lock(mtx_);
+                ++sent[cmd];
+                ++waiting_;
+                cv_.notify_all();
+                cv_.wait(lock, [this] { return open_; });
+                --waiting_;
+                reply = (cmd == "STATUS") ? "POWER=4 POWERGOOD=1" : cmd + "=1";
+                return fail ? ERROR : (fetching ? BUSY : NO_ERROR);
+            };
+        }
+        ArchonStatusCache::Busy busy() { return [this] { return exposing.load(); }; }
+
+        /// replies wait until opened again
+        void hold() { std::lock_guard lock(mtx_); open_ = false; }
+        void open() { std::lock_guard lock(mtx_); open_ = true; cv_.notify_all(); }
+        bool wait_for_senders(int n) {
+            std::unique_lock lock(mtx_);
+            return cv_.wait_for(lock, std::chrono::seconds(2), [&] { return waiting_ >= n; });
+        }
+        int count(const std::string &cmd) {
+            std::lock_guard lock(mtx_);
+            return sent[cmd];
+        }
+
+        std::atomic<bool> exposing{false};
+        bool fail{false};
+        bool fetching{false};
+
+      private:
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::map<std::string, int> sent;
+        bool open_{true};
+        int  waiting_{0};
+    };
+
+    ArchonStatusConfig config_of(unsigned status_ms, unsigned system_ms = 0, unsigned frame_ms = 0) {
+        ArchonStatusConfig cfg;
+        cfg.status_ms   = status_ms;
+        cfg.system_ms   = system_ms;
+        cfg.frame_ms    = frame_ms;
+        cfg.exposing_ms = 0;
+        return cfg;
+    }
+
+}
+
+TEST(ArchonStatusTest, ParseKeysTakesOnlyKeyEqualsValueWords) {
+    const auto keys = Camera::parse_archon_keys("  POWER=4 MOD2/TEMP=25.5\nEMPTY= BAD =x noeq A=b=c\r\n");
+    const std::map<std::string, std::string> expected{
+        { "POWER", "4" }, { "MOD2/TEMP", "25.5" }, { "EMPTY", "" }, { "A", "b=c" } };
+    EXPECT_EQ(keys, expected);
+    EXPECT_TRUE(Camera::parse_archon_keys("").empty());
+}
+
+TEST(ArchonStatusTest, StatusSnapshotSortsReadingsByKind) {
+    const auto s = Camera::ArchonStatusSnapshot::parse(
+        "POWER=4 POWERGOOD=1 OVERHEAT=0 BACKPLANE_TEMP=31.2 MOD2/TEMPA=-100.5 P5V_V=5.01 P5V_I=0.8 "
+        "MOD2/LVLC_V12=3.3 MOD2/LVLC_I3=0.01 MOD2/NAME=abc LOG=2", 7);
+    EXPECT_EQ(s.taken_ns, 7u);
+    EXPECT_EQ(s.power, 4);
+    EXPECT_TRUE(s.powergood);
+    EXPECT_FALSE(s.overheat);
+    EXPECT_EQ(s.temperatures, (std::map<std::string, double>{ { "BACKPLANE_TEMP", 31.2 }, { "MOD2/TEMPA", -100.5 } }));
+    EXPECT_EQ(s.voltages, (std::map<std::string, double>{ { "MOD2/LVLC_V12", 3.3 }, { "P5V_V", 5.01 } }));
+    EXPECT_EQ(s.currents, (std::map<std::string, double>{ { "MOD2/LVLC_I3", 0.01 }, { "P5V_I", 0.8 } }));
+    EXPECT_EQ(s.keys.at("MOD2/NAME"), "abc");
+
+    const auto none = Camera::ArchonStatusSnapshot::parse("", 0);
+    EXPECT_EQ(none.power, -1);
+    EXPECT_TRUE(none.to_json(100)["age_s"].is_null());
+    EXPECT_DOUBLE_EQ(s.to_json(7 + 500000000)["age_s"].get<double>(), 0.5);
+}
+
+TEST(ArchonStatusTest, SystemSnapshotListsTheModulesPresent) {
+    const auto s = Camera::ArchonSystemSnapshot::parse(
+        "BACKPLANE_VERSION=1.0.1 MOD1_TYPE=0 MOD2_TYPE=2 MOD2_VERSION=1.2 MOD3_TYPE=9 MOD5_TYPE=3", 1);
+    EXPECT_EQ(s.backplane_version, "1.0.1");
+    ASSERT_EQ(s.modules.size(), 2u);         // slot 1 empty, and no MOD4 ends the list
+    EXPECT_EQ(s.modules[0].slot, 2);
+    EXPECT_EQ(s.modules[0].type, 2);
+    EXPECT_EQ(s.modules[0].version, "1.2");
+    EXPECT_EQ(s.modules[1].slot, 3);
+    EXPECT_EQ(s.modules[1].version, "");
+}
+
+TEST(ArchonStatusTest, FrameSnapshotReadsEachBufferAndHexTimes) {
+    const auto s = Camera::ArchonFrameSnapshot::parse(
+        "TIMER=1A RBUF=1 WBUF=2 BUF1FRAME=5 BUF1COMPLETE=1 BUF1WIDTH=10 BUF1HEIGHT=4 BUF1SAMPLE=1 "
+        "BUF1TIMESTAMP=ff BUF2FRAME=6 BUF2LINES=3 BUF3COMPLETE=1", 1);
+    EXPECT_EQ(s.timer, 26u);
+    EXPECT_EQ(s.rbuf, 1);
+    EXPECT_EQ(s.wbuf, 2);
+    ASSERT_EQ(s.buffers.size(), 2u);         // BUF3 has no FRAME
+    EXPECT_EQ(s.buffers[0].frame, 5);
+    EXPECT_EQ(s.buffers[0].complete, 1);
+    EXPECT_EQ(s.buffers[0].width, 10);
+    EXPECT_EQ(s.buffers[0].sample, 1);
+    EXPECT_EQ(s.buffers[0].timestamp, 255u);
+    EXPECT_EQ(s.buffers[1].lines, 3);
+    EXPECT_EQ(s.to_json(1)["buffers"].size(), 2u);
+}
+
+TEST(ArchonStatusTest, RefreshQueriesOnlyWhenTheSnapshotIsTooOld) {
+    Controller archon;
+    ArchonStatusCache cache(archon.send(), archon.busy());
+
+    EXPECT_EQ(cache.refresh(Query::Status, 1000), NO_ERROR);
+    EXPECT_EQ(cache.status().power, 4);
+    EXPECT_EQ(cache.refresh(Query::Status, 1000), NO_ERROR);     // young enough
+    EXPECT_EQ(archon.count("STATUS"), 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    EXPECT_EQ(cache.refresh(Query::Status, 1), NO_ERROR);        // too old now
+    EXPECT_EQ(archon.count("STATUS"), 2);
+
+    // a reply got elsewhere counts as fresh
+    cache.update(Query::Frame, "TIMER=10 BUF1FRAME=1");
+    EXPECT_EQ(cache.refresh(Query::Frame, 1000), NO_ERROR);
+    EXPECT_EQ(archon.count("FRAME"), 0);
+    EXPECT_EQ(cache.frame().timer, 16u);
+
+    // a failed query leaves the snapshot as it was
+    archon.fail = true;
+    EXPECT_EQ(cache.refresh(Query::System, 1000), ERROR);
+    EXPECT_EQ(cache.system().taken_ns, 0u);
+
+    const auto j = cache.to_json()["cache"];
+    EXPECT_EQ(j["sent"].get<uint64_t>(), 3u);
+    EXPECT_EQ(j["failed"].get<uint64_t>(), 1u);
+    EXPECT_EQ(j["cached"].get<uint64_t>(), 2u);
+    EXPECT_EQ(j["updates"].get<uint64_t>(), 1u);
+    EXPECT_FALSE(j["polling"].get<bool>());
+}
+
+TEST(ArchonStatusTest, BusyRepliesAreNeitherSentNorFailed) {
+    Controller archon;
+    ArchonStatusCache cache(archon.send(), archon.busy());
+    EXPECT_EQ(ArchonStatusConfig().exposing_ms, 0u);         // paused while exposing by default
+
+    archon.fetching = true;
+    EXPECT_EQ(cache.refresh(Query::Status, 1000), BUSY);
+    EXPECT_EQ(cache.status().taken_ns, 0u);
+    archon.fetching = false;
+    EXPECT_EQ(cache.refresh(Query::Status, 1000), NO_ERROR);  // so the next one goes out
+
+    const auto j = cache.to_json()["cache"];
+    EXPECT_EQ(j["busy"].get<uint64_t>(), 1u);
+    EXPECT_EQ(j["sent"].get<uint64_t>(), 1u);
+    EXPECT_EQ(j["failed"].get<uint64_t>(), 0u);
+}
+
+TEST(ArchonStatusTest, CallersDuringAQueryShareItsReply) {
+    Controller archon;
+    ArchonStatusCache cache(archon.send(), archon.busy());
+    archon.hold();
+
+    std::vector<std::thread> callers;
+    std::atomic<int> ok{0};
+    for (int i = 0; i < 4; ++i) {
+        callers.emplace_back([&] { if (cache.refresh(Query::Status, 0) == NO_ERROR) ++ok; });
+    }
+    ASSERT_TRUE(archon.wait_for_senders(1));
+    for (int i = 0; i < 200 && cache.to_json()["cache"]["coalesced"].get<int>() < 3; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    archon.open();
+    for (auto &t : callers) t.join();
+
+    EXPECT_EQ(archon.count("STATUS"), 1);
+    EXPECT_EQ(ok.load(), 4);
+    EXPECT_EQ(cache.to_json()["cache"]["coalesced"].get<int>(), 3);
+}
+
+TEST(ArchonStatusTest, MaxAgeFollowsTheIntervalAndExposures) {
+    Controller archon;
+    ArchonStatusCache cache(archon.send(), archon.busy());
+    cache.configure(config_of(1000, 0, 200));
+    EXPECT_EQ(cache.max_age_ms(Query::Status), 0u);             // not polling
+
+    cache.start();
+    EXPECT_EQ(cache.max_age_ms(Query::Status), 1500u);
+    EXPECT_EQ(cache.max_age_ms(Query::Frame), 300u);
+    EXPECT_EQ(cache.max_age_ms(Query::System), 0u);             // on demand only
+
+    // polling paused for an exposure: whatever is cached will do
+    archon.exposing = true;
+    EXPECT_EQ(cache.max_age_ms(Query::Status), UINT_MAX);
+    EXPECT_EQ(cache.max_age_ms(Query::System), 0u);
+
+    auto cfg = config_of(1000, 0, 200);
+    cfg.exposing_ms = 5000;
+    cache.configure(cfg);
+    EXPECT_EQ(cache.max_age_ms(Query::Status), 7500u);
+    cache.stop();
+    EXPECT_EQ(cache.max_age_ms(Query::Status), 0u);
+}
+
+TEST(ArchonStatusTest, PollingQueriesOncePerInterval) {
+    Controller archon;
+    ArchonStatusCache cache(archon.send(), archon.busy());
+    cache.configure(config_of(20));
+    cache.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(210));
+    cache.stop();
+
+    // the first at once, then one each interval, none taken from the cache
+    const int sent = archon.count("STATUS");
+    EXPECT_GE(sent, 8);
+    EXPECT_LE(sent, 12);
+    EXPECT_EQ(archon.count("SYSTEM"), 0);
+    EXPECT_EQ(cache.to_json()["cache"]["cached"].get<int>(), 0);
+}
@@ -0,0 +1,146 @@
+#include "gtest/gtest.h"
+#include "../utils/async_output.h"
+#include "capture_output.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <vector>
+
+using Camera::AsyncOutput;
+using Camera::AsyncOutputConfig;
+
+namespace {
+
+    std::shared_ptr<const char[]> shared_frame(size_t bytes, char fill = 0) {
+        std::shared_ptr<char[]> buffer(new char[bytes]);
+        std::fill(buffer.get(), buffer.get() + bytes, fill);
+        return buffer;
+    }
+
+    Camera::FrameMetadata meta_of(uint64_t frame_number) {
+        return frame_meta(32, 1, 2, frame_number);
+    }
+
+    std::vector<uint64_t> frame_numbers(const CaptureOutput &output) {
+        std::vector<uint64_t> numbers;
+        for (const auto &f : output.captured()) numbers.push_back(f.meta.frame_number);
+        return numbers;
+    }
+
+    AsyncOutputConfig config_of(size_t depth, Camera::OverflowPolicy overflow, uint32_t block_ms = 100) {
+        AsyncOutputConfig cfg;
+        cfg.queue_depth = depth;
+        cfg.overflow    = overflow;
+        cfg.block_ms    = block_ms;
+        return cfg;
+    }
+
+}
+
+TEST(AsyncOutputTest, FramesArriveInOrderAndCloseDrainsTheQueue) {
+    auto capture = std::make_unique<CaptureOutput>();
+    CaptureOutput* inner = capture.get();
+    AsyncOutput async(std::move(capture), config_of(4, Camera::OverflowPolicy::Block, 0));
+    ASSERT_EQ(async.open(), NO_ERROR);
+
+    // write() copies, so the caller's buffer may change right after
+    std::vector<char> pixels(64);
+    for (uint64_t n = 1; n <= 20; ++n) {
+        std::fill(pixels.begin(), pixels.end(), static_cast<char>(n));
+        ASSERT_EQ(async.write(pixels.data(), pixels.size(), meta_of(n)), NO_ERROR);
+    }
+    async.close();
+
+    const auto frames = inner->captured();
+    ASSERT_EQ(frames.size(), 20u);
+    for (uint64_t n = 1; n <= 20; ++n) {
+        EXPECT_EQ(frames[n - 1].meta.frame_number, n);
+        EXPECT_EQ(frames[n - 1].data, std::vector<char>(64, static_cast<char>(n)));
+    }
+    const auto s = async.stats();
+    EXPECT_EQ(s.frames_written, 20u);
+    EXPECT_EQ(s.frames_dropped, 0u);
+    EXPECT_EQ(async.metrics().latency.count, 20u);
+}
+
+TEST(AsyncOutputTest, DropNewestKeepsWhatIsQueued) {
+    auto gated = std::make_unique<GatedOutput>();
+    GatedOutput* inner = gated.get();
+    AsyncOutput async(std::move(gated), config_of(2, Camera::OverflowPolicy::DropNewest));
+    ASSERT_EQ(async.open(), NO_ERROR);
+
+    ASSERT_EQ(async.write_shared(shared_frame(64), 64, meta_of(1)), NO_ERROR);
+    inner->wait_entered(1);                       // the worker holds frame 1
+    for (uint64_t n = 2; n <= 5; ++n) EXPECT_EQ(async.write_shared(shared_frame(64), 64, meta_of(n)), NO_ERROR);
+    EXPECT_EQ(async.queue_status().depth, 2u);
+
+    inner->release();
+    async.close();
+    EXPECT_EQ(frame_numbers(*inner), (std::vector<uint64_t>{ 1, 2, 3 }));
+    EXPECT_EQ(async.stats().frames_dropped, 2u);
+    EXPECT_EQ(async.metrics().frames_in, 5u);
+}
+
+TEST(AsyncOutputTest, DropOldestKeepsTheNewest) {
+    auto gated = std::make_unique<GatedOutput>();
+    GatedOutput* inner = gated.get();
+    AsyncOutput async(std::move(gated), config_of(2, Camera::OverflowPolicy::DropOldest));
+    ASSERT_EQ(async.open(), NO_ERROR);
+
+    // the dropped frames' buffers are let go at once
+    const auto oldest = shared_frame(64);
+    ASSERT_EQ(async.write_shared(shared_frame(64), 64, meta_of(1)), NO_ERROR);
+    inner->wait_entered(1);
+    ASSERT_EQ(async.write_shared(oldest, 64, meta_of(2)), NO_ERROR);
+    EXPECT_EQ(oldest.use_count(), 2);
+    for (uint64_t n = 3; n <= 5; ++n) EXPECT_EQ(async.write_shared(shared_frame(64), 64, meta_of(n)), NO_ERROR);
+    EXPECT_EQ(oldest.use_count(), 1);
+
+    inner->release();
+    async.close();
+    EXPECT_EQ(frame_numbers(*inner), (std::vector<uint64_t>{ 1, 4, 5 }));
+    EXPECT_EQ(async.stats().frames_dropped, 2u);
+}
+
+TEST(AsyncOutputTest, BlockWaitsForRoomWithoutDropping) {
+    auto gated = std::make_unique<GatedOutput>();
+    GatedOutput* inner = gated.get();
+    AsyncOutput async(std::move(gated), config_of(1, Camera::OverflowPolicy::Block, 0));
+    ASSERT_EQ(async.open(), NO_ERROR);
+
+    ASSERT_EQ(async.write_shared(shared_frame(64), 64, meta_of(1)), NO_ERROR);
+    inner->wait_entered(1);
+    ASSERT_EQ(async.write_shared(shared_frame(64), 64, meta_of(2)), NO_ERROR);
+
+    auto third = std::async(std::launch::async, [&] { return async.write_shared(shared_frame(64), 64, meta_of(3)); });
+    EXPECT_EQ(third.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+    inner->release();
+    EXPECT_EQ(third.get(), NO_ERROR);
+    async.close();
+
+    EXPECT_EQ(frame_numbers(*inner), (std::vector<uint64_t>{ 1, 2, 3 }));
+    const auto s = async.stats();
+    EXPECT_EQ(s.frames_blocked, 1u);
+    EXPECT_EQ(s.frames_dropped, 0u);
+}
+
+TEST(AsyncOutputTest, ClosedOutputRefusesAndInnerFailuresAreCounted) {
+    auto capture = std::make_unique<CaptureOutput>();
+    capture->result = ERROR;
+    AsyncOutput async(std::move(capture), config_of(4, Camera::OverflowPolicy::Spill));
+    EXPECT_EQ(async.write_shared(shared_frame(64), 64, meta_of(1)), ERROR);     // not started
+
+    ASSERT_EQ(async.open(), NO_ERROR);
+    EXPECT_EQ(async.write_shared(shared_frame(64), 64, meta_of(2)), NO_ERROR);
+    EXPECT_EQ(async.write_shared(shared_frame(64), 64, meta_of(3)), NO_ERROR);
+    async.close();
+    EXPECT_EQ(async.write_shared(shared_frame(64), 64, meta_of(4)), ERROR);
+
+    const auto s = async.stats();
+    EXPECT_EQ(s.frames_written, 0u);
+    EXPECT_EQ(s.frames_failed, 2u);
+    // spill has nowhere to go here and falls back to drop_newest
+    EXPECT_DOUBLE_EQ(async.queue_status().pressure, 0.0);
+}
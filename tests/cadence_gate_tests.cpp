@@ -0,0 +1,160 @@
+#include "gtest/gtest.h"
+#include "../utils/cadence_gate.h"
+#include "capture_output.h"
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+using Camera::CadenceConfig;
+using Camera::CadenceGate;
+using Camera::CadenceMode;
+
+namespace {
+
+    /// CaptureOutput that reports whatever queue the test sets
+    class QueuedOutput : public CaptureOutput {
+      public:
+        Camera::QueueStatus queue_status() const override { return status; }
+        Camera::QueueStatus status;
+    };
+
+    /// a host clock the test moves by hand
+    struct ManualClock {
+        std::chrono::steady_clock::time_point now{std::chrono::hours(1)};
+        void advance_ms(double ms) { now += std::chrono::microseconds(static_cast<int64_t>(ms * 1000)); }
+    };
+
+    struct Harness {
+        explicit Harness(const CadenceConfig &cfg) {
+            auto queued = std::make_unique<QueuedOutput>();
+            inner = queued.get();
+            gate  = std::make_unique<CadenceGate>(std::move(queued), cfg);
+            gate->set_clock([this] { return clock.now; });
+        }
+
+        /// offers frame n with controller timestamp ts; true if it was forwarded
+        bool offer(uint64_t n, uint64_t ts = 0) {
+            const uint64_t before = gate->stats().frames_forwarded;
+            char pixel[2] = { 0, 0 };
+            auto meta = frame_meta(1, 1, 2, n);
+            meta.timestamp = ts;
+            EXPECT_EQ(gate->write(pixel, sizeof(pixel), meta), NO_ERROR);
+            return gate->stats().frames_forwarded > before;
+        }
+
+        /// offers frames at hz for seconds; the number forwarded
+        uint64_t run(double hz, double seconds) {
+            uint64_t forwarded = 0;
+            for (int i = 0; i < static_cast<int>(hz * seconds); ++i) {
+                clock.advance_ms(1000.0 / hz);
+                if (offer(++frame)) forwarded++;
+            }
+            return forwarded;
+        }
+
+        ManualClock clock;
+        QueuedOutput* inner{nullptr};
+        std::unique_ptr<CadenceGate> gate;
+        uint64_t frame{0};
+    };
+
+    CadenceConfig config_of(CadenceMode mode) {
+        CadenceConfig cfg;
+        cfg.mode = mode;
+        return cfg;
+    }
+
+}
+
+TEST(CadenceGateTest, IntervalGoesByTheHostClock) {
+    auto cfg = config_of(CadenceMode::Interval);
+    cfg.interval_ms = 100;
+    Harness h(cfg);
+
+    std::vector<bool> forwarded;
+    for (const double step : { 0.0, 50.0, 50.0, 50.0, 100.0, 99.0 }) {
+        h.clock.advance_ms(step);
+        forwarded.push_back(h.offer(++h.frame));
+    }
+    EXPECT_EQ(forwarded, (std::vector<bool>{ true, false, true, false, true, false }));
+}
+
+TEST(CadenceGateTest, EveryNthStartsWithTheFirst) {
+    auto cfg = config_of(CadenceMode::EveryNth);
+    cfg.every_n = 3;
+    Harness h(cfg);
+
+    std::vector<uint64_t> numbers;
+    for (uint64_t n = 1; n <= 10; ++n) h.offer(n);
+    for (const auto &f : h.inner->captured()) numbers.push_back(f.meta.frame_number);
+    EXPECT_EQ(numbers, (std::vector<uint64_t>{ 1, 4, 7, 10 }));
+    EXPECT_EQ(h.gate->stats().frames_skipped, 6u);
+}
+
+TEST(CadenceGateTest, TimestampIgnoresTheHostClockAndRestarts) {
+    auto cfg = config_of(CadenceMode::Timestamp);
+    cfg.interval_ms  = 10;
+    cfg.timestamp_hz = 1000;      // one tick per ms
+    Harness h(cfg);
+
+    // the host clock stands still; a timestamp going back is a restarted controller
+    std::vector<bool> forwarded;
+    for (const uint64_t ts : { 100, 105, 110, 112, 119, 120, 3, 8, 13 }) forwarded.push_back(h.offer(++h.frame, ts));
+    EXPECT_EQ(forwarded, (std::vector<bool>{ true, false, true, false, false, true, true, false, true }));
+}
+
+TEST(CadenceGateTest, LatestWaitsForAnEmptyQueue) {
+    Harness h(config_of(CadenceMode::Latest));
+    h.inner->status.capacity = 4;
+
+    EXPECT_TRUE(h.offer(1));
+    h.inner->status.depth = 1;
+    EXPECT_FALSE(h.offer(2));
+    EXPECT_FALSE(h.offer(3));
+    h.inner->status.depth = 0;
+    EXPECT_TRUE(h.offer(4));
+    EXPECT_EQ(h.gate->stats().frames_skipped, 2u);
+}
+
+TEST(CadenceGateTest, AdaptivePassesEverythingToAnIdleOutput) {
+    Harness h(config_of(CadenceMode::Adaptive));
+    h.inner->status.capacity = 8;
+
+    EXPECT_EQ(h.run(100, 5), 500u);
+    // raised a quarter at a time, up to twice the arrival rate
+    EXPECT_NEAR(h.gate->stats().rate_hz, 200.0, 1.0);
+}
+
+TEST(CadenceGateTest, AdaptiveBacksOffFromAFullOutput) {
+    auto cfg = config_of(CadenceMode::Adaptive);
+    cfg.min_rate_hz = 2;
+    Harness h(cfg);
+    h.inner->status.capacity = 8;
+    h.inner->status.depth    = 8;
+
+    const uint64_t early = h.run(100, 1);
+    EXPECT_GT(early, 20u);
+    h.run(100, 20);
+    EXPECT_DOUBLE_EQ(h.gate->stats().rate_hz, 2.0);
+    const uint64_t late = h.run(100, 5);
+    EXPECT_GE(late, 9u);
+    EXPECT_LE(late, 11u);
+
+    // room again: the rate climbs back
+    h.inner->status.depth = 0;
+    h.run(100, 10);
+    EXPECT_GT(h.gate->stats().rate_hz, 100.0);
+}
+
+TEST(CadenceGateTest, AdaptiveRateNeverReachesZero) {
+    auto cfg = config_of(CadenceMode::Adaptive);
+    cfg.min_rate_hz = 0;          // taken as the default
+    Harness h(cfg);
+    h.inner->status.capacity = 8;
+    h.inner->status.depth    = 8;
+
+    h.run(100, 120);
+    EXPECT_DOUBLE_EQ(h.gate->stats().rate_hz, CadenceConfig{}.min_rate_hz);
+    EXPECT_GT(h.gate->stats().frames_forwarded, 0u);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file    capture_output.h
+ * @brief   FrameOutput that keeps a copy of every frame written, for tests
+ */
+#pragma once
+
+#include "../utils/frame_output.h"
+#include "../common/common.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct CapturedFrame {
+    std::vector<char> data;
+    Camera::FrameMetadata meta;
+};
+
+class CaptureOutput : public Camera::FrameOutput {
+  public:
+    long open() override { return NO_ERROR; }
+    void close() override { }
+
+    long write(const char* data, size_t size, const Camera::FrameMetadata& meta) override {
+        std::lock_guard lock(mtx);
+        frames.push_back({ std::vector<char>(data, data + size), meta });
+        return result;
+    }
+
+    std::vector<CapturedFrame> captured() const {
+        std::lock_guard lock(mtx);
+        return frames;
+    }
+
+    long result{NO_ERROR};    ///< what write() returns
+
+  private:
+    mutable std::mutex mtx;
+    std::vector<CapturedFrame> frames;
+};
+
+/// CaptureOutput whose writes wait until release(), to hold a queue full
+class GatedOutput : public CaptureOutput {
+  public:
+    long write(const char* data, size_t size, const Camera::FrameMetadata& meta) override {
+        {
+            std::unique_lock lock(gate_mtx);
+            ++entered;
+            gate_cv.notify_all();
+            gate_cv.wait(lock, [this] { return released; });
+        }
+        return CaptureOutput::write(data, size, meta);
+    }
+
+    void release() {
+        std::lock_guard lock(gate_mtx);
+        released = true;
+        gate_cv.notify_all();
+    }
+
+    /// waits until n writes have started
+    void wait_entered(int n) {
+        std::unique_lock lock(gate_mtx);
+        gate_cv.wait(lock, [&] { return entered >= n; });
+    }
+
+  private:
+    std::mutex gate_mtx;
+    std::condition_variable gate_cv;
+    bool released{false};
+    int entered{0};
+};
+
+/// width x height 16-bit frame whose pixel (x,y) holds y*width + x
+inline std::vector<uint16_t> ramp_frame(uint32_t width, uint32_t height) {
+    std::vector<uint16_t> pixels(static_cast<size_t>(width) * height);
+    for (size_t i = 0; i < pixels.size(); ++i) pixels[i] = static_cast<uint16_t>(i);
+    return pixels;
+}
+
+inline Camera::FrameMetadata frame_meta(uint32_t width, uint32_t height, uint32_t bpp = 2,
+                                        uint64_t frame_number = 1) {
+    Camera::FrameMetadata meta;
+    meta.width           = width;
+    meta.height          = height;
+    meta.bytes_per_pixel = bpp;
+    meta.frame_number    = frame_number;
+    return meta;
+}
@@ -0,0 +1,97 @@
+#include "gtest/gtest.h"
+#include "../utils/centroider.h"
+#include "capture_output.h"
+
+#include <cmath>
+
+using Camera::CentroidConfig;
+using Camera::CentroidOutput;
+using Camera::FrameView;
+using Camera::RoiTable;
+using Camera::RoiWindow;
+
+namespace {
+
+    /// background plus a Gaussian of the given sigma centred on (cx, cy)
+    std::vector<uint16_t> gaussian_frame(uint32_t width, uint32_t height, double cx, double cy,
+                                         double sigma, double amplitude, uint16_t background) {
+        std::vector<uint16_t> pixels(static_cast<size_t>(width) * height);
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                const double r2 = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+                pixels[y * width + x] = static_cast<uint16_t>(std::lround(background + amplitude * std::exp(-r2 / (2 * sigma * sigma))));
+            }
+        }
+        return pixels;
+    }
+
+    FrameView view_of(const std::vector<uint16_t> &pixels, uint32_t width, uint32_t height) {
+        return FrameView::full(reinterpret_cast<const char*>(pixels.data()), frame_meta(width, height));
+    }
+
+}
+
+TEST(CentroiderTest, GaussianSpot) {
+    // wider than one vector so both the SIMD body and the scalar tail are used
+    auto pixels = gaussian_frame(37, 31, 17.3, 14.6, 2.0, 5000.0, 100);
+    const auto r = Camera::measure_centroid(view_of(pixels, 37, 31));
+
+    ASSERT_TRUE(r.valid);
+    EXPECT_NEAR(r.x, 17.3, 0.02);
+    EXPECT_NEAR(r.y, 14.6, 0.02);
+    EXPECT_NEAR(r.background, 100.0, 0.5);
+    EXPECT_NEAR(r.peak, 5000.0, 200.0);
+    EXPECT_NEAR(r.flux, 5000.0 * 2 * M_PI * 2.0 * 2.0, 300.0);
+    EXPECT_NEAR(r.fwhm, 2.35482 * 2.0, 0.1);
+}
+
+TEST(CentroiderTest, GaussianSpotInStridedWindow) {
+    auto pixels = gaussian_frame(64, 48, 40.25, 20.75, 1.5, 3000.0, 50);
+    const auto win = view_of(pixels, 64, 48).window(30, 10, 21, 21);
+    const auto r = Camera::measure_centroid(win);
+
+    ASSERT_TRUE(r.valid);
+    EXPECT_NEAR(r.x + 30, 40.25, 0.02);
+    EXPECT_NEAR(r.y + 10, 20.75, 0.02);
+}
+
+TEST(CentroiderTest, FlatWindowHasNoFlux) {
+    std::vector<uint16_t> pixels(20 * 20, 400);
+    const auto r = Camera::measure_centroid(view_of(pixels, 20, 20));
+    EXPECT_FALSE(r.valid);
+    EXPECT_EQ(r.x, 0.0f);
+    EXPECT_EQ(r.y, 0.0f);
+    EXPECT_EQ(r.flux, 0.0f);
+    EXPECT_EQ(r.background, 400.0f);
+}
+
+TEST(CentroiderTest, OutputLeavesInvalidWindowsAtZero) {
+    // window 0 holds the star, window 1 is flat sky, window 2 is off the edge
+    auto table = std::make_shared<RoiTable>(std::vector<RoiWindow>{ {10, 10, 20, 20}, {40, 0, 16, 16}, {50, 30, 20, 20} });
+    CentroidConfig cfg;
+    cfg.budget_us     = 1000000;
+    cfg.report_frames = 0;
+    CentroidOutput centroider(table, cfg);
+    ASSERT_EQ(centroider.open(), NO_ERROR);
+
+    std::vector<uint16_t> pixels = gaussian_frame(64, 48, 20.5, 19.5, 1.5, 4000.0, 100);
+    for (uint32_t y = 0; y < 16; ++y) {
+        for (uint32_t x = 40; x < 56; ++x) pixels[y * 64 + x] = 100;
+    }
+    auto meta = frame_meta(64, 48, 2, 7);
+    ASSERT_EQ(centroider.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2, meta), NO_ERROR);
+
+    const auto &results = centroider.results();
+    ASSERT_EQ(results.size(), 3u);
+    EXPECT_TRUE(results[0].valid);
+    EXPECT_NEAR(results[0].x, 20.5, 0.05);
+    EXPECT_NEAR(results[0].y, 19.5, 0.05);
+    EXPECT_EQ(results[0].frame_number, 7u);
+
+    for (size_t id : { 1, 2 }) {
+        EXPECT_FALSE(results[id].valid) << "window " << id;
+        EXPECT_EQ(results[id].x, 0.0f) << "window " << id;
+        EXPECT_EQ(results[id].y, 0.0f) << "window " << id;
+        EXPECT_EQ(results[id].roi_id, id);
+    }
+}
@@ -0,0 +1,302 @@
+#include "gtest/gtest.h"
+#include "../utils/command_server.h"
+#include "../common/common.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Network::CommandServer;
+using Network::CommandServerConfig;
+
+namespace {
+
+    /// a port nothing is listening on just now
+    int free_port() {
+        const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr{};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        ::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+        ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+        ::close(fd);
+        return ntohs(addr.sin_port);
+    }
+
+    /// blocking loopback client that reads a line at a time
+    class Client {
+      public:
+        explicit Client(int port) {
+            fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr{};
+            addr.sin_family      = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port        = htons(static_cast<uint16_t>(port));
+            connected = ::connect(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+        }
+        ~Client() { if (fd_ >= 0) ::close(fd_); }
+
+        bool send(const std::string &s) {
+            size_t sent = 0;
+            while (sent < s.size()) {
+                const ssize_t n = ::send(fd_, s.data() + sent, s.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0) return false;
+                sent += static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        /// the next line without its newline; "<timeout>" or "<closed>" if there is none
+        std::string line(int timeout_ms = 2000) {
+            while (buf_.find('\n') == std::string::npos) {
+                struct pollfd p{ fd_, POLLIN, 0 };
+                if (::poll(&p, 1, timeout_ms) <= 0) return "<timeout>";
+                char chunk[4096];
+                const ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+                if (n <= 0) return "<closed>";
+                buf_.append(chunk, static_cast<size_t>(n));
+            }
+            const size_t eol = buf_.find('\n');
+            std::string l = buf_.substr(0, eol);
+            buf_.erase(0, eol + 1);
+            return l;
+        }
+
+        bool connected{false};
+
+      private:
+        int fd_{-1};
+        std::string buf_;
+    };
+
+    /// a command server on a free port, its I/O loop on a thread of its own
+    class Running {
+      public:
+        Running(CommandServerConfig cfg, CommandServer::Handler handler) {
+            cfg.port = free_port();
+            port = cfg.port;
+            server = std::make_unique<CommandServer>(cfg, std::move(handler));
+            started = server->start() == NO_ERROR;
+            if (started) io_ = std::thread([this] { server->run(); });
+        }
+        ~Running() {
+            server->stop();
+            if (io_.joinable()) io_.join();
+        }
+
+        int port{0};
+        bool started{false};
+        std::unique_ptr<CommandServer> server;
+
+      private:
+        std::thread io_;
+    };
+
+    /// a gate commands wait at until the test opens it
+    class Gate {
+      public:
+        void wait() {
+            std::unique_lock lock(mtx_);
+            ++waiting_;
+            cv_.notify_all();
+            cv_.wait(lock, [this] { return open_; });
+        }
+        void open() {
+            std::lock_guard lock(mtx_);
+            open_ = true;
+            cv_.notify_all();
+        }
+        bool wait_for_waiters(int n) {
+            std::unique_lock lock(mtx_);
+            return cv_.wait_for(lock, std::chrono::seconds(2), [&] { return waiting_ >= n; });
+        }
+      private:
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        bool open_{false};
+        int waiting_{0};
+    };
+
+    std::string command_of(const std::string &line) {
+        return line.substr(0, line.find(' '));
+    }
+
+}
+
+TEST(CommandServerTest, PipelinedLinesAreAnsweredInOrder) {
+    CommandServerConfig cfg;
+    cfg.workers     = 4;
+    cfg.max_line    = 64;
+    cfg.max_backlog = 256;        // far less than is sent, so reading pauses and resumes
+    Running r(cfg, [](const std::string &line, uint64_t) {
+        // later lines finish sooner, were they allowed to run at once
+        const int n = std::stoi(line.substr(5));
+        std::this_thread::sleep_for(std::chrono::microseconds((7 - n % 8) * 100));
+        return line + "\n";
+    });
+    ASSERT_TRUE(r.started);
+    Client client(r.port);
+    ASSERT_TRUE(client.connected);
+
+    constexpr int LINES = 300;
+    std::string batch;
+    for (int n = 0; n < LINES; ++n) batch += "echo " + std::to_string(n) + "\n";
+    std::thread sender([&] { client.send(batch); });
+    for (int n = 0; n < LINES; ++n) ASSERT_EQ(client.line(), "echo " + std::to_string(n));
+    sender.join();
+
+    const auto m = r.server->metrics();
+    EXPECT_EQ(m["connections"]["commands"].get<uint64_t>(), static_cast<uint64_t>(LINES));
+    EXPECT_EQ(m["commands"]["echo"]["count"].get<uint64_t>(), static_cast<uint64_t>(LINES));
+}
+
+TEST(CommandServerTest, SlowCommandsRunOneAtATimeBesideQuickOnes) {
+    CommandServerConfig cfg;
+    cfg.workers       = 2;
+    cfg.slow_commands = { "expose" };
+    std::atomic<int> running{0}, most{0};
+    Running r(cfg, [&](const std::string &line, uint64_t) -> std::string {
+        if (command_of(line) != "expose") return "ok\n";
+        if (line == "expose ?") return "expose [n]\n";
+        const int now = ++running;
+        int seen = most.load();
+        while (now > seen && !most.compare_exchange_weak(seen, now)) { }
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        --running;
+        return "exposed\n";
+    });
+    ASSERT_TRUE(r.started);
+
+    std::vector<std::unique_ptr<Client>> exposers;
+    for (int i = 0; i < 3; ++i) {
+        exposers.push_back(std::make_unique<Client>(r.port));
+        ASSERT_TRUE(exposers.back()->send("expose\n"));
+    }
+    // a quick command is answered while the exposures queue
+    Client quick(r.port);
+    ASSERT_TRUE(quick.send("status\n"));
+    EXPECT_EQ(quick.line(50), "ok");
+    // and help for a slow command is quick too
+    ASSERT_TRUE(quick.send("expose ?\n"));
+    EXPECT_EQ(quick.line(50), "expose [n]");
+
+    for (auto &c : exposers) EXPECT_EQ(c->line(), "exposed");
+    EXPECT_EQ(most.load(), 1);
+}
+
+TEST(CommandServerTest, BlockingCommandsLeaveThePoolFree) {
+    CommandServerConfig cfg;
+    cfg.workers           = 1;
+    cfg.blocking_commands = { "wait" };
+    Gate gate;
+    Running r(cfg, [&](const std::string &line, uint64_t) -> std::string {
+        if (command_of(line) == "wait") { gate.wait(); return "done\n"; }
+        return "ok\n";
+    });
+    ASSERT_TRUE(r.started);
+
+    std::vector<std::unique_ptr<Client>> waiters;
+    for (int i = 0; i < 3; ++i) {
+        waiters.push_back(std::make_unique<Client>(r.port));
+        ASSERT_TRUE(waiters.back()->send("wait\n"));
+    }
+    ASSERT_TRUE(gate.wait_for_waiters(3));
+
+    // the one worker is not among the waiters
+    Client quick(r.port);
+    ASSERT_TRUE(quick.send("status\n"));
+    EXPECT_EQ(quick.line(500), "ok");
+    EXPECT_EQ(r.server->metrics()["queues"]["blocking"].get<int>(), 3);
+
+    gate.open();
+    for (auto &c : waiters) EXPECT_EQ(c->line(), "done");
+}
+
+TEST(CommandServerTest, BlockingCommandsPastTheCapWaitTheirTurn) {
+    CommandServerConfig cfg;
+    cfg.blocking_commands = { "wait" };
+    cfg.max_blocking      = 2;
+    Gate gate;
+    Running r(cfg, [&](const std::string &, uint64_t) { gate.wait(); return std::string("done\n"); });
+    ASSERT_TRUE(r.started);
+
+    std::vector<std::unique_ptr<Client>> waiters;
+    for (int i = 0; i < 4; ++i) {
+        waiters.push_back(std::make_unique<Client>(r.port));
+        ASSERT_TRUE(waiters.back()->send("wait\n"));
+    }
+    ASSERT_TRUE(gate.wait_for_waiters(2));
+    for (int i = 0; i < 200 && r.server->metrics()["queues"]["blocking_waiting"].get<int>() < 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    auto q = r.server->metrics()["queues"];
+    EXPECT_EQ(q["blocking"].get<int>(), 2);
+    EXPECT_EQ(q["blocking_waiting"].get<int>(), 2);
+
+    gate.open();
+    for (auto &c : waiters) EXPECT_EQ(c->line(), "done");
+    EXPECT_EQ(r.server->metrics()["queues"]["blocking_waiting"].get<int>(), 0);
+}
+
+TEST(CommandServerTest, DestructionLeavesLongCommandsBehind) {
+    CommandServerConfig cfg;
+    cfg.slow_commands     = { "expose" };
+    cfg.blocking_commands = { "wait" };
+    cfg.shutdown_ms       = 50;
+    auto gate = std::make_shared<Gate>();          // outlives the server, held by its handler
+    std::atomic<int> returned{0};
+    auto handler = [gate, &returned](const std::string &line, uint64_t) -> std::string {
+        if (command_of(line) != "status") { gate->wait(); ++returned; }
+        return "ok\n";
+    };
+
+    auto started = std::chrono::steady_clock::now();
+    {
+        Running r(cfg, handler);
+        ASSERT_TRUE(r.started);
+        Client expose(r.port), wait(r.port), quick(r.port);
+        ASSERT_TRUE(expose.send("expose\n"));
+        ASSERT_TRUE(wait.send("wait\n"));
+        ASSERT_TRUE(gate->wait_for_waiters(2));
+        ASSERT_TRUE(quick.send("status\n"));
+        EXPECT_EQ(quick.line(), "ok");
+        started = std::chrono::steady_clock::now();
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::seconds(1));
+
+    // the two left behind return into a server that is gone, and touch none of it
+    gate->open();
+    for (int i = 0; i < 200 && returned.load() < 2; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(returned.load(), 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+TEST(CommandServerTest, OverlongLineClosesTheConnection) {
+    CommandServerConfig cfg;
+    cfg.max_line = 64;
+    Running r(cfg, [](const std::string &, uint64_t) { return std::string("ok\n"); });
+    ASSERT_TRUE(r.started);
+
+    Client client(r.port);
+    ASSERT_TRUE(client.send("status\n"));
+    EXPECT_EQ(client.line(), "ok");
+    client.send(std::string(200, 'x'));
+    EXPECT_EQ(client.line(), "<closed>");
+
+    // other connections carry on
+    Client other(r.port);
+    ASSERT_TRUE(other.send(std::string(60, 'y') + "\n"));
+    EXPECT_EQ(other.line(), "ok");
+    EXPECT_EQ(r.server->metrics()["connections"]["closed"].get<uint64_t>(), 1u);
+}
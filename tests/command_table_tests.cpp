@@ -0,0 +1,165 @@
+#include "gtest/gtest.h"
+#include "../utils/command_table.h"
+#include "../utils/logentry.h"
+#include "../common/common.h"
+
+#include <chrono>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Network::CommandTable;
+
+// with no log open, logwrite() leaves each entry on the queue
+extern std::queue<std::string> log_queue;
+extern std::mutex loglock;
+
+namespace {
+
+    /// the entries logged since the last call
+    std::vector<std::string> take_log() {
+        std::lock_guard lock(loglock);
+        std::vector<std::string> entries;
+        for (; !log_queue.empty(); log_queue.pop()) entries.push_back(log_queue.front());
+        return entries;
+    }
+
+    /// a handler that returns ret with reply, recording the args it was given
+    CommandTable::Handler returns(long ret, std::string reply, std::string* args_seen = nullptr) {
+        return [=](const std::string &args, std::string &retstring, uint64_t) {
+            if (args_seen) *args_seen = args;
+            retstring = reply;
+            return ret;
+        };
+    }
+
+    bool logged(const std::vector<std::string> &entries, const std::string &text) {
+        for (const auto &e : entries) if (e.find(text) != std::string::npos) return true;
+        return false;
+    }
+
+}
+
+TEST(CommandTableTest, AddFindAndReplace) {
+    CommandTable table;
+    table.add("exptime", returns(NO_ERROR, "1"), Network::CMD_NONE, "exptime [ <ms> ]");
+    table.add("expose", returns(NO_ERROR, ""), Network::CMD_SLOW);
+    EXPECT_EQ(table.find("nosuch"), nullptr);
+
+    auto* e = table.find("expose");
+    ASSERT_NE(e, nullptr);
+    EXPECT_EQ(e->syntax, "expose");               // defaults to the name
+    EXPECT_EQ(table.syntax(), (std::vector<std::string>{ "expose", "exptime [ <ms> ]" }));
+
+    // the same name again replaces the command
+    table.add("expose", returns(ERROR, ""), Network::CMD_QUIET, "expose <n>");
+    e = table.find("expose");
+    ASSERT_NE(e, nullptr);
+    EXPECT_TRUE(e->quiet());
+    EXPECT_EQ(e->syntax, "expose <n>");
+    EXPECT_EQ(table.syntax().size(), 2u);
+}
+
+TEST(CommandTableTest, WithFlagsMatchesAnyFlagGiven) {
+    CommandTable table;
+    table.add("expose", returns(NO_ERROR, ""), Network::CMD_SLOW);
+    table.add("load",   returns(NO_ERROR, ""), Network::CMD_SLOW | Network::CMD_QUIET);
+    table.add("wait",   returns(NO_ERROR, ""), Network::CMD_BLOCKING);
+    table.add("status", returns(NO_ERROR, ""), Network::CMD_QUIET);
+    table.add("bin",    returns(NO_ERROR, ""));
+
+    using Names = std::set<std::string>;
+    EXPECT_EQ(table.with_flags(Network::CMD_SLOW), (Names{ "expose", "load" }));
+    EXPECT_EQ(table.with_flags(Network::CMD_BLOCKING), (Names{ "wait" }));
+    EXPECT_EQ(table.with_flags(Network::CMD_QUIET | Network::CMD_BLOCKING), (Names{ "load", "status", "wait" }));
+    EXPECT_TRUE(table.with_flags(Network::CMD_NONE).empty());
+}
+
+TEST(CommandTableTest, CallsAreCountedWithErrorsAndLatency) {
+    CommandTable table;
+    int n = 0;
+    table.add("flaky", [&](const std::string &, std::string &, uint64_t) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return (++n % 2 == 0) ? ERROR : NO_ERROR;
+    });
+    table.add("idle", returns(NO_ERROR, ""));
+    EXPECT_TRUE(table.stats().empty());
+
+    std::string reply;
+    for (int i = 0; i < 3; ++i) table.call(*table.find("flaky"), "", reply, 1);
+
+    const auto j = table.stats();
+    EXPECT_FALSE(j.contains("idle"));             // never called
+    EXPECT_EQ(j["flaky"]["calls"].get<uint64_t>(), 3u);
+    EXPECT_EQ(j["flaky"]["errors"].get<uint64_t>(), 1u);
+    EXPECT_EQ(j["flaky"]["latency"]["count"].get<uint64_t>(), 3u);
+    EXPECT_GE(j["flaky"]["latency"]["max_us"].get<double>(), 2000.0);
+}
+
+TEST(CommandTableTest, DispatchEndsRepliesByWhatTheHandlerReturned) {
+    CommandTable table;
+    std::string args;
+    table.add("exptime", returns(NO_ERROR, "1000", &args));
+    table.add("bad",     returns(ERROR, ""));
+    table.add("help",    returns(HELP, "exptime [ <ms> ]\n"));
+    table.add("json",    returns(JSON, "{}" + JEOF));
+    table.add("silent",  returns(NOTHING, "ignored"));
+
+    EXPECT_EQ(table.dispatch("exptime 1000 fast\r", 7), "1000 DONE\n");
+    EXPECT_EQ(args, "1000 fast");
+    EXPECT_EQ(table.dispatch("bad", 7), "ERROR\n");
+    EXPECT_EQ(table.dispatch("help", 7), "exptime [ <ms> ]\n");
+    EXPECT_EQ(table.dispatch("json", 7), "{}" + JEOF);
+    EXPECT_EQ(table.dispatch("silent", 7), "");
+    EXPECT_EQ(table.dispatch("", 7), "\n");
+    EXPECT_EQ(table.dispatch("\r", 7), "\n");
+
+    EXPECT_EQ(table.dispatch("nosuch 1", 7), "ERROR\n");
+    EXPECT_EQ(table.unknown(), 1u);
+    EXPECT_EQ(table.stats()["bad"]["errors"].get<uint64_t>(), 1u);
+}
+
+TEST(CommandTableTest, OverrideClaimsNamesAheadOfTheTable) {
+    CommandTable table;
+    table.add("native", returns(NO_ERROR, "table"));
+    table.add("status", returns(NO_ERROR, "table"));
+    table.set_override([](const std::string &name) { return name == "native" || name == "instr"; },
+                       [](const std::string &name, const std::string &args, std::string &retstring, uint64_t) {
+                           retstring = name + ":" + args;
+                           return NO_ERROR;
+                       });
+
+    EXPECT_EQ(table.dispatch("native x", 1), "native:x DONE\n");
+    EXPECT_EQ(table.dispatch("instr", 1), "instr: DONE\n");
+    EXPECT_EQ(table.dispatch("status", 1), "table DONE\n");
+    EXPECT_FALSE(table.stats().contains("native"));
+    EXPECT_EQ(table.unknown(), 0u);
+}
+
+TEST(CommandTableTest, QuietCommandsAreNotLogged) {
+    CommandTable table;
+    table.add("status", returns(NO_ERROR, "idle"), Network::CMD_QUIET);
+    table.add("bin",    returns(NO_ERROR, "2"));
+    table.add("json",   returns(JSON, "{}" + JEOF));
+    take_log();
+
+    table.dispatch("status", 3);
+    table.dispatch("status", 3);
+    EXPECT_TRUE(take_log().empty());
+
+    table.dispatch("bin 2", 3);
+    auto entries = take_log();
+    ASSERT_EQ(entries.size(), 2u);
+    EXPECT_TRUE(logged(entries, "connection 3 (3) : bin 2"));     // numbered after the quiet ones
+    EXPECT_TRUE(logged(entries, "command (3) reply: 2 DONE"));
+
+    table.dispatch("json", 3);
+    entries = take_log();
+    EXPECT_TRUE(logged(entries, "reply with JSON message"));
+    EXPECT_FALSE(logged(entries, "EOF"));
+
+    // a quiet command's handler is still counted
+    EXPECT_EQ(table.stats()["status"]["calls"].get<uint64_t>(), 2u);
+}
@@ -0,0 +1,436 @@
+#include "gtest/gtest.h"
+#include "../utils/fits_writer.h"
+#include "capture_output.h"
+
+#include <fitsio.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+using Camera::FitsWriter;
+using Camera::FitsWriterConfig;
+
+namespace {
+
+    /// a fresh directory under /tmp, removed with everything in it
+    class TempDir {
+      public:
+        TempDir() {
+            char name[] = "/tmp/fits_writer_test_XXXXXX";
+            path = ::mkdtemp(name) ? name : "";
+        }
+        ~TempDir() {
+            std::error_code ec;
+            if (!path.empty()) std::filesystem::remove_all(path, ec);
+        }
+        std::string path;
+    };
+
+    FitsWriterConfig config_in(const std::string &dir) {
+        FitsWriterConfig cfg;
+        cfg.output_dir = dir;
+        cfg.basename   = "test";
+        return cfg;
+    }
+
+    std::string frame_file(const std::string &dir, uint64_t frame_number) {
+        char num[32];
+        std::snprintf(num, sizeof(num), "%08llu", static_cast<unsigned long long>(frame_number));
+        return dir + "/test_" + num + ".fits";
+    }
+
+    template <typename T>
+    std::shared_ptr<char[]> shared_copy(const std::vector<T> &pixels) {
+        const size_t bytes = pixels.size() * sizeof(T);
+        std::shared_ptr<char[]> buffer(new char[bytes]);
+        std::memcpy(buffer.get(), pixels.data(), bytes);
+        return buffer;
+    }
+
+    /**
+     * Pixels of HDU hdu of filename read back by cfitsio as datatype, with
+     * its FRAMENO; empty if cfitsio cannot read them. A tile-compressed HDU
+     * is decompressed by cfitsio on the way.
+     */
+    template <typename T>
+    std::vector<T> read_pixels(const std::string &filename, int hdu, int datatype, long &frameno) {
+        fitsfile* fptr = nullptr;
+        int status = 0, naxis = 0, bitpix = 0, anynul = 0;
+        long naxes[3] = { 0, 0, 0 };
+        std::vector<T> pixels;
+        frameno = -1;
+        if (fits_open_file(&fptr, filename.c_str(), READONLY, &status) != 0) return pixels;
+        fits_movabs_hdu(fptr, hdu, nullptr, &status);
+        fits_get_img_param(fptr, 3, &bitpix, &naxis, naxes, &status);
+        fits_read_key(fptr, TLONG, "FRAMENO", &frameno, nullptr, &status);
+        if (status == 0 && naxis == 2) {
+            pixels.resize(static_cast<size_t>(naxes[0]) * naxes[1]);
+            fits_read_img(fptr, datatype, 1, static_cast<LONGLONG>(pixels.size()), nullptr,
+                          pixels.data(), &anynul, &status);
+        }
+        int close_status = 0;
+        fits_close_file(fptr, &close_status);
+        if (status != 0) pixels.clear();
+        return pixels;
+    }
+
+    std::vector<uint16_t> read_u16(const std::string &filename, int hdu, long &frameno) {
+        return read_pixels<uint16_t>(filename, hdu, TUSHORT, frameno);
+    }
+
+    /// samples spread over the whole 32-bit range, with some runs of equal values
+    std::vector<uint32_t> noisy_u32(uint32_t width, uint32_t height) {
+        std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+        uint32_t x = 12345;
+        for (size_t i = 0; i < pixels.size(); ++i) {
+            x = x * 1664525u + 1013904223u;
+            pixels[i] = (i % 50 < 10) ? 1000u : x;
+        }
+        return pixels;
+    }
+
+    /// FRAMEHSH as frame_checksum.h defines it: XXH64 of each DIGEST_BLOCK
+    /// of the frame, then of those hashes in order, seeded with the size
+    template <typename T>
+    std::string content_hash(const std::vector<T> &pixels) {
+        const size_t size = pixels.size() * sizeof(T);
+        const char* p = reinterpret_cast<const char*>(pixels.data());
+        std::vector<uint64_t> blocks;
+        for (size_t at = 0; at < size; at += Camera::DIGEST_BLOCK) {
+            blocks.push_back(Camera::xxh64(p + at, std::min(Camera::DIGEST_BLOCK, size - at)));
+        }
+        return Camera::hash_to_hex(Camera::xxh64(blocks.data(), blocks.size() * sizeof(uint64_t), size));
+    }
+
+    struct TestFrame {
+        std::shared_ptr<char[]> data;
+        size_t size;
+        Camera::FrameMetadata meta;
+        std::string hash;             ///< expected FRAMEHSH
+    };
+
+    template <typename T>
+    TestFrame test_frame(const std::vector<T> &pixels, uint32_t width, uint32_t height, uint64_t frame_number) {
+        return { shared_copy(pixels), pixels.size() * sizeof(T),
+                 frame_meta(width, height, sizeof(T), frame_number), content_hash(pixels) };
+    }
+
+    /**
+     * Checks every HDU of every FITS file in dir with cfitsio, expecting
+     * DATASUM and CHECKSUM both present and correct, and returns the
+     * FRAMEHSH of each frame by number: from its HDU, or from the index
+     * for cube slices, which have no header of their own.
+     */
+    std::map<uint64_t, std::string> verify_dir(const std::string &dir, int &hdus) {
+        std::map<uint64_t, std::string> hashes;
+        hdus = 0;
+        for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+            if (entry.path().extension() != ".fits") continue;
+            const std::string filename = entry.path().string();
+            fitsfile* fptr = nullptr;
+            int status = 0, nhdu = 0;
+            fits_open_file(&fptr, filename.c_str(), READONLY, &status);
+            fits_get_num_hdus(fptr, &nhdu, &status);
+            for (int hdu = 1; hdu <= nhdu && status == 0; ++hdu, ++hdus) {
+                int datastatus = 0, hdustatus = 0;
+                fits_movabs_hdu(fptr, hdu, nullptr, &status);
+                fits_verify_chksum(fptr, &datastatus, &hdustatus, &status);
+                EXPECT_EQ(datastatus, 1) << filename << " HDU " << hdu;
+                EXPECT_EQ(hdustatus, 1) << filename << " HDU " << hdu;
+
+                long frameno = 0;
+                char hash[FLEN_VALUE] = "";
+                int key_status = 0;
+                fits_read_key(fptr, TLONG, "FRAMENO", &frameno, nullptr, &key_status);
+                fits_read_key(fptr, TSTRING, "FRAMEHSH", hash, nullptr, &key_status);
+                if (key_status == 0) hashes[static_cast<uint64_t>(frameno)] = hash;
+            }
+            EXPECT_EQ(status, 0) << filename;
+            int close_status = 0;
+            if (fptr) fits_close_file(fptr, &close_status);
+        }
+
+        std::FILE* index = std::fopen((dir + "/test.index").c_str(), "r");
+        if (!index) return hashes;
+        char line[256];
+        while (std::fgets(line, sizeof(line), index)) {
+            unsigned long long frame = 0, timestamp = 0, host = 0;
+            char file[128], hash[32];
+            long position = 0;
+            if (std::sscanf(line, "%llu %llu %llu %127s %ld %31s", &frame, &timestamp, &host, file, &position, hash) != 6) continue;
+            auto it = hashes.find(frame);
+            if (it == hashes.end()) hashes[frame] = hash;
+            else EXPECT_EQ(it->second, hash) << "frame " << frame << ": header and index disagree";
+        }
+        std::fclose(index);
+        return hashes;
+    }
+
+    /// writes the frames with checksums and content hashes on, then checks every HDU written
+    void expect_verified(FitsWriterConfig cfg, const std::vector<TestFrame> &frames, int expected_hdus) {
+        cfg.checksum     = true;
+        cfg.content_hash = true;
+        FitsWriter writer(cfg);
+        ASSERT_EQ(writer.open(), NO_ERROR);
+        std::map<uint64_t, std::string> expected;
+        for (const auto &f : frames) {
+            ASSERT_EQ(writer.write_shared(f.data, f.size, f.meta), NO_ERROR);
+            expected[f.meta.frame_number] = f.hash;
+        }
+        writer.close();
+        ASSERT_EQ(writer.stats().frames_written, frames.size());
+
+        int hdus = 0;
+        EXPECT_EQ(verify_dir(cfg.output_dir, hdus), expected);
+        EXPECT_EQ(hdus, expected_hdus);
+    }
+
+    /// a 61 x 43 ramp, an odd number of 16-bit pixels, offset by n
+    std::vector<uint16_t> odd_ramp(uint64_t n) {
+        auto pixels = ramp_frame(61, 43);
+        for (auto &p : pixels) p = static_cast<uint16_t>(p + n * 100);
+        return pixels;
+    }
+
+}
+
+TEST(FitsWriterTest, SharedBufferIsWrittenAfterTheCallerLetsGo) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    FitsWriter writer(config_in(dir.path));
+    ASSERT_EQ(writer.open(), NO_ERROR);
+
+    const auto pixels = ramp_frame(64, 32);
+    auto buffer = shared_copy(pixels);
+    ASSERT_EQ(writer.write_shared(buffer, pixels.size() * 2, frame_meta(64, 32, 2, 7)), NO_ERROR);
+    buffer.reset();       // the queue holds the only reference now
+    writer.close();
+
+    const auto s = writer.stats();
+    EXPECT_EQ(s.frames_received, 1u);
+    EXPECT_EQ(s.frames_written, 1u);
+    long frameno = 0;
+    EXPECT_EQ(read_u16(frame_file(dir.path, 7), 1, frameno), pixels);
+    EXPECT_EQ(frameno, 7);
+}
+
+TEST(FitsWriterTest, WorkersShareOneBufferAcrossFrames) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    auto cfg = config_in(dir.path);
+    cfg.workers    = 4;
+    cfg.queue_size = 16;
+    cfg.overflow   = Camera::OverflowPolicy::Block;
+    cfg.block_ms   = 0;
+    FitsWriter writer(cfg);
+    ASSERT_EQ(writer.open(), NO_ERROR);
+
+    const auto pixels = ramp_frame(40, 25);
+    const auto buffer = shared_copy(pixels);
+    constexpr uint64_t FRAMES = 16;
+    for (uint64_t n = 1; n <= FRAMES; ++n) {
+        ASSERT_EQ(writer.write_shared(buffer, pixels.size() * 2, frame_meta(40, 25, 2, n)), NO_ERROR);
+    }
+    writer.close();
+
+    EXPECT_EQ(writer.stats().frames_written, FRAMES);
+    EXPECT_EQ(buffer.use_count(), 1);
+    for (uint64_t n = 1; n <= FRAMES; ++n) {
+        long frameno = 0;
+        EXPECT_EQ(read_u16(frame_file(dir.path, n), 1, frameno), pixels) << "frame " << n;
+        EXPECT_EQ(frameno, static_cast<long>(n));
+    }
+}
+
+TEST(FitsWriterTest, ShortOrUnopenedFramesAreRefused) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    FitsWriter writer(config_in(dir.path));
+    const auto pixels = ramp_frame(16, 16);
+    const auto buffer = shared_copy(pixels);
+
+    EXPECT_EQ(writer.write_shared(buffer, pixels.size() * 2, frame_meta(16, 16)), ERROR);
+    ASSERT_EQ(writer.open(), NO_ERROR);
+    EXPECT_EQ(writer.write_shared(buffer, pixels.size() * 2 - 1, frame_meta(16, 16)), ERROR);
+    EXPECT_EQ(writer.write_shared(buffer, pixels.size() * 2, frame_meta(16, 16, 3)), ERROR);
+    EXPECT_EQ(writer.write_shared(buffer, pixels.size() * 2, frame_meta(16, 16, 1)), ERROR);     // 8-bit previews
+    writer.close();
+
+    EXPECT_EQ(writer.stats().frames_received, 0u);
+    EXPECT_EQ(buffer.use_count(), 1);
+}
+
+TEST(FitsWriterTest, RiceTilesReadBackThroughCfitsio) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    auto cfg = config_in(dir.path);
+    cfg.compression      = Camera::FitsCompression::Rice;
+    cfg.tile_width       = 7;       // edge tiles narrower and shorter than the rest
+    cfg.tile_height      = 5;
+    cfg.compress_threads = 3;
+    FitsWriter writer(cfg);
+    ASSERT_EQ(writer.open(), NO_ERROR);
+
+    const auto ramp = ramp_frame(61, 43);
+    ASSERT_EQ(writer.write_shared(shared_copy(ramp), ramp.size() * 2, frame_meta(61, 43, 2, 1)), NO_ERROR);
+    const auto noisy = noisy_u32(33, 19);
+    ASSERT_EQ(writer.write_shared(shared_copy(noisy), noisy.size() * 4, frame_meta(33, 19, 4, 2)), NO_ERROR);
+    writer.close();
+    ASSERT_EQ(writer.stats().frames_written, 2u);
+
+    // HDU 1 is the empty primary, the tile table follows
+    long frameno = 0;
+    EXPECT_EQ(read_u16(frame_file(dir.path, 1), 2, frameno), ramp);
+    EXPECT_EQ(frameno, 1);
+    EXPECT_EQ(read_pixels<uint32_t>(frame_file(dir.path, 2), 2, TUINT, frameno), noisy);
+    EXPECT_EQ(frameno, 2);
+}
+
+TEST(TileCompressorTest, TilesDecodeWithCfitsioRice) {
+    constexpr uint32_t W = 20, H = 12, TW = 7, TH = 5;
+    const auto pixels = ramp_frame(W, H);
+    Camera::TileCompressor compressor(2);
+    std::vector<Camera::TileCompressor::Tile> tiles;
+    ASSERT_EQ(compressor.compress_rice(reinterpret_cast<const char*>(pixels.data()), frame_meta(W, H),
+                                       TW, TH, tiles), NO_ERROR);
+    ASSERT_EQ(tiles.size(), 3u * 3u);
+
+    // row-major tiles, the last column 6 wide and the last row 2 high,
+    // each holding the samples offset by BZERO=32768
+    size_t t = 0;
+    for (uint32_t y0 = 0; y0 < H; y0 += TH) {
+        for (uint32_t x0 = 0; x0 < W; x0 += TW, ++t) {
+            const uint32_t w = std::min(TW, W - x0), h = std::min(TH, H - y0);
+            std::vector<unsigned short> decoded(w * h);
+            ASSERT_EQ(fits_rdecomp_short(const_cast<unsigned char*>(tiles[t].data()), static_cast<int>(tiles[t].size()),
+                                         decoded.data(), static_cast<int>(decoded.size()), Camera::RICE_BLOCKSIZE), 0)
+                << "tile " << t;
+            for (uint32_t y = 0; y < h; ++y) {
+                for (uint32_t x = 0; x < w; ++x) {
+                    ASSERT_EQ(decoded[y * w + x], pixels[(y0 + y) * W + x0 + x] ^ 0x8000) << "tile " << t;
+                }
+            }
+        }
+    }
+}
+
+TEST(FitsWriterTest, ContainerKeepsQueueOrderWithSeveralWorkers) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    auto cfg = config_in(dir.path);
+    cfg.container   = Camera::FitsContainer::Mef;
+    cfg.compression = Camera::FitsCompression::Rice;
+    cfg.workers     = 4;
+    cfg.queue_size  = 32;
+    cfg.preallocate = false;
+    FitsWriter writer(cfg);
+    ASSERT_EQ(writer.open(), NO_ERROR);
+
+    // frames that take very different times to compress, so the workers
+    // would finish them out of order
+    constexpr uint64_t FRAMES = 24;
+    const auto ramp = ramp_frame(256, 64);
+    std::vector<uint16_t> noise(ramp.size());
+    uint32_t x = 1;
+    for (auto &p : noise) { x = x * 1664525u + 1013904223u; p = static_cast<uint16_t>(x >> 16); }
+    for (uint64_t n = 1; n <= FRAMES; ++n) {
+        const auto &pixels = (n % 3 == 0) ? ramp : noise;
+        ASSERT_EQ(writer.write_shared(shared_copy(pixels), pixels.size() * 2, frame_meta(256, 64, 2, n)), NO_ERROR);
+    }
+    writer.close();
+    ASSERT_EQ(writer.stats().frames_written, FRAMES);
+
+    // HDU n+1 holds frame n, and so says the index
+    for (uint64_t n = 1; n <= FRAMES; ++n) {
+        long frameno = 0;
+        const auto pixels = read_u16(frame_file(dir.path, 1), static_cast<int>(n + 1), frameno);
+        EXPECT_EQ(frameno, static_cast<long>(n));
+        EXPECT_EQ(pixels, (n % 3 == 0) ? ramp : noise) << "HDU " << n + 1;
+    }
+
+    std::FILE* index = std::fopen((dir.path + "/test.index").c_str(), "r");
+    ASSERT_NE(index, nullptr);
+    char line[256];
+    ASSERT_NE(std::fgets(line, sizeof(line), index), nullptr);     // column header
+    for (uint64_t n = 1; n <= FRAMES; ++n) {
+        ASSERT_NE(std::fgets(line, sizeof(line), index), nullptr);
+        unsigned long long frame = 0, timestamp = 0, host = 0;
+        char file[128];
+        long hdu = 0;
+        ASSERT_EQ(std::sscanf(line, "%llu %llu %llu %127s %ld", &frame, &timestamp, &host, file, &hdu), 5);
+        EXPECT_EQ(frame, n);
+        EXPECT_EQ(hdu, static_cast<long>(n + 1));
+    }
+    std::fclose(index);
+}
+
+// The CHECKSUM and DATASUM the writer computes from memory must be the ones
+// cfitsio computes from the file, in every layout it writes
+
+TEST(FitsChecksumTest, FileHdusVerify) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    const auto large = ramp_frame(1024, 520);       // more than one DIGEST_BLOCK
+    expect_verified(config_in(dir.path), { test_frame(odd_ramp(1), 61, 43, 1),
+                                           test_frame(large, 1024, 520, 2),
+                                           test_frame(noisy_u32(33, 19), 33, 19, 3) }, 3);
+}
+
+TEST(FitsChecksumTest, CubeVerifiesFullOrClosedEarly) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    auto cfg = config_in(dir.path);
+    cfg.container       = Camera::FitsContainer::Cube;
+    cfg.frames_per_file = 4;
+    // slices of an odd pixel count start half a word along; the second
+    // cube is cut from 4 slices to 2 on closing
+    std::vector<TestFrame> frames;
+    for (uint64_t n = 1; n <= 6; ++n) frames.push_back(test_frame(odd_ramp(n), 61, 43, n));
+    expect_verified(cfg, frames, 2);
+}
+
+TEST(FitsChecksumTest, MefHdusVerify) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    auto cfg = config_in(dir.path);
+    cfg.container = Camera::FitsContainer::Mef;
+    // the change of sample type starts a second file
+    expect_verified(cfg, { test_frame(odd_ramp(1), 61, 43, 1),
+                           test_frame(odd_ramp(2), 61, 43, 2),
+                           test_frame(odd_ramp(3), 61, 43, 3),
+                           test_frame(noisy_u32(33, 19), 33, 19, 4) }, 4 + 2);
+}
+
+TEST(FitsChecksumTest, RiceTablesVerify) {
+    for (auto container : { Camera::FitsContainer::File, Camera::FitsContainer::Mef }) {
+        TempDir dir;
+        ASSERT_FALSE(dir.path.empty());
+        auto cfg = config_in(dir.path);
+        cfg.container        = container;
+        cfg.compression      = Camera::FitsCompression::Rice;
+        cfg.tile_width       = 7;
+        cfg.tile_height      = 5;
+        cfg.compress_threads = 3;
+        // an empty primary in front of each table, in either layout
+        expect_verified(cfg, { test_frame(odd_ramp(1), 61, 43, 1),
+                               test_frame(noisy_u32(33, 19), 33, 19, 2) }, 4);
+    }
+}
+
+TEST(FitsChecksumTest, GzipHdusVerify) {
+    for (auto container : { Camera::FitsContainer::File, Camera::FitsContainer::Mef }) {
+        TempDir dir;
+        ASSERT_FALSE(dir.path.empty());
+        auto cfg = config_in(dir.path);
+        cfg.container   = container;
+        cfg.compression = Camera::FitsCompression::Gzip1;
+        const int hdus = (container == Camera::FitsContainer::File) ? 4 : 3;
+        expect_verified(cfg, { test_frame(odd_ramp(1), 61, 43, 1),
+                               test_frame(odd_ramp(2), 61, 43, 2) }, hdus);
+    }
+}
@@ -0,0 +1,87 @@
+#include "gtest/gtest.h"
+#include "../utils/frame_checksum.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+    // The FITS definition, one big-endian word at a time, zero filled
+    uint32_t reference_sum(const std::vector<unsigned char> &stored) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < stored.size(); i += 4) {
+            uint32_t word = 0;
+            for (size_t k = 0; k < 4; ++k) {
+                word = (word << 8) | (i + k < stored.size() ? stored[i + k] : 0);
+            }
+            sum += word;
+        }
+        while (sum >> 32) sum = (sum & 0xFFFFFFFFu) + (sum >> 32);
+        return static_cast<uint32_t>(sum);
+    }
+
+}
+
+TEST(FrameChecksumTest, U16DatasumMatchesStoredWords) {
+    std::mt19937 rng(1);
+    for (size_t n : {1u, 3u, 8u, 4097u, 700001u}) {
+        std::vector<uint16_t> frame(n);
+        std::vector<unsigned char> stored;
+        for (auto &v : frame) {
+            v = static_cast<uint16_t>(rng());
+            const uint16_t s = v ^ 0x8000;     // BZERO=32768
+            stored.push_back(s >> 8);
+            stored.push_back(s & 0xFF);
+        }
+        const auto d = Camera::digest_frame(reinterpret_cast<const char*>(frame.data()), n * 2,
+                                            Camera::PixelFormat::U16, true, false);
+        EXPECT_EQ(d.datasum, reference_sum(stored)) << n << " pixels";
+    }
+}
+
+TEST(FrameChecksumTest, U32AndFloatDatasumMatchStoredWords) {
+    std::mt19937 rng(2);
+    std::vector<uint32_t> frame(300007);
+    std::vector<unsigned char> u32, f32;
+    for (auto &v : frame) {
+        v = rng();
+        for (int k = 3; k >= 0; --k) u32.push_back(static_cast<unsigned char>((v ^ 0x80000000u) >> (8 * k)));
+        for (int k = 3; k >= 0; --k) f32.push_back(static_cast<unsigned char>(v >> (8 * k)));
+    }
+    const char* data = reinterpret_cast<const char*>(frame.data());
+    EXPECT_EQ(Camera::digest_frame(data, frame.size() * 4, Camera::PixelFormat::U32, true, false).datasum,
+              reference_sum(u32));
+    EXPECT_EQ(Camera::digest_frame(data, frame.size() * 4, Camera::PixelFormat::F32, true, false).datasum,
+              reference_sum(f32));
+}
+
+TEST(FrameChecksumTest, ShiftedPartsAddUpToTheWhole) {
+    std::vector<unsigned char> bytes(1001);
+    for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = static_cast<unsigned char>(i * 7 + 3);
+    for (size_t split : {1u, 2u, 3u, 4u, 501u}) {
+        const uint32_t head = Camera::fits_sum_bytes(bytes.data(), split);
+        const uint32_t tail = Camera::fits_sum_shift(Camera::fits_sum_bytes(bytes.data() + split, bytes.size() - split), split);
+        EXPECT_EQ(Camera::fits_sum_add(head, tail), reference_sum(bytes)) << "split at " << split;
+    }
+}
+
+TEST(FrameChecksumTest, ParallelBlocksGiveTheSameDigest) {
+    std::vector<char> frame(3 * Camera::DIGEST_BLOCK + 12);
+    for (size_t i = 0; i < frame.size(); ++i) frame[i] = static_cast<char>(i * 31 + (i >> 12));
+    const Camera::ParallelFor reversed = [](size_t n, const std::function<bool(size_t)> &fn) {
+        for (size_t i = n; i-- > 0; ) fn(i);
+        return true;
+    };
+    const auto serial   = Camera::digest_frame(frame.data(), frame.size(), Camera::PixelFormat::U16, true, true);
+    const auto parallel = Camera::digest_frame(frame.data(), frame.size(), Camera::PixelFormat::U16, true, true, reversed);
+    EXPECT_EQ(serial.datasum, parallel.datasum);
+    EXPECT_EQ(serial.hash, parallel.hash);
+}
+
+TEST(FrameChecksumTest, Xxh64KnownValues) {
+    EXPECT_EQ(Camera::hash_to_hex(Camera::xxh64("", 0)), "ef46db3751d8e999");
+    EXPECT_EQ(Camera::hash_to_hex(Camera::xxh64("abc", 3)), "44bc2cf5ad770999");
+    const char* text = "Nobody inspects the spammish repetition";
+    EXPECT_EQ(Camera::hash_to_hex(Camera::xxh64(text, std::strlen(text))), "fbcea83c8a378bf1");
+}
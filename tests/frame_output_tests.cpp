@@ -0,0 +1,209 @@
+#include "gtest/gtest.h"
+#include "../utils/shared_memory_writer.h"
+#include "../utils/shared_memory_reader.h"
+#include "../utils/async_output.h"
+#include "../utils/cadence_gate.h"
+#include "capture_output.h"
+
+#include <cstring>
+
+using Camera::SharedMemoryReader;
+using Camera::SharedMemoryWriter;
+
+namespace {
+
+    constexpr const char* SEGMENT = "camerad_reserve_commit_test";
+
+    Camera::FrameMetadata meta_of(uint64_t frame_number, size_t bytes) {
+        return frame_meta(static_cast<uint32_t>(bytes / 2), 1, 2, frame_number);
+    }
+
+}
+
+TEST(ReserveCommitTest, DefaultOutputHasNoStorage) {
+    CaptureOutput output;
+    EXPECT_EQ(output.reserve(64), nullptr);
+    EXPECT_EQ(output.commit(64, meta_of(1, 64)), ERROR);
+    output.abandon();
+    EXPECT_TRUE(output.captured().empty());
+}
+
+TEST(ReserveCommitTest, CommittedSlotIsPublishedInPlace) {
+    SharedMemoryWriter writer(SEGMENT, 64, 4);
+    ASSERT_EQ(writer.open(), NO_ERROR);
+    SharedMemoryReader reader(SEGMENT, SharedMemoryReader::Mode::Lossless);
+    ASSERT_EQ(reader.open(), NO_ERROR);
+
+    char* slot = writer.reserve(64);
+    ASSERT_NE(slot, nullptr);
+    std::memset(slot, 0x5A, 64);
+    ASSERT_EQ(writer.commit(64, meta_of(11, 64)), NO_ERROR);
+
+    SharedMemoryReader::Frame frame;
+    ASSERT_EQ(reader.next(frame, 100), NO_ERROR);
+    EXPECT_EQ(frame.info.frame_number, 11u);
+    EXPECT_EQ(frame.info.data_size, 64u);
+    for (size_t i = 0; i < 64; ++i) ASSERT_EQ(frame.data[i], 0x5A);
+
+    reader.close();
+    writer.close();
+}
+
+TEST(ReserveCommitTest, SecondReserveAbandonsTheFirst) {
+    SharedMemoryWriter writer(SEGMENT, 64, 4);
+    ASSERT_EQ(writer.open(), NO_ERROR);
+    SharedMemoryReader reader(SEGMENT, SharedMemoryReader::Mode::Lossless);
+    ASSERT_EQ(reader.open(), NO_ERROR);
+
+    ASSERT_NE(writer.reserve(64), nullptr);
+    char* slot = writer.reserve(32);
+    ASSERT_NE(slot, nullptr);
+    std::memset(slot, 1, 32);
+    ASSERT_EQ(writer.commit(32, meta_of(2, 32)), NO_ERROR);
+
+    // the emptied slot is passed over, not delivered
+    SharedMemoryReader::Frame frame;
+    ASSERT_EQ(reader.next(frame, 100), NO_ERROR);
+    EXPECT_EQ(frame.info.frame_number, 2u);
+    EXPECT_EQ(frame.info.data_size, 32u);
+    EXPECT_EQ(reader.stats().skipped, 1u);
+
+    reader.close();
+    writer.close();
+}
+
+TEST(ReserveCommitTest, CommitNeedsAReservationThatFits) {
+    SharedMemoryWriter writer(SEGMENT, 64, 4);
+    EXPECT_EQ(writer.reserve(64), nullptr);       // not open
+    ASSERT_EQ(writer.open(), NO_ERROR);
+    EXPECT_EQ(writer.reserve(65), nullptr);       // larger than a slot
+    EXPECT_EQ(writer.commit(64, meta_of(1, 64)), ERROR);
+
+    ASSERT_NE(writer.reserve(64), nullptr);
+    EXPECT_EQ(writer.commit(65, meta_of(1, 65)), ERROR);
+    EXPECT_EQ(writer.commit(64, meta_of(1, 64)), ERROR);    // the failed commit gave the slot up
+    writer.close();
+}
+
+// A decorator has to see every frame to queue or thin it, so it never
+// lends the storage of the output it wraps; the producer writes instead
+TEST(ReserveCommitTest, DecoratorsFallBackToWrite) {
+    auto shm = std::make_unique<SharedMemoryWriter>(SEGMENT, 64, 4);
+    ASSERT_EQ(shm->open(), NO_ERROR);
+
+    Camera::CadenceConfig cfg;
+    cfg.mode    = Camera::CadenceMode::EveryNth;
+    cfg.every_n = 2;
+    Camera::CadenceGate gate(std::move(shm), cfg);
+    EXPECT_EQ(gate.reserve(64), nullptr);
+    EXPECT_EQ(gate.commit(64, meta_of(1, 64)), ERROR);
+
+    Camera::AsyncOutput async(std::make_unique<CaptureOutput>(), Camera::AsyncOutputConfig{});
+    EXPECT_EQ(async.reserve(64), nullptr);
+    EXPECT_EQ(async.commit(64, meta_of(1, 64)), ERROR);
+
+    SharedMemoryReader reader(SEGMENT, SharedMemoryReader::Mode::Lossless);
+    ASSERT_EQ(reader.open(), NO_ERROR);
+    std::vector<char> pixels(64, 7);
+    for (uint64_t n = 1; n <= 4; ++n) gate.write(pixels.data(), pixels.size(), meta_of(n, 64));
+
+    SharedMemoryReader::Frame frame;
+    ASSERT_EQ(reader.next(frame, 100), NO_ERROR);
+    EXPECT_EQ(frame.info.frame_number, 1u);
+    ASSERT_EQ(reader.next(frame, 100), NO_ERROR);
+    EXPECT_EQ(frame.info.frame_number, 3u);
+    EXPECT_EQ(reader.next(frame, 0), TIMEOUT);
+
+    reader.close();
+    gate.close();
+}
+
+namespace {
+
+    std::shared_ptr<const char[]> shared_frame(size_t bytes) {
+        return std::shared_ptr<const char[]>(new char[bytes]());
+    }
+
+}
+
+// Only a queue that makes its writer wait pushes back on acquisition
+TEST(BackpressureTest, OnlyBlockQueuesReportPressure) {
+    for (const auto policy : { Camera::OverflowPolicy::DropOldest, Camera::OverflowPolicy::Block }) {
+        SharedMemoryWriter writer(SEGMENT, 64, 4);
+        writer.set_overflow(policy, 10);
+        ASSERT_EQ(writer.open(), NO_ERROR);
+        SharedMemoryReader reader(SEGMENT, SharedMemoryReader::Mode::Lossless);
+        ASSERT_EQ(reader.open(), NO_ERROR);
+
+        std::vector<char> pixels(64, 1);
+        for (uint64_t n = 1; n <= 4; ++n) ASSERT_EQ(writer.write(pixels.data(), 64, meta_of(n, 64)), NO_ERROR);
+        const auto status = writer.queue_status();
+        EXPECT_DOUBLE_EQ(status.fill(), 1.0);
+        EXPECT_DOUBLE_EQ(status.pressure, policy == Camera::OverflowPolicy::Block ? 1.0 : 0.0);
+
+        // a Block write that times out fails rather than passing for written
+        if (policy == Camera::OverflowPolicy::Block) {
+            EXPECT_EQ(writer.write(pixels.data(), 64, meta_of(5, 64)), ERROR);
+            EXPECT_EQ(writer.queue_status().dropped, 1u);
+        }
+        reader.close();
+        writer.close();
+    }
+}
+
+TEST(BackpressureTest, FullDropNewestOutputIsIgnored) {
+    auto gated = std::make_unique<GatedOutput>();
+    GatedOutput* inner = gated.get();
+    Camera::AsyncOutputConfig cfg;
+    cfg.queue_depth = 1;
+    cfg.overflow    = Camera::OverflowPolicy::DropNewest;
+    Camera::AsyncOutput async(std::move(gated), cfg);
+    ASSERT_EQ(async.open(), NO_ERROR);
+
+    ASSERT_EQ(async.write_shared(shared_frame(64), 64, meta_of(1, 64)), NO_ERROR);
+    inner->wait_entered(1);                       // the worker holds frame 1
+    ASSERT_EQ(async.write_shared(shared_frame(64), 64, meta_of(2, 64)), NO_ERROR);
+    EXPECT_EQ(async.write_shared(shared_frame(64), 64, meta_of(3, 64)), NO_ERROR);   // dropped
+
+    const auto status = async.queue_status();
+    EXPECT_DOUBLE_EQ(status.fill(), 1.0);
+    EXPECT_EQ(status.dropped, 1u);
+    EXPECT_DOUBLE_EQ(status.pressure, 0.0);
+
+    // and so is what it merges in, here a full DropNewest queue beside a quiet Block one
+    Camera::QueueStatus merged;
+    merged.capacity = 8;
+    merged.set_pressure(Camera::OverflowPolicy::Block);
+    merged.merge(status);
+    EXPECT_DOUBLE_EQ(merged.fill(), 1.0);
+    EXPECT_DOUBLE_EQ(merged.pressure, 0.0);
+
+    inner->release();
+    async.close();
+    EXPECT_EQ(inner->captured().size(), 2u);
+}
+
+TEST(BackpressureTest, FullBlockOutputPushesBackAndTimesOut) {
+    auto gated = std::make_unique<GatedOutput>();
+    GatedOutput* inner = gated.get();
+    Camera::AsyncOutputConfig cfg;
+    cfg.queue_depth = 1;
+    cfg.overflow    = Camera::OverflowPolicy::Block;
+    cfg.block_ms    = 20;
+    Camera::AsyncOutput async(std::move(gated), cfg);
+    ASSERT_EQ(async.open(), NO_ERROR);
+
+    ASSERT_EQ(async.write_shared(shared_frame(64), 64, meta_of(1, 64)), NO_ERROR);
+    inner->wait_entered(1);
+    ASSERT_EQ(async.write_shared(shared_frame(64), 64, meta_of(2, 64)), NO_ERROR);
+    EXPECT_DOUBLE_EQ(async.queue_status().pressure, 1.0);
+    EXPECT_EQ(async.write_shared(shared_frame(64), 64, meta_of(3, 64)), ERROR);
+
+    const auto s = async.stats();
+    EXPECT_EQ(s.frames_blocked, 1u);
+    EXPECT_EQ(s.frames_dropped, 1u);
+
+    inner->release();
+    async.close();
+    EXPECT_EQ(inner->captured().size(), 2u);
+}
@@ -0,0 +1,141 @@
+#include "gtest/gtest.h"
+#include "../utils/job_table.h"
+#include "../common/common.h"
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Camera::JobInfo;
+using Camera::JobTable;
+
+namespace {
+
+    /// every message the table sends, in order
+    class Messages {
+      public:
+        explicit Messages(JobTable &jobs) {
+            jobs.set_notify([this](const nlohmann::json &m) {
+                std::lock_guard lock(mtx_);
+                all_.push_back(m);
+            });
+        }
+        std::vector<nlohmann::json> all() const {
+            std::lock_guard lock(mtx_);
+            return all_;
+        }
+      private:
+        mutable std::mutex mtx_;
+        std::vector<nlohmann::json> all_;
+    };
+
+    std::vector<uint64_t> ids_of(const nlohmann::json &list) {
+        std::vector<uint64_t> ids;
+        for (const auto &j : list) ids.push_back(j["job"].get<uint64_t>());
+        return ids;
+    }
+
+}
+
+TEST(JobTableTest, StatesGoQueuedRunningThenDoneOrError) {
+    JobTable jobs;
+    Messages messages(jobs);
+
+    const uint64_t good = jobs.create("expose 1");
+    const uint64_t bad  = jobs.create("expose 2");
+    EXPECT_EQ(bad, good + 1);
+    jobs.started(good);
+    jobs.finished(good, "1 DONE\n");
+    jobs.finished(bad, "2 ERROR\n");          // never seen to start
+    jobs.finished(99, "DONE\n");              // no such job: ignored
+
+    std::vector<std::string> states;
+    for (const auto &m : messages.all()) states.push_back(m["state"].get<std::string>());
+    EXPECT_EQ(states, (std::vector<std::string>{ "queued", "queued", "running", "done", "error" }));
+
+    const auto list = jobs.list();
+    ASSERT_EQ(list.size(), 2u);
+    EXPECT_EQ(list[0]["command"], "expose 1");
+    EXPECT_EQ(list[0]["reply"], "1 DONE");
+    EXPECT_EQ(list[1]["state"], "error");
+    EXPECT_DOUBLE_EQ(list[1]["elapsed_s"].get<double>(), 0.0);
+}
+
+TEST(JobTableTest, WaitTellsTimeoutFromDoneFromUnknown) {
+    JobTable jobs;
+    const uint64_t id = jobs.create("expose");
+    JobInfo info;
+
+    EXPECT_EQ(jobs.wait(id, 20, info), TIMEOUT);
+    EXPECT_EQ(info.state, "queued");
+
+    std::thread runner([&] {
+        jobs.started(id);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        jobs.finished(id, "DONE\n");
+    });
+    EXPECT_EQ(jobs.wait(id, -1, info), NO_ERROR);
+    runner.join();
+    EXPECT_EQ(info.state, "done");
+    EXPECT_EQ(info.reply, "DONE\n");
+    EXPECT_GE(info.finished_ns - info.started_ns, 20000000u);
+
+    // finished already: no waiting at all
+    EXPECT_EQ(jobs.wait(id, 0, info), NO_ERROR);
+    EXPECT_EQ(jobs.wait(id + 1, 0, info), ERROR);
+}
+
+TEST(JobTableTest, KeepFinishedDropsTheOldestFinishedOnly) {
+    JobTable jobs(2);
+    std::vector<uint64_t> id;
+    for (int i = 0; i < 4; ++i) id.push_back(jobs.create("job"));
+    jobs.started(id[0]);                      // still running, never dropped
+
+    for (int i = 1; i < 4; ++i) jobs.finished(id[i], "DONE\n");
+    EXPECT_EQ(ids_of(jobs.list()), (std::vector<uint64_t>{ id[0], id[2], id[3] }));
+
+    JobInfo info;
+    EXPECT_EQ(jobs.wait(id[1], 0, info), ERROR);          // evicted
+    EXPECT_EQ(jobs.wait(id[2], 0, info), NO_ERROR);
+
+    // the oldest job finishing last drops the oldest of the others, not itself
+    const uint64_t late = jobs.create("job");
+    std::thread runner([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        jobs.finished(id[0], "0 DONE\n");
+    });
+    EXPECT_EQ(jobs.wait(id[0], 1000, info), NO_ERROR);
+    EXPECT_EQ(info.reply, "0 DONE\n");
+    EXPECT_EQ(jobs.wait(late, 20, info), TIMEOUT);
+    runner.join();
+    EXPECT_EQ(ids_of(jobs.list()), (std::vector<uint64_t>{ id[0], id[3], late }));
+}
+
+TEST(JobTableTest, ProgressGoesOutOnlyWhileAJobRuns) {
+    JobTable jobs;
+    Messages messages(jobs);
+    jobs.start_progress([] { return nlohmann::json{ { "frame", 3 } }; }, 5);
+
+    const uint64_t id = jobs.create("expose");
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    jobs.started(id);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    jobs.finished(id, "DONE\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));    // one already taken may still go out
+    const size_t settled = messages.all().size();
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    jobs.stop();
+
+    const auto all = messages.all();
+    EXPECT_EQ(all.size(), settled);
+    size_t progress = 0;
+    for (const auto &m : all) {
+        if (m["messagetype"] != "jobprogress") continue;
+        ++progress;
+        EXPECT_EQ(m["progress"]["frame"], 3);
+        EXPECT_EQ(m["state"], "running");
+    }
+    EXPECT_GT(progress, 0u);
+}
@@ -0,0 +1,115 @@
+#include "gtest/gtest.h"
+#include "../utils/network.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Network::TcpSocket;
+
+namespace {
+
+    /// a port nothing is listening on just now
+    int free_port() {
+        const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr{};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        ::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+        ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+        ::close(fd);
+        return ntohs(addr.sin_port);
+    }
+
+    /// a server TcpSocket accepted from a raw loopback client the test writes with
+    class Pair {
+      public:
+        Pair() : server(free_port(), true, Network::POLLTIMEOUT, 0) {
+            if (server.Listen() < 0) return;
+            client_ = ::socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr{};
+            addr.sin_family      = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port        = htons(static_cast<uint16_t>(server.getport()));
+            if (::connect(client_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) return;
+            connected = server.Accept() >= 0;
+        }
+        ~Pair() { if (client_ >= 0) ::close(client_); }
+
+        void send(const std::string &s) { ASSERT_EQ(::send(client_, s.data(), s.size(), 0), static_cast<ssize_t>(s.size())); }
+        void hang_up() { ::close(client_); client_ = -1; }
+
+        TcpSocket server;
+        bool connected{false};
+
+      private:
+        int client_{-1};
+    };
+
+}
+
+TEST(TcpSocketTest, ReadDelimKeepsWhatFollowsTheLine) {
+    Pair p;
+    ASSERT_TRUE(p.connected);
+    p.send("one\ntwo\nthree\nraw");
+    p.hang_up();
+
+    // one read() brings in everything; the rest comes from the buffer
+    std::string line;
+    EXPECT_EQ(p.server.Read(line, '\n'), 4);
+    EXPECT_EQ(line, "one\n");
+    EXPECT_EQ(p.server.Read(line, '\n'), 4);
+    EXPECT_EQ(line, "two\n");
+    EXPECT_EQ(p.server.Read(line, '\n'), 6);
+    EXPECT_EQ(line, "three\n");
+
+    // and a raw Read takes the leftovers before the socket
+    char buf[16] = {};
+    EXPECT_EQ(p.server.Read(buf, sizeof(buf)), 3);
+    EXPECT_EQ(std::string(buf, 3), "raw");
+    EXPECT_EQ(p.server.Read(line, '\n'), 0);
+    EXPECT_LT(p.server.getfd(), 0);         // the hang-up closed it
+}
+
+TEST(TcpSocketTest, ReadDelimJoinsALineSplitAcrossReads) {
+    Pair p;
+    ASSERT_TRUE(p.connected);
+    std::thread sender([&] {
+        p.send("hel");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        p.send("lo\nwor");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        p.send("ld\n");
+    });
+    std::string line;
+    EXPECT_EQ(p.server.Read(line, '\n'), 6);
+    EXPECT_EQ(line, "hello\n");
+    EXPECT_EQ(p.server.Read(line, '\n'), 6);
+    EXPECT_EQ(line, "world\n");
+    sender.join();
+}
+
+TEST(TcpSocketTest, ReadDelimTimesOutWithThePartialLine) {
+    Pair p;
+    ASSERT_TRUE(p.connected);
+    p.send("one\npart");
+
+    std::string line;
+    EXPECT_EQ(p.server.Read(line, '\n'), 4);
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(p.server.Read(line, '\n'), 4);
+    const auto waited = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(line, "part");
+    EXPECT_GE(waited, std::chrono::milliseconds(Network::POLLTIMEOUT - 50));
+
+    // the partial line was handed back, not kept to prefix the next one
+    p.send("next\n");
+    EXPECT_EQ(p.server.Read(line, '\n'), 5);
+    EXPECT_EQ(line, "next\n");
+}
@@ -0,0 +1,150 @@
+#include "gtest/gtest.h"
+#include "../utils/output_metrics.h"
+#include "../utils/async_output.h"
+#include "capture_output.h"
+
+#include <memory>
+#include <vector>
+
+using Camera::OutputMetrics;
+using Camera::QueueStatus;
+
+namespace {
+
+    /// output that reports whatever metrics the test sets
+    class MetricsOutput : public CaptureOutput {
+      public:
+        explicit MetricsOutput(OutputMetrics m) : m_(std::move(m)) { }
+        OutputMetrics metrics() const override { return m_; }
+      private:
+        OutputMetrics m_;
+    };
+
+    OutputMetrics metrics_of(const std::string &kind, uint64_t in, uint64_t dropped,
+                             size_t depth = 0, size_t capacity = 0, uint64_t latency_us = 0) {
+        OutputMetrics m;
+        m.kind           = kind;
+        m.frames_in      = in;
+        m.frames_dropped = dropped;
+        m.frames_written = in - dropped;
+        m.queue.depth    = depth;
+        m.queue.capacity = capacity;
+        if (latency_us > 0) {
+            Camera::LatencyHistogram h;
+            h.record(latency_us * 1000);
+            m.latency = h.snapshot();
+        }
+        return m;
+    }
+
+    std::vector<std::unique_ptr<Camera::FrameOutput>> outputs_of(const std::vector<OutputMetrics> &all) {
+        std::vector<std::unique_ptr<Camera::FrameOutput>> outputs;
+        for (const auto &m : all) outputs.push_back(std::make_unique<MetricsOutput>(m));
+        return outputs;
+    }
+
+}
+
+TEST(QueueStatusTest, MergeKeepsTheFullerQueueAndSumsCounters) {
+    QueueStatus outer;
+    outer.depth = 2; outer.capacity = 8; outer.dropped = 1; outer.blocked = 2;
+    outer.set_pressure(Camera::OverflowPolicy::Block);
+
+    QueueStatus inner;
+    inner.depth = 3; inner.capacity = 4; inner.dropped = 5; inner.spilled = 7;
+    inner.set_pressure(Camera::OverflowPolicy::DropNewest);
+
+    outer.merge(inner);
+    EXPECT_EQ(outer.depth, 3u);
+    EXPECT_EQ(outer.capacity, 4u);
+    EXPECT_EQ(outer.dropped, 6u);
+    EXPECT_EQ(outer.blocked, 2u);
+    EXPECT_EQ(outer.spilled, 7u);
+    EXPECT_DOUBLE_EQ(outer.pressure, 0.25);      // the Block queue's, not the fuller one's
+
+    QueueStatus empty;
+    empty.merge(QueueStatus{});
+    EXPECT_DOUBLE_EQ(empty.fill(), 0.0);
+}
+
+TEST(OutputMetricsTest, LatencyJsonTrimsEmptyBuckets) {
+    Camera::LatencyHistogram h;
+    for (const uint64_t us : { 0, 3, 3, 100 }) h.record(us * 1000);
+    const auto j = Camera::to_json(h.snapshot());
+
+    EXPECT_EQ(j["count"].get<uint64_t>(), 4u);
+    EXPECT_DOUBLE_EQ(j["max_us"].get<double>(), 100.0);
+    EXPECT_DOUBLE_EQ(j["p50_us"].get<double>(), 4.0);      // upper edge of [2, 4)
+    EXPECT_DOUBLE_EQ(j["p99_us"].get<double>(), 100.0);    // capped at the maximum
+    // 100 us lands in [64, 128), bucket 7, the last one kept
+    const auto buckets = j["buckets"].get<std::vector<uint64_t>>();
+    ASSERT_EQ(buckets.size(), 8u);
+    EXPECT_EQ(buckets[0], 1u);
+    EXPECT_EQ(buckets[2], 2u);
+    EXPECT_EQ(buckets[7], 1u);
+}
+
+TEST(OutputMetricsTest, JsonLeavesOutWhatAnOutputDoesNotHave) {
+    auto m = metrics_of("roi", 10, 0);
+    m.detail["windows"]  = 3;
+    m.detail["rate_hz"]  = 2.5;
+    m.sinks.push_back(metrics_of("fits", 10, 1, 2, 8, 50));
+
+    const auto j = Camera::to_json(m);
+    EXPECT_EQ(j["kind"], "roi");
+    EXPECT_FALSE(j.contains("queue"));
+    EXPECT_FALSE(j.contains("latency"));
+    EXPECT_TRUE(j["detail"]["windows"].is_number_integer());
+    EXPECT_DOUBLE_EQ(j["detail"]["rate_hz"].get<double>(), 2.5);
+
+    ASSERT_EQ(j["sinks"].size(), 1u);
+    const auto &sink = j["sinks"][0];
+    EXPECT_EQ(sink["frames_dropped"].get<uint64_t>(), 1u);
+    EXPECT_DOUBLE_EQ(sink["queue"]["fill"].get<double>(), 0.25);
+    EXPECT_EQ(sink["latency"]["count"].get<uint64_t>(), 1u);
+}
+
+TEST(OutputMetricsTest, SnapshotReportsEachChainOutermostFirst) {
+    std::vector<std::unique_ptr<Camera::FrameOutput>> outputs;
+    outputs.push_back(std::make_unique<Camera::AsyncOutput>(std::make_unique<CaptureOutput>(), Camera::AsyncOutputConfig{}));
+    outputs.push_back(std::make_unique<CaptureOutput>());
+
+    const auto j = Camera::metrics_snapshot(outputs);
+    EXPECT_TRUE(j.contains("time"));
+    ASSERT_EQ(j["outputs"].size(), 2u);
+    ASSERT_EQ(j["outputs"][0].size(), 2u);
+    EXPECT_EQ(j["outputs"][0][0]["kind"], "async");
+    EXPECT_EQ(j["outputs"][0][1]["kind"], "output");
+    EXPECT_EQ(j["outputs"][1].size(), 1u);
+}
+
+TEST(OutputMetricsTest, BottleneckIsDropsThenFillThenLatency) {
+    // the largest share dropped wins, however full or slow the others
+    auto j = Camera::metrics_snapshot(outputs_of({ metrics_of("shm", 100, 0, 7, 8, 5000),
+                                                   metrics_of("fits", 100, 10),
+                                                   metrics_of("zmq", 1000, 20) }));
+    EXPECT_EQ(j["bottleneck"]["output"].get<size_t>(), 1u);
+    EXPECT_DOUBLE_EQ(j["bottleneck"]["dropped_fraction"].get<double>(), 0.1);
+
+    // no drops: the fullest queue
+    j = Camera::metrics_snapshot(outputs_of({ metrics_of("shm", 100, 0, 2, 8, 5000),
+                                              metrics_of("fits", 100, 0, 6, 8, 10) }));
+    EXPECT_EQ(j["bottleneck"]["kind"], "fits");
+
+    // nothing queued: the slowest
+    j = Camera::metrics_snapshot(outputs_of({ metrics_of("shm", 100, 0, 0, 0, 10),
+                                              metrics_of("fits", 100, 0, 0, 0, 5000) }));
+    EXPECT_EQ(j["bottleneck"]["kind"], "fits");
+    EXPECT_GT(j["bottleneck"]["p99_us"].get<double>(), 1000.0);
+
+    // a sink competes for its parent's place
+    auto roi = metrics_of("roi", 100, 0);
+    roi.sinks.push_back(metrics_of("roi_fits", 100, 50));
+    j = Camera::metrics_snapshot(outputs_of({ metrics_of("shm", 100, 10), roi }));
+    EXPECT_EQ(j["bottleneck"]["output"].get<size_t>(), 1u);
+    EXPECT_EQ(j["bottleneck"]["kind"], "roi_fits");
+
+    j = Camera::metrics_snapshot({});
+    EXPECT_FALSE(j.contains("bottleneck"));
+    EXPECT_TRUE(j["outputs"].empty());
+}
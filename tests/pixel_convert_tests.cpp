@@ -0,0 +1,174 @@
+#include "gtest/gtest.h"
+#include "../utils/pixel_convert.h"
+#include "capture_output.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Lengths that are not a multiple of the vector width exercise the scalar tail
+
+TEST(PixelConvertTest, U32ToU16ShiftsAndClips) {
+    std::vector<uint32_t> src = {0, 1, 0x1FFFF, 0x20000, 0xFFFFFFFF, 12345 << 1, 7, 8, 65535 << 1, 3, 0x30000};
+    std::vector<uint16_t> dst(src.size());
+    Camera::convert_u32_to_u16(src.data(), dst.data(), src.size(), 1);
+    for (size_t i = 0; i < src.size(); ++i) {
+        const uint32_t expect = std::min<uint32_t>(src[i] >> 1, 0xFFFF);
+        EXPECT_EQ(dst[i], expect) << "index " << i;
+    }
+}
+
+TEST(PixelConvertTest, U32ToI32AppliesBzero) {
+    std::vector<uint32_t> src = {0, 0x80000000u, 0xFFFFFFFFu, 1, 2, 3, 4, 5, 6};
+    std::vector<int32_t> dst(src.size());
+    Camera::convert_u32_to_i32(src.data(), dst.data(), src.size());
+    for (size_t i = 0; i < src.size(); ++i) {
+        EXPECT_EQ(static_cast<int64_t>(dst[i]) + 2147483648LL, static_cast<int64_t>(src[i]));
+    }
+}
+
+TEST(PixelConvertTest, U32ToF32Scales) {
+    std::vector<uint32_t> src(19);
+    for (size_t i = 0; i < src.size(); ++i) src[i] = static_cast<uint32_t>(i * 1000);
+    std::vector<float> dst(src.size());
+    Camera::convert_u32_to_f32(src.data(), dst.data(), src.size(), 0.5f, -10.0f);
+    for (size_t i = 0; i < src.size(); ++i) EXPECT_FLOAT_EQ(dst[i], src[i] * 0.5f - 10.0f);
+}
+
+TEST(PixelConvertTest, ByteSwapRoundTrips) {
+    std::vector<uint32_t> w32 = {0x01020304, 0xA0B0C0D0, 1, 2, 3, 4, 5, 6, 7, 0xDEADBEEF};
+    auto orig32 = w32;
+    Camera::byteswap32(w32.data(), w32.size());
+    EXPECT_EQ(w32[0], 0x04030201u);
+    EXPECT_EQ(w32[9], 0xEFBEADDEu);
+    Camera::byteswap32(w32.data(), w32.size());
+    EXPECT_EQ(w32, orig32);
+
+    std::vector<uint16_t> w16 = {0x0102, 0xA0B0, 1, 2, 3, 4, 5, 6, 7, 0xBEEF};
+    Camera::byteswap16(w16.data(), w16.size());
+    EXPECT_EQ(w16[0], 0x0201);
+    EXPECT_EQ(w16[9], 0xEFBE);
+}
+
+namespace {
+
+    using Camera::ConvertConfig;
+    using Camera::ConvertMode;
+    using Camera::PixelConverter;
+    using Camera::PixelFormat;
+
+    /// a converter in front of a capture, which it owns
+    std::unique_ptr<PixelConverter> converter(ConvertConfig cfg, CaptureOutput* &capture) {
+        auto inner = std::make_unique<CaptureOutput>();
+        capture = inner.get();
+        return std::make_unique<PixelConverter>(std::move(inner), cfg);
+    }
+
+    std::vector<uint32_t> ramp32(uint32_t width, uint32_t height) {
+        std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+        for (size_t i = 0; i < pixels.size(); ++i) pixels[i] = static_cast<uint32_t>(i * 2 + 0x10000);
+        return pixels;
+    }
+
+    template <typename T>
+    std::vector<T> samples_of(const CapturedFrame &f) {
+        std::vector<T> v(f.data.size() / sizeof(T));
+        std::memcpy(v.data(), f.data.data(), v.size() * sizeof(T));
+        return v;
+    }
+
+}
+
+TEST(PixelConverterTest, OutputMetaDescribesTheConvertedSamples) {
+    const auto pixels = ramp32(10, 3);
+    const char* data = reinterpret_cast<const char*>(pixels.data());
+    const size_t size = pixels.size() * 4;
+
+    struct Case { ConvertMode mode; bool byteswap; PixelFormat format; uint32_t bpp; };
+    for (const auto &c : { Case{ ConvertMode::Float, false, PixelFormat::F32, 4 },
+                           Case{ ConvertMode::Int32, false, PixelFormat::I32, 4 },
+                           Case{ ConvertMode::U16,   true,  PixelFormat::U16, 2 },
+                           Case{ ConvertMode::None,  true,  PixelFormat::Unspecified, 4 } }) {
+        ConvertConfig cfg;
+        cfg.mode     = c.mode;
+        cfg.shift    = 1;
+        cfg.byteswap = c.byteswap;
+        CaptureOutput* capture = nullptr;
+        auto conv = converter(cfg, capture);
+        ASSERT_EQ(conv->write(data, size, frame_meta(10, 3, 4, 5)), NO_ERROR);
+
+        const auto f = capture->captured().at(0);
+        EXPECT_EQ(f.meta.pixel_format, c.format);
+        EXPECT_EQ(f.meta.bytes_per_pixel, c.bpp);
+        EXPECT_EQ(f.meta.big_endian, c.byteswap);
+        EXPECT_EQ(f.meta.frame_number, 5u);
+        EXPECT_EQ(f.meta.width, 10u);
+        ASSERT_EQ(f.data.size(), pixels.size() * c.bpp);
+        if (c.mode == ConvertMode::U16) {
+            const auto out = samples_of<uint16_t>(f);
+            EXPECT_EQ(out[7], __builtin_bswap16(static_cast<uint16_t>(pixels[7] >> 1)));
+        }
+        if (c.mode == ConvertMode::None) {
+            EXPECT_EQ(samples_of<uint32_t>(f)[7], __builtin_bswap32(pixels[7]));
+        }
+    }
+}
+
+TEST(PixelConverterTest, OtherSampleTypesOnlyHaveTheirBytesSwapped) {
+    ConvertConfig cfg;
+    cfg.mode     = ConvertMode::Float;
+    cfg.byteswap = true;
+    CaptureOutput* capture = nullptr;
+    auto conv = converter(cfg, capture);
+
+    const auto u16 = ramp_frame(9, 2);
+    ASSERT_EQ(conv->write(reinterpret_cast<const char*>(u16.data()), u16.size() * 2, frame_meta(9, 2)), NO_ERROR);
+
+    // an 8-bit frame is copied at its own size and left in order
+    const std::vector<uint8_t> u8 = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+    ASSERT_EQ(conv->write(reinterpret_cast<const char*>(u8.data()), u8.size(), frame_meta(11, 1, 1)), NO_ERROR);
+
+    const auto frames = capture->captured();
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0].meta.pixel_format, PixelFormat::Unspecified);
+    EXPECT_EQ(frames[0].meta.bytes_per_pixel, 2u);
+    EXPECT_TRUE(frames[0].meta.big_endian);
+    const auto swapped = samples_of<uint16_t>(frames[0]);
+    ASSERT_EQ(swapped.size(), u16.size());
+    for (size_t i = 0; i < u16.size(); ++i) EXPECT_EQ(swapped[i], __builtin_bswap16(u16[i]));
+
+    EXPECT_EQ(frames[1].data, std::vector<char>(u8.begin(), u8.end()));
+    EXPECT_FALSE(frames[1].meta.big_endian);
+}
+
+TEST(PixelConverterTest, WriteViewPacksTheWindowAsItConverts) {
+    const auto pixels = ramp32(16, 8);
+    const auto meta = frame_meta(16, 8, 4);
+    const auto view = Camera::FrameView::full(reinterpret_cast<const char*>(pixels.data()), meta)
+                          .window(3, 2, 5, 3);
+
+    for (auto mode : { ConvertMode::U16, ConvertMode::None }) {
+        ConvertConfig cfg;
+        cfg.mode     = mode;
+        cfg.shift    = 1;
+        cfg.byteswap = (mode == ConvertMode::None);
+        CaptureOutput* capture = nullptr;
+        auto conv = converter(cfg, capture);
+        ASSERT_EQ(conv->write_view(view, frame_meta(5, 3, 4)), NO_ERROR);
+
+        const auto f = capture->captured().at(0);
+        for (uint32_t y = 0; y < 3; ++y) {
+            for (uint32_t x = 0; x < 5; ++x) {
+                const uint32_t in = pixels[(y + 2) * 16 + x + 3];
+                if (mode == ConvertMode::U16) {
+                    EXPECT_EQ(samples_of<uint16_t>(f)[y * 5 + x], in >> 1);
+                }
+                else {
+                    EXPECT_EQ(samples_of<uint32_t>(f)[y * 5 + x], __builtin_bswap32(in));
+                }
+            }
+        }
+        EXPECT_EQ(f.data.size(), 5u * 3 * f.meta.bytes_per_pixel);
+    }
+}
@@ -0,0 +1,247 @@
+#include "gtest/gtest.h"
+#include "../utils/preview_output.h"
+#include "../utils/shared_memory_reader.h"
+#include "capture_output.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+#include <opencv2/imgcodecs.hpp>
+
+using Camera::FrameMetadata;
+using Camera::PixelFormat;
+using Camera::PreviewConfig;
+using Camera::PreviewFormat;
+using Camera::PreviewMethod;
+using Camera::PreviewOutput;
+using Camera::SharedMemoryReader;
+
+namespace {
+
+    constexpr const char* SEGMENT = "camerad_preview_test";
+
+    class TempDir {
+      public:
+        TempDir() {
+            char name[] = "/tmp/preview_output_test_XXXXXX";
+            path = ::mkdtemp(name) ? name : "";
+        }
+        ~TempDir() {
+            std::error_code ec;
+            if (!path.empty()) std::filesystem::remove_all(path, ec);
+        }
+        std::string path;
+    };
+
+    /// a preview to SHM with the whole range stretched, unless changed
+    PreviewConfig config_of(uint32_t max_size, PreviewMethod method = PreviewMethod::Bin) {
+        PreviewConfig cfg;
+        cfg.max_size    = max_size;
+        cfg.method      = method;
+        cfg.low_pct     = 0;
+        cfg.high_pct    = 100;
+        cfg.shm_segment = SEGMENT;
+        return cfg;
+    }
+
+    /**
+     * A frame of factor x factor blocks, each averaging to mean(bx, by) but
+     * with its first pixel mean - bx - 1. Pixels in no whole block are far
+     * brighter than the rest, so any that reach the preview show.
+     */
+    template <typename T>
+    std::vector<T> blocks(uint32_t width, uint32_t height, uint32_t factor) {
+        std::vector<T> pixels(static_cast<size_t>(width) * height, T(60000));
+        for (uint32_t by = 0; by < height / factor; ++by) {
+            for (uint32_t bx = 0; bx < width / factor; ++bx) {
+                const double mean = 100 + 10 * bx + 40 * by;
+                for (uint32_t dy = 0; dy < factor; ++dy) {
+                    for (uint32_t dx = 0; dx < factor; ++dx) {
+                        double v = mean;
+                        if (dx == 0 && dy == 0) v -= bx + 1;
+                        if (dx == factor - 1 && dy == factor - 1) v += bx + 1;
+                        pixels[static_cast<size_t>(by * factor + dy) * width + bx * factor + dx] = static_cast<T>(v);
+                    }
+                }
+            }
+        }
+        return pixels;
+    }
+
+    /// the values blocks() reduces to, by method
+    std::vector<double> reduced(uint32_t out_w, uint32_t out_h, PreviewMethod method) {
+        std::vector<double> values;
+        for (uint32_t by = 0; by < out_h; ++by) {
+            for (uint32_t bx = 0; bx < out_w; ++bx) {
+                const double mean = 100 + 10 * bx + 40 * by;
+                values.push_back(method == PreviewMethod::Bin ? mean : mean - bx - 1);
+            }
+        }
+        return values;
+    }
+
+    /// each pixel within rounding of its value stretched over the whole range
+    void expect_stretched(const std::vector<uint8_t> &image, const std::vector<double> &values) {
+        ASSERT_EQ(image.size(), values.size());
+        const auto [pmin, pmax] = std::minmax_element(values.begin(), values.end());
+        const double top = *pmin + std::max(*pmax - *pmin, 1.0) * 4096 / 4095;    // past the last histogram bin
+        for (size_t i = 0; i < image.size(); ++i) {
+            EXPECT_NEAR(image[i], (values[i] - *pmin) * 255.0 / (top - *pmin), 0.501) << "pixel " << i;
+        }
+    }
+
+    /// writes one frame through a preview to SHM and reads back what it published
+    template <typename T>
+    std::vector<uint8_t> preview_of(const PreviewConfig &cfg, const std::vector<T> &pixels, FrameMetadata meta,
+                                    Camera::SharedFrameInfo &info) {
+        PreviewOutput preview(cfg);
+        if (preview.open() != NO_ERROR) return {};
+        SharedMemoryReader reader(cfg.shm_segment);
+        if (reader.open() != NO_ERROR) return {};
+        if (preview.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * sizeof(T), meta) != NO_ERROR) return {};
+        SharedMemoryReader::Frame frame;
+        if (reader.next(frame, 1000) != NO_ERROR) return {};
+        info = frame.info;
+        return std::vector<uint8_t>(frame.data, frame.data + frame.info.data_size);
+    }
+
+    template <typename T>
+    void expect_reduced(PixelFormat format, PreviewMethod method) {
+        // 48 wide at factor 2 fills six whole vectors of a row
+        const auto pixels = blocks<T>(48, 6, 2);
+        auto meta = frame_meta(48, 6, sizeof(T));
+        meta.pixel_format = format;
+        Camera::SharedFrameInfo info;
+        const auto image = preview_of(config_of(24, method), pixels, meta, info);
+        ASSERT_EQ(info.width, 24u);
+        ASSERT_EQ(info.height, 3u);
+        expect_stretched(image, reduced(24, 3, method));
+    }
+
+}
+
+TEST(PreviewOutputTest, BinAveragesEachBlock) {
+    expect_reduced<uint16_t>(PixelFormat::U16, PreviewMethod::Bin);
+    expect_reduced<uint32_t>(PixelFormat::U32, PreviewMethod::Bin);
+    expect_reduced<float>   (PixelFormat::F32, PreviewMethod::Bin);
+}
+
+TEST(PreviewOutputTest, DecimateTakesTheFirstPixelOfEachBlock) {
+    expect_reduced<uint16_t>(PixelFormat::U16, PreviewMethod::Decimate);
+    expect_reduced<uint32_t>(PixelFormat::U32, PreviewMethod::Decimate);
+    expect_reduced<float>   (PixelFormat::F32, PreviewMethod::Decimate);
+}
+
+TEST(PreviewOutputTest, OddSizesDropThePartBlocks) {
+    // factor 5 leaves two columns and three rows in no whole block, and a
+    // 35 pixel row ends short of a whole vector
+    const auto pixels = blocks<uint16_t>(37, 23, 5);
+    for (auto method : { PreviewMethod::Bin, PreviewMethod::Decimate }) {
+        Camera::SharedFrameInfo info;
+        const auto image = preview_of(config_of(8, method), pixels, frame_meta(37, 23), info);
+        ASSERT_EQ(info.width, 7u);
+        ASSERT_EQ(info.height, 4u);
+        expect_stretched(image, reduced(7, 4, method));
+    }
+}
+
+TEST(PreviewOutputTest, StretchClipsOutsideThePercentiles) {
+    // a ramp of 16 * k, k = 100..1121, with one cold and one hot pixel;
+    // the histogram bins are then 16 wide starting at 0
+    std::vector<uint16_t> pixels(32 * 32);
+    pixels.front() = 0;
+    for (size_t i = 1; i + 1 < pixels.size(); ++i) pixels[i] = static_cast<uint16_t>(16 * (99 + i));
+    pixels.back() = 16 * 4095;
+    auto cfg = config_of(32);
+    cfg.low_pct  = 0.5;       // the 5th of 1024 lies in bin 104
+    cfg.high_pct = 99.5;      // the 1018th in bin 1116
+    Camera::SharedFrameInfo info;
+    const auto image = preview_of(cfg, pixels, frame_meta(32, 32), info);
+    ASSERT_EQ(image.size(), pixels.size());
+
+    const double lo = 16 * 104, hi = 16 * 1117;
+    EXPECT_EQ(image.front(), 0);
+    EXPECT_EQ(image.back(), 255);
+    EXPECT_EQ(image[4], 0);                         // 16 * 103, below lo
+    EXPECT_EQ(image[5], 0);                         // lo itself
+    EXPECT_EQ(image[1018], 255);                    // 16 * 1117, hi itself
+    EXPECT_EQ(image[1021], 255);
+    for (size_t i = 6; i < 1018; ++i) {
+        EXPECT_NEAR(image[i], (pixels[i] - lo) * 255.0 / (hi - lo), 0.501) << "pixel " << i;
+    }
+}
+
+TEST(PreviewOutputTest, ShmPreviewCarriesTheFrameIdentity) {
+    const auto pixels = blocks<uint16_t>(64, 64, 2);
+    auto meta = frame_meta(64, 64, 2, 42);
+    meta.timestamp       = 7;
+    meta.sequence_number = 9;
+    Camera::SharedFrameInfo info;
+    const auto image = preview_of(config_of(32), pixels, meta, info);
+    EXPECT_EQ(image.size(), 32u * 32);
+    EXPECT_EQ(info.width, 32u);
+    EXPECT_EQ(info.height, 32u);
+    EXPECT_EQ(info.bytes_per_pixel, 1u);
+    EXPECT_EQ(info.pixel_format, static_cast<uint32_t>(PixelFormat::U8));
+    EXPECT_EQ(info.frame_number, 42u);
+    EXPECT_EQ(info.timestamp, 7u);
+    EXPECT_EQ(info.sequence_number, 9u);
+}
+
+TEST(PreviewOutputTest, PngIsReplacedWhole) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    auto cfg = config_of(24);
+    cfg.format     = PreviewFormat::Png;
+    cfg.image_path = dir.path + "/preview.png";
+    PreviewOutput preview(cfg);
+    ASSERT_EQ(preview.open(), NO_ERROR);
+
+    const auto pixels = blocks<uint16_t>(48, 6, 2);
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_EQ(preview.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2, frame_meta(48, 6)), NO_ERROR);
+    }
+    EXPECT_FALSE(std::filesystem::exists(cfg.image_path + ".tmp"));
+
+    std::ifstream f(cfg.image_path, std::ios::binary);
+    char signature[8] = {};
+    f.read(signature, sizeof(signature));
+    EXPECT_EQ(std::string(signature, 8), std::string("\x89PNG\r\n\x1a\n", 8));
+
+    // lossless, so it decodes to the very pixels SHM would carry
+    cv::Mat png = cv::imread(cfg.image_path, cv::IMREAD_UNCHANGED);
+    ASSERT_FALSE(png.empty());
+    ASSERT_EQ(png.type(), CV_8UC1);
+    ASSERT_EQ(png.rows, 3);
+    ASSERT_EQ(png.cols, 24);
+    std::vector<uint8_t> image;
+    for (int y = 0; y < png.rows; ++y) image.insert(image.end(), png.ptr<uint8_t>(y), png.ptr<uint8_t>(y) + png.cols);
+    expect_stretched(image, reduced(24, 3, PreviewMethod::Bin));
+
+    const auto s = preview.stats();
+    EXPECT_EQ(s.frames, 2u);
+    EXPECT_EQ(preview.metrics().bytes_written, 2u * 24 * 3);
+}
+
+TEST(PreviewOutputTest, FramesItCannotPreviewAreCounted) {
+    PreviewOutput preview(config_of(16));
+    ASSERT_EQ(preview.open(), NO_ERROR);
+    const std::vector<uint16_t> pixels(16 * 16, 1);
+    auto meta = frame_meta(16, 16);
+
+    meta.big_endian = true;
+    EXPECT_EQ(preview.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2, meta), NO_ERROR);
+    meta = frame_meta(16, 16, 1);
+    EXPECT_EQ(preview.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2, meta), NO_ERROR);
+    meta = frame_meta(16, 16);
+    EXPECT_EQ(preview.write(reinterpret_cast<const char*>(pixels.data()), 100, meta), NO_ERROR);   // short
+
+    const auto s = preview.stats();
+    EXPECT_EQ(s.unsupported, 3u);
+    EXPECT_EQ(s.frames, 0u);
+}
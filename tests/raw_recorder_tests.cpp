@@ -0,0 +1,165 @@
+#include "gtest/gtest.h"
+#include "../utils/raw_recorder.h"
+#include "capture_output.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using Camera::RawRecorder;
+using Camera::RawRecorderConfig;
+
+namespace {
+
+    class TempDir {
+      public:
+        TempDir() {
+            char name[] = "/tmp/raw_recorder_test_XXXXXX";
+            path = ::mkdtemp(name) ? name : "";
+        }
+        ~TempDir() {
+            std::error_code ec;
+            if (!path.empty()) std::filesystem::remove_all(path, ec);
+        }
+        std::string path;
+    };
+
+    RawRecorderConfig config_in(const std::string &dir, Camera::RawIoMode io) {
+        RawRecorderConfig cfg;
+        cfg.output_dir      = dir;
+        cfg.basename        = "burst";
+        cfg.queue_depth     = 4;
+        cfg.max_frame_bytes = 64 * 50 * 2;
+        cfg.bytes_per_file  = 64 * 1024;      // rotates every few frames
+        cfg.io              = io;
+        cfg.huge_pages      = Camera::HugePageMode::None;
+        cfg.overflow        = Camera::OverflowPolicy::Block;
+        cfg.block_ms        = 0;
+        return cfg;
+    }
+
+    std::vector<char> read_file(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    /// the session's index records, empty if the header is not valid
+    std::vector<Camera::RawIndexRecord> read_index(const std::string &session) {
+        const auto bytes = read_file(session + ".idx");
+        std::vector<Camera::RawIndexRecord> records;
+        Camera::RawIndexHeader header;
+        if (bytes.size() < sizeof(header)) return records;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, Camera::RAW_INDEX_MAGIC, sizeof(header.magic)) != 0) return records;
+        for (size_t at = sizeof(header); at + sizeof(Camera::RawIndexRecord) <= bytes.size();
+             at += sizeof(Camera::RawIndexRecord)) {
+            records.emplace_back();
+            std::memcpy(&records.back(), bytes.data() + at, sizeof(Camera::RawIndexRecord));
+        }
+        return records;
+    }
+
+    /// writes frames 1..n, each a ramp offset by its number, and checks
+    /// every one comes back from the data files where the index says
+    void record_and_read_back(Camera::RawIoMode io) {
+        TempDir dir;
+        ASSERT_FALSE(dir.path.empty());
+        RawRecorder recorder(config_in(dir.path, io));
+        ASSERT_EQ(recorder.open(), NO_ERROR);
+
+        constexpr uint64_t FRAMES = 12;
+        std::vector<std::vector<uint16_t>> sent;
+        for (uint64_t n = 1; n <= FRAMES; ++n) {
+            auto pixels = ramp_frame(64, 50);
+            for (auto &p : pixels) p = static_cast<uint16_t>(p + n);
+            ASSERT_EQ(recorder.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2,
+                                     frame_meta(64, 50, 2, n)), NO_ERROR);
+            sent.push_back(std::move(pixels));
+        }
+        recorder.close();
+
+        const auto s = recorder.stats();
+        EXPECT_EQ(s.frames_received, FRAMES);
+        EXPECT_EQ(s.frames_written, FRAMES);
+        EXPECT_EQ(s.frames_failed, 0u);
+
+        auto records = read_index(recorder.session());
+        ASSERT_EQ(records.size(), FRAMES);
+        for (const auto &r : records) {
+            ASSERT_GE(r.frame_number, 1u);
+            ASSERT_LE(r.frame_number, FRAMES);
+            EXPECT_EQ(r.width, 64u);
+            EXPECT_EQ(r.offset % Camera::RAW_BLOCK_BYTES, 0u);
+            const auto data = read_file(Camera::raw_data_file(recorder.session(), r.file_seq));
+            ASSERT_LE(r.offset + r.size, data.size());
+            const auto &pixels = sent[r.frame_number - 1];
+            ASSERT_EQ(r.size, pixels.size() * 2);
+            EXPECT_EQ(std::memcmp(data.data() + r.offset, pixels.data(), r.size), 0) << "frame " << r.frame_number;
+        }
+
+        // whatever order the writes completed in, the burst's order comes back
+        Camera::sort_by_submission(records);
+        for (uint64_t n = 0; n < FRAMES; ++n) EXPECT_EQ(records[n].frame_number, n + 1);
+        EXPECT_GT(records.back().file_seq, 0u);
+    }
+
+}
+
+TEST(RawRecorderTest, OpenRequiresMaxFrameBytes) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    auto cfg = config_in(dir.path, Camera::RawIoMode::Threads);
+    cfg.max_frame_bytes = 0;
+    RawRecorder recorder(cfg);
+    EXPECT_EQ(recorder.open(), ERROR);
+}
+
+TEST(RawRecorderTest, PwriteThreadsRecordEveryFrame) {
+    record_and_read_back(Camera::RawIoMode::Threads);
+}
+
+TEST(RawRecorderTest, UringOrItsFallbackRecordsEveryFrame) {
+    record_and_read_back(Camera::RawIoMode::Uring);
+}
+
+TEST(RawRecorderTest, OversizeFramesFailWithoutRemapping) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    const auto cfg = config_in(dir.path, Camera::RawIoMode::Threads);
+    RawRecorder recorder(cfg);
+    ASSERT_EQ(recorder.open(), NO_ERROR);
+
+    // buffers are rounded up to whole pages, so go well past them
+    std::vector<char> big(cfg.max_frame_bytes + (1 << 20));
+    EXPECT_EQ(recorder.write(big.data(), big.size(), frame_meta(static_cast<uint32_t>(big.size() / 2), 1)), ERROR);
+    EXPECT_EQ(recorder.reserve(big.size()), nullptr);
+    recorder.close();
+
+    EXPECT_EQ(recorder.stats().frames_failed, 1u);
+    EXPECT_EQ(recorder.stats().frames_written, 0u);
+}
+
+TEST(RawRecorderTest, ReserveCommitNeedsAnOpenRecorder) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    RawRecorder recorder(config_in(dir.path, Camera::RawIoMode::Threads));
+    EXPECT_EQ(recorder.reserve(128), nullptr);
+    EXPECT_EQ(recorder.commit(128, frame_meta(64, 1)), ERROR);
+
+    ASSERT_EQ(recorder.open(), NO_ERROR);
+    char* buffer = recorder.reserve(128);
+    ASSERT_NE(buffer, nullptr);
+    std::memset(buffer, 0x3C, 128);
+    EXPECT_EQ(recorder.commit(128, frame_meta(64, 1, 2, 9)), NO_ERROR);
+    EXPECT_EQ(recorder.commit(128, frame_meta(64, 1, 2, 10)), ERROR);     // nothing reserved
+    recorder.close();
+
+    EXPECT_EQ(recorder.commit(128, frame_meta(64, 1)), ERROR);
+    const auto records = read_index(recorder.session());
+    ASSERT_EQ(records.size(), 1u);
+    EXPECT_EQ(records[0].frame_number, 9u);
+}
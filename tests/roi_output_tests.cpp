@@ -0,0 +1,107 @@
+#include "gtest/gtest.h"
+#include "../utils/roi_output.h"
+#include "capture_output.h"
+
+#include <cstring>
+
+using Camera::FrameView;
+using Camera::RoiOutput;
+using Camera::RoiTable;
+using Camera::RoiWindow;
+
+TEST(RoiOutputTest, WindowViewIsStridedIntoParent) {
+    auto pixels = ramp_frame(16, 8);
+    const auto view = FrameView::full(reinterpret_cast<const char*>(pixels.data()), frame_meta(16, 8));
+    const auto win  = view.window(3, 2, 4, 3);
+
+    EXPECT_EQ(win.stride, 16u * 2);
+    EXPECT_FALSE(win.contiguous());
+    EXPECT_EQ(win.size(), 4u * 3 * 2);
+
+    std::vector<uint16_t> packed(4 * 3);
+    win.copy_to(reinterpret_cast<char*>(packed.data()));
+    for (uint32_t y = 0; y < 3; ++y) {
+        for (uint32_t x = 0; x < 4; ++x) EXPECT_EQ(packed[y * 4 + x], (y + 2) * 16 + (x + 3));
+    }
+}
+
+TEST(RoiOutputTest, FullWidthWindowIsContiguous) {
+    auto pixels = ramp_frame(16, 8);
+    const auto view = FrameView::full(reinterpret_cast<const char*>(pixels.data()), frame_meta(16, 8));
+    const auto win  = view.window(0, 5, 16, 2);
+    EXPECT_TRUE(win.contiguous());
+    EXPECT_EQ(reinterpret_cast<const uint16_t*>(win.data)[0], 5 * 16);
+}
+
+TEST(RoiOutputTest, EachSinkGetsItsWindow) {
+    auto table = std::make_shared<RoiTable>(std::vector<RoiWindow>{ {1, 1, 2, 2}, {10, 4, 6, 4} });
+    auto a = std::make_unique<CaptureOutput>();
+    auto b = std::make_unique<CaptureOutput>();
+    CaptureOutput* pa = a.get();
+    CaptureOutput* pb = b.get();
+    std::vector<std::vector<std::unique_ptr<Camera::FrameOutput>>> sinks(2);
+    sinks[0].push_back(std::move(a));
+    sinks[1].push_back(std::move(b));
+    RoiOutput roi(table, std::move(sinks));
+
+    auto pixels = ramp_frame(16, 8);
+    ASSERT_EQ(roi.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2, frame_meta(16, 8, 2, 42)), NO_ERROR);
+
+    const auto fa = pa->captured();
+    ASSERT_EQ(fa.size(), 1u);
+    EXPECT_EQ(fa[0].meta.width, 2u);
+    EXPECT_EQ(fa[0].meta.height, 2u);
+    EXPECT_EQ(fa[0].meta.roi_id, 0u);
+    EXPECT_EQ(fa[0].meta.frame_number, 42u);
+    const auto* p = reinterpret_cast<const uint16_t*>(fa[0].data.data());
+    EXPECT_EQ(p[0], 1 * 16 + 1);
+    EXPECT_EQ(p[3], 2 * 16 + 2);
+
+    const auto fb = pb->captured();
+    ASSERT_EQ(fb.size(), 1u);
+    EXPECT_EQ(fb[0].meta.roi_id, 1u);
+    EXPECT_EQ(fb[0].meta.roi_x, 10u);
+    EXPECT_EQ(fb[0].meta.roi_y, 4u);
+    EXPECT_EQ(fb[0].data.size(), 6u * 4 * 2);
+    p = reinterpret_cast<const uint16_t*>(fb[0].data.data());
+    EXPECT_EQ(p[6 * 4 - 1], 7 * 16 + 15);
+}
+
+TEST(RoiOutputTest, MovedWindowOffTheFrameIsSkipped) {
+    auto table = std::make_shared<RoiTable>(std::vector<RoiWindow>{ {0, 0, 4, 4} });
+    auto sink = std::make_unique<CaptureOutput>();
+    CaptureOutput* ps = sink.get();
+    std::vector<std::vector<std::unique_ptr<Camera::FrameOutput>>> sinks(1);
+    sinks[0].push_back(std::move(sink));
+    RoiOutput roi(table, std::move(sinks));
+
+    std::string err;
+    ASSERT_EQ(table->set(0, {14, 0, 4, 4}, err), NO_ERROR);
+    auto pixels = ramp_frame(16, 8);
+    EXPECT_EQ(roi.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2, frame_meta(16, 8)), NO_ERROR);
+    EXPECT_TRUE(ps->captured().empty());
+    EXPECT_EQ(roi.windows_clipped(), 1u);
+
+    ASSERT_EQ(table->set(0, {12, 4, 4, 4}, err), NO_ERROR);
+    roi.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2, frame_meta(16, 8));
+    ASSERT_EQ(ps->captured().size(), 1u);
+    EXPECT_EQ(reinterpret_cast<const uint16_t*>(ps->captured()[0].data.data())[0], 4 * 16 + 12);
+}
+
+TEST(RoiOutputTest, WindowMayNotGrow) {
+    RoiTable table({ {0, 0, 4, 4} });
+    std::string err;
+    EXPECT_EQ(table.set(0, {0, 0, 8, 2}, err), NO_ERROR);
+    EXPECT_EQ(table.set(0, {0, 0, 5, 4}, err), ERROR);
+    EXPECT_EQ(table.set(1, {0, 0, 1, 1}, err), ERROR);
+    EXPECT_EQ(table.set(0, {0, 0, 0, 4}, err), ERROR);
+}
+
+TEST(RoiOutputTest, ShortFrameFails) {
+    auto table = std::make_shared<RoiTable>(std::vector<RoiWindow>{ {0, 0, 2, 2} });
+    std::vector<std::vector<std::unique_ptr<Camera::FrameOutput>>> sinks(1);
+    sinks[0].push_back(std::make_unique<CaptureOutput>());
+    RoiOutput roi(table, std::move(sinks));
+    auto pixels = ramp_frame(16, 8);
+    EXPECT_EQ(roi.write(reinterpret_cast<const char*>(pixels.data()), 100, frame_meta(16, 8)), ERROR);
+}
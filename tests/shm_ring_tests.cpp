@@ -0,0 +1,240 @@
+#include "gtest/gtest.h"
+#include "../utils/shared_memory_writer.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace bip = boost::interprocess;
+
+namespace {
+
+    constexpr const char* SEGMENT = "camerad_shm_ring_test";
+    constexpr size_t FRAME_WORDS = 4096;
+    constexpr uint32_t NUM_SLOTS = 4;
+    constexpr uint64_t NUM_FRAMES = 200000;
+
+    struct ReaderStats {
+        uint64_t ok{0};
+        uint64_t overrun{0};
+        uint64_t torn{0};
+        uint64_t out_of_order{0};
+    };
+
+    // Every word of frame k holds k, so any mix of two frames is detectable
+    bool consistent(const std::vector<uint64_t> &buf, const Camera::SharedFrameInfo &info) {
+        if (info.data_size != FRAME_WORDS * sizeof(uint64_t)) return false;
+        for (auto w : buf) if (w != info.frame_number) return false;
+        return true;
+    }
+
+    void run_reader(Camera::RingBufferControl* control, bool lossless,
+                    const std::atomic<bool> &done, ReaderStats &stats) {
+        using Camera::ShmRing::ReadStatus;
+        std::vector<uint64_t> buf(FRAME_WORDS);
+        Camera::SharedFrameInfo info;
+        uint64_t cursor = 0;
+        uint64_t last = ~0ULL;
+        const struct timespec timeout{0, 10000000};
+
+        while (true) {
+            const uint32_t bell = control->doorbell.load();
+            const uint64_t published = control->write_index.load(std::memory_order_acquire);
+            if (published == 0 || (lossless ? cursor >= published : published - 1 == last)) {
+                if (done.load()) break;
+                Camera::ShmRing::wait_doorbell(control, bell, &timeout);
+                continue;
+            }
+
+            const uint64_t want = lossless ? cursor : published - 1;
+            const auto status = Camera::ShmRing::read(control, want, info,
+                                                      reinterpret_cast<char*>(buf.data()),
+                                                      buf.size() * sizeof(uint64_t));
+            if (status == ReadStatus::Overrun) {
+                ++stats.overrun;
+                cursor = published - 1;     // resynchronize to the newest frame
+                continue;
+            }
+            if (status == ReadStatus::Skipped) cursor = want + 1;
+            if (status != ReadStatus::Ok) continue;
+
+            if (!consistent(buf, info) || info.frame_number != want) ++stats.torn;
+            if (last != ~0ULL && want <= last) ++stats.out_of_order;
+            last = want;
+            cursor = want + 1;
+            ++stats.ok;
+        }
+    }
+
+}
+
+// Readers chase a writer running flat out through a small ring; no reader
+// may ever accept a frame whose header and pixels are not all from one write.
+TEST(ShmRingTest, ReadersNeverSeeTornFrames) {
+    Camera::SharedMemoryWriter writer(SEGMENT, FRAME_WORDS * sizeof(uint64_t), NUM_SLOTS);
+    ASSERT_EQ(writer.open(), 0);
+
+    bip::shared_memory_object shm(bip::open_only, SEGMENT, bip::read_write);
+    bip::mapped_region region(shm, bip::read_write);
+    auto* control = static_cast<Camera::RingBufferControl*>(region.get_address());
+    ASSERT_TRUE(Camera::ShmRing::compatible(control));
+
+    std::atomic<bool> done{false};
+    std::vector<ReaderStats> stats(4);
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        readers.emplace_back(run_reader, control, i % 2 == 1, std::cref(done), std::ref(stats[i]));
+    }
+
+    std::vector<uint64_t> frame(FRAME_WORDS);
+    Camera::FrameMetadata meta;
+    meta.width = FRAME_WORDS;
+    meta.height = 1;
+    meta.bytes_per_pixel = sizeof(uint64_t);
+    for (uint64_t k = 0; k < NUM_FRAMES; ++k) {
+        std::fill(frame.begin(), frame.end(), k);
+        meta.frame_number = k;
+        // alternate the copying and the in-place paths
+        if (k % 2) {
+            ASSERT_EQ(writer.write(reinterpret_cast<const char*>(frame.data()), frame.size() * sizeof(uint64_t), meta), 0);
+        }
+        else {
+            char* slot = writer.reserve(frame.size() * sizeof(uint64_t));
+            ASSERT_NE(slot, nullptr);
+            std::memcpy(slot, frame.data(), frame.size() * sizeof(uint64_t));
+            ASSERT_EQ(writer.commit(frame.size() * sizeof(uint64_t), meta), 0);
+        }
+    }
+    done.store(true);
+    for (auto &t : readers) t.join();
+
+    EXPECT_EQ(control->write_index.load(), NUM_FRAMES);
+    for (const auto &s : stats) {
+        EXPECT_GT(s.ok, 0u);
+        EXPECT_EQ(s.torn, 0u);
+        EXPECT_EQ(s.out_of_order, 0u);
+    }
+    writer.close();
+}
+
+TEST(ShmRingTest, AbandonedReservationIsPublishedEmpty) {
+    Camera::SharedMemoryWriter writer(SEGMENT, 64, 2);
+    ASSERT_EQ(writer.open(), 0);
+
+    bip::shared_memory_object shm(bip::open_only, SEGMENT, bip::read_write);
+    bip::mapped_region region(shm, bip::read_write);
+    auto* control = static_cast<Camera::RingBufferControl*>(region.get_address());
+
+    ASSERT_NE(writer.reserve(64), nullptr);
+    writer.abandon();
+
+    Camera::SharedFrameInfo info;
+    char buf[64];
+    EXPECT_EQ(Camera::ShmRing::read(control, 0, info, buf, sizeof(buf)), Camera::ShmRing::ReadStatus::Skipped);
+    EXPECT_EQ(info.data_size, 0u);
+    EXPECT_EQ(Camera::ShmRing::read(control, 1, info, buf, sizeof(buf)), Camera::ShmRing::ReadStatus::NotReady);
+    writer.close();
+}
+
+TEST(ShmRingTest, PinnedSlotIsSkippedByWriter) {
+    Camera::SharedMemoryWriter writer(SEGMENT, 64, 2);
+    ASSERT_EQ(writer.open(), 0);
+
+    bip::shared_memory_object shm(bip::open_only, SEGMENT, bip::read_write);
+    bip::mapped_region region(shm, bip::read_write);
+    auto* control = static_cast<Camera::RingBufferControl*>(region.get_address());
+
+    char frame[64] = {1};
+    Camera::FrameMetadata meta;
+    ASSERT_EQ(writer.write(frame, sizeof(frame), meta), 0);
+
+    Camera::SharedFrameInfo info;
+    ASSERT_EQ(Camera::ShmRing::pin(control, 0, info), Camera::ShmRing::ReadStatus::Ok);
+
+    // positions 1 and 3 go to the free slot, 2 lands on the pinned one
+    for (int i = 0; i < 2; ++i) ASSERT_EQ(writer.write(frame, sizeof(frame), meta), 0);
+    EXPECT_EQ(writer.pinned_skips(), 1u);
+    EXPECT_EQ(control->write_index.load(), 4u);
+    EXPECT_EQ(Camera::ShmRing::read(control, 2, info, nullptr, 0), Camera::ShmRing::ReadStatus::Skipped);
+    EXPECT_EQ(info.position, 0u);
+
+    Camera::ShmRing::unpin(control, 0);
+    ASSERT_EQ(writer.write(frame, sizeof(frame), meta), 0);
+    EXPECT_EQ(writer.pinned_skips(), 1u);
+    writer.close();
+}
+
+TEST(ShmRingTest, ConsumerHoldsBackNonOverwritingWriter) {
+    Camera::SharedMemoryWriter writer(SEGMENT, 64, 2);
+    writer.set_overflow(Camera::OverflowPolicy::DropNewest);
+    ASSERT_EQ(writer.open(), 0);
+
+    bip::shared_memory_object shm(bip::open_only, SEGMENT, bip::read_write);
+    bip::mapped_region region(shm, bip::read_write);
+    auto* control = static_cast<Camera::RingBufferControl*>(region.get_address());
+    ASSERT_TRUE(Camera::ShmRing::attach_consumer(control, 0));
+    EXPECT_FALSE(Camera::ShmRing::attach_consumer(control, 0));
+
+    char frame[64] = {1};
+    Camera::FrameMetadata meta;
+    for (int i = 0; i < 2; ++i) ASSERT_EQ(writer.write(frame, sizeof(frame), meta), 0);
+
+    // the ring holds two frames the consumer has not finished with
+    EXPECT_NE(writer.write(frame, sizeof(frame), meta), 0);
+    auto status = writer.queue_status();
+    EXPECT_EQ(status.depth, 2u);
+    EXPECT_EQ(status.dropped, 1u);
+    EXPECT_EQ(control->write_index.load(), 2u);
+
+    Camera::ShmRing::consume(control, 1);
+    EXPECT_EQ(writer.write(frame, sizeof(frame), meta), 0);
+
+    // under block the writer waits for the consumer instead
+    writer.set_overflow(Camera::OverflowPolicy::Block, 5000);
+    std::thread consumer([control]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        Camera::ShmRing::consume(control, 2);
+    });
+    EXPECT_EQ(writer.write(frame, sizeof(frame), meta), 0);
+    consumer.join();
+    status = writer.queue_status();
+    EXPECT_EQ(status.blocked, 1u);
+    EXPECT_EQ(status.dropped, 1u);
+
+    // once detached nothing holds the writer back
+    Camera::ShmRing::detach_consumer(control);
+    for (int i = 0; i < 4; ++i) EXPECT_EQ(writer.write(frame, sizeof(frame), meta), 0);
+    writer.close();
+}
+
+TEST(ShmRingTest, MetricsAreSafeToReadWhileTheWriterClosesAndReopens) {
+    Camera::SharedMemoryWriter writer(SEGMENT, 64, 2);
+    ASSERT_EQ(writer.open(), 0);
+
+    // a status reader on its own thread, as the telemetry poller is
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> reads{0};
+    std::thread poller([&] {
+        while (!done.load()) {
+            const auto m = writer.metrics();
+            EXPECT_LE(m.queue.depth, 2u);
+            ++reads;
+        }
+    });
+
+    char frame[64] = {1};
+    Camera::FrameMetadata meta;
+    for (int cycle = 0; cycle < 20; ++cycle) {
+        for (int i = 0; i < 4; ++i) ASSERT_EQ(writer.write(frame, sizeof(frame), meta), 0);
+        writer.close();
+        ASSERT_EQ(writer.open(), 0);
+    }
+    while (reads.load() < 100) std::this_thread::yield();
+    done = true;
+    poller.join();
+    writer.close();
+}
@@ -0,0 +1,60 @@
+#include "gtest/gtest.h"
+#include "../utils/telemetry_format.h"
+#include "../utils/telemetry_output.h"
+
+#include <cstdint>
+#include <vector>
+
+TEST(TelemetryTest, BinaryRoundTrip) {
+    Camera::TelemetryFrame in;
+    in.frame_number    = 123456789012ULL;
+    in.sequence_number = 7;
+    in.timestamp       = 0x0102030405060708ULL;
+    in.host_time_ns    = 42;
+    in.width           = 2048;
+    in.height          = 1024;
+    in.latency_us      = 850;
+    in.taps    = { { 1000.5f, 3.25f, 990.f, 1011.f }, { 2000.f, 4.f, 1980.f, 2040.f } };
+    in.outputs = { { "fits", 3, 8, 0, 1 }, { "zmq_publisher", 1, 64, 12, 0 } };
+
+    const std::string wire = Camera::encode_telemetry(in);
+    Camera::TelemetryFrame out;
+    ASSERT_TRUE(Camera::decode_telemetry(wire.data(), wire.size(), out));
+    EXPECT_EQ(out.frame_number, in.frame_number);
+    EXPECT_EQ(out.timestamp, in.timestamp);
+    EXPECT_EQ(out.latency_us, in.latency_us);
+    ASSERT_EQ(out.taps.size(), 2u);
+    EXPECT_FLOAT_EQ(out.taps[1].max, 2040.f);
+    ASSERT_EQ(out.outputs.size(), 2u);
+    EXPECT_EQ(out.outputs[0].kind, "fits");
+    EXPECT_EQ(out.outputs[1].kind, "zmq_publ");     // kind is cut to 8 characters
+    EXPECT_EQ(out.outputs[1].dropped, 12u);
+
+    // truncated datagrams and text are not telemetry
+    EXPECT_FALSE(Camera::decode_telemetry(wire.data(), wire.size() - 1, out));
+    const std::string text = Camera::to_json(in).dump();
+    EXPECT_FALSE(Camera::decode_telemetry(text.data(), text.size(), out));
+}
+
+TEST(TelemetryTest, TapStatisticsPerColumnStrip) {
+    Camera::FrameMetadata meta;
+    meta.width = 8;
+    meta.height = 4;
+    meta.bytes_per_pixel = 2;
+    std::vector<uint16_t> frame(meta.width * meta.height);
+    for (uint32_t y = 0; y < meta.height; ++y) {
+        for (uint32_t x = 0; x < meta.width; ++x) frame[y * meta.width + x] = (x < 4) ? 100 + y : 500;
+    }
+
+    const auto taps = Camera::tap_statistics(reinterpret_cast<const char*>(frame.data()), meta, 2, 1);
+    ASSERT_EQ(taps.size(), 2u);
+    EXPECT_FLOAT_EQ(taps[0].mean, 101.5f);
+    EXPECT_FLOAT_EQ(taps[0].min, 100.f);
+    EXPECT_FLOAT_EQ(taps[0].max, 103.f);
+    EXPECT_NEAR(taps[0].stddev, 1.118f, 1e-3);
+    EXPECT_FLOAT_EQ(taps[1].mean, 500.f);
+    EXPECT_FLOAT_EQ(taps[1].stddev, 0.f);
+
+    meta.big_endian = true;
+    EXPECT_TRUE(Camera::tap_statistics(reinterpret_cast<const char*>(frame.data()), meta, 2, 1).empty());
+}
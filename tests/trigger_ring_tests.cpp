@@ -0,0 +1,201 @@
+#include "gtest/gtest.h"
+#include "../utils/trigger_ring.h"
+#include "capture_output.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Camera::TriggerRing;
+using Camera::TriggerRingConfig;
+
+namespace {
+
+    class TempDir {
+      public:
+        TempDir() {
+            char name[] = "/tmp/trigger_ring_test_XXXXXX";
+            path = ::mkdtemp(name) ? name : "";
+        }
+        ~TempDir() {
+            std::error_code ec;
+            if (!path.empty()) std::filesystem::remove_all(path, ec);
+        }
+        std::string path;
+    };
+
+    constexpr size_t FRAME_BYTES = 4096;
+
+    /// a ring of `slots` frames that dumps to raw files in dir
+    TriggerRingConfig config_in(const std::string &dir, uint32_t slots, uint32_t post_frames = 0) {
+        TriggerRingConfig cfg;
+        cfg.max_frame_bytes  = FRAME_BYTES;
+        cfg.budget_bytes     = slots * FRAME_BYTES;
+        cfg.seconds          = 0;
+        cfg.post_frames      = post_frames;
+        cfg.huge_pages       = Camera::HugePageMode::None;
+        cfg.dump             = Camera::TriggerDump::Raw;
+        cfg.raw.output_dir   = dir;
+        cfg.raw.basename     = "ring";
+        cfg.raw.huge_pages   = Camera::HugePageMode::None;
+        return cfg;
+    }
+
+    /// frame n, every byte of it n's low byte, so a torn copy shows
+    long write_frame(TriggerRing &ring, uint64_t n) {
+        std::vector<char> bytes(FRAME_BYTES, static_cast<char>(n));
+        return ring.write(bytes.data(), bytes.size(), frame_meta(FRAME_BYTES / 2, 1, 2, n));
+    }
+
+    void wait_for_dump(const TriggerRing &ring) {
+        for (int i = 0; i < 5000 && ring.dumping(); ++i) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::vector<char> read_file(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    /**
+     * The frames of dump `name`, in the order recorded, as their numbers;
+     * -1 for a frame whose bytes are not all its own.
+     */
+    std::vector<long> dumped_frames(const std::string &dir, const std::string &name) {
+        std::vector<long> frames;
+        std::string session;
+        for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+            const std::string path = entry.path().string();
+            if (entry.path().extension() == ".idx" && entry.path().filename().string().rfind(name, 0) == 0) {
+                session = path.substr(0, path.size() - 4);
+            }
+        }
+        const auto index = read_file(session + ".idx");
+        for (size_t at = sizeof(Camera::RawIndexHeader); at + sizeof(Camera::RawIndexRecord) <= index.size();
+             at += sizeof(Camera::RawIndexRecord)) {
+            Camera::RawIndexRecord r;
+            std::memcpy(&r, index.data() + at, sizeof(r));
+            const auto data = read_file(Camera::raw_data_file(session, r.file_seq));
+            bool whole = r.size == FRAME_BYTES && r.offset + r.size <= data.size();
+            for (size_t i = 0; whole && i < r.size; ++i) whole = data[r.offset + i] == static_cast<char>(r.frame_number);
+            frames.push_back(whole ? static_cast<long>(r.frame_number) : -1);
+        }
+        return frames;
+    }
+
+}
+
+TEST(TriggerRingTest, DumpWritesTheLastFramesHeld) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    TriggerRing ring(config_in(dir.path, 4));
+    std::string name;
+    EXPECT_EQ(ring.dump("too soon", name), ERROR);
+    ASSERT_EQ(ring.open(), NO_ERROR);
+    EXPECT_EQ(ring.stats().slots, 4u);
+
+    for (uint64_t n = 1; n <= 10; ++n) ASSERT_EQ(write_frame(ring, n), NO_ERROR);
+    ASSERT_EQ(ring.dump("test", name), NO_ERROR);
+    EXPECT_EQ(name, "ring_trig0001");
+    wait_for_dump(ring);
+    ASSERT_FALSE(ring.dumping());
+    ASSERT_EQ(ring.dump("again", name), NO_ERROR);
+    EXPECT_EQ(name, "ring_trig0002");
+    wait_for_dump(ring);
+    ring.close();
+
+    EXPECT_EQ(dumped_frames(dir.path, "ring_trig0001"), (std::vector<long>{ 7, 8, 9, 10 }));
+    EXPECT_EQ(dumped_frames(dir.path, "ring_trig0002"), (std::vector<long>{ 7, 8, 9, 10 }));
+    const auto s = ring.stats();
+    EXPECT_EQ(s.frames_recorded, 10u);
+    EXPECT_EQ(s.frames_dumped, 8u);
+    EXPECT_EQ(s.frames_lost, 0u);
+    EXPECT_EQ(s.dumps, 2u);
+}
+
+TEST(TriggerRingTest, DumpWaitsForThePostFrames) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    TriggerRing ring(config_in(dir.path, 8, 2));
+    ASSERT_EQ(ring.open(), NO_ERROR);
+
+    for (uint64_t n = 1; n <= 4; ++n) ASSERT_EQ(write_frame(ring, n), NO_ERROR);
+    std::string name;
+    ASSERT_EQ(ring.dump("test", name), NO_ERROR);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_TRUE(ring.dumping());
+    EXPECT_EQ(ring.dump("again", name), ERROR);         // one at a time
+
+    for (uint64_t n = 5; n <= 6; ++n) ASSERT_EQ(write_frame(ring, n), NO_ERROR);
+    wait_for_dump(ring);
+    ASSERT_FALSE(ring.dumping());
+    ring.close();
+
+    EXPECT_EQ(dumped_frames(dir.path, "ring_trig0001"), (std::vector<long>{ 1, 2, 3, 4, 5, 6 }));
+    EXPECT_EQ(ring.stats().frames_dumped, 6u);
+}
+
+TEST(TriggerRingTest, FramesLargerThanASlotAreCountedNotKept) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    TriggerRing ring(config_in(dir.path, 4));
+    ASSERT_EQ(ring.open(), NO_ERROR);
+
+    std::vector<char> big(FRAME_BYTES + 1);
+    EXPECT_EQ(ring.write(big.data(), big.size(), frame_meta(1, 1)), NO_ERROR);
+    EXPECT_EQ(write_frame(ring, 1), NO_ERROR);
+    ring.close();
+    EXPECT_EQ(ring.write(big.data(), FRAME_BYTES, frame_meta(1, 1)), ERROR);
+
+    const auto s = ring.stats();
+    EXPECT_EQ(s.frames_too_large, 1u);
+    EXPECT_EQ(s.frames_recorded, 1u);
+}
+
+// A writer lapping the dump never hands it a torn frame: each one comes
+// out whole or is counted lost
+TEST(TriggerRingTest, OverwrittenSlotsAreLostNotTorn) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    constexpr uint32_t POST = 3000;
+    TriggerRing ring(config_in(dir.path, 2, POST));
+    ASSERT_EQ(ring.open(), NO_ERROR);
+
+    for (uint64_t n = 1; n <= 2; ++n) ASSERT_EQ(write_frame(ring, n), NO_ERROR);
+    std::string name;
+    ASSERT_EQ(ring.dump("test", name), NO_ERROR);
+
+    std::atomic<bool> stats_ok{true};
+    std::thread reader([&] {
+        // stats() reads the slots the same way, alongside the writer
+        while (ring.dumping()) {
+            if (ring.stats().slots != 2) stats_ok = false;
+        }
+    });
+    // paced so the dump sometimes keeps up and sometimes is lapped
+    for (uint64_t n = 3; n < 3 + POST; ++n) {
+        ASSERT_EQ(write_frame(ring, n), NO_ERROR);
+        if (n % 8 == 0) std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    wait_for_dump(ring);
+    reader.join();
+    ASSERT_FALSE(ring.dumping());
+    ring.close();
+
+    const auto frames = dumped_frames(dir.path, name);
+    const auto s = ring.stats();
+    EXPECT_EQ(s.frames_dumped + s.frames_lost, 2u + POST);
+    EXPECT_EQ(frames.size(), s.frames_dumped);
+    long last = 0;
+    for (const long f : frames) {
+        ASSERT_NE(f, -1) << "torn frame after " << last;
+        EXPECT_GT(f, last);
+        last = f;
+    }
+    EXPECT_TRUE(stats_ok);
+}
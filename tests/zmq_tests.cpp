@@ -0,0 +1,156 @@
+#include "gtest/gtest.h"
+#include "../utils/zmq_publisher.h"
+#include "../utils/zmq_subscriber.h"
+#include "capture_output.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using Camera::ZmqPublisher;
+using Camera::ZmqPublisherConfig;
+using Camera::ZmqSubscriber;
+
+namespace {
+
+    /// a fresh directory under /tmp to hold ipc endpoints
+    class TempDir {
+      public:
+        TempDir() {
+            char name[] = "/tmp/zmq_test_XXXXXX";
+            path = ::mkdtemp(name) ? name : "";
+        }
+        ~TempDir() {
+            std::error_code ec;
+            if (!path.empty()) std::filesystem::remove_all(path, ec);
+        }
+        std::string path;
+    };
+
+    ZmqPublisherConfig config_at(const std::string &endpoint, Camera::ZmqPattern pattern) {
+        ZmqPublisherConfig cfg;
+        cfg.endpoint    = endpoint;
+        cfg.pattern     = pattern;
+        cfg.chunk_bytes = 1000;       // several parts per frame
+        cfg.linger_ms   = 0;
+        return cfg;
+    }
+
+    std::vector<uint16_t> frame_pixels(uint64_t n) {
+        auto pixels = ramp_frame(40, 30);
+        for (auto &p : pixels) p = static_cast<uint16_t>(p + n);
+        return pixels;
+    }
+
+}
+
+TEST(ZmqPublisherTest, PushFramesReassembleOnPull) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    const std::string endpoint = "ipc://" + dir.path + "/frames";
+    auto cfg = config_at(endpoint, Camera::ZmqPattern::Push);
+    cfg.overflow = Camera::OverflowPolicy::Block;
+    cfg.block_ms = 2000;          // until the puller connects
+    ZmqPublisher publisher(cfg);
+    ASSERT_EQ(publisher.open(), NO_ERROR);
+    ZmqSubscriber subscriber(endpoint, Camera::ZmqPattern::Push);
+    ASSERT_EQ(subscriber.open(), NO_ERROR);
+
+    constexpr uint64_t FRAMES = 5;
+    for (uint64_t n = 1; n <= FRAMES; ++n) {
+        const auto pixels = frame_pixels(n);
+        ASSERT_EQ(publisher.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2,
+                                  frame_meta(40, 30, 2, n)), NO_ERROR);
+    }
+
+    for (uint64_t n = 1; n <= FRAMES; ++n) {
+        ZmqSubscriber::Frame frame;
+        ASSERT_EQ(subscriber.next(frame, 2000), NO_ERROR);
+        const auto pixels = frame_pixels(n);
+        EXPECT_EQ(frame.info.frame_number, n);
+        EXPECT_EQ(frame.info.publish_seq, n - 1);
+        EXPECT_EQ(frame.info.width, 40u);
+        EXPECT_EQ(frame.info.num_chunks, 3u);
+        ASSERT_EQ(frame.info.data_size, pixels.size() * 2);
+        EXPECT_EQ(std::memcmp(frame.data, pixels.data(), frame.info.data_size), 0) << "frame " << n;
+    }
+
+    const auto s = subscriber.stats();
+    EXPECT_EQ(s.frames, FRAMES);
+    EXPECT_EQ(s.dropped, 0u);
+    EXPECT_EQ(s.malformed, 0u);
+    EXPECT_EQ(s.latency.count, FRAMES);
+    EXPECT_EQ(publisher.stats().frames_sent, FRAMES);
+
+    subscriber.clear_stats();
+    EXPECT_EQ(subscriber.stats().latency.count, 0u);
+    publisher.close();
+}
+
+TEST(ZmqPublisherTest, SubscriberSeesOnlyItsTopic) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    const std::string endpoint = "ipc://" + dir.path + "/frames";
+    ZmqPublisher publisher(config_at(endpoint, Camera::ZmqPattern::Pub));
+    ASSERT_EQ(publisher.open(), NO_ERROR);
+    ZmqSubscriber other(endpoint, Camera::ZmqPattern::Pub, "guide");
+    ASSERT_EQ(other.open(), NO_ERROR);
+    ZmqSubscriber subscriber(endpoint, Camera::ZmqPattern::Pub, "frame");
+    ASSERT_EQ(subscriber.open(), NO_ERROR);
+
+    // a subscription takes a moment to reach the publisher
+    const auto pixels = frame_pixels(0);
+    ZmqSubscriber::Frame frame;
+    long ret = TIMEOUT;
+    for (uint64_t n = 1; n <= 100 && ret == TIMEOUT; ++n) {
+        ASSERT_EQ(publisher.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2,
+                                  frame_meta(40, 30, 2, n)), NO_ERROR);
+        ret = subscriber.next(frame, 50);
+    }
+    ASSERT_EQ(ret, NO_ERROR);
+    EXPECT_EQ(std::memcmp(frame.data, pixels.data(), frame.info.data_size), 0);
+
+    EXPECT_EQ(other.next(frame, 100), TIMEOUT);
+    EXPECT_EQ(other.stats().frames, 0u);
+    EXPECT_EQ(other.stats().malformed, 0u);
+    publisher.close();
+}
+
+TEST(ZmqPublisherTest, PushWithNoPeerDropsOrTimesOut) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    const auto pixels = ramp_frame(40, 30);
+
+    ZmqPublisher dropping(config_at("ipc://" + dir.path + "/dropping", Camera::ZmqPattern::Push));
+    ASSERT_EQ(dropping.open(), NO_ERROR);
+    EXPECT_EQ(dropping.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2,
+                             frame_meta(40, 30)), NO_ERROR);
+    dropping.close();
+    EXPECT_EQ(dropping.stats().frames_dropped, 1u);
+    EXPECT_EQ(dropping.stats().frames_blocked, 0u);
+    EXPECT_EQ(dropping.stats().frames_sent, 0u);
+
+    auto cfg = config_at("ipc://" + dir.path + "/blocking", Camera::ZmqPattern::Push);
+    cfg.overflow = Camera::OverflowPolicy::Block;
+    cfg.block_ms = 20;
+    ZmqPublisher blocking(cfg);
+    ASSERT_EQ(blocking.open(), NO_ERROR);
+    EXPECT_EQ(blocking.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * 2,
+                             frame_meta(40, 30)), ERROR);
+    EXPECT_DOUBLE_EQ(blocking.queue_status().pressure, 0.0);
+    blocking.close();
+    EXPECT_EQ(blocking.stats().frames_dropped, 1u);
+    EXPECT_EQ(blocking.stats().frames_blocked, 1u);
+}
+
+TEST(ZmqPublisherTest, OpenTwiceIsRefused) {
+    TempDir dir;
+    ASSERT_FALSE(dir.path.empty());
+    ZmqPublisher publisher(config_at("ipc://" + dir.path + "/frames", Camera::ZmqPattern::Pub));
+    ASSERT_EQ(publisher.open(), NO_ERROR);
+    EXPECT_EQ(publisher.open(), ERROR);
+    publisher.close();
+    EXPECT_EQ(publisher.write("x", 1, frame_meta(1, 1, 1)), ERROR);
+}
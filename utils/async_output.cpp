@@ -0,0 +1,169 @@
+/**
+ * @file    async_output.cpp
+ * @brief   FrameOutput decorator that runs a wrapped output on its own thread
+ */
+
+#include "async_output.h"
+#include "common.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace Camera {
+
+  AsyncOutput::AsyncOutput(std::unique_ptr<FrameOutput> inner, AsyncOutputConfig cfg)
+    : inner_(std::move(inner)), cfg_(cfg) {
+    if (cfg_.queue_depth == 0) cfg_.queue_depth = 1;
+    if (cfg_.overflow == OverflowPolicy::Spill) {
+      logwrite("Camera::AsyncOutput::AsyncOutput", "NOTICE overflow=spill does not apply here; using drop_newest");
+      cfg_.overflow = OverflowPolicy::DropNewest;
+    }
+  }
+
+  AsyncOutput::~AsyncOutput() {
+    this->close();
+  }
+
+  long AsyncOutput::open() {
+    const long ret = inner_->open();
+    if (ret == NO_ERROR) this->start();
+    return ret;
+  }
+
+  void AsyncOutput::start() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (thread_.joinable()) return;
+    stopping_ = false;
+    thread_ = std::thread(&AsyncOutput::worker, this);
+  }
+
+  void AsyncOutput::close() {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      if (!thread_.joinable()) { inner_->close(); return; }
+      stopping_ = true;
+    }
+    work_cv_.notify_one();
+    room_cv_.notify_all();
+    thread_.join();
+    inner_->close();
+
+    const Stats s = this->stats();
+    char latency[64];
+    std::snprintf(latency, sizeof(latency), "%.1fus max=%.1fus", s.latency_mean_us, s.latency_max_us);
+    logwrite("Camera::AsyncOutput::close", "written=" + std::to_string(s.frames_written) +
+             " dropped=" + std::to_string(s.frames_dropped) +
+             " blocked=" + std::to_string(s.frames_blocked) +
+             " failed=" + std::to_string(s.frames_failed) +
+             " latency mean=" + latency);
+  }
+
+  long AsyncOutput::write(const char* data, size_t size, const FrameMetadata& meta) {
+    // the frame must outlive the call, so it is copied once here
+    std::shared_ptr<char[]> copy(new char[size]);
+    std::memcpy(copy.get(), data, size);
+    return this->write_shared(std::move(copy), size, meta);
+  }
+
+  long AsyncOutput::write_shared(std::shared_ptr<const char[]> data, size_t size, const FrameMetadata& meta) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    if (!thread_.joinable() || stopping_) return ERROR;
+
+    if (queue_.size() >= cfg_.queue_depth) {
+      if (cfg_.overflow == OverflowPolicy::Block) {
+        n_blocked_.fetch_add(1, std::memory_order_relaxed);
+        const auto room = [this] { return queue_.size() < cfg_.queue_depth || stopping_; };
+        if (cfg_.block_ms == 0) room_cv_.wait(lock, room);
+        else room_cv_.wait_for(lock, std::chrono::milliseconds(cfg_.block_ms), room);
+      }
+      if (queue_.size() >= cfg_.queue_depth || stopping_) {
+        n_dropped_.fetch_add(1, std::memory_order_relaxed);
+        if (cfg_.overflow == OverflowPolicy::Block && !stopping_) return ERROR;
+        if (cfg_.overflow != OverflowPolicy::DropOldest || stopping_) return NO_ERROR;
+        queue_.pop_front();
+      }
+    }
+
+    queue_.push_back(Item{ std::move(data), size, meta, get_clock_time_nsec() });
+    lock.unlock();
+    work_cv_.notify_one();
+    return NO_ERROR;
+  }
+
+  void AsyncOutput::worker() {
+    const std::string function("Camera::AsyncOutput::worker");
+
+    while (true) {
+      Item item;
+      {
+        std::unique_lock<std::mutex> lock(mtx_);
+        work_cv_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+        if (queue_.empty()) break;      // stopping, and drained
+        item = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      room_cv_.notify_one();
+
+      if (inner_->write_shared(std::move(item.data), item.size, item.meta) == NO_ERROR) {
+        n_written_.fetch_add(1, std::memory_order_relaxed);
+      }
+      else if (n_failed_.fetch_add(1, std::memory_order_relaxed) == 0) {
+        logwrite(function, "ERROR writing frame " + std::to_string(item.meta.frame_number) +
+                 "; later failures are only counted");
+      }
+
+      latency_.record(get_clock_time_nsec() - item.queued_ns);
+    }
+  }
+
+  QueueStatus AsyncOutput::queue_status() const {
+    QueueStatus status;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      status.depth = queue_.size();
+    }
+    status.capacity = cfg_.queue_depth;
+    status.dropped  = n_dropped_.load();
+    status.blocked  = n_blocked_.load();
+    status.set_pressure(cfg_.overflow);
+    // the worker, not the writer, waits on the inner output
+    const double pressure = status.pressure;
+    status.merge(inner_->queue_status());
+    status.pressure = pressure;
+    return status;
+  }
+
+  AsyncOutput::Stats AsyncOutput::stats() const {
+    Stats s;
+    s.frames_written = n_written_.load();
+    s.frames_dropped = n_dropped_.load();
+    s.frames_blocked = n_blocked_.load();
+    s.frames_failed  = n_failed_.load();
+    const LatencySnapshot latency = latency_.snapshot();
+    s.latency_mean_us = latency.mean_us();
+    s.latency_max_us  = latency.max_us();
+    return s;
+  }
+
+  OutputMetrics AsyncOutput::metrics() const {
+    OutputMetrics m;
+    m.kind           = "async";
+    m.frames_written = n_written_.load();
+    m.frames_dropped = n_dropped_.load();
+    m.frames_failed  = n_failed_.load();
+    m.latency = latency_.snapshot();
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      m.queue.depth = queue_.size();
+    }
+    m.frames_in = m.frames_written + m.frames_dropped + m.frames_failed + m.queue.depth;
+    m.queue.capacity = cfg_.queue_depth;
+    m.queue.dropped  = m.frames_dropped;
+    m.queue.blocked  = n_blocked_.load();
+    m.detail["blocked"] = m.queue.blocked;
+    return m;
+  }
+
+}
@@ -0,0 +1,90 @@
+/**
+ * @file    async_output.h
+ * @brief   FrameOutput decorator that runs a wrapped output on its own thread
+ *
+ * Writes are queued by reference to the producer's buffer and handed to
+ * the wrapped output by a worker thread, so a slow output holds up only
+ * its own queue, never the dispatcher or the other outputs. The queue is
+ * bounded; its overflow policy is drop_newest, drop_oldest or block.
+ */
+#pragma once
+
+#include "frame_output.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace Camera {
+
+  struct AsyncOutputConfig {
+    size_t         queue_depth{8};
+    OverflowPolicy overflow{OverflowPolicy::DropNewest};
+    uint32_t       block_ms{100};               ///< block: longest a write waits, 0 for no limit
+  };
+
+  class AsyncOutput : public FrameOutput {
+    public:
+      AsyncOutput(std::unique_ptr<FrameOutput> inner, AsyncOutputConfig cfg);
+      ~AsyncOutput() override;
+
+      AsyncOutput(const AsyncOutput&) = delete;
+      AsyncOutput& operator=(const AsyncOutput&) = delete;
+
+      // Opens the wrapped output and starts the worker; start() alone
+      // starts the worker for an output that is already open
+      long open() override;
+      void start();
+
+      long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      long write_shared(std::shared_ptr<const char[]> data, size_t size, const FrameMetadata& meta) override;
+
+      // Drains the queue, then closes the wrapped output
+      void close() override;
+
+      QueueStatus queue_status() const override;
+      FrameOutput* decorated() const override { return inner_.get(); }
+      OutputMetrics metrics() const override;     ///< latency is the time from queued to written
+
+      struct Stats {
+        uint64_t frames_written{0};
+        uint64_t frames_dropped{0};
+        uint64_t frames_blocked{0};
+        uint64_t frames_failed{0};
+        double   latency_mean_us{0};            ///< queued to written
+        double   latency_max_us{0};
+      };
+      Stats stats() const;
+
+    private:
+      struct Item {
+        std::shared_ptr<const char[]> data;
+        size_t size;
+        FrameMetadata meta;
+        uint64_t queued_ns;
+      };
+
+      void worker();
+
+      std::unique_ptr<FrameOutput> inner_;
+      AsyncOutputConfig cfg_;
+
+      mutable std::mutex mtx_;
+      std::condition_variable work_cv_;         ///< an item was queued, or stopping
+      std::condition_variable room_cv_;         ///< an item left the queue
+      std::deque<Item> queue_;
+      bool stopping_{false};
+      std::thread thread_;
+
+      std::atomic<uint64_t> n_written_{0};
+      std::atomic<uint64_t> n_dropped_{0};
+      std::atomic<uint64_t> n_blocked_{0};
+      std::atomic<uint64_t> n_failed_{0};
+      LatencyHistogram latency_;                ///< queued to written
+  };
+
+}
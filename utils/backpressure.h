@@ -0,0 +1,73 @@
+/**
+ * @file    backpressure.h
+ * @brief   overflow policies and queue state shared by the frame outputs
+ *
+ * Every output that buffers frames has a bound, and an OverflowPolicy
+ * saying what happens to a frame that arrives while it is at that bound.
+ * Outputs report a QueueStatus so the acquisition side can watch how full
+ * they are and slow down, or stop, before anything is dropped.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace Camera {
+
+  enum class OverflowPolicy {
+    DropNewest,     ///< discard the arriving frame
+    DropOldest,     ///< discard the oldest queued frame to make room
+    Block,          ///< hold the producer until there is room or a deadline passes, then drop newest and fail the write
+    Spill           ///< divert the frame to a raw journal, converted later with raw2fits
+  };
+
+  // "drop_newest" | "drop_oldest" | "block" | "spill"; throws std::invalid_argument
+  inline OverflowPolicy parse_overflow_policy(const std::string &s) {
+    if (s == "drop_newest") return OverflowPolicy::DropNewest;
+    if (s == "drop_oldest") return OverflowPolicy::DropOldest;
+    if (s == "block")       return OverflowPolicy::Block;
+    if (s == "spill")       return OverflowPolicy::Spill;
+    throw std::invalid_argument("expected drop_newest, drop_oldest, block or spill");
+  }
+
+  inline const char* to_string(OverflowPolicy policy) {
+    switch (policy) {
+      case OverflowPolicy::DropNewest: return "drop_newest";
+      case OverflowPolicy::DropOldest: return "drop_oldest";
+      case OverflowPolicy::Block:      return "block";
+      case OverflowPolicy::Spill:      return "spill";
+    }
+    return "unknown";
+  }
+
+  struct QueueStatus {
+    size_t   depth{0};            ///< frames queued or in flight
+    size_t   capacity{0};         ///< bound on depth, 0 for an output that does not queue
+    uint64_t dropped{0};          ///< frames lost to overflow
+    uint64_t blocked{0};          ///< writes that had to wait for room
+    uint64_t spilled{0};          ///< frames diverted to a spill journal
+    double   pressure{0};         ///< fill of the fullest queue a write would wait on, 0 if none
+
+    double fill() const { return capacity > 0 ? static_cast<double>(depth) / capacity : 0.0; }
+
+    /// sets pressure from this queue, which only holds up its writer under
+    /// Block; a queue that drops frames never pushes back
+    void set_pressure(OverflowPolicy policy) {
+      pressure = (policy == OverflowPolicy::Block) ? fill() : 0.0;
+    }
+
+    /// folds in another queue, e.g. a sink of a decorator: keeps the
+    /// fuller depth and pressure and sums the counters
+    void merge(const QueueStatus &other) {
+      if (other.fill() > this->fill()) { depth = other.depth; capacity = other.capacity; }
+      pressure = std::max(pressure, other.pressure);
+      dropped += other.dropped;
+      blocked += other.blocked;
+      spilled += other.spilled;
+    }
+  };
+
+}
@@ -1,18 +1,52 @@
 /**
  * @file    cadence_gate.cpp
- * @brief   FrameOutput decorator that rate-limits frames to a wrapped output
+ * @brief   FrameOutput decorator that thins frames to a wrapped output
  */
 
 #include "cadence_gate.h"
 #include "common.h"
 
+#include <algorithm>
+#include <stdexcept>
 #include <utility>
 
 namespace Camera {
 
-  CadenceGate::CadenceGate(std::unique_ptr<FrameOutput> inner, uint32_t write_interval_ms)
+  CadenceMode parse_cadence_mode(const std::string &s) {
+    if (s == "interval")  return CadenceMode::Interval;
+    if (s == "every_n")   return CadenceMode::EveryNth;
+    if (s == "timestamp") return CadenceMode::Timestamp;
+    if (s == "latest")    return CadenceMode::Latest;
+    if (s == "adaptive")  return CadenceMode::Adaptive;
+    throw std::invalid_argument("expected interval, every_n, timestamp, latest or adaptive");
+  }
+
+  const char* to_string(CadenceMode mode) {
+    switch (mode) {
+      case CadenceMode::Interval:  return "interval";
+      case CadenceMode::EveryNth:  return "every_n";
+      case CadenceMode::Timestamp: return "timestamp";
+      case CadenceMode::Latest:    return "latest";
+      case CadenceMode::Adaptive:  return "adaptive";
+    }
+    return "unknown";
+  }
+
+  CadenceGate::CadenceGate(std::unique_ptr<FrameOutput> inner, CadenceConfig cfg)
     : inner_(std::move(inner)),
-      interval_(std::chrono::milliseconds(write_interval_ms)) {
+      cfg_(cfg),
+      interval_(std::chrono::milliseconds(cfg.interval_ms)) {
+    if (cfg_.every_n == 0) cfg_.every_n = 1;
+    // the adaptive interval is 1/rate, so the rate must stay above 0
+    if (!(cfg_.min_rate_hz > 0)) {
+      logwrite("Camera::CadenceGate::CadenceGate", "NOTICE min_rate_hz must be above 0; using " +
+               std::to_string(CadenceConfig{}.min_rate_hz));
+      cfg_.min_rate_hz = CadenceConfig{}.min_rate_hz;
+    }
+  }
+
+  CadenceGate::CadenceGate(std::unique_ptr<FrameOutput> inner, uint32_t write_interval_ms)
+    : CadenceGate(std::move(inner), CadenceConfig{CadenceMode::Interval, write_interval_ms}) {
   }
 
   long CadenceGate::open() {
@@ -20,17 +54,149 @@ namespace Camera {
   }
 
   long CadenceGate::write(const char* data, size_t size, const FrameMetadata& meta) {
-    const auto now = std::chrono::steady_clock::now();
-    if (now - last_forwarded_ < interval_) {
-      n_skipped_.fetch_add(1, std::memory_order_relaxed);
-      return NO_ERROR;
-    }
-    last_forwarded_ = now;
+    if (!should_forward(meta)) return NO_ERROR;
     return inner_->write(data, size, meta);
   }
 
+  // Gate before the inner output packs the view, so skipped frames cost nothing
+  long CadenceGate::write_view(const FrameView &view, const FrameMetadata& meta) {
+    if (!should_forward(meta)) return NO_ERROR;
+    return inner_->write_view(view, meta);
+  }
+
+  long CadenceGate::write_shared(std::shared_ptr<const char[]> data, size_t size, const FrameMetadata& meta) {
+    if (!should_forward(meta)) return NO_ERROR;
+    return inner_->write_shared(std::move(data), size, meta);
+  }
+
+  bool CadenceGate::should_forward(const FrameMetadata& meta) {
+    const auto now = clock_();
+    bool forward = true;
+    seen_++;
+
+    switch (cfg_.mode) {
+      case CadenceMode::Interval:
+        // min() is never; now - min() would overflow
+        forward = last_forwarded_ == std::chrono::steady_clock::time_point::min() ||
+                  now - last_forwarded_ >= interval_;
+        if (forward) last_forwarded_ = now;
+        break;
+
+      case CadenceMode::EveryNth:
+        forward = ((seen_ - 1) % cfg_.every_n == 0);
+        break;
+
+      case CadenceMode::Timestamp: {
+        // a timestamp that goes backwards is a restarted controller clock
+        const uint64_t ticks = cfg_.interval_ms * cfg_.timestamp_hz / 1000;
+        forward = !have_timestamp_ || meta.timestamp < last_timestamp_ ||
+                  meta.timestamp - last_timestamp_ >= ticks;
+        if (forward) { last_timestamp_ = meta.timestamp; have_timestamp_ = true; }
+        break;
+      }
+
+      case CadenceMode::Latest:
+        forward = (inner_->queue_status().depth == 0);
+        break;
+
+      case CadenceMode::Adaptive:
+        adapt(now);
+        // paced by the current rate, carrying over at most one interval so
+        // the average holds when frames arrive unevenly
+        if (last_forwarded_ != std::chrono::steady_clock::time_point::min() &&
+            now < last_forwarded_ + interval_) {
+          forward = false;
+        }
+        else {
+          last_forwarded_ = std::max(last_forwarded_ + interval_, now - interval_);
+          if (last_forwarded_ > now) last_forwarded_ = now;
+        }
+        break;
+    }
+
+    if (forward) n_forwarded_.fetch_add(1, std::memory_order_relaxed);
+    else n_skipped_.fetch_add(1, std::memory_order_relaxed);
+    return forward;
+  }
+
+  /**
+   * Revises the adaptive rate once per adapt_ms. Above target_fill the
+   * rate drops below what the wrapped output drained, so its queue
+   * shrinks; below half of it the rate rises by a quarter to find out
+   * whether the output can take more. The rate stays between min_rate_hz
+   * and twice the arrival rate, and under the interval_ms floor if set.
+   */
+  void CadenceGate::adapt(std::chrono::steady_clock::time_point now) {
+    const QueueStatus status = inner_->queue_status();
+    const uint64_t forwarded = n_forwarded_.load(std::memory_order_relaxed);
+    const uint64_t gone = status.depth + status.dropped;
+    const uint64_t drained = forwarded > gone ? forwarded - gone : 0;
+
+    if (adapt_start_ == std::chrono::steady_clock::time_point{}) {
+      adapt_start_   = now;
+      adapt_drained_ = drained;
+      adapt_seen_    = seen_;
+      return;
+    }
+    const double dt = std::chrono::duration<double>(now - adapt_start_).count();
+    if (dt * 1000 < cfg_.adapt_ms) return;
+
+    const double drain_hz = (drained > adapt_drained_ ? drained - adapt_drained_ : 0) / dt;
+    arrival_hz_ = (seen_ - adapt_seen_) / dt;
+    adapt_start_   = now;
+    adapt_drained_ = drained;
+    adapt_seen_    = seen_;
+
+    double rate = rate_hz_.load(std::memory_order_relaxed);
+    if (rate <= 0) rate = arrival_hz_;                  // unlimited so far
+
+    if (status.capacity == 0) rate = arrival_hz_;       // no queue to watch, pass everything
+    else if (status.fill() > cfg_.target_fill) rate = 0.8 * drain_hz;
+    else if (status.fill() < cfg_.target_fill / 2) rate = 1.25 * std::max(rate, drain_hz);
+
+    if (cfg_.interval_ms > 0) rate = std::min(rate, 1000.0 / cfg_.interval_ms);
+    rate = std::min(rate, 2 * arrival_hz_);
+    rate = std::max(rate, cfg_.min_rate_hz);
+
+    rate_hz_.store(rate, std::memory_order_relaxed);
+    drain_hz_.store(drain_hz, std::memory_order_relaxed);
+    // however low min_rate_hz, the interval fits in int64 nanoseconds
+    interval_ = std::chrono::nanoseconds(static_cast<int64_t>(std::min(1.0e9 / rate, 1.0e18)));
+  }
+
+  CadenceGate::Stats CadenceGate::stats() const {
+    Stats s;
+    s.frames_forwarded = n_forwarded_.load();
+    s.frames_skipped   = n_skipped_.load();
+    s.rate_hz          = rate_hz_.load();
+    s.drain_hz         = drain_hz_.load();
+    return s;
+  }
+
+  OutputMetrics CadenceGate::metrics() const {
+    const Stats s = this->stats();
+    OutputMetrics m;
+    m.kind           = "cadence";
+    m.frames_in      = s.frames_forwarded + s.frames_skipped;
+    m.frames_written = s.frames_forwarded;
+    m.detail["skipped"] = s.frames_skipped;
+    if (cfg_.mode == CadenceMode::Adaptive) {
+      m.detail["rate_hz"]  = s.rate_hz;
+      m.detail["drain_hz"] = s.drain_hz;
+    }
+    return m;
+  }
+
   void CadenceGate::close() {
     inner_->close();
+    if (cfg_.mode != CadenceMode::Interval || n_skipped_.load() > 0) {
+      const Stats s = this->stats();
+      logwrite("Camera::CadenceGate::close", std::string("mode=") + to_string(cfg_.mode) +
+               " forwarded=" + std::to_string(s.frames_forwarded) +
+               " skipped=" + std::to_string(s.frames_skipped) +
+               (cfg_.mode == CadenceMode::Adaptive ? " rate=" + std::to_string(s.rate_hz) +
+                                                     "Hz drain=" + std::to_string(s.drain_hz) + "Hz" : ""));
+    }
   }
 
 }
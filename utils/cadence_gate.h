@@ -1,10 +1,19 @@
 /**
  * @file    cadence_gate.h
- * @brief   FrameOutput decorator that rate-limits frames to a wrapped output
+ * @brief   FrameOutput decorator that thins frames to a wrapped output
  *
- * Forwards a frame only when at least write_interval_ms has elapsed since the
- * last forwarded frame; otherwise the frame is dropped. Keeps the cadence
- * policy out of the concrete writers, which then just do their I/O.
+ * Decides per frame whether to forward it, by one of these modes:
+ *   interval   at least interval_ms since the last forwarded frame, by the host clock
+ *   every_n    every Nth frame
+ *   timestamp  at least interval_ms apart by the controller's frame timestamp,
+ *              so the spacing holds however late the frames reach the host
+ *   latest     only when the wrapped output has nothing queued, so it always
+ *              gets the newest frame it can take
+ *   adaptive   at a rate revised every adapt_ms from how fast the wrapped
+ *              output drains and how full its queue is, so it keeps as many
+ *              frames as it can absorb without dropping any
+ * Frames not forwarded are skipped. Keeps the cadence policy out of the
+ * concrete writers, which then just do their I/O.
  */
 #pragma once
 
@@ -13,13 +22,34 @@
 #include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
 
 namespace Camera {
 
-  /// FrameOutput that thins frames by minimum interval before delegating
+  enum class CadenceMode { Interval, EveryNth, Timestamp, Latest, Adaptive };
+
+  // "interval" | "every_n" | "timestamp" | "latest" | "adaptive"; throws std::invalid_argument
+  CadenceMode parse_cadence_mode(const std::string &s);
+  const char* to_string(CadenceMode mode);
+
+  struct CadenceConfig {
+    CadenceMode mode{CadenceMode::Interval};
+    uint32_t interval_ms{0};          ///< interval, timestamp: minimum spacing; adaptive: floor on it
+    uint32_t every_n{1};
+    uint64_t timestamp_hz{100000000}; ///< controller timestamp clock, 100 MHz for Archon
+    double   target_fill{0.5};        ///< adaptive: wrapped queue fill to hold
+    double   min_rate_hz{0.1};        ///< adaptive: never forward slower than this, above 0
+    uint32_t adapt_ms{250};           ///< adaptive: how often the rate is revised
+
+    /// false for a gate that would forward every frame
+    bool active() const { return mode != CadenceMode::Interval || interval_ms > 0; }
+  };
+
   class CadenceGate : public FrameOutput {
     public:
+      CadenceGate(std::unique_ptr<FrameOutput> inner, CadenceConfig cfg);
       CadenceGate(std::unique_ptr<FrameOutput> inner, uint32_t write_interval_ms);
       ~CadenceGate() override = default;
 
@@ -28,19 +58,51 @@ namespace Camera {
 
       long open() override;
       long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      long write_view(const FrameView &view, const FrameMetadata& meta) override;
+      long write_shared(std::shared_ptr<const char[]> data, size_t size, const FrameMetadata& meta) override;
       void close() override;
+      QueueStatus queue_status() const override { return inner_->queue_status(); }
+      FrameOutput* decorated() const override { return inner_.get(); }
+      OutputMetrics metrics() const override;
 
+      struct Stats {
+        uint64_t frames_forwarded{0};
+        uint64_t frames_skipped{0};
+        double   rate_hz{0};              ///< adaptive: current forwarding rate, 0 until first revised
+        double   drain_hz{0};             ///< adaptive: last measured drain rate of the wrapped output
+      };
+      Stats stats() const;
       uint64_t frames_skipped() const { return n_skipped_.load(); }
 
+      /// replaces the host clock the interval and adaptive modes go by, for tests
+      void set_clock(std::function<std::chrono::steady_clock::time_point()> clock) { clock_ = std::move(clock); }
+
     private:
+      bool should_forward(const FrameMetadata& meta);
+      void adapt(std::chrono::steady_clock::time_point now);
+
       std::unique_ptr<FrameOutput> inner_;
-      std::chrono::milliseconds interval_;
+      CadenceConfig cfg_;
+      std::chrono::nanoseconds interval_;
+      std::function<std::chrono::steady_clock::time_point()> clock_{&std::chrono::steady_clock::now};
 
       // Only touched on the producer thread
       std::chrono::steady_clock::time_point last_forwarded_{
           std::chrono::steady_clock::time_point::min()};
+      uint64_t last_timestamp_{0};
+      bool     have_timestamp_{false};
+      uint64_t seen_{0};
+
+      // adaptive state, producer thread only
+      std::chrono::steady_clock::time_point adapt_start_{};
+      uint64_t adapt_drained_{0};         ///< frames drained by the wrapped output at adapt_start_
+      uint64_t adapt_seen_{0};            ///< frames offered at adapt_start_
+      double   arrival_hz_{0};
 
+      std::atomic<uint64_t> n_forwarded_{0};
       std::atomic<uint64_t> n_skipped_{0};
+      std::atomic<double>   rate_hz_{0};
+      std::atomic<double>   drain_hz_{0};
   };
 
 }
@@ -0,0 +1,279 @@
+/**
+ * @file    centroider.cpp
+ * @brief   FrameOutput that measures guide-star centroids in ROI windows
+ */
+
+#include "centroider.h"
+#include "shared_memory_writer.h"
+#include "network.h"
+#include "simd.h"
+#include "common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+namespace {
+
+  constexpr float SIGMA_TO_FWHM = 2.3548200f;   // 2*sqrt(2*ln 2)
+
+  template <typename T>
+  inline float pixel_at(const Camera::FrameView &view, uint32_t x, uint32_t y) {
+    T p;
+    std::memcpy(&p, view.row(y) + static_cast<size_t>(x) * sizeof(T), sizeof(T));
+    return static_cast<float>(p);
+  }
+
+  /// median of the one-pixel border, which is the sky for a centred star
+  template <typename T>
+  float border_median(const Camera::FrameView &view) {
+    thread_local std::vector<float> border;
+    border.clear();
+    const uint32_t w = view.width, h = view.height;
+    for (uint32_t x = 0; x < w; ++x) {
+      border.push_back(pixel_at<T>(view, x, 0));
+      if (h > 1) border.push_back(pixel_at<T>(view, x, h - 1));
+    }
+    for (uint32_t y = 1; y + 1 < h; ++y) {
+      border.push_back(pixel_at<T>(view, 0, y));
+      if (w > 1) border.push_back(pixel_at<T>(view, w - 1, y));
+    }
+    auto mid = border.begin() + border.size() / 2;
+    std::nth_element(border.begin(), mid, border.end());
+    return *mid;
+  }
+
+  struct RowSums {
+    float s0{0}, sx{0}, sxx{0}, peak{0};
+  };
+
+  /// zeroth, first and second x-moments of one background-subtracted row,
+  /// with negative residuals clipped so sky noise does not bias the centroid
+  template <typename T, typename V>
+  RowSums row_moments(const char* row, uint32_t width, float bg) {
+    using Simd::f32x8;
+    const f32x8 zero{};
+    f32x8 xs = {0, 1, 2, 3, 4, 5, 6, 7};
+    f32x8 s0{}, sx{}, sxx{}, pk{};
+
+    uint32_t x = 0;
+    for (; x + Simd::LANES <= width; x += Simd::LANES, xs += 8.0f) {
+      f32x8 v = Simd::to_f32(Simd::load<V>(row + static_cast<size_t>(x) * sizeof(T))) - bg;
+      v = (v > zero) ? v : zero;
+      s0  += v;
+      sx  += v * xs;
+      sxx += v * xs * xs;
+      pk   = (v > pk) ? v : pk;
+    }
+
+    RowSums r{ Simd::hsum(s0), Simd::hsum(sx), Simd::hsum(sxx), Simd::hmax(pk) };
+    for (; x < width; ++x) {
+      T p;
+      std::memcpy(&p, row + static_cast<size_t>(x) * sizeof(T), sizeof(T));
+      const float v = std::max(static_cast<float>(p) - bg, 0.0f);
+      const float fx = static_cast<float>(x);
+      r.s0 += v; r.sx += v * fx; r.sxx += v * fx * fx;
+      r.peak = std::max(r.peak, v);
+    }
+    return r;
+  }
+
+  template <typename T, typename V>
+  Camera::CentroidResult measure(const Camera::FrameView &view) {
+    Camera::CentroidResult result;
+    result.background = border_median<T>(view);
+
+    // rows are reduced in float, the frame total in double
+    double s0 = 0, sx = 0, sxx = 0, sy = 0, syy = 0;
+    float peak = 0;
+    for (uint32_t y = 0; y < view.height; ++y) {
+      const RowSums r = row_moments<T, V>(view.row(y), view.width, result.background);
+      s0  += r.s0;
+      sx  += r.sx;
+      sxx += r.sxx;
+      sy  += static_cast<double>(r.s0) * y;
+      syy += static_cast<double>(r.s0) * y * y;
+      peak = std::max(peak, r.peak);
+    }
+    if (s0 <= 0) return result;
+
+    const double cx = sx / s0;
+    const double cy = sy / s0;
+    const double var = 0.5 * ((sxx / s0 - cx * cx) + (syy / s0 - cy * cy));
+
+    result.valid = 1;
+    result.x     = static_cast<float>(cx);
+    result.y     = static_cast<float>(cy);
+    result.flux  = static_cast<float>(s0);
+    result.peak  = peak;
+    result.fwhm  = SIGMA_TO_FWHM * static_cast<float>(std::sqrt(std::max(var, 0.0)));
+    return result;
+  }
+
+}
+
+namespace Camera {
+
+  CentroidResult measure_centroid(const FrameView &view) {
+    if (view.width == 0 || view.height == 0) return CentroidResult{};
+    if (view.bytes_per_pixel == 2) return measure<uint16_t, Simd::u16x8>(view);
+    if (view.bytes_per_pixel == 4) return measure<uint32_t, Simd::u32x8>(view);
+    return CentroidResult{};
+  }
+
+  CentroidOutput::CentroidOutput(std::shared_ptr<RoiTable> table, CentroidConfig cfg)
+    : table_(std::move(table)),
+      cfg_(std::move(cfg)) {
+  }
+
+  CentroidOutput::~CentroidOutput() {
+    this->close();
+  }
+
+  long CentroidOutput::open() {
+    const std::string function("Camera::CentroidOutput::open");
+
+    if (!cfg_.udp_group.empty()) {
+      udp_ = std::make_unique<Network::UdpSocket>(cfg_.udp_port, cfg_.udp_group);
+      if (udp_->Create() < 0) {
+        logwrite(function, "ERROR creating UDP socket for " + cfg_.udp_group +
+                 ":" + std::to_string(cfg_.udp_port));
+        udp_.reset();
+        return ERROR;
+      }
+    }
+
+    if (!cfg_.shm_segment.empty()) {
+      shm_ = std::make_unique<SharedMemoryWriter>(cfg_.shm_segment,
+                                                  table_->size() * sizeof(CentroidResult),
+                                                  cfg_.shm_num_frames);
+      if (shm_->open() != NO_ERROR) {
+        shm_.reset();
+        return ERROR;
+      }
+    }
+
+    logwrite(function, "windows=" + std::to_string(table_->size()) +
+             " budget_us=" + std::to_string(cfg_.budget_us) +
+             " udp=" + (udp_ ? cfg_.udp_group + ":" + std::to_string(cfg_.udp_port) : "no") +
+             " shm=" + (shm_ ? cfg_.shm_segment : "no"));
+    return NO_ERROR;
+  }
+
+  long CentroidOutput::write(const char* data, size_t size, const FrameMetadata& meta) {
+    const std::string function("Camera::CentroidOutput::write");
+    const auto start = std::chrono::steady_clock::now();
+    const auto budget = std::chrono::microseconds(cfg_.budget_us);
+
+    const uint64_t gen = table_->generation();
+    if (gen != generation_) {
+      windows_ = table_->snapshot();
+      generation_ = gen;
+    }
+
+    n_frames_.fetch_add(1, std::memory_order_relaxed);
+    const FrameView frame = FrameView::full(data, meta);
+    if (frame.size() > size) {
+      n_failed_.fetch_add(1, std::memory_order_relaxed);
+      return ERROR;
+    }
+
+    results_.assign(windows_.size(), CentroidResult{});
+    bool over_budget = false;
+
+    for (size_t id = 0; id < windows_.size(); ++id) {
+      const auto &w = windows_[id];
+      auto &r = results_[id];
+      r.frame_number = meta.frame_number;
+      r.timestamp    = meta.timestamp;
+      r.roi_id       = static_cast<uint32_t>(id);
+
+      if (over_budget) continue;
+      if (static_cast<uint64_t>(w.x0) + w.width  > meta.width ||
+          static_cast<uint64_t>(w.y0) + w.height > meta.height) continue;
+
+      // windows not reached within the budget are published as invalid
+      // rather than delaying the results of the ones already measured
+      if (std::chrono::steady_clock::now() - start > budget) {
+        over_budget = true;
+        continue;
+      }
+
+      const CentroidResult m = measure_centroid(frame.window(w.x0, w.y0, w.width, w.height));
+      r.valid      = m.valid;
+      r.background = m.background;
+      if (!m.valid) continue;   // no flux: x, y stay 0 rather than the window origin
+      r.x          = m.x + static_cast<float>(w.x0);
+      r.y          = m.y + static_cast<float>(w.y0);
+      r.flux       = m.flux;
+      r.peak       = m.peak;
+      r.fwhm       = m.fwhm;
+    }
+    if (over_budget) n_over_budget_.fetch_add(1, std::memory_order_relaxed);
+
+    compute_us_.record_since(start);
+    this->publish(meta);
+    if (meta.host_time_ns > 0) {
+      const uint64_t latency_ns = get_clock_time_nsec() - meta.host_time_ns;
+      latency_us_.add(static_cast<double>(latency_ns) / 1000.0);
+      latency_.record(latency_ns);
+    }
+
+    if (cfg_.report_frames > 0 && compute_us_.count() >= cfg_.report_frames) {
+      logwrite(function, compute_us_.summary("centroid compute"));
+      if (!latency_us_.empty()) logwrite(function, latency_us_.summary("frame arrival to centroid"));
+      logwrite(function, "frames over budget: " + std::to_string(n_over_budget_.load()));
+      compute_us_.clear();
+      latency_us_.clear();
+    }
+    return NO_ERROR;
+  }
+
+  OutputMetrics CentroidOutput::metrics() const {
+    OutputMetrics m;
+    m.kind           = "centroid";
+    m.frames_in      = n_frames_.load();
+    m.frames_failed  = n_failed_.load();
+    m.frames_written = m.frames_in - std::min(m.frames_in, m.frames_failed);
+    m.latency = latency_.snapshot();
+    m.detail["over_budget"] = n_over_budget_.load();
+    return m;
+  }
+
+  void CentroidOutput::publish(const FrameMetadata &meta) {
+    if (shm_) {
+      FrameMetadata m;
+      m.frame_number    = meta.frame_number;
+      m.timestamp       = meta.timestamp;
+      m.sequence_number = meta.sequence_number;
+      m.width           = static_cast<uint32_t>(results_.size());
+      m.height          = 1;
+      m.bytes_per_pixel = sizeof(CentroidResult);
+      shm_->write(reinterpret_cast<const char*>(results_.data()),
+                  results_.size() * sizeof(CentroidResult), m);
+    }
+
+    if (udp_) {
+      // CENTROID <frame> <timestamp> <id>:<x>,<y>,<flux>,<peak>,<fwhm> ...
+      std::string msg = "CENTROID " + std::to_string(meta.frame_number) +
+                        " " + std::to_string(meta.timestamp);
+      char field[96];
+      for (const auto &r : results_) {
+        if (!r.valid) continue;
+        SNPRINTF(field, " %u:%.3f,%.3f,%.1f,%.1f,%.2f", r.roi_id, r.x, r.y, r.flux, r.peak, r.fwhm);
+        msg.append(field);
+      }
+      udp_->Send(msg);
+    }
+  }
+
+  void CentroidOutput::close() {
+    if (shm_) shm_->close();
+    shm_.reset();
+    if (udp_) udp_->Close();
+    udp_.reset();
+  }
+
+}
@@ -0,0 +1,95 @@
+/**
+ * @file    centroider.h
+ * @brief   FrameOutput that measures guide-star centroids in ROI windows
+ *
+ * For every window in the shared RoiTable this computes a background-
+ * subtracted centroid, flux, peak and FWHM directly from a strided view
+ * of the frame, within a fixed per-frame time budget, and publishes the
+ * results tagged with the Archon timestamp over UDP multicast and/or a
+ * small shared memory ring.
+ */
+#pragma once
+
+#include "frame_output.h"
+#include "roi_output.h"
+#include "timing_stats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Network { class UdpSocket; }
+
+namespace Camera {
+
+  class SharedMemoryWriter;
+
+  /// One window's measurement; also the element type of the SHM result ring
+  struct CentroidResult {
+    uint64_t frame_number{0};
+    uint64_t timestamp{0};        ///< Archon buftimestamp of the frame
+    uint32_t roi_id{0};
+    uint32_t valid{0};            ///< 0 if skipped for budget, off-frame or no flux
+    float    x{0};                ///< centroid column in full-frame pixels, 0 unless valid
+    float    y{0};                ///< centroid row in full-frame pixels, 0 unless valid
+    float    flux{0};             ///< background-subtracted sum (ADU)
+    float    peak{0};             ///< background-subtracted peak (ADU)
+    float    background{0};       ///< per-pixel background (ADU)
+    float    fwhm{0};             ///< from second moments, assuming a Gaussian (pixels)
+  };
+
+  // Background is the median of the window border; x, y are window-local
+  CentroidResult measure_centroid(const FrameView &view);
+
+  struct CentroidConfig {
+    uint32_t    budget_us{200};        ///< per-frame time allowed for all windows
+    std::string udp_group;             ///< multicast group, empty to disable
+    int         udp_port{-1};
+    std::string shm_segment;           ///< result ring name, empty to disable
+    uint32_t    shm_num_frames{16};
+    uint32_t    report_frames{1000};   ///< log a latency summary every N frames
+  };
+
+  class CentroidOutput : public FrameOutput {
+    public:
+      CentroidOutput(std::shared_ptr<RoiTable> table, CentroidConfig cfg);
+      ~CentroidOutput() override;
+
+      CentroidOutput(const CentroidOutput&) = delete;
+      CentroidOutput& operator=(const CentroidOutput&) = delete;
+
+      long open() override;
+      long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      void close() override;
+
+      std::shared_ptr<RoiTable> table() const { return table_; }
+      uint64_t frames_over_budget() const { return n_over_budget_.load(); }
+      /// results of the last frame written; only valid on the producer thread
+      const std::vector<CentroidResult>& results() const { return results_; }
+      OutputMetrics metrics() const override;
+
+    private:
+      void publish(const FrameMetadata &meta);
+
+      std::shared_ptr<RoiTable> table_;
+      CentroidConfig cfg_;
+
+      std::unique_ptr<Network::UdpSocket> udp_;
+      std::unique_ptr<SharedMemoryWriter> shm_;
+
+      // Only touched on the producer thread
+      std::vector<RoiWindow> windows_;
+      uint64_t generation_{~0ULL};
+      std::vector<CentroidResult> results_;
+      Utils::TimingStats compute_us_;     ///< time spent measuring each frame
+      Utils::TimingStats latency_us_;     ///< frame arrival to results published
+
+      std::atomic<uint64_t> n_frames_{0};
+      std::atomic<uint64_t> n_failed_{0};
+      std::atomic<uint64_t> n_over_budget_{0};
+      LatencyHistogram latency_;          ///< as latency_us_, but never cleared
+  };
+
+}
@@ -0,0 +1,571 @@
+/**
+ * @file    command_server.cpp
+ * @brief   epoll-based line-command server with a small worker pool
+ */
+
+#include "command_server.h"
+#include "network.h"
+#include "output_metrics.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+  constexpr uint64_t LISTEN_KEY = 0;             ///< epoll keys; connections count up from 1
+  constexpr uint64_t WAKE_KEY   = UINT64_MAX;
+  constexpr size_t   MAX_COMMAND_NAMES = 256;    ///< further names share one entry
+
+  std::string peer_name(const struct sockaddr_in &addr) {
+    char ip[INET_ADDRSTRLEN] = "?";
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+  }
+
+}
+
+namespace Network {
+
+  struct CommandServer::Connection {
+    uint64_t    id{0};
+    int         fd{-1};
+    std::string in;                  ///< received, not yet dispatched
+    std::string out;                 ///< replies not yet sent
+    bool        busy{false};         ///< a command of this connection is running
+    bool        want_read{true};     ///< EPOLLIN armed
+    bool        want_write{false};   ///< EPOLLOUT armed
+    bool        eof{false};          ///< client shut down its side; close once answered
+  };
+
+  CommandServer::CommandServer(CommandServerConfig cfg, Handler handler)
+    : cfg_(std::move(cfg)), handler_(std::move(handler)) {
+    // a backlog must hold the longest line allowed, or that line never completes
+    cfg_.max_backlog  = std::max(cfg_.max_backlog, cfg_.max_line + 1);
+    cfg_.max_blocking = std::max(cfg_.max_blocking, 1u);
+  }
+
+  CommandServer::~CommandServer() {
+    const std::string function("Network::CommandServer::~CommandServer");
+    this->stop();
+
+    // a blocking thread takes the lock to look for more work, so join outside it
+    std::vector<std::unique_ptr<Thread>> threads;
+    threads.swap(threads_);
+    {
+      std::lock_guard lock(blocking_mtx_);
+      for (auto &b : blocking_) threads.push_back(std::move(b));
+      blocking_.clear();
+      blocking_queue_.clear();
+    }
+
+    // idle threads exit at once; commands still running get shutdown_ms,
+    // then are left to finish on their own
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(cfg_.shutdown_ms);
+    auto running = [&]() {
+      return std::any_of(threads.begin(), threads.end(), [](const auto &t) { return t->running.load(); });
+    };
+    while (running() && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    size_t left = 0;
+    {
+      std::lock_guard guard(shutdown_->mtx);
+      shutdown_->abandoned = true;
+      for (auto &t : threads) {
+        if (t->running.load()) { t->thread.detach(); ++left; }
+      }
+    }
+    for (auto &t : threads) {
+      if (t->thread.joinable()) t->thread.join();
+    }
+    if (left > 0) logwrite(function, "NOTICE left " + std::to_string(left) + " command(s) running at shutdown");
+    for (auto &[id, c] : connections_) ::close(c->fd);
+    if (listen_fd_ >= 0) ::close(listen_fd_);
+    if (epoll_fd_ >= 0) ::close(epoll_fd_);
+    if (wake_fd_ >= 0) ::close(wake_fd_);
+  }
+
+  long CommandServer::start() {
+    const std::string function("Network::CommandServer::start");
+
+    if (cfg_.port <= 0 || cfg_.workers == 0) {
+      logwrite(function, "ERROR port and workers must be > 0");
+      return ERROR;
+    }
+
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+      logwrite(function, "ERROR creating socket: " + std::string(strerror(errno)));
+      return ERROR;
+    }
+    const int on = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(static_cast<uint16_t>(cfg_.port));
+    if (::bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listen_fd_, LISTENQ) != 0) {
+      logwrite(function, "ERROR listening on port " + std::to_string(cfg_.port) + ": " + strerror(errno));
+      return ERROR;
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+      logwrite(function, "ERROR creating epoll: " + std::string(strerror(errno)));
+      return ERROR;
+    }
+    struct epoll_event ev{};
+    ev.events   = EPOLLIN;
+    ev.data.u64 = LISTEN_KEY;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+    ev.data.u64 = WAKE_KEY;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+
+    auto spawn = [this](std::deque<Job> &queue, std::condition_variable &cv) {
+      auto t = std::make_unique<Thread>();
+      t->thread = std::thread(&CommandServer::pool_loop, this, t.get(), std::ref(queue), std::ref(cv));
+      threads_.push_back(std::move(t));
+    };
+    for (unsigned i = 0; i < cfg_.workers; ++i) spawn(worker_queue_, worker_cv_);
+    spawn(executor_queue_, executor_cv_);
+
+    std::string slow;
+    for (const auto &cmd : cfg_.slow_commands) slow += " " + cmd;
+    logwrite(function, "listening on port " + std::to_string(cfg_.port) +
+             " workers=" + std::to_string(cfg_.workers) + " executor:" + slow);
+    return NO_ERROR;
+  }
+
+  void CommandServer::run() {
+    const std::string function("Network::CommandServer::run");
+    struct epoll_event events[64];
+
+    while (!stop_.load()) {
+      const int n = epoll_wait(epoll_fd_, events, 64, -1);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        logwrite(function, "ERROR epoll_wait: " + std::string(strerror(errno)));
+        break;
+      }
+      for (int i = 0; i < n; ++i) {
+        const uint64_t key = events[i].data.u64;
+        if (key == LISTEN_KEY) { this->accept_all(); continue; }
+        if (key == WAKE_KEY)   { this->collect_replies(); continue; }
+
+        auto it = connections_.find(key);
+        if (it == connections_.end()) continue;
+        Connection &c = *it->second;
+        if (events[i].events & (EPOLLHUP | EPOLLERR)) {   // nobody left to reply to
+          this->close_connection(c.id);
+          continue;
+        }
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+          if (!this->read_from(c)) continue;
+        }
+        if (events[i].events & EPOLLOUT) this->write_to(c);
+      }
+    }
+  }
+
+  void CommandServer::stop() {
+    {
+      std::lock_guard lock(queue_mtx_);
+      stop_.store(true);
+    }
+    worker_cv_.notify_all();
+    executor_cv_.notify_all();
+    if (wake_fd_ >= 0) {
+      const uint64_t one = 1;
+      (void)!::write(wake_fd_, &one, sizeof(one));
+    }
+  }
+
+  void CommandServer::accept_all() {
+    const std::string function("Network::CommandServer::accept_all");
+
+    while (true) {
+      struct sockaddr_in addr{};
+      socklen_t len = sizeof(addr);
+      const int fd = accept4(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), &len,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          logwrite(function, "ERROR accept: " + std::string(strerror(errno)));
+        }
+        return;
+      }
+      const int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+      auto c = std::make_unique<Connection>();
+      c->id = next_id_++;
+      c->fd = fd;
+      struct epoll_event ev{};
+      ev.events   = EPOLLIN | EPOLLRDHUP;
+      ev.data.u64 = c->id;
+      if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        logwrite(function, "ERROR adding connection to epoll: " + std::string(strerror(errno)));
+        ::close(fd);
+        continue;
+      }
+      {
+        std::lock_guard lock(stats_mtx_);
+        auto &s = conn_stats_[c->id];
+        s.peer = peer_name(addr);
+        s.connected_ns = get_clock_time_nsec();
+      }
+      n_accepted_.fetch_add(1, std::memory_order_relaxed);
+      connections_.emplace(c->id, std::move(c));
+    }
+  }
+
+  // false if the connection was closed
+  bool CommandServer::read_from(Connection &c) {
+    const std::string function("Network::CommandServer::read_from");
+    char buf[65536];
+    uint64_t bytes = 0;
+    bool closed = false;
+
+    while (!c.eof && c.in.size() < cfg_.max_backlog) {
+      const ssize_t n = ::recv(c.fd, buf, sizeof(buf), 0);
+      if (n > 0) { c.in.append(buf, static_cast<size_t>(n)); bytes += n; continue; }
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+      if (n == 0) c.eof = true;      // commands already sent still get their replies
+      else closed = true;            // a reset
+      break;
+    }
+    if (bytes > 0) {
+      std::lock_guard lock(stats_mtx_);
+      conn_stats_[c.id].bytes_in += bytes;
+    }
+    if (closed) {
+      this->close_connection(c.id);
+      return false;
+    }
+    if (c.in.size() > cfg_.max_line && c.in.find('\n') == std::string::npos) {
+      logwrite(function, "ERROR connection " + std::to_string(c.id) + " sent a line over " +
+               std::to_string(cfg_.max_line) + " bytes; closing");
+      this->close_connection(c.id);
+      return false;
+    }
+    this->dispatch_next(c);
+    return this->update_events(c);
+  }
+
+  // false if the connection was closed
+  bool CommandServer::write_to(Connection &c) {
+    size_t sent = 0;
+    while (sent < c.out.size()) {
+      const ssize_t n = ::send(c.fd, c.out.data() + sent, c.out.size() - sent, MSG_NOSIGNAL);
+      if (n > 0) { sent += static_cast<size_t>(n); continue; }
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+      this->close_connection(c.id);
+      return false;
+    }
+    c.out.erase(0, sent);
+    if (sent > 0) {
+      std::lock_guard lock(stats_mtx_);
+      conn_stats_[c.id].bytes_out += sent;
+    }
+    return this->update_events(c);
+  }
+
+  /**
+   * Watches for output room only while replies are waiting, and reads
+   * only while the backlog has room and the client has not shut down its
+   * side, closing the connection when nothing of it is left to run or
+   * send. false if the connection was closed.
+   */
+  bool CommandServer::update_events(Connection &c) {
+    if (c.eof && !c.busy && c.out.empty() && c.in.find('\n') == std::string::npos) {
+      this->close_connection(c.id);
+      return false;
+    }
+    const bool want_read  = !c.eof && c.in.size() < cfg_.max_backlog;
+    const bool want_write = !c.out.empty();
+    if (c.want_read == want_read && c.want_write == want_write) return true;
+    c.want_read  = want_read;
+    c.want_write = want_write;
+    uint32_t events = 0;
+    if (want_read)  events |= EPOLLIN | EPOLLRDHUP;
+    if (want_write) events |= EPOLLOUT;
+    struct epoll_event ev{};
+    ev.events   = events;
+    ev.data.u64 = c.id;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c.fd, &ev);
+    return true;
+  }
+
+  void CommandServer::dispatch_next(Connection &c) {
+    if (c.busy) return;
+    const size_t eol = c.in.find('\n');
+    if (eol == std::string::npos) return;
+
+    bool slow;
+    Job job = this->make_job(c.in.substr(0, eol), c.id, slow);
+    c.in.erase(0, eol + 1);
+
+    c.busy = true;
+    if (cfg_.blocking_commands.count(job.command) > 0) this->run_blocking(std::move(job));
+    else this->enqueue(std::move(job), slow);
+  }
+
+  void CommandServer::submit(const std::string &line, uint64_t conn_id,
+                             std::function<void()> started, Completion done) {
+    bool slow;
+    Job job = this->make_job(line, conn_id, slow);
+    job.started = std::move(started);
+    job.done    = std::move(done);
+    this->enqueue(std::move(job), slow);
+  }
+
+  CommandServer::Job CommandServer::make_job(const std::string &line, uint64_t conn_id, bool &slow) const {
+    Job job;
+    job.conn_id     = conn_id;
+    job.received_ns = get_clock_time_nsec();
+    job.line        = line;
+
+    const size_t sep = job.line.find_first_of(" \r");
+    job.command = job.line.substr(0, sep);
+    std::string args = (sep == std::string::npos) ? "" : job.line.substr(sep + 1);
+    args.erase(std::remove(args.begin(), args.end(), '\r'), args.end());
+
+    // help for a slow command is quick
+    slow = cfg_.slow_commands.count(job.command) > 0 && args != "?" && args != "help";
+    return job;
+  }
+
+  void CommandServer::enqueue(Job job, bool slow) {
+    {
+      std::lock_guard lock(queue_mtx_);
+      (slow ? executor_queue_ : worker_queue_).push_back(std::move(job));
+    }
+    (slow ? executor_cv_ : worker_cv_).notify_one();
+  }
+
+  void CommandServer::run_blocking(Job job) {
+    std::lock_guard lock(blocking_mtx_);
+    blocking_.erase(std::remove_if(blocking_.begin(), blocking_.end(), [](auto &b) {
+                      if (!b->finished.load()) return false;
+                      b->thread.join();
+                      return true;
+                    }), blocking_.end());
+
+    if (blocking_.size() >= cfg_.max_blocking) {
+      blocking_queue_.push_back(std::move(job));
+      return;
+    }
+
+    // the thread runs queued blocking commands too until there are none;
+    // finished is set under the lock so a job queued meanwhile is not missed
+    auto b = std::make_unique<Thread>();
+    Thread* self = b.get();
+    self->running.store(true);
+    b->thread = std::thread([this, self, shutdown = shutdown_, handler = handler_, job = std::move(job)]() mutable {
+      while (true) {
+        const uint64_t start = get_clock_time_nsec();
+        std::string reply = call_handler(handler, job);
+        const uint64_t end = get_clock_time_nsec();
+
+        std::lock_guard guard(shutdown->mtx);
+        if (shutdown->abandoned) return;           // the server is gone
+        this->finish_job(job, std::move(reply), start, end);
+        std::lock_guard lock(blocking_mtx_);
+        if (blocking_queue_.empty() || stop_.load()) {
+          self->running.store(false);
+          self->finished.store(true);
+          return;
+        }
+        job = std::move(blocking_queue_.front());
+        blocking_queue_.pop_front();
+      }
+    });
+    blocking_.push_back(std::move(b));
+  }
+
+  void CommandServer::collect_replies() {
+    uint64_t count;
+    (void)!::read(wake_fd_, &count, sizeof(count));
+
+    std::deque<Done> done;
+    {
+      std::lock_guard lock(done_mtx_);
+      done.swap(done_);
+    }
+    for (auto &d : done) {
+      auto it = connections_.find(d.conn_id);
+      if (it == connections_.end()) continue;     // the client went away meanwhile
+      Connection &c = *it->second;
+      c.busy = false;
+      c.out.append(d.reply);
+      this->dispatch_next(c);
+      this->write_to(c);
+    }
+  }
+
+  void CommandServer::close_connection(uint64_t id) {
+    auto it = connections_.find(id);
+    if (it == connections_.end()) return;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second->fd, nullptr);
+    ::close(it->second->fd);
+    connections_.erase(it);
+    {
+      std::lock_guard lock(stats_mtx_);
+      conn_stats_.erase(id);
+    }
+    n_closed_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // running is set under queue_mtx_, so once stop() has taken it every
+  // thread either holds a command already or never picks one up
+  void CommandServer::pool_loop(Thread* self, std::deque<Job> &queue, std::condition_variable &cv) {
+    const bool executor = (&queue == &executor_queue_);
+    const std::shared_ptr<Shutdown> shutdown = shutdown_;
+    const Handler handler = handler_;
+
+    while (true) {
+      Job job;
+      {
+        std::unique_lock lock(queue_mtx_);
+        cv.wait(lock, [&]{ return stop_.load() || !queue.empty(); });
+        if (stop_.load()) { self->finished.store(true); return; }
+        job = std::move(queue.front());
+        queue.pop_front();
+        self->running.store(true);
+        if (executor) executor_busy_.store(1);
+      }
+
+      const uint64_t start = get_clock_time_nsec();
+      std::string reply = call_handler(handler, job);
+      const uint64_t end = get_clock_time_nsec();
+
+      std::lock_guard guard(shutdown->mtx);
+      if (shutdown->abandoned) return;             // the server is gone
+      this->finish_job(job, std::move(reply), start, end);
+      if (executor) executor_busy_.store(0);
+      self->running.store(false);
+    }
+  }
+
+  std::string CommandServer::call_handler(const Handler &handler, Job &job) {
+    const std::string function("Network::CommandServer::call_handler");
+    try {
+      if (job.started) job.started();
+      return handler(job.line, job.conn_id);
+    }
+    catch (const std::exception &e) {
+      logwrite(function, "ERROR command \"" + job.line + "\" threw: " + e.what());
+      return "ERROR\n";
+    }
+  }
+
+  void CommandServer::finish_job(Job &job, std::string reply, uint64_t start, uint64_t end) {
+    const std::string function("Network::CommandServer::finish_job");
+
+    CommandStats &stats = this->command_stats(job.command);
+    stats.count.fetch_add(1, std::memory_order_relaxed);
+    stats.wait.record(start - job.received_ns);
+    stats.run.record(end - start);
+    n_commands_.fetch_add(1, std::memory_order_relaxed);
+    {
+      std::lock_guard lock(stats_mtx_);
+      auto it = conn_stats_.find(job.conn_id);
+      if (it != conn_stats_.end()) {
+        it->second.commands++;
+        it->second.last_command    = job.command;
+        it->second.last_latency_ns = end - job.received_ns;
+      }
+    }
+
+    if (job.done) {
+      try {
+        job.done(std::move(reply));
+      }
+      catch (const std::exception &e) {
+        logwrite(function, "ERROR completing \"" + job.line + "\": " + e.what());
+      }
+      return;
+    }
+    {
+      std::lock_guard lock(done_mtx_);
+      done_.push_back({ job.conn_id, std::move(reply) });
+    }
+    const uint64_t one = 1;
+    (void)!::write(wake_fd_, &one, sizeof(one));
+  }
+
+  CommandServer::CommandStats& CommandServer::command_stats(const std::string &command) {
+    std::lock_guard lock(stats_mtx_);
+    auto it = cmd_stats_.find(command);
+    if (it == cmd_stats_.end()) {
+      const std::string name = (cmd_stats_.size() < MAX_COMMAND_NAMES) ? command : "_other";
+      it = cmd_stats_.find(name);
+      if (it == cmd_stats_.end()) it = cmd_stats_.emplace(name, std::make_unique<CommandStats>()).first;
+    }
+    return *it->second;
+  }
+
+  nlohmann::json CommandServer::metrics() const {
+    nlohmann::json j;
+    const uint64_t now = get_clock_time_nsec();
+    {
+      std::lock_guard lock(stats_mtx_);
+      j["connections"] = { { "open",     conn_stats_.size() },
+                           { "accepted", n_accepted_.load() },
+                           { "closed",   n_closed_.load() },
+                           { "commands", n_commands_.load() } };
+      nlohmann::json conns = nlohmann::json::array();
+      for (const auto &[id, s] : conn_stats_) {
+        conns.push_back({ { "id",              id },
+                          { "peer",            s.peer },
+                          { "age_s",           (now - s.connected_ns) / 1.0e9 },
+                          { "commands",        s.commands },
+                          { "bytes_in",        s.bytes_in },
+                          { "bytes_out",       s.bytes_out },
+                          { "last_command",    s.last_command },
+                          { "last_latency_us", s.last_latency_ns / 1.0e3 } });
+      }
+      j["per_connection"] = conns;
+      nlohmann::json cmds = nlohmann::json::object();
+      for (const auto &[name, s] : cmd_stats_) {
+        cmds[name] = { { "count", s->count.load() },
+                       { "wait",  Camera::to_json(s->wait.snapshot()) },
+                       { "run",   Camera::to_json(s->run.snapshot()) } };
+      }
+      j["commands"] = cmds;
+    }
+    {
+      std::lock_guard lock(queue_mtx_);
+      j["queues"] = { { "workers",       worker_queue_.size() },
+                      { "worker_threads", cfg_.workers },
+                      { "executor",      executor_queue_.size() },
+                      { "executor_busy", executor_busy_.load() > 0 } };
+    }
+    {
+      std::lock_guard lock(blocking_mtx_);
+      j["queues"]["blocking"] = std::count_if(blocking_.begin(), blocking_.end(),
+                                              [](const auto &b) { return !b->finished.load(); });
+      j["queues"]["blocking_waiting"] = blocking_queue_.size();
+    }
+    return j;
+  }
+
+}
@@ -0,0 +1,194 @@
+/**
+ * @file    command_server.h
+ * @brief   epoll-based line-command server with a small worker pool
+ *
+ * One I/O thread owns the listening socket and every connection, all
+ * non-blocking under epoll, so an idle status poller costs a descriptor
+ * and a buffer rather than a thread. Each newline-terminated command goes
+ * to a small pool of worker threads or, if it is listed as slow (expose
+ * and the like), to a single executor thread that runs those in order, so
+ * a long exposure holds up neither the I/O loop nor the quick commands.
+ * A connection has one command in flight at a time; lines it sends
+ * meanwhile wait in its buffer, so replies come back in order; once
+ * max_backlog bytes are waiting the connection is not read until some
+ * have run, and TCP holds the client back. Commands
+ * that only wait on something else (e.g. for a job to finish) are listed
+ * as blocking and get a thread of their own while they wait, so they tie
+ * up neither the pool nor the executor; past max_blocking of them at once
+ * the rest queue for the next of those threads to come free.
+ *
+ * Destroying the server gives commands still running shutdown_ms to
+ * finish and then leaves them behind, detached: an exposure in progress
+ * or a wait with no limit does not hold up the exit, and such a command
+ * touches nothing of the server once its handler returns.
+ *
+ * submit() queues a command the same way without a connection, handing
+ * the reply to a callback instead; async jobs run through it so they keep
+ * the executor's one-at-a-time order with commands sent directly.
+ *
+ * Counters per connection and queue-wait and run-time histograms per
+ * command are kept for metrics().
+ */
+#pragma once
+
+#include "latency_histogram.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace Network {
+
+  struct CommandServerConfig {
+    int      port{-1};
+    unsigned workers{4};                       ///< threads running quick commands
+    std::set<std::string> slow_commands;       ///< run one at a time on the executor
+    std::set<std::string> blocking_commands;   ///< each on a thread of its own
+    unsigned max_blocking{16};                 ///< blocking-command threads at once; more wait their turn
+    unsigned shutdown_ms{2000};                ///< how long destruction waits for commands still running
+    size_t   max_line{1 << 20};                ///< longer lines close the connection
+    size_t   max_backlog{4 << 20};             ///< received bytes held per connection before it is no longer read
+  };
+
+  class CommandServer {
+    public:
+      /**
+       * Runs one command line, without its newline, for connection conn_id
+       * and returns the reply to send, empty for none. Called from the
+       * worker and executor threads, several at once.
+       */
+      using Handler = std::function<std::string(const std::string &line, uint64_t conn_id)>;
+
+      /// called with the reply of a submitted command, on the thread that ran it
+      using Completion = std::function<void(std::string reply)>;
+
+      CommandServer(CommandServerConfig cfg, Handler handler);
+      ~CommandServer();
+
+      CommandServer(const CommandServer&) = delete;
+      CommandServer& operator=(const CommandServer&) = delete;
+
+      /// binds and listens on the port and starts the threads; ERROR if it cannot
+      long start();
+
+      /// runs the I/O loop on the calling thread until stop()
+      void run();
+
+      void stop();
+
+      /**
+       * Queues line as though received on conn_id, to the executor if it is
+       * a slow command, and calls started() when it is picked up and done()
+       * with its reply. Returns at once.
+       */
+      void submit(const std::string &line, uint64_t conn_id,
+                  std::function<void()> started, Completion done);
+
+      /// {"connections": {...}, "per_connection": [...], "commands": {...}, "queues": {...}}
+      nlohmann::json metrics() const;
+
+    private:
+      struct Connection;
+      struct Job {
+        uint64_t    conn_id{0};
+        std::string line;
+        std::string command;
+        uint64_t    received_ns{0};
+        std::function<void()> started;           ///< set by submit()
+        Completion  done;                        ///< set by submit(); replaces the connection reply
+      };
+      struct Done {
+        uint64_t    conn_id{0};
+        std::string reply;
+      };
+      struct CommandStats {
+        std::atomic<uint64_t> count{0};
+        Camera::LatencyHistogram wait;           ///< line received to picked up
+        Camera::LatencyHistogram run;            ///< picked up to reply ready
+      };
+      struct ConnectionStats {
+        std::string peer;
+        uint64_t connected_ns{0};
+        uint64_t commands{0};
+        uint64_t bytes_in{0};
+        uint64_t bytes_out{0};
+        std::string last_command;
+        uint64_t last_latency_ns{0};
+      };
+
+      void accept_all();
+      bool read_from(Connection &c);
+      bool write_to(Connection &c);
+      void dispatch_next(Connection &c);
+      void collect_replies();
+      void close_connection(uint64_t id);
+      bool update_events(Connection &c);
+
+      Job make_job(const std::string &line, uint64_t conn_id, bool &slow) const;
+      void enqueue(Job job, bool slow);
+      struct Thread {
+        std::thread thread;
+        std::atomic<bool> running{false};        ///< has a command, from pick-up until its reply is handed on
+        std::atomic<bool> finished{false};       ///< returned, or about to
+      };
+      /// who may still touch the server: a thread left running at destruction checks under mtx
+      struct Shutdown {
+        std::mutex mtx;
+        bool abandoned{false};
+      };
+
+      static std::string call_handler(const Handler &handler, Job &job);
+      void finish_job(Job &job, std::string reply, uint64_t start, uint64_t end);
+      void run_blocking(Job job);
+      void pool_loop(Thread* self, std::deque<Job> &queue, std::condition_variable &cv);
+      CommandStats& command_stats(const std::string &command);
+
+      CommandServerConfig cfg_;
+      Handler handler_;
+
+      int listen_fd_{-1};
+      int epoll_fd_{-1};
+      int wake_fd_{-1};                          ///< eventfd: replies ready or stopping
+      std::atomic<bool> stop_{false};
+
+      // the I/O thread's alone
+      std::map<uint64_t, std::unique_ptr<Connection>> connections_;
+      uint64_t next_id_{1};
+
+      mutable std::mutex queue_mtx_;
+      std::condition_variable worker_cv_;
+      std::condition_variable executor_cv_;
+      std::deque<Job> worker_queue_;
+      std::deque<Job> executor_queue_;
+      std::vector<std::unique_ptr<Thread>> threads_;
+      std::atomic<int> executor_busy_{0};
+
+      mutable std::mutex blocking_mtx_;
+      std::vector<std::unique_ptr<Thread>> blocking_;
+      std::deque<Job> blocking_queue_;           ///< blocking commands past max_blocking
+
+      std::mutex done_mtx_;
+      std::deque<Done> done_;
+
+      mutable std::mutex stats_mtx_;
+      std::map<uint64_t, ConnectionStats> conn_stats_;
+      std::map<std::string, std::unique_ptr<CommandStats>> cmd_stats_;
+      std::atomic<uint64_t> n_accepted_{0};
+      std::atomic<uint64_t> n_closed_{0};
+      std::atomic<uint64_t> n_commands_{0};
+
+      std::shared_ptr<Shutdown> shutdown_{std::make_shared<Shutdown>()};
+  };
+
+}
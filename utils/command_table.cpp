@@ -0,0 +1,119 @@
+/**
+ * @file    command_table.cpp
+ * @brief   hash table of command handlers with per-command call statistics
+ */
+
+#include "command_table.h"
+#include "output_metrics.h"
+#include "common.h"
+
+#include <algorithm>
+#include <map>
+
+namespace Network {
+
+  void CommandTable::add(const std::string &name, Handler handler, unsigned flags,
+                         const std::string &syntax) {
+    auto entry = std::make_unique<Entry>();
+    entry->name    = name;
+    entry->syntax  = syntax.empty() ? name : syntax;
+    entry->flags   = flags;
+    entry->handler = std::move(handler);
+    entries_[name] = std::move(entry);
+  }
+
+  CommandTable::Entry* CommandTable::find(const std::string &name) const {
+    auto it = entries_.find(name);
+    return (it == entries_.end()) ? nullptr : it->second.get();
+  }
+
+  long CommandTable::call(Entry &entry, const std::string &args, std::string &retstring, uint64_t conn_id) {
+    const uint64_t start = get_clock_time_nsec();
+    const long ret = entry.handler(args, retstring, conn_id);
+    entry.latency.record(get_clock_time_nsec() - start);
+    entry.calls.fetch_add(1, std::memory_order_relaxed);
+    if (ret == ERROR) entry.errors.fetch_add(1, std::memory_order_relaxed);
+    return ret;
+  }
+
+  void CommandTable::set_override(Claims claims, Override handler) {
+    claims_   = std::move(claims);
+    override_ = std::move(handler);
+  }
+
+  std::string CommandTable::dispatch(const std::string &line, uint64_t conn_id) {
+    const std::string function("Network::CommandTable::dispatch");
+
+    // remove any trailing carriage return
+    //
+    std::string sbuf(line);
+    sbuf.erase(std::remove(sbuf.begin(), sbuf.end(), '\r'), sbuf.end());
+
+    const size_t sep = sbuf.find_first_of(' ');    // separates command from argument list
+    const std::string cmd = sbuf.substr(0, sep);
+    if (cmd.empty()) return "\n";
+    const std::string args = (sep == std::string::npos) ? "" : sbuf.substr(sep + 1);
+
+    const bool claimed = claims_ && claims_(cmd);
+    Entry* entry = claimed ? nullptr : this->find(cmd);
+    const bool quiet = (entry && entry->quiet());
+
+    const std::string num = std::to_string(++num_);
+    if (!quiet) logwrite(function, "connection "+std::to_string(conn_id)+" ("+num+") : "+cmd+" "+args);
+
+    std::string retstring;
+    long ret;
+    if (claimed) ret = override_(cmd, args, retstring, conn_id);
+    else
+    if (entry) ret = this->call(*entry, args, retstring, conn_id);
+    else {
+      unknown_.fetch_add(1, std::memory_order_relaxed);
+      logwrite(function, "ERROR unknown command: "+cmd);
+      ret = ERROR;
+    }
+
+    // HELP and JSON replies go as they are and are not logged, NOTHING has
+    // no reply, and anything else ends DONE or ERROR
+    //
+    if (ret == NOTHING) return "";
+    if (ret != HELP && ret != JSON) {
+      if (!retstring.empty()) retstring.append(" ");
+      retstring.append(ret == NO_ERROR ? "DONE\n" : "ERROR\n");
+    }
+    if (!quiet && ret == JSON) logwrite(function, "command ("+num+") reply with JSON message");
+    else
+    if (!quiet && ret != HELP) logwrite(function, "command ("+num+") reply: "+retstring);
+
+    return retstring;
+  }
+
+  std::set<std::string> CommandTable::with_flags(unsigned flags) const {
+    std::set<std::string> names;
+    for (const auto &[name, entry] : entries_) {
+      if (entry->flags & flags) names.insert(name);
+    }
+    return names;
+  }
+
+  std::vector<std::string> CommandTable::syntax() const {
+    std::map<std::string, const Entry*> sorted;
+    for (const auto &[name, entry] : entries_) sorted[name] = entry.get();
+    std::vector<std::string> lines;
+    lines.reserve(sorted.size());
+    for (const auto &[name, entry] : sorted) lines.push_back(entry->syntax);
+    return lines;
+  }
+
+  nlohmann::json CommandTable::stats() const {
+    nlohmann::json j = nlohmann::json::object();
+    for (const auto &[name, entry] : entries_) {
+      const uint64_t calls = entry->calls.load();
+      if (calls == 0) continue;
+      j[name] = { { "calls",   calls },
+                  { "errors",  entry->errors.load() },
+                  { "latency", Camera::to_json(entry->latency.snapshot()) } };
+    }
+    return j;
+  }
+
+}
@@ -0,0 +1,112 @@
+/**
+ * @file    command_table.h
+ * @brief   hash table of command handlers with per-command call statistics
+ *
+ * Maps each command name to its handler, syntax line and flags, so a
+ * daemon finds the handler for a line with one hash lookup instead of
+ * comparing the name against every command it knows. The flags say how
+ * a command is to be run: SLOW and BLOCKING feed the CommandServer's
+ * executor and blocking lists, and QUIET commands (status polls, sent
+ * many times a second) are not logged on every call. Each entry counts
+ * its calls and errors and keeps a histogram of the time its handler
+ * took, for a stats command.
+ *
+ * dispatch() runs a whole command line the way every daemon answers one:
+ * the reply ends DONE or ERROR, and line and reply are logged unless the
+ * command is quiet. Names an override claims (help, an instrument's own
+ * commands) go to it ahead of the table.
+ *
+ * Commands are added before serving starts; lookups and calls are then
+ * safe from any number of threads at once, without a lock.
+ */
+#pragma once
+
+#include "latency_histogram.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace Network {
+
+  enum CommandFlags : unsigned {
+    CMD_NONE     = 0,
+    CMD_SLOW     = 1 << 0,      ///< run one at a time on the executor, e.g. expose
+    CMD_BLOCKING = 1 << 1,      ///< only waits on something else; gets a thread of its own
+    CMD_QUIET    = 1 << 2       ///< polled often; neither the command nor its reply is logged
+  };
+
+  class CommandTable {
+    public:
+      /// returns ERROR, NO_ERROR, HELP, JSON or NOTHING, as the daemon's commands do
+      using Handler = std::function<long(const std::string &args, std::string &retstring, uint64_t conn_id)>;
+
+      /// claims command names ahead of the table, and runs those it claims
+      using Claims   = std::function<bool(const std::string &name)>;
+      using Override = std::function<long(const std::string &name, const std::string &args,
+                                          std::string &retstring, uint64_t conn_id)>;
+
+      struct Entry {
+        std::string name;
+        std::string syntax;                 ///< one line for the help listing
+        unsigned    flags{CMD_NONE};
+        Handler     handler;
+
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> errors{0};
+        Camera::LatencyHistogram latency;   ///< time in the handler
+
+        bool quiet() const { return flags & CMD_QUIET; }
+      };
+
+      /// adds name, or replaces the command of that name; syntax defaults to name
+      void add(const std::string &name, Handler handler, unsigned flags = CMD_NONE,
+               const std::string &syntax = "");
+
+      /// nullptr if there is no such command
+      Entry* find(const std::string &name) const;
+
+      /// runs the entry's handler and records the call
+      long call(Entry &entry, const std::string &args, std::string &retstring, uint64_t conn_id);
+
+      void set_override(Claims claims, Override handler);
+
+      /**
+       * Runs one command line, without its newline: the first word names the
+       * command and the rest are its args. The reply is the handler's with
+       * " DONE\n" or " ERROR\n" appended, as is except for HELP and JSON, and
+       * empty for NOTHING; an empty line is answered with a bare newline so
+       * the client does not time out. Unknown commands are counted and are
+       * an ERROR.
+       */
+      std::string dispatch(const std::string &line, uint64_t conn_id);
+
+      /// lines whose command was neither claimed nor in the table
+      uint64_t unknown() const { return unknown_.load(); }
+
+      /// names of the commands with any of flags set
+      std::set<std::string> with_flags(unsigned flags) const;
+
+      /// one syntax line per command, in name order
+      std::vector<std::string> syntax() const;
+
+      /// {"<name>": {"calls", "errors", "latency": {...}}, ...} for commands called at least once
+      nlohmann::json stats() const;
+
+    private:
+      std::unordered_map<std::string, std::unique_ptr<Entry>> entries_;
+      Claims   claims_;
+      Override override_;
+
+      std::atomic<uint64_t> num_{0};        ///< numbers each line in the log
+      std::atomic<uint64_t> unknown_{0};
+  };
+
+}
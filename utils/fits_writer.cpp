@@ -2,25 +2,309 @@
  * @file    fits_writer.cpp
  * @brief   FrameOutput implementation that writes FITS files asynchronously
  *
- * Producer enqueues from the readout thread; a dedicated worker thread
- * drains the queue and writes one FITS file per frame via CCfits.
+ * Producer enqueues from the readout thread; a pool of worker threads
+ * drains the queue and writes one FITS file per frame with cfitsio,
+ * directly from the queued buffer.
  */
 
 #include "fits_writer.h"
+#include "raw_recorder.h"
 #include "common.h"
 #include "utilities.h"
 
-#include <CCfits/CCfits>
+#include <fitsio.h>
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
+#include <functional>
 #include <stdexcept>
 #include <utility>
-#include <valarray>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+  using Camera::FitsCompression;
+
+  int compression_type(FitsCompression c) {
+    switch (c) {
+      case FitsCompression::Rice:      return RICE_1;
+      case FitsCompression::Gzip1:     return GZIP_1;
+      case FitsCompression::Gzip2:     return GZIP_2;
+      case FitsCompression::Hcompress: return HCOMPRESS_1;
+      default:                         return NOCOMPRESS;
+    }
+  }
+
+  std::string to_string(FitsCompression c) {
+    switch (c) {
+      case FitsCompression::Rice:      return "rice";
+      case FitsCompression::Gzip1:     return "gzip";
+      case FitsCompression::Gzip2:     return "gzip2";
+      case FitsCompression::Hcompress: return "hcompress";
+      default:                         return "none";
+    }
+  }
+
+  struct ImageType {
+    int bitpix;
+    int datatype;
+  };
+
+  // I32 samples are already offset by 2^31, so they are stored as they are
+  // under BZERO (see write_i32_scaling) rather than converted by cfitsio
+  ImageType image_type(Camera::PixelFormat format) {
+    switch (format) {
+      case Camera::PixelFormat::U16: return { USHORT_IMG, TUSHORT };
+      case Camera::PixelFormat::F32: return { FLOAT_IMG,  TFLOAT  };
+      case Camera::PixelFormat::I32: return { LONG_IMG,   TINT    };
+      default:                       return { ULONG_IMG,  TUINT   };
+    }
+  }
+
+  std::string fits_error_text(int status) {
+    char text[FLEN_STATUS];
+    fits_get_errstatus(status, text);
+    return text;
+  }
+
+  /**
+   * Creates name(0), or name(1), name(2)... if it exists. cfitsio refuses
+   * to create over an existing file, which also keeps concurrent workers
+   * from claiming the same name. nullptr with status set on failure.
+   */
+  fitsfile* create_unique(const std::function<std::string(int)> &name, std::string &filename, int &status) {
+    fitsfile* fptr = nullptr;
+    for (int suffix = 0; ; ++suffix) {
+      filename = name(suffix);
+      status = 0;
+      if (fits_create_file(&fptr, filename.c_str(), &status) == 0) return fptr;
+      std::error_code ec;
+      if (status != FILE_NOT_CREATED || !std::filesystem::exists(filename, ec)) return nullptr;
+    }
+  }
+
+  void write_i32_scaling(fitsfile* fptr, int &status) {
+    fits_write_key_dbl(fptr, "BZERO", 2147483648.0, -10, "offset data range to that of unsigned long", &status);
+    fits_write_key_dbl(fptr, "BSCALE", 1.0, -10, "default scaling factor", &status);
+    fits_set_hdustruc(fptr, &status);
+    fits_set_bscale(fptr, 1.0, 0.0, &status);
+  }
+
+  // Reserves disk blocks without changing the file size, so cfitsio's
+  // appends land in extents allocated up front
+  void preallocate_file(const std::string &filename, uint64_t bytes) {
+    const int fd = ::open(filename.c_str(), O_WRONLY);
+    if (fd < 0) return;
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(bytes)) != 0) {
+      logwrite("Camera::FitsWriter::preallocate_file", "NOTICE fallocate not supported for " + filename);
+    }
+    ::close(fd);
+  }
+
+  // Frees whatever preallocated space the file did not use
+  void release_preallocation(const std::string &filename) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(filename, ec);
+    if (!ec) ::truncate(filename.c_str(), static_cast<off_t>(size));
+  }
+
+  // hash, if not empty, is the frame's content hash
+  void write_frame_keys(fitsfile* fptr, const Camera::FrameMetadata &meta, const std::string &hash, int &status) {
+    fits_write_key_lng(fptr, "FRAMENO", static_cast<LONGLONG>(meta.frame_number),
+                       "Frame number", &status);
+    fits_write_key_lng(fptr, "TIMESTMP", static_cast<LONGLONG>(meta.timestamp),
+                       "Archon timestamp (0.01 us units)", &status);
+    fits_write_key_str(fptr, "DATE", get_timestamp().c_str(), "FITS file write time", &status);
+    if (!hash.empty()) {
+      fits_write_key_str(fptr, "FRAMEHSH", hash.c_str(), "XXH64 tree hash of frame as received", &status);
+    }
+  }
+
+  // Written before the data, so filling them in never moves the data unit
+  void write_checksum_keys(fitsfile* fptr, int &status) {
+    fits_write_key_str(fptr, "CHECKSUM", "0000000000000000", "HDU checksum", &status);
+    fits_write_key_str(fptr, "DATASUM", "0", "data unit checksum", &status);
+  }
+
+  /**
+   * Sets DATASUM to a sum already taken from memory and CHECKSUM so the
+   * whole HDU sums to -0, as fits_write_chksum does but without reading the
+   * data unit back. The header sum comes from the cards themselves: each
+   * is a whole number of words, so only how many blank cards fill the
+   * header matters, not where cfitsio put the END card among them.
+   */
+  void write_checksum(fitsfile* fptr, uint32_t datasum, int &status) {
+    char text[FLEN_VALUE];
+    std::snprintf(text, sizeof(text), "%u", datasum);
+    fits_modify_key_str(fptr, "DATASUM", text, "&", &status);
+    fits_modify_key_str(fptr, "CHECKSUM", "0000000000000000", "&", &status);
+    fits_set_hdustruc(fptr, &status);       // PCOUNT and END as they will be closed
+
+    int nkeys = 0, morekeys = 0;
+    LONGLONG headstart = 0, datastart = 0, dataend = 0;
+    fits_get_hdrspace(fptr, &nkeys, &morekeys, &status);
+    fits_get_hduaddrll(fptr, &headstart, &datastart, &dataend, &status);
+    if (status != 0) return;
+
+    std::string header;
+    header.reserve(static_cast<size_t>(datastart - headstart));
+    char card[FLEN_CARD];
+    for (int k = 1; k <= nkeys && status == 0; ++k) {
+      fits_read_record(fptr, k, card, &status);
+      header.append(card).resize(static_cast<size_t>(k) * 80, ' ');
+    }
+    header.append("END").resize(static_cast<size_t>(datastart - headstart), ' ');
+
+    char ascii[FLEN_VALUE];
+    fits_encode_chksum(Camera::fits_sum_add(Camera::fits_sum_bytes(header.data(), header.size()), datasum),
+                       TRUE, ascii);
+    fits_modify_key_str(fptr, "CHECKSUM", ascii, "&", &status);
+  }
+
+  /**
+   * Creates the tiled-image table extension fpack produces for
+   * Rice-compressed tiles, so funpack and cfitsio read it back as the
+   * original image; write_rice_tiles() fills it. The file must already
+   * have a primary HDU.
+   */
+  void create_rice_table(fitsfile* fptr, const Camera::FrameMetadata &meta, const long tile[2],
+                         size_t ntiles, int &status) {
+    const Camera::PixelFormat format = Camera::pixel_format_of(meta);
+    const int bytepix = (format == Camera::PixelFormat::U16) ? 2 : 4;
+
+    char ttype[] = "COMPRESSED_DATA";
+    char tform[] = "1PB";
+    char* ttypes[] = { ttype };
+    char* tforms[] = { tform };
+    fits_create_tbl(fptr, BINARY_TBL, static_cast<LONGLONG>(ntiles), 1, ttypes, tforms,
+                    nullptr, "COMPRESSED_IMAGE", &status);
+
+    fits_write_key_log(fptr, "ZIMAGE", 1, "extension contains compressed image", &status);
+    fits_write_key_lng(fptr, "ZBITPIX", bytepix * 8, "data type of original image", &status);
+    fits_write_key_lng(fptr, "ZNAXIS", 2, "dimension of original image", &status);
+    fits_write_key_lng(fptr, "ZNAXIS1", meta.width, "length of original image axis", &status);
+    fits_write_key_lng(fptr, "ZNAXIS2", meta.height, "length of original image axis", &status);
+    fits_write_key_lng(fptr, "ZTILE1", tile[0], "size of tiles to be compressed", &status);
+    fits_write_key_lng(fptr, "ZTILE2", tile[1], "size of tiles to be compressed", &status);
+    fits_write_key_str(fptr, "ZCMPTYPE", "RICE_1", "compression algorithm", &status);
+    fits_write_key_str(fptr, "ZNAME1", "BLOCKSIZE", "compression block size", &status);
+    fits_write_key_lng(fptr, "ZVAL1", Camera::RICE_BLOCKSIZE, "pixels per block", &status);
+    fits_write_key_str(fptr, "ZNAME2", "BYTEPIX", "bytes per pixel (1, 2, 4, or 8)", &status);
+    fits_write_key_lng(fptr, "ZVAL2", bytepix, "bytes per pixel (1, 2, 4, or 8)", &status);
+    fits_write_key_dbl(fptr, "BZERO", (bytepix == 2) ? 32768.0 : 2147483648.0, -10,
+                       "offset data range to that of unsigned", &status);
+    fits_write_key_dbl(fptr, "BSCALE", 1.0, -10, "default scaling factor", &status);
+  }
+
+  void write_rice_tiles(fitsfile* fptr, const std::vector<Camera::TileCompressor::Tile> &tiles, int &status) {
+    for (size_t t = 0; t < tiles.size() && status == 0; ++t) {
+      fits_write_col(fptr, TBYTE, 1, static_cast<LONGLONG>(t + 1), 1,
+                     static_cast<LONGLONG>(tiles[t].size()),
+                     const_cast<unsigned char*>(tiles[t].data()), &status);
+    }
+  }
+
+  /**
+   * DATASUM of the tile table: a (length, heap offset) pair of big-endian
+   * words per tile, then the heap, which starts right after the rows. The
+   * descriptors are read back from cfitsio rather than assumed. Also sets
+   * TFORM1 to the 1PB(maxlen) form cfitsio gives it on closing the HDU,
+   * which would otherwise change the header after CHECKSUM was computed.
+   */
+  uint32_t rice_table_datasum(fitsfile* fptr, const std::vector<Camera::TileCompressor::Tile> &tiles, int &status) {
+    const uint64_t heap = 8 * static_cast<uint64_t>(tiles.size());
+    std::vector<uint32_t> rows;
+    rows.reserve(2 * tiles.size());
+    uint32_t sum = 0;
+    LONGLONG maxlen = 0;
+    for (size_t t = 0; t < tiles.size() && status == 0; ++t) {
+      LONGLONG length = 0, offset = 0;
+      fits_read_descriptll(fptr, 1, static_cast<LONGLONG>(t + 1), &length, &offset, &status);
+      rows.push_back(__builtin_bswap32(static_cast<uint32_t>(length)));
+      rows.push_back(__builtin_bswap32(static_cast<uint32_t>(offset)));
+      maxlen = std::max(maxlen, length);
+      sum = Camera::fits_sum_add(sum, Camera::fits_sum_shift(Camera::fits_sum_bytes(tiles[t].data(), tiles[t].size()),
+                                                             heap + static_cast<uint64_t>(offset)));
+    }
+    const std::string tform = "1PB(" + std::to_string(maxlen) + ")";
+    fits_modify_key_str(fptr, "TFORM1", tform.c_str(), "&", &status);
+    return Camera::fits_sum_add(sum, Camera::fits_sum_bytes(rows.data(), rows.size() * sizeof(uint32_t)));
+  }
+
+  /**
+   * Appends one frame as an image HDU: the primary HDU of an empty file,
+   * else an extension. tiles, if given, are the frame already Rice coded;
+   * otherwise cfitsio applies cfg.compression itself, and it is cfitsio
+   * that checksums what it compressed.
+   */
+  void write_image_hdu(fitsfile* fptr, const Camera::FitsWriterConfig &cfg, const char* data,
+                       const Camera::FrameMetadata &meta, const Camera::FrameDigest &digest, const long tile[2],
+                       const std::vector<Camera::TileCompressor::Tile>* tiles, int &status) {
+    const std::string hash = cfg.content_hash ? Camera::hash_to_hex(digest.hash) : "";
+    if (tiles) {
+      create_rice_table(fptr, meta, tile, tiles->size(), status);
+      write_frame_keys(fptr, meta, hash, status);
+      if (cfg.checksum) write_checksum_keys(fptr, status);
+      write_rice_tiles(fptr, *tiles, status);
+      if (cfg.checksum) write_checksum(fptr, rice_table_datasum(fptr, *tiles, status), status);
+      return;
+    }
+
+    const Camera::PixelFormat format = Camera::pixel_format_of(meta);
+    const ImageType type = image_type(format);
+    long axes[2] = { static_cast<long>(meta.width),
+                     static_cast<long>(meta.height) };
+
+    if (cfg.compression != FitsCompression::None) {
+      fits_set_compression_type(fptr, compression_type(cfg.compression), &status);
+      fits_set_tile_dim(fptr, 2, const_cast<long*>(tile), &status);
+      if (format == Camera::PixelFormat::F32) fits_set_quantize_level(fptr, cfg.quantize_level, &status);
+    }
+    const bool own_checksum = cfg.checksum && cfg.compression == FitsCompression::None;
+    fits_create_img(fptr, type.bitpix, 2, axes, &status);
+    write_frame_keys(fptr, meta, hash, status);
+    if (format == Camera::PixelFormat::I32) write_i32_scaling(fptr, status);
+    if (own_checksum) write_checksum_keys(fptr, status);
+    fits_write_img(fptr, type.datatype, 1, static_cast<LONGLONG>(meta.width) * meta.height,
+                   const_cast<char*>(data), &status);
+    if (own_checksum) write_checksum(fptr, digest.datasum, status);
+    else if (cfg.checksum) fits_write_chksum(fptr, &status);
+  }
+
+  // the primary HDU in front of extensions, with no data
+  void create_empty_primary(fitsfile* fptr, bool checksum, int &status) {
+    fits_create_img(fptr, SHORT_IMG, 0, nullptr, &status);
+    if (checksum) {
+      write_checksum_keys(fptr, status);
+      write_checksum(fptr, 0, status);
+    }
+  }
+
+}
 
 namespace Camera {
 
+  FitsCompression parse_fits_compression(const std::string &s) {
+    if (s == "none")      return FitsCompression::None;
+    if (s == "rice")      return FitsCompression::Rice;
+    if (s == "gzip")      return FitsCompression::Gzip1;
+    if (s == "gzip2")     return FitsCompression::Gzip2;
+    if (s == "hcompress") return FitsCompression::Hcompress;
+    throw std::invalid_argument("expected none|rice|gzip|gzip2|hcompress");
+  }
+
+  FitsContainer parse_fits_container(const std::string &s) {
+    if (s == "file") return FitsContainer::File;
+    if (s == "cube") return FitsContainer::Cube;
+    if (s == "mef")  return FitsContainer::Mef;
+    throw std::invalid_argument("expected file|cube|mef");
+  }
+
   FitsWriter::FitsWriter(FitsWriterConfig cfg)
-    : cfg_(std::move(cfg)) {
+    : cfg_(std::move(cfg)), container_(std::make_unique<Container>()) {
   }
 
   FitsWriter::~FitsWriter() {
@@ -36,8 +320,8 @@ namespace Camera {
       return ERROR;
     }
 
-    if (cfg_.queue_size == 0) {
-      logwrite(function, "ERROR queue_size must be > 0");
+    if (cfg_.queue_size == 0 || cfg_.workers == 0) {
+      logwrite(function, "ERROR queue_size and workers must be > 0");
       started_.store(false);
       return ERROR;
     }
@@ -49,19 +333,70 @@ namespace Camera {
       return ERROR;
     }
 
+    if (cfg_.workers > 1 && !fits_is_reentrant()) {
+      logwrite(function, "WARNING cfitsio is not built reentrant; using one worker");
+      cfg_.workers = 1;
+    }
+
+    // cfitsio cannot shrink a compressed cube that ends early
+    if (cfg_.container == FitsContainer::Cube && cfg_.compression != FitsCompression::None) {
+      logwrite(function, "NOTICE compressed frames go in MEF containers rather than a cube");
+      cfg_.container = FitsContainer::Mef;
+    }
+    if (cfg_.container == FitsContainer::Cube && cfg_.frames_per_file == 0 && cfg_.bytes_per_file == 0) {
+      logwrite(function, "ERROR a cube needs a frames or bytes per file limit");
+      started_.store(false);
+      return ERROR;
+    }
+
+    // the journal's buffers are sized once, for every frame it may take
+    if (cfg_.overflow == OverflowPolicy::Spill && cfg_.max_frame_bytes == 0) {
+      logwrite(function, "ERROR overflow=spill needs max_frame_bytes");
+      started_.store(false);
+      return ERROR;
+    }
+
+    if (cfg_.container != FitsContainer::File && !index_) {
+      const std::string index_file = cfg_.output_dir + "/" + cfg_.basename + ".index";
+      index_ = std::fopen(index_file.c_str(), "a");
+      if (!index_) {
+        logwrite(function, "ERROR opening frame index " + index_file);
+        started_.store(false);
+        return ERROR;
+      }
+      if (std::ftell(index_) == 0) {
+        std::fputs(cfg_.content_hash ? "# frame timestamp host_time_ns file slice_or_hdu hash\n"
+                                     : "# frame timestamp host_time_ns file slice_or_hdu\n", index_);
+      }
+    }
+
+    if (cfg_.compression == FitsCompression::Rice && !compressor_) {
+      compressor_ = std::make_unique<TileCompressor>(cfg_.compress_threads);
+    }
+
     stop_.store(false);
-    worker_ = std::thread(&FitsWriter::worker_loop, this);
+    dequeued_ = 0;
+    next_append_ = 0;
+    worker_stats_.assign(cfg_.workers, WorkerStats{});
+    for (uint32_t i = 0; i < cfg_.workers; ++i) {
+      workers_.emplace_back(&FitsWriter::worker_loop, this, i);
+    }
 
     logwrite(function, "started: dir=" + cfg_.output_dir +
              " basename=" + cfg_.basename +
-             " queue_size=" + std::to_string(cfg_.queue_size));
+             " queue_size=" + std::to_string(cfg_.queue_size) +
+             " workers=" + std::to_string(cfg_.workers) +
+             " overflow=" + to_string(cfg_.overflow) +
+             " compression=" + ::to_string(cfg_.compression) +
+             " checksum=" + (cfg_.checksum ? "on" : "off") +
+             " hash=" + (cfg_.content_hash ? "on" : "off") +
+             " container=" + (cfg_.container == FitsContainer::Cube ? "cube" :
+                              cfg_.container == FitsContainer::Mef  ? "mef"  : "file"));
     return NO_ERROR;
   }
 
-  long FitsWriter::write(const char* data, size_t size, const FrameMetadata& meta) {
-    const std::string function("Camera::FitsWriter::write");
-
-    if (!started_.load()) return ERROR;
+  long FitsWriter::check_frame(size_t size, const FrameMetadata& meta) const {
+    const std::string function("Camera::FitsWriter::check_frame");
 
     if (meta.width == 0 || meta.height == 0) {
       logwrite(function, "ERROR invalid frame geometry");
@@ -69,7 +404,11 @@ namespace Camera {
     }
     if (meta.bytes_per_pixel != 2 && meta.bytes_per_pixel != 4) {
       logwrite(function, "ERROR unsupported bytes_per_pixel=" +
-               std::to_string(meta.bytes_per_pixel));
+               std::to_string(meta.bytes_per_pixel) + "; FITS output takes 2 or 4");
+      return ERROR;
+    }
+    if (meta.big_endian) {
+      logwrite(function, "ERROR FITS output takes native-order samples");
       return ERROR;
     }
     const size_t expected_bytes =
@@ -79,40 +418,157 @@ namespace Camera {
                " < expected " + std::to_string(expected_bytes));
       return ERROR;
     }
+    return NO_ERROR;
+  }
 
-    QueuedFrame frame;
-    frame.meta = meta;
-    frame.data.assign(data, data + size);   // the one memcpy — outside the lock
+  long FitsWriter::write(const char* data, size_t size, const FrameMetadata& meta) {
+    if (!started_.load()) return ERROR;
+    if (check_frame(size, meta) != NO_ERROR) return ERROR;
+
+    // the one memcpy, outside the lock
+    std::shared_ptr<char[]> copy(new char[size]);
+    std::memcpy(copy.get(), data, size);
 
+    return enqueue({ meta, std::move(copy), size });
+  }
+
+  long FitsWriter::write_shared(std::shared_ptr<const char[]> data, size_t size, const FrameMetadata& meta) {
+    if (!started_.load()) return ERROR;
+    if (check_frame(size, meta) != NO_ERROR) return ERROR;
+
+    return enqueue({ meta, std::move(data), size });
+  }
+
+  long FitsWriter::enqueue(QueuedFrame frame) {
+    n_received_.fetch_add(1, std::memory_order_relaxed);
     {
-      std::lock_guard lock(mtx_);
+      std::unique_lock lock(mtx_);
       if (queue_.size() >= cfg_.queue_size) {
-        queue_.pop_front();
-        n_dropped_queue_.fetch_add(1, std::memory_order_relaxed);
+        switch (cfg_.overflow) {
+          case OverflowPolicy::DropOldest:
+            queue_.pop_front();
+            n_dropped_queue_.fetch_add(1, std::memory_order_relaxed);
+            break;
+
+          case OverflowPolicy::Block: {
+            n_blocked_.fetch_add(1, std::memory_order_relaxed);
+            const auto room = [this]{ return queue_.size() < cfg_.queue_size || stop_.load(); };
+            if (cfg_.block_ms == 0) room_cv_.wait(lock, room);
+            else room_cv_.wait_for(lock, std::chrono::milliseconds(cfg_.block_ms), room);
+            if (queue_.size() < cfg_.queue_size && !stop_.load()) break;
+            n_dropped_queue_.fetch_add(1, std::memory_order_relaxed);
+            return ERROR;       // the producer asked to wait, not to lose frames
+          }
+
+          case OverflowPolicy::Spill:
+            lock.unlock();
+            return this->spill(frame);
+
+          case OverflowPolicy::DropNewest:
+            n_dropped_queue_.fetch_add(1, std::memory_order_relaxed);
+            return NO_ERROR;
+        }
       }
       queue_.push_back(std::move(frame));
     }
-    n_received_.fetch_add(1, std::memory_order_relaxed);
     cv_.notify_one();
     return NO_ERROR;
   }
 
+  // The journal keeps the frame as it would have been queued, for raw2fits
+  long FitsWriter::spill(const QueuedFrame &frame) {
+    const std::string function("Camera::FitsWriter::spill");
+
+    std::lock_guard lock(spill_mtx_);
+    if (!spill_ && !spill_failed_) {
+      RawRecorderConfig raw;
+      raw.output_dir = cfg_.spill_dir.empty() ? cfg_.output_dir : cfg_.spill_dir;
+      raw.basename   = cfg_.basename + "_spill";
+      raw.max_frame_bytes = cfg_.max_frame_bytes;
+      raw.overflow   = OverflowPolicy::Block;     // the journal is the last resort
+      raw.block_ms   = cfg_.block_ms;
+      spill_ = std::make_unique<RawRecorder>(raw);
+      if (spill_->open() != NO_ERROR) {
+        logwrite(function, "ERROR opening spill journal in " + raw.output_dir + "; frame dropped");
+        spill_.reset();
+        spill_failed_ = true;     // not retried until the next open()
+      }
+      else logwrite(function, "NOTICE queue full, spilling to " + spill_->session() + ".idx");
+    }
+    if (!spill_) {
+      n_dropped_queue_.fetch_add(1, std::memory_order_relaxed);
+      return ERROR;
+    }
+    const uint64_t dropped = spill_->stats().frames_dropped;
+    if (spill_->write(frame.data.get(), frame.size, frame.meta) != NO_ERROR ||
+        spill_->stats().frames_dropped != dropped) {
+      n_dropped_queue_.fetch_add(1, std::memory_order_relaxed);
+      return ERROR;
+    }
+    n_spilled_.fetch_add(1, std::memory_order_relaxed);
+    return NO_ERROR;
+  }
+
+  QueueStatus FitsWriter::queue_status() const {
+    QueueStatus status;
+    status.capacity = cfg_.queue_size;
+    status.dropped  = n_dropped_queue_.load();
+    status.blocked  = n_blocked_.load();
+    status.spilled  = n_spilled_.load();
+    std::lock_guard lock(mtx_);
+    status.depth = queue_.size();
+    status.set_pressure(cfg_.overflow);
+    return status;
+  }
+
   void FitsWriter::close() {
     if (!started_.load()) return;
 
     stop_time_ = std::chrono::steady_clock::now();
     stop_.store(true);
     cv_.notify_all();
+    room_cv_.notify_all();
+
+    for (auto &worker : workers_) {
+      if (worker.joinable()) worker.join();
+    }
+    workers_.clear();
 
-    if (worker_.joinable()) worker_.join();
+    {
+      std::lock_guard lock(container_mtx_);
+      close_container();
+      if (index_) { std::fclose(index_); index_ = nullptr; }
+    }
+    {
+      std::lock_guard lock(spill_mtx_);
+      if (spill_) {
+        spill_->close();
+        // journal writes that failed on disk were spilled but are lost
+        const uint64_t failed = spill_->stats().frames_failed;
+        n_spilled_.fetch_sub(failed, std::memory_order_relaxed);
+        n_failed_.fetch_add(failed, std::memory_order_relaxed);
+        spill_.reset();
+      }
+      spill_failed_ = false;
+    }
     started_.store(false);
 
     const std::string function("Camera::FitsWriter::close");
-    logwrite(function, "stopped: received=" + std::to_string(n_received_.load()) +
-             " written=" + std::to_string(n_written_.load()) +
-             " dropped_queue=" + std::to_string(n_dropped_queue_.load()) +
-             " failed=" + std::to_string(n_failed_.load()) +
-             " dropped_shutdown=" + std::to_string(n_dropped_shutdown_.load()));
+    const Stats s = this->stats();
+    std::string per_worker;
+    for (size_t i = 0; i < s.workers.size(); ++i) {
+      char rate[64];
+      std::snprintf(rate, sizeof(rate), " w%zu=%.1fMB/s", i, s.workers[i].mb_per_s());
+      per_worker += rate;
+    }
+    logwrite(function, "stopped: received=" + std::to_string(s.frames_received) +
+             " written=" + std::to_string(s.frames_written) +
+             " dropped_queue=" + std::to_string(s.frames_dropped_queue) +
+             " failed=" + std::to_string(s.frames_failed) +
+             " dropped_shutdown=" + std::to_string(s.frames_dropped_shutdown) +
+             " blocked=" + std::to_string(s.frames_blocked) +
+             " spilled=" + std::to_string(s.frames_spilled) +
+             per_worker + (cfg_.compression == FitsCompression::None ? "" : " ratio=" + std::to_string(s.compression_ratio())));
   }
 
   FitsWriter::Stats FitsWriter::stats() const {
@@ -122,10 +578,61 @@ namespace Camera {
     s.frames_dropped_queue   = n_dropped_queue_.load();
     s.frames_failed          = n_failed_.load();
     s.frames_dropped_shutdown= n_dropped_shutdown_.load();
+    s.frames_blocked         = n_blocked_.load();
+    s.frames_spilled         = n_spilled_.load();
+    s.containers             = n_containers_.load();
+    s.container_stored       = n_container_stored_.load();
+    std::lock_guard lock(mtx_);
+    s.workers = worker_stats_;
     return s;
   }
 
-  void FitsWriter::worker_loop() {
+  OutputMetrics FitsWriter::metrics() const {
+    const Stats s = this->stats();
+    OutputMetrics m;
+    m.kind           = "fits";
+    m.frames_in      = s.frames_received;
+    m.frames_written = s.frames_written;
+    m.frames_dropped = s.frames_dropped_queue + s.frames_dropped_shutdown;
+    m.frames_failed  = s.frames_failed;
+    m.bytes_written  = s.container_stored;
+    for (const auto &w : s.workers) m.bytes_written += w.stored;
+    m.latency = latency_.snapshot();
+    m.queue   = this->queue_status();
+    m.detail["blocked"]           = s.frames_blocked;
+    m.detail["spilled"]           = s.frames_spilled;
+    m.detail["containers"]        = s.containers;
+    m.detail["compression_ratio"] = s.compression_ratio();
+    m.detail["compress_mb_per_s"] = s.compress_mb_per_s();
+    m.detail["digest_mb_per_s"]   = s.digest_mb_per_s();
+    return m;
+  }
+
+  double FitsWriter::Stats::compression_ratio() const {
+    uint64_t bytes = 0, stored = container_stored;
+    for (const auto &w : workers) { bytes += w.bytes; stored += w.stored; }
+    return stored > 0 ? static_cast<double>(bytes) / stored : 0.0;
+  }
+
+  double FitsWriter::Stats::compress_mb_per_s() const {
+    uint64_t bytes = 0;
+    double seconds = 0;
+    for (const auto &w : workers) {
+      if (w.compress_s > 0) { bytes += w.bytes; seconds += w.compress_s; }
+    }
+    return seconds > 0 ? bytes / seconds / 1.0e6 : 0.0;
+  }
+
+  double FitsWriter::Stats::digest_mb_per_s() const {
+    uint64_t bytes = 0;
+    double seconds = 0;
+    for (const auto &w : workers) {
+      if (w.digest_s > 0) { bytes += w.bytes; seconds += w.digest_s; }
+    }
+    return seconds > 0 ? bytes / seconds / 1.0e6 : 0.0;
+  }
+
+  void FitsWriter::worker_loop(size_t index) {
     const auto drain_timeout = std::chrono::milliseconds(cfg_.drain_timeout_ms);
 
     while (true) {
@@ -146,76 +653,289 @@ namespace Camera {
         }
 
         frame = std::move(queue_.front());
+        frame.sequence = dequeued_++;
         queue_.pop_front();
       }
+      room_cv_.notify_one();
+
+      WorkerStats delta;
+      const auto t0 = std::chrono::steady_clock::now();
+      const long ret = write_fits_file(frame, delta);
+      if (cfg_.container != FitsContainer::File) this->end_turn(frame.sequence);
+      const double busy = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
 
-      if (write_fits_file(frame) == NO_ERROR) {
+      if (ret == NO_ERROR) {
         n_written_.fetch_add(1, std::memory_order_relaxed);
+        latency_.record_since(frame.meta.host_time_ns);
+        std::lock_guard lock(mtx_);
+        auto &ws = worker_stats_[index];
+        ws.frames++;
+        ws.bytes += frame.size;
+        ws.stored += delta.stored;
+        ws.busy_s += busy;
+        ws.compress_s += delta.compress_s;
+        ws.digest_s += delta.digest_s;
       } else {
         n_failed_.fetch_add(1, std::memory_order_relaxed);
       }
     }
   }
 
-  long FitsWriter::write_fits_file(const QueuedFrame &frame) {
+  long FitsWriter::write_fits_file(const QueuedFrame &frame, WorkerStats &ws) {
     const std::string function("Camera::FitsWriter::write_fits_file");
     const auto &meta = frame.meta;
-    const size_t npixels = static_cast<size_t>(meta.width) * meta.height;
-
-    const std::string filename = make_filename(meta.frame_number);
-    // CCfits requires a non-existing path; "!" prefix would overwrite,
-    // but make_filename() already resolved any conflict
-    const int bitpix = (meta.bytes_per_pixel == 2) ? USHORT_IMG : ULONG_IMG;
-    long axes[2] = { static_cast<long>(meta.width),
-                     static_cast<long>(meta.height) };
+    long tile[2] = { static_cast<long>(cfg_.tile_width  == 0 ? meta.width  : std::min(cfg_.tile_width,  meta.width)),
+                     static_cast<long>(cfg_.tile_height == 0 ? meta.height : std::min(cfg_.tile_height, meta.height)) };
+
+    // Rice tiles of integer frames are compressed across the tile pool
+    // before the file is touched; this worker then only writes them out
+    const PixelFormat format = pixel_format_of(meta);
+    const bool parallel_rice = cfg_.compression == FitsCompression::Rice && format != PixelFormat::F32;
+    thread_local std::vector<TileCompressor::Tile> tiles;
+    if (parallel_rice) {
+      const auto t0 = std::chrono::steady_clock::now();
+      if (this->pool()->compress_rice(frame.data.get(), meta, tile[0], tile[1], tiles) != NO_ERROR) return ERROR;
+      ws.compress_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
 
-    try {
-      auto pFits = std::make_unique<CCfits::FITS>(filename, bitpix, 2, axes);
-      auto &phdu = pFits->pHDU();
-
-      phdu.addKey("FRAMENO", static_cast<long>(meta.frame_number),
-                  "Frame number");
-      phdu.addKey("TIMESTMP", static_cast<long>(meta.timestamp),
-                  "Archon timestamp (0.01 us units)");
-      phdu.addKey("DATE", get_timestamp(), "FITS file write time");
-
-      const long first_pixel = 1;
-      if (meta.bytes_per_pixel == 2) {
-        const auto *src = reinterpret_cast<const uint16_t*>(frame.data.data());
-        std::valarray<uint16_t> data(src, npixels);
-        phdu.write(first_pixel, npixels, data);
-      } else {
-        const auto *src = reinterpret_cast<const uint32_t*>(frame.data.data());
-        std::valarray<uint32_t> data(src, npixels);
-        phdu.write(first_pixel, npixels, data);
+    // the sum of uncompressed pixels, and the hash, come from memory in
+    // blocks across the same pool; a frame of one block stays on this thread
+    FrameDigest digest;
+    const bool datasum = cfg_.checksum && cfg_.compression == FitsCompression::None;
+    if (datasum || cfg_.content_hash) {
+      const auto t0 = std::chrono::steady_clock::now();
+      const size_t bytes = static_cast<size_t>(meta.width) * meta.height * meta.bytes_per_pixel;
+      ParallelFor parallel;
+      if (bytes > DIGEST_BLOCK) {
+        parallel = [pool = this->pool()](size_t n, const std::function<bool(size_t)> &fn) {
+          return pool->parallel_for(n, fn);
+        };
       }
+      digest = digest_frame(frame.data.get(), bytes, format, datasum, cfg_.content_hash, parallel);
+      ws.digest_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    if (cfg_.container != FitsContainer::File) {
+      return append_to_container(frame, digest, tile, parallel_rice ? &tiles : nullptr);
     }
-    catch (const CCfits::FitsException &e) {
-      logwrite(function, "ERROR FITS exception writing " + filename + ": " + e.message());
+
+    std::string filename;
+    int status = 0;
+    fitsfile* fptr = create_unique([&](int suffix) { return make_filename(meta.frame_number, suffix); },
+                                   filename, status);
+    if (!fptr) {
+      logwrite(function, "ERROR creating " + filename + ": " + fits_error_text(status));
+      return ERROR;
+    }
+
+    if (parallel_rice) create_empty_primary(fptr, cfg_.checksum, status);
+    write_image_hdu(fptr, cfg_, frame.data.get(), meta, digest, tile, parallel_rice ? &tiles : nullptr, status);
+
+    if (status != 0) {
+      logwrite(function, "ERROR writing " + filename + ": " + fits_error_text(status));
+      int close_status = 0;
+      fits_close_file(fptr, &close_status);
+      std::error_code ec;
+      std::filesystem::remove(filename, ec);
       return ERROR;
     }
-    catch (const std::exception &e) {
-      logwrite(function, "ERROR exception writing " + filename + ": " + e.what());
+
+    fits_close_file(fptr, &status);
+    if (status != 0) {
+      logwrite(function, "ERROR closing " + filename + ": " + fits_error_text(status));
       return ERROR;
     }
 
+    std::error_code ec;
+    const auto stored = std::filesystem::file_size(filename, ec);
+    ws.stored += ec ? 0 : stored;
+    return NO_ERROR;
+  }
+
+  struct FitsWriter::Container {
+    fitsfile*   fptr{nullptr};
+    std::string filename;
+    uint32_t    frames{0};
+    uint32_t    capacity{0};          ///< frames before rotating; cube NAXIS3 as created
+    uint64_t    bytes{0};             ///< uncompressed frame bytes appended
+    uint32_t    datasum{0};           ///< cube: DATASUM of the slices appended
+    uint32_t    width{0};
+    uint32_t    height{0};
+    PixelFormat format{PixelFormat::Unspecified};
+  };
+
+  long FitsWriter::append_to_container(const QueuedFrame &frame, const FrameDigest &digest, const long tile[2],
+                                       const std::vector<TileCompressor::Tile>* tiles) {
+    const std::string function("Camera::FitsWriter::append_to_container");
+    const auto &meta = frame.meta;
+    const PixelFormat format = pixel_format_of(meta);
+
+    // the turn is passed on by end_turn() once this frame is finished with
+    std::unique_lock lock(container_mtx_);
+    turn_cv_.wait(lock, [&]{ return next_append_ == frame.sequence; });
+    auto &c = *container_;
+
+    if (c.fptr && (c.frames >= c.capacity ||
+                   meta.width != c.width || meta.height != c.height || format != c.format ||
+                   (cfg_.bytes_per_file > 0 && c.bytes + frame.size > cfg_.bytes_per_file))) {
+      close_container();
+    }
+    if (!c.fptr && open_container(meta, frame.size) != NO_ERROR) return ERROR;
+
+    int status = 0;
+    long position;                    // cube slice or MEF HDU, both 1-based
+    if (cfg_.container == FitsContainer::Cube) {
+      const LONGLONG npixels = static_cast<LONGLONG>(meta.width) * meta.height;
+      fits_write_img(c.fptr, image_type(format).datatype, c.frames * npixels + 1, npixels,
+                     const_cast<char*>(frame.data.get()), &status);
+      // a slice of an odd number of 16-bit pixels leaves the next one half a word along
+      c.datasum = fits_sum_add(c.datasum, fits_sum_shift(digest.datasum, c.frames * npixels * meta.bytes_per_pixel));
+      position = c.frames + 1;
+    }
+    else {
+      write_image_hdu(c.fptr, cfg_, frame.data.get(), meta, digest, tile, tiles, status);
+      position = c.frames + 2;        // HDU 1 is the empty primary
+    }
+
+    if (status != 0) {
+      logwrite(function, "ERROR appending frame " + std::to_string(meta.frame_number) +
+               " to " + c.filename + ": " + fits_error_text(status));
+      close_container();              // the next frame starts a fresh file
+      return ERROR;
+    }
+
+    c.frames++;
+    c.bytes += frame.size;
+    if (index_) {
+      std::fprintf(index_, "%llu %llu %llu %s %ld%s%s\n",
+                   static_cast<unsigned long long>(meta.frame_number),
+                   static_cast<unsigned long long>(meta.timestamp),
+                   static_cast<unsigned long long>(meta.host_time_ns),
+                   std::filesystem::path(c.filename).filename().c_str(), position,
+                   cfg_.content_hash ? " " : "",
+                   cfg_.content_hash ? hash_to_hex(digest.hash).c_str() : "");
+    }
     return NO_ERROR;
   }
 
-  std::string FitsWriter::make_filename(uint64_t frame_number) const {
+  long FitsWriter::open_container(const FrameMetadata &meta, size_t frame_bytes) {
+    const std::string function("Camera::FitsWriter::open_container");
+    auto &c = *container_;
+    const PixelFormat format = pixel_format_of(meta);
+
+    uint64_t capacity = (cfg_.frames_per_file > 0) ? cfg_.frames_per_file : UINT32_MAX;
+    if (cfg_.bytes_per_file > 0) {
+      capacity = std::min<uint64_t>(capacity, std::max<uint64_t>(1, cfg_.bytes_per_file / frame_bytes));
+    }
+
+    int status = 0;
+    c.fptr = create_unique([&](int suffix) { return make_filename(meta.frame_number, suffix); },
+                           c.filename, status);
+    if (!c.fptr) {
+      logwrite(function, "ERROR creating " + c.filename + ": " + fits_error_text(status));
+      return ERROR;
+    }
+
+    // a header block per HDU on top of the pixels; unused space is
+    // returned when the container is closed
+    if (cfg_.preallocate) {
+      uint64_t bytes = (capacity < UINT32_MAX) ? capacity * (frame_bytes + 2 * 2880) + 2880 : 0;
+      if (cfg_.bytes_per_file > 0) bytes = std::min(bytes > 0 ? bytes : UINT64_MAX, cfg_.bytes_per_file);
+      if (bytes > 0) preallocate_file(c.filename, bytes);
+    }
+
+    if (cfg_.container == FitsContainer::Cube) {
+      const ImageType type = image_type(format);
+      long axes[3] = { static_cast<long>(meta.width), static_cast<long>(meta.height),
+                       static_cast<long>(capacity) };
+      fits_create_img(c.fptr, type.bitpix, 3, axes, &status);
+    }
+    else {
+      fits_create_img(c.fptr, SHORT_IMG, 0, nullptr, &status);
+    }
+    fits_write_key_lng(c.fptr, "FRAME0", static_cast<LONGLONG>(meta.frame_number), "First frame number", &status);
+    fits_write_key_lng(c.fptr, "NFRAMES", 0, "Frames in this file", &status);
+    fits_write_key_str(c.fptr, "DATE", get_timestamp().c_str(), "FITS file creation time", &status);
+    if (cfg_.container == FitsContainer::Cube && format == PixelFormat::I32) write_i32_scaling(c.fptr, status);
+    if (cfg_.checksum) write_checksum_keys(c.fptr, status);
+
+    if (status != 0) {
+      logwrite(function, "ERROR starting " + c.filename + ": " + fits_error_text(status));
+      int close_status = 0;
+      fits_close_file(c.fptr, &close_status);
+      std::error_code ec;
+      std::filesystem::remove(c.filename, ec);
+      c = Container{};
+      return ERROR;
+    }
+
+    c.frames   = 0;
+    c.capacity = static_cast<uint32_t>(capacity);
+    c.bytes    = 0;
+    c.datasum  = 0;
+    c.width    = meta.width;
+    c.height   = meta.height;
+    c.format   = format;
+    return NO_ERROR;
+  }
+
+  void FitsWriter::close_container() {
+    const std::string function("Camera::FitsWriter::close_container");
+    auto &c = *container_;
+    if (!c.fptr) return;
+
+    // a cube closed early is cut down to the slices actually written
+    int status = 0;
+    if (cfg_.container == FitsContainer::Cube && c.frames < c.capacity && c.frames > 0) {
+      long axes[3] = { static_cast<long>(c.width), static_cast<long>(c.height), static_cast<long>(c.frames) };
+      fits_resize_img(c.fptr, image_type(c.format).bitpix, 3, axes, &status);
+    }
+    fits_movabs_hdu(c.fptr, 1, nullptr, &status);
+    fits_update_key_lng(c.fptr, "NFRAMES", c.frames, "Frames in this file", &status);
+    if (cfg_.checksum) write_checksum(c.fptr, cfg_.container == FitsContainer::Cube ? c.datasum : 0, status);
+    fits_close_file(c.fptr, &status);
+    if (status != 0) {
+      logwrite(function, "ERROR closing " + c.filename + ": " + fits_error_text(status));
+    }
+
+    if (cfg_.preallocate) release_preallocation(c.filename);
+    std::error_code ec;
+    const auto stored = std::filesystem::file_size(c.filename, ec);
+    n_container_stored_.fetch_add(ec ? 0 : stored, std::memory_order_relaxed);
+    n_containers_.fetch_add(1, std::memory_order_relaxed);
+    if (index_) std::fflush(index_);
+
+    c = Container{};
+  }
+
+  // Waits for the frame's turn, which is at once if append_to_container()
+  // took it, then hands it to the next frame. Called for every frame a
+  // worker takes, so a frame that failed before appending does not hold
+  // up the ones behind it.
+  void FitsWriter::end_turn(uint64_t sequence) {
+    {
+      std::unique_lock lock(container_mtx_);
+      turn_cv_.wait(lock, [&]{ return next_append_ == sequence; });
+      ++next_append_;
+    }
+    turn_cv_.notify_all();
+  }
+
+  TileCompressor* FitsWriter::pool() {
+    std::call_once(pool_once_, [this] {
+      if (!compressor_) compressor_ = std::make_unique<TileCompressor>(cfg_.compress_threads);
+    });
+    return compressor_.get();
+  }
+
+  std::string FitsWriter::make_filename(uint64_t frame_number, int suffix) const {
     char num[32];
     std::snprintf(num, sizeof(num), "%08llu",
                   static_cast<unsigned long long>(frame_number));
 
     const std::string prefix = cfg_.output_dir + "/" + cfg_.basename + "_" + num;
-    std::string filename = prefix + ".fits";
-
-    int suffix = 1;
-    while (std::filesystem::exists(filename)) {
-      filename = prefix + "_" + std::to_string(suffix) + ".fits";
-      suffix++;
-    }
-    return filename;
+    if (suffix == 0) return prefix + ".fits";
+    return prefix + "_" + std::to_string(suffix) + ".fits";
   }
 
 }
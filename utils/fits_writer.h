@@ -2,20 +2,47 @@
  * @file    fits_writer.h
  * @brief   FrameOutput implementation that writes FITS files asynchronously
  *
- * Producer calls write() from the readout thread; data is memcpy'd into
- * a bounded queue (drop-oldest on overflow) and a dedicated worker thread
- * drains the queue to disk. write() never touches CCfits or blocks on
- * disk I/O.
+ * Producer calls write() from the readout thread; data is memcpy'd once
+ * into a bounded queue, or with write_shared() the queue just holds a
+ * reference to the producer's buffer. A frame arriving with the queue full
+ * is handled by the overflow policy: drop it or the oldest, wait a bounded
+ * time for a worker to make room, or spill it to a RawRecorder journal
+ * (<basename>_spill_NNNN.idx) for raw2fits to convert later. A pool of
+ * worker threads drains the queue, each writing whole frames to disk with
+ * cfitsio straight from the queued buffer. write() never touches cfitsio,
+ * and only waits on the workers under the block policy.
+ *
+ * Frames can be written tile-compressed, readable by funpack and cfitsio.
+ * Rice tiles of integer frames are compressed in parallel by a
+ * TileCompressor; the other algorithms, and float frames, which must be
+ * quantized first, are compressed by cfitsio on the worker thread.
+ *
+ * Instead of one file per frame, frames can be appended to a container
+ * file, as slices of a NAXIS3 cube or as one image extension each (MEF),
+ * rotating after a frame count or byte limit. With several workers the
+ * frames still go in in the order they were queued. Container space is
+ * preallocated, and <basename>.index in the output directory records the
+ * file and slice or HDU each frame went to.
+ *
+ * Every HDU gets the standard DATASUM and CHECKSUM keywords. The data sum
+ * is taken from the frame in memory across the tile pool as it is written,
+ * so nothing is read back; only the header cards are summed afterwards.
+ * Optionally a content hash of the frame as received goes in FRAMEHSH and
+ * the container index.
  */
 #pragma once
 
 #include "frame_output.h"
+#include "frame_checksum.h"
+#include "tile_compressor.h"
 
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -23,13 +50,41 @@
 
 namespace Camera {
 
+  enum class FitsCompression { None, Rice, Gzip1, Gzip2, Hcompress };
+
+  // "none" | "rice" | "gzip" | "gzip2" | "hcompress"; throws std::invalid_argument
+  FitsCompression parse_fits_compression(const std::string &s);
+
+  enum class FitsContainer { File, Cube, Mef };
+
+  // "file" | "cube" | "mef"; throws std::invalid_argument
+  FitsContainer parse_fits_container(const std::string &s);
+
   struct FitsWriterConfig {
     std::string output_dir{"/tmp/images"};
     std::string basename{"tracking"};
     size_t      queue_size{32};
     uint32_t    drain_timeout_ms{5000};
+    uint32_t    workers{1};             ///< frames written concurrently
+    FitsCompression compression{FitsCompression::None};
+    uint32_t    tile_width{0};          ///< 0 for whole rows
+    uint32_t    tile_height{1};
+    float       quantize_level{4.0f};   ///< float frames, as fpack -q
+    uint32_t    compress_threads{0};    ///< Rice tile and checksum threads, 0 for one per core
+    FitsContainer container{FitsContainer::File};
+    uint32_t    frames_per_file{100};   ///< cube/mef: rotate after this many frames, 0 for no limit
+    uint64_t    bytes_per_file{0};      ///< cube/mef: and before passing this size, 0 for no limit
+    bool        preallocate{true};      ///< reserve container disk space up front
+    OverflowPolicy overflow{OverflowPolicy::DropOldest};   ///< a frame arriving with queue_size waiting
+    uint32_t    block_ms{100};          ///< block: longest a write waits for room, 0 for no limit
+    std::string spill_dir;              ///< spill: journal directory, empty for output_dir
+    size_t      max_frame_bytes{0};     ///< spill: largest frame the journal takes, required
+    bool        checksum{true};         ///< DATASUM/CHECKSUM in every HDU
+    bool        content_hash{false};    ///< FRAMEHSH key and index column
   };
 
+  class RawRecorder;
+
   class FitsWriter : public FrameOutput {
     public:
       explicit FitsWriter(FitsWriterConfig cfg);
@@ -40,37 +95,89 @@ namespace Camera {
 
       long open() override;
       long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      long write_shared(std::shared_ptr<const char[]> data, size_t size, const FrameMetadata& meta) override;
       void close() override;
 
+      struct WorkerStats {
+        uint64_t frames{0};
+        uint64_t bytes{0};              ///< uncompressed frame bytes
+        uint64_t stored{0};             ///< file bytes on disk
+        double   busy_s{0};             ///< time spent writing files
+        double   compress_s{0};         ///< of which compressing tiles in parallel
+        double   digest_s{0};           ///< of which checksumming and hashing frames
+        double mb_per_s() const { return busy_s > 0 ? bytes / busy_s / 1.0e6 : 0.0; }
+      };
+
       struct Stats {
         uint64_t frames_received{0};
         uint64_t frames_written{0};
         uint64_t frames_dropped_queue{0};
         uint64_t frames_failed{0};
         uint64_t frames_dropped_shutdown{0};
+        uint64_t frames_blocked{0};     ///< writes that waited for room
+        uint64_t frames_spilled{0};     ///< handed to the spill journal
+        uint64_t containers{0};         ///< container files completed
+        uint64_t container_stored{0};   ///< their bytes on disk
+        std::vector<WorkerStats> workers;
+        double compression_ratio() const;     ///< uncompressed / stored bytes
+        double compress_mb_per_s() const;     ///< parallel tile compression rate
+        double digest_mb_per_s() const;       ///< checksum and hash rate
       };
       Stats stats() const;
 
+      QueueStatus queue_status() const override;
+      OutputMetrics metrics() const override;
+
     private:
       struct QueuedFrame {
         FrameMetadata meta;
-        std::vector<char> data;
+        std::shared_ptr<const char[]> data;
+        size_t size{0};
+        uint64_t sequence{0};           ///< order taken from the queue
       };
 
-      void worker_loop();
-      long write_fits_file(const QueuedFrame &frame);
-      std::string make_filename(uint64_t frame_number) const;
+      long check_frame(size_t size, const FrameMetadata& meta) const;
+      long enqueue(QueuedFrame frame);
+      long spill(const QueuedFrame &frame);
+      void worker_loop(size_t index);
+      long write_fits_file(const QueuedFrame &frame, WorkerStats &ws);
+      std::string make_filename(uint64_t frame_number, int suffix) const;
+
+      struct Container;
+      long append_to_container(const QueuedFrame &frame, const FrameDigest &digest, const long tile[2],
+                               const std::vector<TileCompressor::Tile>* tiles);
+      long open_container(const FrameMetadata &meta, size_t frame_bytes);
+      void close_container();
+      void end_turn(uint64_t sequence);
+      TileCompressor* pool();
 
       FitsWriterConfig cfg_;
 
       std::deque<QueuedFrame> queue_;
       mutable std::mutex mtx_;
       std::condition_variable cv_;
+      std::condition_variable room_cv_;         ///< a worker took a frame
 
       std::atomic<bool> stop_{false};
       std::atomic<bool> started_{false};
-      std::thread worker_;
-      // Set in close() before stop_, so worker can read race-free
+      std::vector<std::thread> workers_;
+      std::vector<WorkerStats> worker_stats_;   ///< guarded by mtx_
+      std::unique_ptr<TileCompressor> compressor_;   ///< Rice tiles; started on first use for checksums
+      std::once_flag pool_once_;
+
+      uint64_t dequeued_{0};                    ///< frames taken from queue_, guarded by mtx_
+
+      // Workers compress and checksum frames concurrently but append them
+      // to the container one at a time, in the order they were queued
+      std::mutex container_mtx_;
+      std::condition_variable turn_cv_;         ///< next_append_ moved on
+      uint64_t next_append_{0};                 ///< sequence whose turn it is, guarded by container_mtx_
+      std::unique_ptr<Container> container_;    ///< guarded by container_mtx_
+      std::FILE* index_{nullptr};               ///< guarded by container_mtx_
+      std::mutex spill_mtx_;
+      std::unique_ptr<RawRecorder> spill_;      ///< opened on the first spill, guarded by spill_mtx_
+      bool spill_failed_{false};                ///< guarded by spill_mtx_
+      // Set in close() before stop_, so workers can read race-free
       std::chrono::steady_clock::time_point stop_time_;
 
       std::atomic<uint64_t> n_received_{0};
@@ -78,6 +185,11 @@ namespace Camera {
       std::atomic<uint64_t> n_dropped_queue_{0};
       std::atomic<uint64_t> n_failed_{0};
       std::atomic<uint64_t> n_dropped_shutdown_{0};
+      std::atomic<uint64_t> n_blocked_{0};
+      std::atomic<uint64_t> n_spilled_{0};
+      std::atomic<uint64_t> n_containers_{0};
+      std::atomic<uint64_t> n_container_stored_{0};
+      LatencyHistogram latency_;                ///< frame arrival to file written
   };
 
 }
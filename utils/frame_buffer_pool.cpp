@@ -0,0 +1,201 @@
+/**
+ * @file    frame_buffer_pool.cpp
+ * @brief   huge-page, NUMA-local, locked memory for frame buffers
+ */
+
+#include "frame_buffer_pool.h"
+#include "common.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+  // From <numaif.h>, spelled out to avoid depending on libnuma
+  constexpr int MPOL_BIND_MODE = 2;
+  constexpr unsigned MPOL_MF_MOVE_FLAG = 1u << 1;
+
+  constexpr size_t HUGE_PAGE_BYTES = 2UL << 20;
+
+  size_t round_up(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+}
+
+namespace Camera {
+
+  HugePageMode parse_huge_page_mode(const std::string &s) {
+    if (s == "none")      return HugePageMode::None;
+    if (s == "thp")       return HugePageMode::Thp;
+    if (s == "hugetlbfs") return HugePageMode::Hugetlbfs;
+    throw std::invalid_argument("expected none|thp|hugetlbfs");
+  }
+
+  std::string to_string(HugePageMode mode) {
+    switch (mode) {
+      case HugePageMode::Thp:       return "thp";
+      case HugePageMode::Hugetlbfs: return "hugetlbfs";
+      default:                      return "none";
+    }
+  }
+
+  int nic_numa_node(const std::string &iface) {
+    std::ifstream f("/sys/class/net/" + iface + "/device/numa_node");
+    int node = -1;
+    if (!(f >> node)) return -1;
+    return node;
+  }
+
+  bool bind_to_numa_node(void* addr, size_t len, int node) {
+    if (node < 0 || node >= 64) return false;
+    const unsigned long mask = 1UL << node;
+    return syscall(SYS_mbind, addr, len, MPOL_BIND_MODE, &mask, sizeof(mask) * 8,
+                   MPOL_MF_MOVE_FLAG) == 0;
+  }
+
+  bool advise_huge_pages(void* addr, size_t len) {
+#ifdef MADV_HUGEPAGE
+    return madvise(addr, len, MADV_HUGEPAGE) == 0;
+#else
+    return false;
+#endif
+  }
+
+  void* map_frame_memory(size_t &bytes, HugePageMode want, HugePageMode &got) {
+    void* addr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (want == HugePageMode::Hugetlbfs) {
+      const size_t len = round_up(bytes, HUGE_PAGE_BYTES);
+      addr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (addr != MAP_FAILED) { bytes = len; got = HugePageMode::Hugetlbfs; return addr; }
+      want = HugePageMode::Thp;     // no hugetlb pages reserved, try THP
+    }
+#endif
+
+    if (want == HugePageMode::None) {
+      bytes = round_up(bytes, static_cast<size_t>(getpagesize()));
+      addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      got = HugePageMode::None;
+      return (addr == MAP_FAILED) ? nullptr : addr;
+    }
+
+    // THP only backs 2 MB aligned ranges, so over-map and trim to alignment
+    bytes = round_up(bytes, HUGE_PAGE_BYTES);
+    addr = mmap(nullptr, bytes + HUGE_PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) return nullptr;
+
+    auto* raw = static_cast<char*>(addr);
+    auto* aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<uintptr_t>(raw), HUGE_PAGE_BYTES));
+    if (aligned > raw) munmap(raw, aligned - raw);
+    munmap(aligned + bytes, raw + HUGE_PAGE_BYTES - aligned);
+
+    got = advise_huge_pages(aligned, bytes) ? HugePageMode::Thp : HugePageMode::None;
+    return aligned;
+  }
+
+  void unmap_frame_memory(void* addr, size_t bytes) {
+    if (addr) munmap(addr, bytes);
+  }
+
+  void apply_config_overrides(FrameBufferPoolConfig &out, const Config &cfg) {
+    const std::string function("Camera::apply_config_overrides");
+    for (int row = 0; row < cfg.n_rows; ++row) {
+      const auto &key = cfg.param[row];
+      const auto &val = cfg.arg[row];
+      try {
+        if      (key == "FRAMEPOOL_BUFFERS")   out.num_buffers = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "FRAMEPOOL_BUFFER_BYTES") out.buffer_bytes = std::stoull(val);
+        else if (key == "FRAMEPOOL_HUGEPAGES") out.huge_pages  = parse_huge_page_mode(val);
+        else if (key == "FRAMEPOOL_NUMA_NODE") out.numa_node   = std::stoi(val);
+        else if (key == "FRAMEPOOL_NUMA_NIC")  out.numa_nic    = val;
+        else if (key == "FRAMEPOOL_MLOCK")     out.lock        = parse_bool(val);
+      }
+      catch (const std::exception &e) {
+        logwrite(function, "WARNING bad value for " + key + "=" + val + ": " + e.what());
+      }
+    }
+  }
+
+  FrameBufferPool::FrameBufferPool(FrameBufferPoolConfig cfg)
+    : cfg_(std::move(cfg)) {
+  }
+
+  FrameBufferPool::~FrameBufferPool() {
+    if (locked_) munlock(base_, mapped_bytes_);
+    unmap_frame_memory(base_, mapped_bytes_);
+  }
+
+  long FrameBufferPool::open() {
+    const std::string function("Camera::FrameBufferPool::open");
+
+    if (cfg_.buffer_bytes == 0 || cfg_.num_buffers == 0) {
+      logwrite(function, "ERROR buffer_bytes and num_buffers must be > 0");
+      return ERROR;
+    }
+
+    stride_ = round_up(cfg_.buffer_bytes, static_cast<size_t>(getpagesize()));
+    mapped_bytes_ = stride_ * cfg_.num_buffers;
+
+    HugePageMode got = HugePageMode::None;
+    base_ = static_cast<char*>(map_frame_memory(mapped_bytes_, cfg_.huge_pages, got));
+    if (!base_) {
+      logwrite(function, "ERROR mapping " + std::to_string(mapped_bytes_) + " bytes");
+      return ERROR;
+    }
+    if (got != cfg_.huge_pages) {
+      logwrite(function, "NOTICE " + to_string(cfg_.huge_pages) + " pages unavailable, using " + to_string(got));
+    }
+
+    // bind before first touch so the pages are allocated on that node
+    int node = cfg_.numa_node;
+    if (node < 0 && !cfg_.numa_nic.empty()) node = nic_numa_node(cfg_.numa_nic);
+    if (node >= 0 && !bind_to_numa_node(base_, mapped_bytes_, node)) {
+      logwrite(function, "WARNING could not bind frame buffers to NUMA node " + std::to_string(node));
+      node = -1;
+    }
+
+    // mlock faults every page in now rather than on the first frame
+    if (cfg_.lock) {
+      locked_ = (mlock(base_, mapped_bytes_) == 0);
+      if (!locked_) {
+        logwrite(function, "WARNING mlock failed (check RLIMIT_MEMLOCK); frame buffers not locked");
+      }
+    }
+
+    free_.clear();
+    for (uint32_t i = 0; i < cfg_.num_buffers; ++i) free_.push_back(base_ + stride_ * i);
+
+    logwrite(function, std::to_string(cfg_.num_buffers) + " buffers of " +
+             std::to_string(cfg_.buffer_bytes) + " bytes, pages=" + to_string(got) +
+             " numa_node=" + std::to_string(node) + " locked=" + (locked_ ? "yes" : "no"));
+    return NO_ERROR;
+  }
+
+  std::shared_ptr<char[]> FrameBufferPool::acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+      n_misses_++;
+      return nullptr;
+    }
+    char* buffer = free_.back();
+    free_.pop_back();
+    return std::shared_ptr<char[]>(buffer, [pool = shared_from_this()](char* p) { pool->give_back(p); });
+  }
+
+  size_t FrameBufferPool::available() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_.size();
+  }
+
+  void FrameBufferPool::give_back(char* buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(buffer);
+  }
+
+}
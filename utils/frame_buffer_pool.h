@@ -0,0 +1,101 @@
+/**
+ * @file    frame_buffer_pool.h
+ * @brief   huge-page, NUMA-local, locked memory for frame buffers
+ *
+ * Frames are tens of MB, so copying them through 4 KB pages costs a TLB
+ * miss every few KB. Memory here is mapped with huge pages where the
+ * system has them (explicit hugetlb pages, else transparent huge pages,
+ * else ordinary pages), bound to the NUMA node nearest the NIC the frames
+ * arrive on, and locked so it is never paged out mid-exposure.
+ */
+#pragma once
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Camera {
+
+  enum class HugePageMode {
+    None,         ///< ordinary pages
+    Thp,          ///< transparent huge pages via madvise, if the kernel allows
+    Hugetlbfs     ///< preallocated hugetlb pages (vm.nr_hugepages or a hugetlbfs mount)
+  };
+
+  // "none" | "thp" | "hugetlbfs"; throws std::invalid_argument
+  HugePageMode parse_huge_page_mode(const std::string &s);
+  std::string to_string(HugePageMode mode);
+
+  // NUMA node of a network interface's PCI device, -1 if unknown
+  int nic_numa_node(const std::string &iface);
+
+  // Binds [addr, addr+len) to a NUMA node before first touch; false on failure
+  bool bind_to_numa_node(void* addr, size_t len, int node);
+
+  // Asks for transparent huge pages on an existing mapping; false if refused
+  bool advise_huge_pages(void* addr, size_t len);
+
+  /**
+   * Anonymous mapping with the requested page size, falling back towards
+   * ordinary pages; got reports what was actually obtained. nullptr on
+   * failure. Release with unmap_frame_memory() and the rounded size.
+   */
+  void* map_frame_memory(size_t &bytes, HugePageMode want, HugePageMode &got);
+  void unmap_frame_memory(void* addr, size_t bytes);
+
+  struct FrameBufferPoolConfig {
+    size_t       buffer_bytes{0};                  ///< largest frame held; from the geometry or FRAMEPOOL_BUFFER_BYTES
+    uint32_t     num_buffers{0};                   ///< 0 disables the pool
+    HugePageMode huge_pages{HugePageMode::Thp};
+    int          numa_node{-1};                    ///< -1: node of numa_nic, or no binding
+    std::string  numa_nic;                         ///< e.g. the Archon link, "enp1s0f0"
+    bool         lock{true};                       ///< mlock the pool
+  };
+
+  // FRAMEPOOL_BUFFERS, FRAMEPOOL_BUFFER_BYTES, FRAMEPOOL_HUGEPAGES,
+  // FRAMEPOOL_NUMA_NODE, FRAMEPOOL_NUMA_NIC, FRAMEPOOL_MLOCK
+  void apply_config_overrides(FrameBufferPoolConfig &out, const Config &cfg);
+
+  /**
+   * Fixed set of equal-size buffers carved from one mapping. acquire()
+   * returns a buffer whose deleter gives it back to the pool, so it can be
+   * passed anywhere a heap frame buffer goes. The pool must be held in a
+   * shared_ptr; outstanding buffers keep it alive.
+   */
+  class FrameBufferPool : public std::enable_shared_from_this<FrameBufferPool> {
+    public:
+      explicit FrameBufferPool(FrameBufferPoolConfig cfg);
+      ~FrameBufferPool();
+
+      FrameBufferPool(const FrameBufferPool&) = delete;
+      FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+      long open();
+
+      // nullptr when every buffer is in use; the caller falls back to the heap
+      std::shared_ptr<char[]> acquire();
+
+      size_t buffer_bytes() const { return cfg_.buffer_bytes; }
+      size_t available();
+      uint64_t misses() const { return n_misses_; }
+
+    private:
+      void give_back(char* buffer);
+
+      FrameBufferPoolConfig cfg_;
+      char*  base_{nullptr};
+      size_t mapped_bytes_{0};
+      size_t stride_{0};           ///< buffer_bytes rounded to a page
+      bool   locked_{false};
+
+      std::mutex mutex_;
+      std::vector<char*> free_;
+      uint64_t n_misses_{0};
+  };
+
+}
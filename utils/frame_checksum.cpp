@@ -0,0 +1,197 @@
+/**
+ * @file    frame_checksum.cpp
+ * @brief   FITS data checksums and a content hash computed from the frame in memory
+ */
+
+#include "frame_checksum.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+  /**
+   * Where the bytes of a little-endian word of the frame end up in the
+   * stored FITS word. Bytes 0 and 2 of the native word are summed together
+   * as one 16-bit-field pair, bytes 1 and 3 as the other; each pair's sum
+   * is then rotated into its place in the big-endian word, rotation being
+   * multiplication by a power of two in ones-complement arithmetic.
+   */
+  struct Layout {
+    uint32_t flip;                ///< sign bits flipped by the BZERO offset
+    unsigned rot_even;            ///< rotation of bytes 0 and 2
+    unsigned rot_odd;             ///< rotation of bytes 1 and 3
+  };
+
+  constexpr Layout FILE_ORDER{ 0, 24, 16 };
+
+  Layout layout_of(Camera::PixelFormat format) {
+    switch (format) {
+      case Camera::PixelFormat::U16: return { 0x80008000u, 16, 24 };
+      case Camera::PixelFormat::U32: return { 0x80000000u, 0, 8 };
+      case Camera::PixelFormat::I32:
+      case Camera::PixelFormat::F32: return { 0, 0, 8 };
+      default:                       return FILE_ORDER;   // bytes are stored as they are
+    }
+  }
+
+  uint32_t fold(uint64_t sum) {
+    while (sum >> 32) sum = (sum & 0xFFFFFFFFu) + (sum >> 32);
+    return static_cast<uint32_t>(sum);
+  }
+
+  uint32_t rotl(uint32_t v, unsigned r) {
+    r &= 31;
+    return r == 0 ? v : (v << r) | (v >> (32 - r));
+  }
+
+  uint32_t sum_words(const unsigned char* p, size_t n, const Layout &layout) {
+    const Simd::u32x8 pairs = Simd::u32x8{} + 0x00FF00FFu;
+    uint64_t even = 0, odd = 0;
+    size_t i = 0;
+
+    // a 16-bit field takes 256 bytes before it can carry into its neighbour
+    const size_t whole = n & ~static_cast<size_t>(31);
+    while (i < whole) {
+      Simd::u32x8 ve{}, vo{};
+      const size_t stop = std::min(whole, i + 256 * 32);
+      for (; i < stop; i += 32) {
+        const Simd::u32x8 w = Simd::load<Simd::u32x8>(p + i) ^ layout.flip;
+        ve += w & pairs;
+        vo += (w >> 8) & pairs;
+      }
+      for (int k = 0; k < Simd::LANES; ++k) { even += ve[k]; odd += vo[k]; }
+    }
+    for (; i + 4 <= n; i += 4) {
+      uint32_t w;
+      std::memcpy(&w, p + i, 4);
+      w ^= layout.flip;
+      even += w & 0x00FF00FFu;
+      odd  += (w >> 8) & 0x00FF00FFu;
+    }
+    if (i < n) {                  // a short last word, zero filled as in the file
+      uint32_t w = 0, present = 0;
+      std::memcpy(&w, p + i, n - i);
+      std::memset(&present, 0xFF, n - i);
+      w ^= layout.flip & present;
+      even += w & 0x00FF00FFu;
+      odd  += (w >> 8) & 0x00FF00FFu;
+    }
+    return Camera::fits_sum_add(rotl(fold(even), layout.rot_even), rotl(fold(odd), layout.rot_odd));
+  }
+
+  constexpr uint64_t P1 = 0x9E3779B185EBCA87ULL;
+  constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+  constexpr uint64_t P3 = 0x165667B19E3779F9ULL;
+  constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+  constexpr uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+  uint64_t rotl64(uint64_t v, unsigned r) { return (v << r) | (v >> (64 - r)); }
+
+  uint64_t read64(const unsigned char* p) { uint64_t v; std::memcpy(&v, p, 8); return v; }
+  uint32_t read32(const unsigned char* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+
+  uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    return rotl64(acc, 31) * P1;
+  }
+
+  uint64_t xxh_merge(uint64_t acc, uint64_t v) {
+    acc ^= xxh_round(0, v);
+    return acc * P1 + P4;
+  }
+
+}
+
+namespace Camera {
+
+  uint32_t fits_sum_add(uint32_t a, uint32_t b) {
+    return fold(static_cast<uint64_t>(a) + b);
+  }
+
+  uint32_t fits_sum_shift(uint32_t sum, uint64_t offset) {
+    return rotl(sum, 32 - 8 * static_cast<unsigned>(offset % 4));
+  }
+
+  uint32_t fits_sum_bytes(const void* data, size_t size) {
+    return sum_words(static_cast<const unsigned char*>(data), size, FILE_ORDER);
+  }
+
+  FrameDigest digest_frame(const char* data, size_t size, PixelFormat format,
+                           bool datasum, bool hash, const ParallelFor &parallel) {
+    const auto* p = reinterpret_cast<const unsigned char*>(data);
+    const Layout layout = layout_of(format);
+    const size_t blocks = (size + DIGEST_BLOCK - 1) / DIGEST_BLOCK;
+
+    std::vector<uint32_t> sums(datasum ? blocks : 0);
+    std::vector<uint64_t> hashes(hash ? blocks : 0);
+    const std::function<bool(size_t)> digest_block = [&](size_t b) {
+      const size_t offset = b * DIGEST_BLOCK;      // a whole number of words
+      const size_t n = std::min(DIGEST_BLOCK, size - offset);
+      if (datasum) sums[b] = sum_words(p + offset, n, layout);
+      if (hash) hashes[b] = xxh64(p + offset, n);
+      return true;
+    };
+    if (parallel && blocks > 1) parallel(blocks, digest_block);
+    else for (size_t b = 0; b < blocks; ++b) digest_block(b);
+
+    FrameDigest digest;
+    for (const uint32_t s : sums) digest.datasum = fits_sum_add(digest.datasum, s);
+    if (hash) digest.hash = xxh64(hashes.data(), hashes.size() * sizeof(uint64_t), size);
+    return digest;
+  }
+
+  uint64_t xxh64(const void* data, size_t size, uint64_t seed) {
+    const auto* p = static_cast<const unsigned char*>(data);
+    const unsigned char* const end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+      uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+      for (; p + 32 <= end; p += 32) {
+        v1 = xxh_round(v1, read64(p));
+        v2 = xxh_round(v2, read64(p + 8));
+        v3 = xxh_round(v3, read64(p + 16));
+        v4 = xxh_round(v4, read64(p + 24));
+      }
+      h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+      h = xxh_merge(h, v1);
+      h = xxh_merge(h, v2);
+      h = xxh_merge(h, v3);
+      h = xxh_merge(h, v4);
+    }
+    else h = seed + P5;
+
+    h += size;
+    for (; p + 8 <= end; p += 8) {
+      h ^= xxh_round(0, read64(p));
+      h = rotl64(h, 27) * P1 + P4;
+    }
+    if (p + 4 <= end) {
+      h ^= static_cast<uint64_t>(read32(p)) * P1;
+      h = rotl64(h, 23) * P2 + P3;
+      p += 4;
+    }
+    for (; p < end; ++p) {
+      h ^= *p * P5;
+      h = rotl64(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+  }
+
+  std::string hash_to_hex(uint64_t hash) {
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+    return text;
+  }
+
+}
@@ -0,0 +1,62 @@
+/**
+ * @file    frame_checksum.h
+ * @brief   FITS data checksums and a content hash computed from the frame in memory
+ *
+ * The FITS DATASUM is the 32-bit ones-complement sum of the data unit as
+ * stored: big-endian words, unsigned samples offset under BZERO. Since
+ * that sum is unchanged by reordering and a byte moved k places within its
+ * word only rotates its contribution, it can be taken straight from the
+ * native-order frame, in blocks on several threads, and folded together,
+ * instead of reading the file back as fits_write_chksum does.
+ *
+ * The content hash is XXH64 over 1 MiB blocks, the block hashes then
+ * hashed in order with the frame size as seed, so blocks hash in parallel
+ * and the result does not depend on the number of threads. It covers the
+ * frame exactly as received, before any FITS conversion.
+ */
+#pragma once
+
+#include "frame_output.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace Camera {
+
+  /// frame bytes per checksum/hash block, the unit of work across threads
+  constexpr size_t DIGEST_BLOCK = 1 << 20;
+
+  /// runs fn(i) for i in [0,n), possibly on several threads; false if any call was
+  using ParallelFor = std::function<bool(size_t, const std::function<bool(size_t)>&)>;
+
+  struct FrameDigest {
+    uint32_t datasum{0};          ///< FITS DATASUM of the frame as stored
+    uint64_t hash{0};             ///< content hash of the frame as received
+  };
+
+  /// ones-complement addition of two 32-bit sums
+  uint32_t fits_sum_add(uint32_t a, uint32_t b);
+
+  /// the sum of data that starts `offset` bytes into a data unit rather than at 0
+  uint32_t fits_sum_shift(uint32_t sum, uint64_t offset);
+
+  /// sum of bytes already in file order, e.g. compressed tiles or header cards
+  uint32_t fits_sum_bytes(const void* data, size_t size);
+
+  /**
+   * DATASUM and/or content hash of a native-order frame of the given format.
+   * parallel, if set, spreads the DIGEST_BLOCK blocks over a thread pool;
+   * otherwise they are done on the calling thread.
+   */
+  FrameDigest digest_frame(const char* data, size_t size, PixelFormat format,
+                           bool datasum, bool hash, const ParallelFor &parallel = {});
+
+  /// XXH64 of one buffer
+  uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0);
+
+  /// 16 lowercase hex digits
+  std::string hash_to_hex(uint64_t hash);
+
+}
@@ -5,11 +5,30 @@
  */
 #pragma once
 
+#include "backpressure.h"
+#include "latency_histogram.h"
+#include "common.h"
+
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace Camera {
 
+  /// Sample type of the pixel data; Unspecified means unsigned by bytes_per_pixel
+  enum class PixelFormat : uint32_t {
+    Unspecified = 0,
+    U16,
+    U32,
+    I32,          ///< unsigned value minus 2^31, i.e. FITS BZERO=2147483648
+    F32,
+    U8            ///< 8-bit display images, e.g. previews
+  };
+
   struct FrameMetadata {
     uint64_t frame_number{0};
     uint64_t timestamp{0};
@@ -17,6 +36,71 @@ namespace Camera {
     uint32_t height{0};
     uint32_t bytes_per_pixel{0};
     uint64_t sequence_number{0};
+    uint32_t roi_id{0};           ///< window index when this is a sub-frame
+    uint32_t roi_x{0};            ///< window origin column in the parent frame
+    uint32_t roi_y{0};            ///< window origin row in the parent frame
+    uint64_t host_time_ns{0};     ///< CLOCK_MONOTONIC when the frame arrived from the controller
+    PixelFormat pixel_format{PixelFormat::Unspecified};
+    bool     big_endian{false};   ///< samples byte-swapped to FITS/network order
+  };
+
+  inline PixelFormat pixel_format_of(const FrameMetadata &meta) {
+    if (meta.pixel_format != PixelFormat::Unspecified) return meta.pixel_format;
+    if (meta.bytes_per_pixel == 1) return PixelFormat::U8;
+    return (meta.bytes_per_pixel == 4) ? PixelFormat::U32 : PixelFormat::U16;
+  }
+
+  /**
+   * Non-owning view of a 2-D block of pixels. Rows are stride bytes apart,
+   * so a window into a larger frame is described without copying it.
+   */
+  struct FrameView {
+    const char* data{nullptr};
+    uint32_t width{0};
+    uint32_t height{0};
+    uint32_t bytes_per_pixel{0};
+    size_t   stride{0};           ///< bytes between the starts of adjacent rows
+
+    static FrameView full(const char* data, const FrameMetadata &meta) {
+      return { data, meta.width, meta.height, meta.bytes_per_pixel,
+               static_cast<size_t>(meta.width) * meta.bytes_per_pixel };
+    }
+
+    size_t row_bytes() const { return static_cast<size_t>(width) * bytes_per_pixel; }
+    size_t size() const { return row_bytes() * height; }
+    bool contiguous() const { return stride == row_bytes(); }
+    const char* row(uint32_t y) const { return data + stride * y; }
+
+    /// caller guarantees the window lies inside this view
+    FrameView window(uint32_t x0, uint32_t y0, uint32_t w, uint32_t h) const {
+      return { data + stride * y0 + static_cast<size_t>(x0) * bytes_per_pixel,
+               w, h, bytes_per_pixel, stride };
+    }
+
+    /// pack the rows into dst, which must hold size() bytes
+    void copy_to(char* dst) const {
+      if (contiguous()) { std::memcpy(dst, data, size()); return; }
+      const size_t n = row_bytes();
+      for (uint32_t y = 0; y < height; ++y, dst += n) std::memcpy(dst, row(y), n);
+    }
+  };
+
+  /**
+   * What every output reports about itself, the same way, so the one
+   * holding up the others can be found. Decorators count the frames that
+   * pass through them and leave latency empty.
+   */
+  struct OutputMetrics {
+    std::string kind;                 ///< "fits", "shm", "async", ...
+    uint64_t frames_in{0};            ///< frames offered to it
+    uint64_t frames_written{0};       ///< frames it finished with (forwarded, for decorators)
+    uint64_t frames_dropped{0};       ///< discarded by its overflow policy
+    uint64_t frames_failed{0};
+    uint64_t bytes_written{0};
+    LatencySnapshot latency;          ///< frame reaching the host to finished here; queued to written for async
+    QueueStatus queue;                ///< its own queue, not those of outputs it wraps
+    std::map<std::string, double> detail;   ///< counters particular to the kind
+    std::vector<OutputMetrics> sinks;       ///< outputs it fans out to, e.g. per ROI window
   };
 
   class FrameOutput {
@@ -25,6 +109,56 @@ namespace Camera {
       virtual long open() = 0;
       virtual long write(const char* data, size_t size, const FrameMetadata& meta) = 0;
       virtual void close() = 0;
+
+      /// Outputs that can consume strided rows directly override this;
+      /// the default packs the view into a per-thread scratch buffer.
+      virtual long write_view(const FrameView &view, const FrameMetadata& meta) {
+        if (view.contiguous()) return this->write(view.data, view.size(), meta);
+        thread_local std::vector<char> scratch;
+        scratch.resize(view.size());
+        view.copy_to(scratch.data());
+        return this->write(scratch.data(), scratch.size(), meta);
+      }
+
+      /// Outputs that queue frames override this to keep a reference to the
+      /// producer's buffer instead of copying it. The producer must not
+      /// reuse the buffer while a reference is held.
+      virtual long write_shared(std::shared_ptr<const char[]> data, size_t size, const FrameMetadata& meta) {
+        return this->write(data.get(), size, meta);
+      }
+
+      /// Zero-copy path for outputs that own their storage: reserve() hands
+      /// out a buffer of at least size bytes for the producer to fill in
+      /// place, and commit() publishes the first size bytes of it as a frame.
+      /// The default has no storage, returns nullptr, and the producer falls
+      /// back to write(). A reservation not committed is dropped by abandon()
+      /// or by the next reserve().
+      virtual char* reserve(size_t /*size*/) { return nullptr; }
+      virtual long commit(size_t /*size*/, const FrameMetadata& /*meta*/) { return ERROR; }
+      virtual void abandon() { }
+
+      /// Outputs that buffer frames report how full they are; the default
+      /// has no queue
+      virtual QueueStatus queue_status() const { return {}; }
+
+      /// Decorators return the output they forward to, so the chain can
+      /// be searched for a concrete writer
+      virtual FrameOutput* decorated() const { return nullptr; }
+
+      /// Counters for the metrics snapshot; the default knows only the queue
+      virtual OutputMetrics metrics() const {
+        OutputMetrics m;
+        m.kind  = "output";
+        m.queue = this->queue_status();
+        return m;
+      }
   };
 
+  /// Metrics of output and every output it decorates, outermost first
+  inline std::vector<OutputMetrics> chain_metrics(const FrameOutput &output) {
+    std::vector<OutputMetrics> chain;
+    for (const FrameOutput* link = &output; link; link = link->decorated()) chain.push_back(link->metrics());
+    return chain;
+  }
+
 }
@@ -6,15 +6,61 @@
 #include "frame_output_factory.h"
 #include "fits_writer.h"
 #include "cadence_gate.h"
+#include "roi_output.h"
+#include "centroider.h"
+#include "pixel_convert.h"
 #include "shared_memory_writer.h"
+#include "raw_recorder.h"
+#include "zmq_publisher.h"
+#include "async_output.h"
+#include "preview_output.h"
+#include "trigger_ring.h"
+#include "telemetry_output.h"
 #include "common.h"
 
+#include <sstream>
 #include <stdexcept>
 #include <utility>
 
 namespace {
-  bool parse_bool(const std::string &v) {
-    return v == "yes" || v == "YES" || v == "true" || v == "TRUE" || v == "1";
+  // "<x0> <y0> <width> <height>"
+  Camera::RoiWindow parse_roi_window(const std::string &v) {
+    std::istringstream iss(v);
+    Camera::RoiWindow w;
+    if (!(iss >> w.x0 >> w.y0 >> w.width >> w.height) || w.width == 0 || w.height == 0) {
+      throw std::invalid_argument("expected <x0> <y0> <width> <height>");
+    }
+    return w;
+  }
+
+  // "<width>x<height>", width 0 for whole rows
+  void parse_tile(const std::string &v, uint32_t &width, uint32_t &height) {
+    char x = 0;
+    std::istringstream iss(v);
+    if (!(iss >> width >> x >> height) || x != 'x' || height == 0) {
+      throw std::invalid_argument("expected <width>x<height>");
+    }
+  }
+
+  // a rate in Hz, above 0
+  double parse_rate(const std::string &v) {
+    const double hz = std::stod(v);
+    if (!(hz > 0)) throw std::invalid_argument("expected a rate above 0");
+    return hz;
+  }
+
+  std::string roi_suffix(size_t id) {
+    return "_roi" + std::to_string(id);
+  }
+
+  // Gives an output that would otherwise do its work on the dispatching
+  // thread a thread and queue of its own
+  std::unique_ptr<Camera::FrameOutput> detach(std::unique_ptr<Camera::FrameOutput> output,
+                                              const Camera::FrameOutputsConfig &cfg) {
+    if (!cfg.async_enabled) return output;
+    auto async = std::make_unique<Camera::AsyncOutput>(std::move(output), cfg.async);
+    async->start();
+    return async;
   }
 }
 
@@ -22,6 +68,7 @@ namespace Camera {
 
   void apply_config_overrides(FrameOutputsConfig &out, const Config &cfg) {
     const std::string function("Camera::apply_config_overrides");
+    bool roi_from_cfg = false;   // first ROI_WINDOW replaces any caller default
     for (int row = 0; row < cfg.n_rows; ++row) {
       const auto &key = cfg.param[row];
       const auto &val = cfg.arg[row];
@@ -29,12 +76,115 @@ namespace Camera {
         if      (key == "SHM_ENABLED")            out.shm_enabled            = parse_bool(val);
         else if (key == "SHM_SEGMENT_NAME")       out.shm_segment_name       = val;
         else if (key == "SHM_NUM_FRAMES")         out.shm_num_frames         = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "SHM_CONVERT")            out.shm_convert.mode       = parse_convert_mode(val);
+        else if (key == "SHM_CONVERT_SHIFT")      out.shm_convert.shift      = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "SHM_CONVERT_SCALE")      out.shm_convert.scale      = std::stof(val);
+        else if (key == "SHM_CONVERT_OFFSET")     out.shm_convert.offset     = std::stof(val);
+        else if (key == "SHM_BYTESWAP")           out.shm_convert.byteswap   = parse_bool(val);
+        else if (key == "SHM_HUGEPAGES")          out.shm_huge_pages         = parse_huge_page_mode(val);
+        else if (key == "SHM_HUGETLBFS_DIR")      out.shm_hugetlbfs_dir      = val;
+        else if (key == "SHM_NUMA_NODE")          out.shm_numa_node          = std::stoi(val);
+        else if (key == "SHM_OVERFLOW")           out.shm_overflow           = parse_overflow_policy(val);
+        else if (key == "SHM_BLOCK_MS")           out.shm_block_ms           = static_cast<uint32_t>(std::stoul(val));
         else if (key == "FITS_ENABLED")           out.fits_enabled           = parse_bool(val);
+        else if (key == "FITS_CONVERT")           out.fits_convert.mode      = parse_convert_mode(val);
+        else if (key == "FITS_CONVERT_SHIFT")     out.fits_convert.shift     = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "FITS_CONVERT_SCALE")     out.fits_convert.scale     = std::stof(val);
+        else if (key == "FITS_CONVERT_OFFSET")    out.fits_convert.offset    = std::stof(val);
         else if (key == "FITS_OUTPUT_DIR")        out.fits.output_dir        = val;
         else if (key == "FITS_BASENAME")          out.fits.basename          = val;
-        else if (key == "FITS_WRITE_INTERVAL_MS") out.fits_write_interval_ms = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "FITS_WRITE_INTERVAL_MS") out.fits_cadence.interval_ms = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "FITS_CADENCE")           out.fits_cadence.mode        = parse_cadence_mode(val);
+        else if (key == "FITS_CADENCE_N")         out.fits_cadence.every_n     = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "FITS_CADENCE_FILL")      out.fits_cadence.target_fill = std::stod(val);
+        else if (key == "FITS_CADENCE_MIN_HZ")    out.fits_cadence.min_rate_hz = parse_rate(val);
         else if (key == "FITS_QUEUE_SIZE")        out.fits.queue_size        = static_cast<size_t>(std::stoul(val));
+        else if (key == "FITS_COMPRESS")          out.fits.compression       = parse_fits_compression(val);
+        else if (key == "FITS_TILE")              parse_tile(val, out.fits.tile_width, out.fits.tile_height);
+        else if (key == "FITS_QUANTIZE")          out.fits.quantize_level    = std::stof(val);
+        else if (key == "FITS_COMPRESS_THREADS")  out.fits.compress_threads  = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "FITS_CONTAINER")         out.fits.container         = parse_fits_container(val);
+        else if (key == "FITS_FRAMES_PER_FILE")   out.fits.frames_per_file   = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "FITS_BYTES_PER_FILE")    out.fits.bytes_per_file    = std::stoull(val);
+        else if (key == "FITS_PREALLOCATE")       out.fits.preallocate       = parse_bool(val);
         else if (key == "FITS_DRAIN_TIMEOUT_MS")  out.fits.drain_timeout_ms  = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "FITS_WORKERS")           out.fits.workers           = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "FITS_OVERFLOW")          out.fits.overflow          = parse_overflow_policy(val);
+        else if (key == "FITS_BLOCK_MS")          out.fits.block_ms          = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "FITS_SPILL_DIR")         out.fits.spill_dir         = val;
+        else if (key == "FITS_MAX_FRAME_BYTES")   out.fits.max_frame_bytes   = static_cast<size_t>(std::stoull(val));
+        else if (key == "FITS_CHECKSUM")          out.fits.checksum          = parse_bool(val);
+        else if (key == "FITS_HASH")              out.fits.content_hash      = parse_bool(val);
+        else if (key == "ROI_WINDOW") {
+          const auto window = parse_roi_window(val);
+          if (!roi_from_cfg) { out.roi_windows.clear(); roi_from_cfg = true; }
+          out.roi_windows.push_back(window);
+        }
+        else if (key == "ROI_SHM_ENABLED")            out.roi_shm_enabled            = parse_bool(val);
+        else if (key == "ROI_SHM_NUM_FRAMES")         out.roi_shm_num_frames         = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "ROI_FITS_ENABLED")           out.roi_fits_enabled           = parse_bool(val);
+        else if (key == "RAW_ENABLED")                out.raw_enabled                = parse_bool(val);
+        else if (key == "RAW_OUTPUT_DIR")             out.raw.output_dir             = val;
+        else if (key == "RAW_BASENAME")               out.raw.basename               = val;
+        else if (key == "RAW_QUEUE_DEPTH")            out.raw.queue_depth            = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "RAW_MAX_FRAME_BYTES")        out.raw.max_frame_bytes        = static_cast<size_t>(std::stoull(val));
+        else if (key == "RAW_BYTES_PER_FILE")         out.raw.bytes_per_file         = std::stoull(val);
+        else if (key == "RAW_IO")                     out.raw.io                     = parse_raw_io_mode(val);
+        else if (key == "RAW_IO_THREADS")             out.raw.io_threads             = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "RAW_HUGEPAGES")              out.raw.huge_pages             = parse_huge_page_mode(val);
+        else if (key == "RAW_OVERFLOW")               out.raw.overflow               = parse_overflow_policy(val);
+        else if (key == "RAW_BLOCK_MS")               out.raw.block_ms               = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "ZMQ_ENABLED")                out.zmq_enabled                = parse_bool(val);
+        else if (key == "ZMQ_ENDPOINT")               out.zmq.endpoint               = val;
+        else if (key == "ZMQ_PATTERN")                out.zmq.pattern                = parse_zmq_pattern(val);
+        else if (key == "ZMQ_TOPIC")                  out.zmq.topic                  = val;
+        else if (key == "ZMQ_CHUNK_BYTES")            out.zmq.chunk_bytes            = static_cast<size_t>(std::stoull(val));
+        else if (key == "ZMQ_HWM")                    out.zmq.hwm                    = std::stoi(val);
+        else if (key == "ZMQ_OVERFLOW")               out.zmq.overflow               = parse_overflow_policy(val);
+        else if (key == "ZMQ_BLOCK_MS")               out.zmq.block_ms               = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "ZMQ_IO_THREADS")             out.zmq.io_threads             = std::stoi(val);
+        else if (key == "ZMQ_WRITE_INTERVAL_MS")      out.zmq_cadence.interval_ms    = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "ZMQ_CADENCE")                out.zmq_cadence.mode           = parse_cadence_mode(val);
+        else if (key == "ZMQ_CADENCE_N")              out.zmq_cadence.every_n        = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "ASYNC_ENABLED")              out.async_enabled              = parse_bool(val);
+        else if (key == "ASYNC_QUEUE_DEPTH")          out.async.queue_depth          = static_cast<size_t>(std::stoul(val));
+        else if (key == "ASYNC_OVERFLOW")             out.async.overflow             = parse_overflow_policy(val);
+        else if (key == "ASYNC_BLOCK_MS")             out.async.block_ms             = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "PREVIEW_ENABLED")            out.preview_enabled            = parse_bool(val);
+        else if (key == "PREVIEW_INTERVAL_MS")        out.preview_interval_ms        = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "PREVIEW_SIZE")               out.preview.max_size           = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "PREVIEW_METHOD")             out.preview.method             = parse_preview_method(val);
+        else if (key == "PREVIEW_LOW_PCT")            out.preview.low_pct            = std::stod(val);
+        else if (key == "PREVIEW_HIGH_PCT")           out.preview.high_pct           = std::stod(val);
+        else if (key == "PREVIEW_FORMAT")             out.preview.format             = parse_preview_format(val);
+        else if (key == "PREVIEW_SHM_SEGMENT")        out.preview.shm_segment        = val;
+        else if (key == "PREVIEW_PATH")               out.preview.image_path         = val;
+        else if (key == "PREVIEW_JPEG_QUALITY")       out.preview.jpeg_quality       = std::stoi(val);
+        else if (key == "TRIGGER_ENABLED")            out.trigger_enabled            = parse_bool(val);
+        else if (key == "TRIGGER_BUDGET_MB")          out.trigger.budget_bytes       = std::stoull(val) << 20;
+        else if (key == "TRIGGER_SECONDS")            out.trigger.seconds            = std::stod(val);
+        else if (key == "TRIGGER_POST_FRAMES")        out.trigger.post_frames        = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "TRIGGER_HUGEPAGES")          out.trigger.huge_pages         = parse_huge_page_mode(val);
+        else if (key == "TRIGGER_DUMP")               out.trigger.dump               = parse_trigger_dump(val);
+        else if (key == "TRIGGER_SIGMA")              out.trigger.trigger_sigma      = std::stod(val);
+        else if (key == "TRIGGER_WARMUP")             out.trigger.trigger_warmup     = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "ROI_FITS_WRITE_INTERVAL_MS") out.roi_fits_write_interval_ms = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "CENTROID_ENABLED")           out.centroid_enabled           = parse_bool(val);
+        else if (key == "CENTROID_BUDGET_US")         out.centroid.budget_us         = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "CENTROID_UDP_GROUP")         out.centroid.udp_group         = val;
+        else if (key == "CENTROID_UDP_PORT")          out.centroid.udp_port          = std::stoi(val);
+        else if (key == "CENTROID_SHM_SEGMENT")       out.centroid.shm_segment       = val;
+        else if (key == "CENTROID_SHM_NUM_FRAMES")    out.centroid.shm_num_frames    = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "CENTROID_REPORT_FRAMES")     out.centroid.report_frames     = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "TELEMETRY_ENABLED")          out.telemetry_enabled          = parse_bool(val);
+        else if (key == "TELEMETRY_UDP_GROUP")        out.telemetry.udp_group        = val;
+        else if (key == "TELEMETRY_UDP_PORT")         out.telemetry.udp_port         = std::stoi(val);
+        else if (key == "TELEMETRY_FORMAT")           out.telemetry.format           = parse_telemetry_format(val);
+        else if (key == "TELEMETRY_TAPS")             out.telemetry.taps             = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "TELEMETRY_SAMPLE")           out.telemetry.sample           = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "TELEMETRY_INTERVAL_MS")      out.telemetry_cadence.interval_ms = static_cast<uint32_t>(std::stoul(val));
+        else if (key == "TELEMETRY_CADENCE")          out.telemetry_cadence.mode     = parse_cadence_mode(val);
+        else if (key == "TELEMETRY_CADENCE_N")        out.telemetry_cadence.every_n  = static_cast<uint32_t>(std::stoul(val));
       }
       catch (const std::exception &e) {
         logwrite(function, "WARNING bad value for " + key + "=" + val + ": " + e.what());
@@ -54,11 +204,18 @@ namespace Camera {
       else {
         auto shm = std::make_unique<SharedMemoryWriter>(
             cfg.shm_segment_name, cfg.shm_max_frame_bytes, cfg.shm_num_frames);
+        shm->set_backing(cfg.shm_huge_pages, cfg.shm_hugetlbfs_dir, cfg.shm_numa_node);
+        shm->set_overflow(cfg.shm_overflow, cfg.shm_block_ms);
         if (shm->open() == NO_ERROR) {
           logwrite(function, "SHM output enabled: segment=" + cfg.shm_segment_name +
                    " max_bytes=" + std::to_string(cfg.shm_max_frame_bytes) +
-                   " frames=" + std::to_string(cfg.shm_num_frames));
-          outputs.push_back(std::move(shm));
+                   " frames=" + std::to_string(cfg.shm_num_frames) +
+                   " overflow=" + to_string(cfg.shm_overflow));
+          std::unique_ptr<FrameOutput> output = std::move(shm);
+          if (cfg.shm_convert.mode != ConvertMode::None || cfg.shm_convert.byteswap) {
+            output = std::make_unique<PixelConverter>(std::move(output), cfg.shm_convert);
+          }
+          outputs.push_back(std::move(output));
         }
         else {
           logwrite(function, "WARNING SHM output failed to open; skipped");
@@ -67,15 +224,23 @@ namespace Camera {
     }
 
     if (cfg.fits_enabled) {
-      auto fits = std::make_unique<FitsWriter>(cfg.fits);
+      FitsWriterConfig fits_cfg = cfg.fits;
+      if (fits_cfg.max_frame_bytes == 0) fits_cfg.max_frame_bytes = cfg.shm_max_frame_bytes;
+      auto fits = std::make_unique<FitsWriter>(fits_cfg);
       if (fits->open() == NO_ERROR) {
         logwrite(function, "FITS output enabled: dir=" + cfg.fits.output_dir +
                  " basename=" + cfg.fits.basename +
-                 " interval_ms=" + std::to_string(cfg.fits_write_interval_ms) +
-                 " queue=" + std::to_string(cfg.fits.queue_size));
+                 " cadence=" + to_string(cfg.fits_cadence.mode) +
+                 " interval_ms=" + std::to_string(cfg.fits_cadence.interval_ms) +
+                 " queue=" + std::to_string(cfg.fits.queue_size) +
+                 " workers=" + std::to_string(cfg.fits.workers));
         std::unique_ptr<FrameOutput> output = std::move(fits);
-        if (cfg.fits_write_interval_ms > 0) {
-          output = std::make_unique<CadenceGate>(std::move(output), cfg.fits_write_interval_ms);
+        if (cfg.fits_convert.mode != ConvertMode::None) {
+          output = std::make_unique<PixelConverter>(std::move(output), cfg.fits_convert);
+        }
+        // the gate goes outermost so skipped frames are never converted
+        if (cfg.fits_cadence.active()) {
+          output = std::make_unique<CadenceGate>(std::move(output), cfg.fits_cadence);
         }
         outputs.push_back(std::move(output));
       }
@@ -84,6 +249,156 @@ namespace Camera {
       }
     }
 
+    if (cfg.raw_enabled) {
+      RawRecorderConfig raw_cfg = cfg.raw;
+      if (raw_cfg.max_frame_bytes == 0) raw_cfg.max_frame_bytes = cfg.shm_max_frame_bytes;
+      auto raw = std::make_unique<RawRecorder>(raw_cfg);
+      if (raw->open() == NO_ERROR) {
+        logwrite(function, "raw recorder enabled: session=" + raw->session() +
+                 " depth=" + std::to_string(raw_cfg.queue_depth));
+        outputs.push_back(std::move(raw));
+      }
+      else {
+        logwrite(function, "WARNING raw recorder failed to open; skipped");
+      }
+    }
+
+    if (cfg.zmq_enabled) {
+      std::unique_ptr<FrameOutput> output = std::make_unique<ZmqPublisher>(cfg.zmq);
+      if (output->open() == NO_ERROR) {
+        logwrite(function, "ZeroMQ output enabled: endpoint=" + cfg.zmq.endpoint +
+                 " cadence=" + to_string(cfg.zmq_cadence.mode) +
+                 " interval_ms=" + std::to_string(cfg.zmq_cadence.interval_ms));
+        if (cfg.zmq_cadence.active()) {
+          output = std::make_unique<CadenceGate>(std::move(output), cfg.zmq_cadence);
+        }
+        outputs.push_back(detach(std::move(output), cfg));
+      }
+      else {
+        logwrite(function, "WARNING ZeroMQ output failed to open; skipped");
+      }
+    }
+
+    // The gate thins frames before they are queued, and the single-slot
+    // queue drops whatever arrives while a preview is being made, so the
+    // dispatching thread never pays more than a clock read and an enqueue
+    if (cfg.preview_enabled) {
+      auto preview = std::make_unique<PreviewOutput>(cfg.preview);
+      if (preview->open() == NO_ERROR) {
+        auto async = std::make_unique<AsyncOutput>(std::move(preview), AsyncOutputConfig{1, OverflowPolicy::DropNewest, 0});
+        async->start();
+        std::unique_ptr<FrameOutput> output = std::move(async);
+        if (cfg.preview_interval_ms > 0) {
+          output = std::make_unique<CadenceGate>(std::move(output), cfg.preview_interval_ms);
+        }
+        outputs.push_back(std::move(output));
+      }
+      else {
+        logwrite(function, "WARNING preview output failed to open; skipped");
+      }
+    }
+
+    // Written on the dispatching thread: recording is one copy into a
+    // preallocated slot, and dumps run on the ring's own thread
+    if (cfg.trigger_enabled) {
+      TriggerRingConfig trig_cfg = cfg.trigger;
+      if (trig_cfg.max_frame_bytes == 0) trig_cfg.max_frame_bytes = cfg.shm_max_frame_bytes;
+      trig_cfg.fits = cfg.fits;
+      trig_cfg.raw  = cfg.raw;
+      auto ring = std::make_unique<TriggerRing>(trig_cfg);
+      if (ring->open() == NO_ERROR) {
+        logwrite(function, "pre-trigger ring enabled: frames=" + std::to_string(ring->stats().slots) +
+                 " seconds=" + std::to_string(static_cast<int>(trig_cfg.seconds)) +
+                 " post_frames=" + std::to_string(trig_cfg.post_frames));
+        outputs.push_back(std::move(ring));
+      }
+      else {
+        logwrite(function, "WARNING pre-trigger ring failed to open; skipped");
+      }
+    }
+
+    // ROI and centroid outputs move together when a window is moved
+    std::shared_ptr<RoiTable> table;
+    if (!cfg.roi_windows.empty()) table = std::make_shared<RoiTable>(cfg.roi_windows);
+
+    if (table && (cfg.roi_shm_enabled || cfg.roi_fits_enabled)) {
+      std::vector<std::vector<std::unique_ptr<FrameOutput>>> sinks(cfg.roi_windows.size());
+
+      for (size_t id = 0; id < cfg.roi_windows.size(); ++id) {
+        const auto &w = cfg.roi_windows[id];
+        if (cfg.roi_shm_enabled) {
+          // size for the widest sample mode so a window never outgrows its slot
+          const size_t max_bytes = static_cast<size_t>(w.width) * w.height * sizeof(uint32_t);
+          auto shm = std::make_unique<SharedMemoryWriter>(
+              cfg.shm_segment_name + roi_suffix(id), max_bytes, cfg.roi_shm_num_frames);
+          shm->set_overflow(cfg.shm_overflow, cfg.shm_block_ms);
+          sinks[id].push_back(std::move(shm));
+        }
+        if (cfg.roi_fits_enabled) {
+          FitsWriterConfig fits_cfg = cfg.fits;
+          fits_cfg.basename += roi_suffix(id);
+          fits_cfg.max_frame_bytes = static_cast<size_t>(w.width) * w.height * sizeof(uint32_t);
+          std::unique_ptr<FrameOutput> fits = std::make_unique<FitsWriter>(fits_cfg);
+          if (cfg.roi_fits_write_interval_ms > 0) {
+            fits = std::make_unique<CadenceGate>(std::move(fits), cfg.roi_fits_write_interval_ms);
+          }
+          sinks[id].push_back(std::move(fits));
+        }
+      }
+
+      auto roi = std::make_unique<RoiOutput>(table, std::move(sinks));
+      if (roi->open() == NO_ERROR) {
+        logwrite(function, "ROI output enabled: windows=" + std::to_string(cfg.roi_windows.size()) +
+                 " shm=" + (cfg.roi_shm_enabled ? "yes" : "no") +
+                 " fits=" + (cfg.roi_fits_enabled ? "yes" : "no"));
+        outputs.push_back(detach(std::move(roi), cfg));
+      }
+      else {
+        logwrite(function, "WARNING ROI output failed to open; skipped");
+      }
+    }
+
+    if (cfg.centroid_enabled) {
+      if (!table) {
+        logwrite(function, "WARNING centroid_enabled but no ROI_WINDOW configured; centroid skipped");
+      }
+      else {
+        auto centroid = std::make_unique<CentroidOutput>(table, cfg.centroid);
+        if (centroid->open() == NO_ERROR) {
+          outputs.push_back(detach(std::move(centroid), cfg));
+        }
+        else {
+          logwrite(function, "WARNING centroid output failed to open; skipped");
+        }
+      }
+    }
+
+    // Built last so it can watch every other output. It goes first in the
+    // list, so it is destroyed, and stops reading their queues, before them.
+    if (cfg.telemetry_enabled) {
+      auto telemetry = std::make_unique<TelemetryOutput>(cfg.telemetry);
+      if (telemetry->open() == NO_ERROR) {
+        std::vector<const FrameOutput*> watched;
+        for (const auto &output : outputs) watched.push_back(output.get());
+        telemetry->watch(std::move(watched));
+        logwrite(function, "telemetry enabled: udp=" + cfg.telemetry.udp_group + ":" +
+                 std::to_string(cfg.telemetry.udp_port) +
+                 " cadence=" + to_string(cfg.telemetry_cadence.mode) +
+                 " interval_ms=" + std::to_string(cfg.telemetry_cadence.interval_ms) +
+                 " outputs=" + std::to_string(outputs.size()));
+        auto async = std::make_unique<AsyncOutput>(std::move(telemetry), AsyncOutputConfig{1, OverflowPolicy::DropNewest, 0});
+        async->start();
+        std::unique_ptr<FrameOutput> output = std::move(async);
+        if (cfg.telemetry_cadence.active()) {
+          output = std::make_unique<CadenceGate>(std::move(output), cfg.telemetry_cadence);
+        }
+        outputs.insert(outputs.begin(), std::move(output));
+      }
+      else {
+        logwrite(function, "WARNING telemetry output failed to open; skipped");
+      }
+    }
+
     if (outputs.empty()) {
       logwrite(function, "no frame outputs configured");
     }
@@ -11,6 +11,17 @@
 #include "config.h"
 #include "frame_output.h"
 #include "fits_writer.h"
+#include "roi_output.h"
+#include "centroider.h"
+#include "pixel_convert.h"
+#include "cadence_gate.h"
+#include "frame_buffer_pool.h"
+#include "raw_recorder.h"
+#include "zmq_publisher.h"
+#include "async_output.h"
+#include "preview_output.h"
+#include "trigger_ring.h"
+#include "telemetry_output.h"
 
 #include <cstddef>
 #include <cstdint>
@@ -25,10 +36,62 @@ namespace Camera {
     std::string shm_segment_name{"camera"};
     size_t      shm_max_frame_bytes{0};   // required > 0 when shm_enabled
     uint32_t    shm_num_frames{4};
+    ConvertConfig shm_convert;            // e.g. float for analysis consumers
+    HugePageMode shm_huge_pages{HugePageMode::None};
+    std::string  shm_hugetlbfs_dir{"/dev/hugepages"};
+    int          shm_numa_node{-1};       // -1 leaves placement to the kernel
+    OverflowPolicy shm_overflow{OverflowPolicy::DropOldest};   // toward a lossless reader
+    uint32_t     shm_block_ms{100};
 
     bool             fits_enabled{false};
-    uint32_t         fits_write_interval_ms{0};
-    FitsWriterConfig fits;
+    CadenceConfig    fits_cadence;        // interval 0 forwards every frame
+    ConvertConfig    fits_convert;        // none keeps the native sample type
+    FitsWriterConfig fits;                // max_frame_bytes 0 takes shm_max_frame_bytes
+
+    // Burst recording; max_frame_bytes 0 takes shm_max_frame_bytes
+    bool              raw_enabled{false};
+    RawRecorderConfig raw;
+
+    // Network delivery to quick-look machines; see zmqsub
+    bool               zmq_enabled{false};
+    CadenceConfig      zmq_cadence;
+    ZmqPublisherConfig zmq;
+
+    // Small 8-bit images for GUIs, made on their own thread at most
+    // every preview_interval_ms; a preview still in progress skips the next
+    bool          preview_enabled{false};
+    uint32_t      preview_interval_ms{250};
+    PreviewConfig preview;
+
+    // The last few seconds of frames kept in RAM and written out by the
+    // trigger command; dumps use the FITS or raw settings above, and
+    // max_frame_bytes 0 takes shm_max_frame_bytes
+    bool              trigger_enabled{false};
+    TriggerRingConfig trigger;
+
+    // One output chain per window; segment and file names get a "_roi<N>" suffix
+    std::vector<RoiWindow> roi_windows;
+    bool     roi_shm_enabled{false};
+    uint32_t roi_shm_num_frames{4};
+    bool     roi_fits_enabled{false};
+    uint32_t roi_fits_write_interval_ms{0};
+
+    // Measures every ROI window; shares the window table with the ROI output
+    bool           centroid_enabled{false};
+    CentroidConfig centroid;
+
+    // One datagram per frame forwarded by the cadence (by default every
+    // telemetry_cadence.interval_ms) with tap statistics and the queues
+    // of all the outputs above; a datagram still being made skips the next
+    bool            telemetry_enabled{false};
+    CadenceConfig   telemetry_cadence{CadenceMode::Interval, 1000};
+    TelemetryConfig telemetry;
+
+    // The ZeroMQ, ROI and centroid outputs each get a thread and bounded
+    // queue, so none of them holds up dispatch or the others. SHM writes
+    // in place and FITS and raw already queue, so they are left as they are.
+    bool              async_enabled{true};
+    AsyncOutputConfig async;
   };
 
   // Defaults set on `out` by the caller survive for keys not present in cfg
@@ -0,0 +1,180 @@
+/**
+ * @file    job_table.cpp
+ * @brief   job IDs, states and waiters for commands run asynchronously
+ */
+
+#include "job_table.h"
+#include "common.h"
+
+#include <chrono>
+#include <vector>
+
+namespace {
+
+  // a reply ends with DONE or ERROR and a newline, JSON replies with JEOF
+  bool reply_is_error(const std::string &reply) {
+    size_t end = reply.find_last_not_of(" \r\n");
+    if (end == std::string::npos) return false;
+    return end >= 4 && reply.compare(end - 4, 5, "ERROR") == 0;
+  }
+
+}
+
+namespace Camera {
+
+  JobTable::JobTable(size_t keep_finished)
+    : keep_finished_(keep_finished) {
+  }
+
+  JobTable::~JobTable() {
+    this->stop();
+  }
+
+  void JobTable::set_notify(Notify notify) {
+    std::lock_guard lock(notify_mtx_);
+    notify_ = std::move(notify);
+  }
+
+  void JobTable::start_progress(Progress progress, unsigned interval_ms) {
+    if (!progress || interval_ms == 0 || progress_thread_.joinable()) return;
+    progress_    = std::move(progress);
+    interval_ms_ = interval_ms;
+    progress_thread_ = std::thread(&JobTable::progress_loop, this);
+  }
+
+  void JobTable::stop() {
+    {
+      std::lock_guard lock(mtx_);
+      stop_ = true;
+    }
+    changed_.notify_all();
+    if (progress_thread_.joinable()) progress_thread_.join();
+  }
+
+  uint64_t JobTable::create(const std::string &line) {
+    nlohmann::json msg;
+    uint64_t id;
+    {
+      std::lock_guard lock(mtx_);
+      id = next_id_++;
+      JobInfo &job = jobs_[id];
+      job.id           = id;
+      job.line         = line;
+      job.state        = "queued";
+      job.submitted_ns = get_clock_time_nsec();
+      msg = this->message(job, job.submitted_ns);
+    }
+    this->notify(msg);
+    return id;
+  }
+
+  void JobTable::started(uint64_t id) {
+    nlohmann::json msg;
+    {
+      std::lock_guard lock(mtx_);
+      auto it = jobs_.find(id);
+      if (it == jobs_.end()) return;
+      it->second.state      = "running";
+      it->second.started_ns = get_clock_time_nsec();
+      msg = this->message(it->second, it->second.started_ns);
+    }
+    changed_.notify_all();
+    this->notify(msg);
+  }
+
+  void JobTable::finished(uint64_t id, const std::string &reply) {
+    nlohmann::json msg;
+    {
+      std::lock_guard lock(mtx_);
+      auto it = jobs_.find(id);
+      if (it == jobs_.end()) return;
+      JobInfo &job = it->second;
+      job.state       = reply_is_error(reply) ? "error" : "done";
+      job.reply       = reply;
+      job.finished_ns = get_clock_time_nsec();
+      if (job.started_ns == 0) job.started_ns = job.finished_ns;
+      msg = this->message(job, job.finished_ns);
+
+      // drop the oldest finished jobs beyond the limit, never this one,
+      // or a long job could go the moment it ends, before its waiter sees it
+      if (++n_finished_ > keep_finished_) {
+        for (auto old = jobs_.begin(); old != jobs_.end(); ++old) {
+          if (old->first != id && old->second.finished()) { jobs_.erase(old); --n_finished_; break; }
+        }
+      }
+    }
+    changed_.notify_all();
+    this->notify(msg);
+  }
+
+  long JobTable::wait(uint64_t id, int timeout_ms, JobInfo &info) {
+    std::unique_lock lock(mtx_);
+    auto done = [&]() {
+      auto it = jobs_.find(id);
+      return stop_ || it == jobs_.end() || it->second.finished();
+    };
+    if (timeout_ms < 0) changed_.wait(lock, done);
+    else changed_.wait_for(lock, std::chrono::milliseconds(timeout_ms), done);
+
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return ERROR;
+    info = it->second;
+    return info.finished() ? NO_ERROR : TIMEOUT;
+  }
+
+  nlohmann::json JobTable::list() const {
+    nlohmann::json jobs = nlohmann::json::array();
+    std::lock_guard lock(mtx_);
+    const uint64_t now = get_clock_time_nsec();
+    for (const auto &[id, job] : jobs_) jobs.push_back(this->message(job, now));
+    return jobs;
+  }
+
+  nlohmann::json JobTable::message(const JobInfo &job, uint64_t now) const {
+    nlohmann::json j;
+    j["messagetype"] = "job";
+    j["job"]         = job.id;
+    j["command"]     = job.line;
+    j["state"]       = job.state;
+    const uint64_t since = job.started_ns ? job.started_ns : job.submitted_ns;
+    const uint64_t until = job.finished_ns ? job.finished_ns : now;
+    j["elapsed_s"]   = (until - since) / 1.0e9;
+    if (job.finished()) {
+      std::string reply = job.reply;
+      reply.erase(reply.find_last_not_of(" \r\n") + 1);
+      j["reply"] = reply;
+    }
+    return j;
+  }
+
+  void JobTable::notify(const nlohmann::json &message) {
+    std::lock_guard lock(notify_mtx_);
+    if (notify_) notify_(message);
+  }
+
+  void JobTable::progress_loop() {
+    std::unique_lock lock(mtx_);
+    auto next = std::chrono::steady_clock::now();
+    while (!stop_) {
+      next += std::chrono::milliseconds(interval_ms_);
+      if (changed_.wait_until(lock, next, [this]{ return stop_; })) break;
+
+      std::vector<nlohmann::json> running;
+      const uint64_t now = get_clock_time_nsec();
+      for (const auto &[id, job] : jobs_) {
+        if (job.state == "running") running.push_back(this->message(job, now));
+      }
+      if (running.empty()) continue;
+
+      lock.unlock();
+      const nlohmann::json progress = progress_();
+      for (auto &msg : running) {
+        msg["messagetype"] = "jobprogress";
+        msg["progress"]    = progress;
+        this->notify(msg);
+      }
+      lock.lock();
+    }
+  }
+
+}
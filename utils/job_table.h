@@ -0,0 +1,92 @@
+/**
+ * @file    job_table.h
+ * @brief   job IDs, states and waiters for commands run asynchronously
+ *
+ * A command sent as "async <command>" is given a job ID at once and runs
+ * later; the table follows it from queued through running to done or
+ * error, keeps its reply for a later "wait", and reports each change and,
+ * while a job runs, periodic progress through a notify callback (the UDP
+ * multicast group in camerad). Finished jobs are kept, oldest dropped
+ * first, up to a limit.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+namespace Camera {
+
+  struct JobInfo {
+    uint64_t    id{0};
+    std::string line;                   ///< the command as submitted
+    std::string state;                  ///< queued, running, done or error
+    std::string reply;                  ///< the command's reply once finished
+    uint64_t    submitted_ns{0};
+    uint64_t    started_ns{0};
+    uint64_t    finished_ns{0};
+
+    bool finished() const { return state == "done" || state == "error"; }
+  };
+
+  class JobTable {
+    public:
+      using Notify   = std::function<void(const nlohmann::json &message)>;
+      using Progress = std::function<nlohmann::json()>;
+
+      explicit JobTable(size_t keep_finished = 256);
+      ~JobTable();
+
+      JobTable(const JobTable&) = delete;
+      JobTable& operator=(const JobTable&) = delete;
+
+      /// where state changes and progress go; none until set
+      void set_notify(Notify notify);
+
+      /// while a job runs, send progress() every interval_ms (0 for never)
+      void start_progress(Progress progress, unsigned interval_ms);
+      void stop();
+
+      uint64_t create(const std::string &line);
+      void started(uint64_t id);
+      void finished(uint64_t id, const std::string &reply);
+
+      /**
+       * Waits up to timeout_ms (negative for no limit) for job id to finish
+       * and fills info. ERROR if there is no such job, TIMEOUT if it is
+       * still running, else NO_ERROR.
+       */
+      long wait(uint64_t id, int timeout_ms, JobInfo &info);
+
+      /// every job kept, oldest first
+      nlohmann::json list() const;
+
+    private:
+      nlohmann::json message(const JobInfo &job, uint64_t now) const;
+      void notify(const nlohmann::json &message);
+      void progress_loop();
+
+      const size_t keep_finished_;
+
+      mutable std::mutex mtx_;
+      std::condition_variable changed_;
+      std::map<uint64_t, JobInfo> jobs_;
+      uint64_t next_id_{1};
+      size_t   n_finished_{0};
+      bool     stop_{false};
+
+      std::mutex notify_mtx_;
+      Notify notify_;
+
+      Progress progress_;
+      unsigned interval_ms_{0};
+      std::thread progress_thread_;
+  };
+
+}
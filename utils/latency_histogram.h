@@ -0,0 +1,90 @@
+/**
+ * @file    latency_histogram.h
+ * @brief   fixed-size, lock-free histogram of latencies
+ *
+ * Power-of-two buckets of microseconds, so recording is a few relaxed
+ * atomic adds from any thread and the memory never grows however long
+ * the night. Percentiles come out to within a factor of two, which is
+ * enough to tell a 50 us output from a 5 ms one.
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+namespace Camera {
+
+  struct LatencySnapshot {
+    static constexpr size_t BUCKETS = 32;
+    std::array<uint64_t, BUCKETS> counts{};   ///< counts[i]: [2^(i-1), 2^i) us; counts[0]: under 1 us
+    uint64_t count{0};
+    uint64_t sum_ns{0};
+    uint64_t max_ns{0};
+
+    double mean_us() const { return count > 0 ? sum_ns / 1.0e3 / count : 0.0; }
+    double max_us() const { return max_ns / 1.0e3; }
+
+    /// upper edge of the bucket holding percentile p (0-100), capped at the maximum
+    double percentile_us(double p) const {
+      if (count == 0) return 0.0;
+      const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p / 100.0 * count + 0.5));
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i < BUCKETS; ++i) {
+        cumulative += counts[i];
+        if (cumulative >= rank) return std::min(static_cast<double>(1ULL << i), max_us());
+      }
+      return max_us();
+    }
+  };
+
+  class LatencyHistogram {
+    public:
+      void record(uint64_t ns) {
+        const uint64_t us = ns / 1000;
+        const size_t bucket = us == 0 ? 0 : std::min<size_t>(LatencySnapshot::BUCKETS - 1,
+                                                              64 - __builtin_clzll(us));
+        counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t max = max_ns_.load(std::memory_order_relaxed);
+        while (ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) { }
+      }
+
+      /// records CLOCK_MONOTONIC now less start_ns; a start of 0 means unknown and is ignored
+      void record_since(uint64_t start_ns) {
+        if (start_ns == 0) return;
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        const uint64_t now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        if (now > start_ns) this->record(now - start_ns);
+      }
+
+      /// starts over; a record() racing with this may be partly kept
+      void clear() {
+        for (auto &c : counts_) c.store(0, std::memory_order_relaxed);
+        count_.store(0, std::memory_order_relaxed);
+        sum_ns_.store(0, std::memory_order_relaxed);
+        max_ns_.store(0, std::memory_order_relaxed);
+      }
+
+      LatencySnapshot snapshot() const {
+        LatencySnapshot s;
+        for (size_t i = 0; i < LatencySnapshot::BUCKETS; ++i) s.counts[i] = counts_[i].load(std::memory_order_relaxed);
+        s.count  = count_.load(std::memory_order_relaxed);
+        s.sum_ns = sum_ns_.load(std::memory_order_relaxed);
+        s.max_ns = max_ns_.load(std::memory_order_relaxed);
+        return s;
+      }
+
+    private:
+      std::array<std::atomic<uint64_t>, LatencySnapshot::BUCKETS> counts_{};
+      std::atomic<uint64_t> count_{0};
+      std::atomic<uint64_t> sum_ns_{0};
+      std::atomic<uint64_t> max_ns_{0};
+  };
+
+}
@@ -8,6 +8,7 @@
 // * Compiles for Linux
 // * Takes the port and group on the command line
 // * adopted c++ idiomatic practices
+// * decodes binary telemetry datagrams and prints them as JSON
 //
 
 #include <sys/types.h>
@@ -17,8 +18,11 @@
 
 #include <cstring>
 #include <iostream>
+#include <string>
 
-constexpr size_t MSGBUFSIZE=256;
+#include "telemetry_format.h"
+
+constexpr size_t MSGBUFSIZE=65536;    // largest UDP datagram
 
 int main(int argc, char *argv[]) {
     if (argc < 3) {
@@ -93,8 +97,8 @@ int main(int argc, char *argv[]) {
 
     // now just enter a read-print loop
     //
+    static char msgbuf[MSGBUFSIZE+1];
     while (1) {
-        char msgbuf[MSGBUFSIZE];
         socklen_t addrlen = sizeof(addr);
         int nbytes = recvfrom(
             fd,
@@ -109,9 +113,15 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         msgbuf[nbytes] = '\0';
+
+        // binary telemetry is printed as its JSON form, so it can be filtered the same way
+        std::string text = msgbuf;
+        Camera::TelemetryFrame frame;
+        if (Camera::decode_telemetry(msgbuf, nbytes, frame)) text = Camera::to_json(frame).dump();
+
         if (filterstr != nullptr) {
-            if (strstr(msgbuf, filterstr) != nullptr) std::cout << msgbuf << "\n";
-        } else std::cout << msgbuf << "\n";
+            if (text.find(filterstr) != std::string::npos) std::cout << text << "\n";
+        } else std::cout << text << "\n";
     }
 
     return 0;
@@ -0,0 +1,121 @@
+//
+// membench.cpp
+//
+// Measures frame copy and processing bandwidth with ordinary pages,
+// transparent huge pages and hugetlb pages, for host frame buffers and
+// for the SHM ring, optionally bound to a NUMA node.
+//
+//   membench [-s frame_bytes] [-r reps] [-f ring_frames] [-N numa_node] [-d hugetlbfs_dir]
+//
+
+#include "frame_buffer_pool.h"
+#include "shared_memory_writer.h"
+#include "common.h"
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+namespace {
+
+  constexpr std::string_view usage() {
+    return "usage: membench [-s frame_bytes] [-r reps] [-f ring_frames] [-N numa_node] [-d hugetlbfs_dir]\n";
+  }
+
+  double gbps(size_t bytes, std::chrono::steady_clock::time_point t0) {
+    const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return (s > 0) ? bytes / s / 1.0e9 : 0.0;
+  }
+
+  // stands in for a processing pass: read every pixel once
+  uint64_t sum_pixels(const uint16_t* p, size_t n) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += p[i];
+    return sum;
+  }
+
+}
+
+int main(int argc, char *argv[]) {
+  size_t frame_bytes = 32 << 20;
+  int reps = 50;
+  uint32_t ring_frames = 8;
+  int numa_node = -1;
+  std::string hugetlbfs_dir = "/dev/hugepages";
+
+  try {
+  for ( int i=1; i<argc; ++i ) {
+    const std::string arg = argv[i];
+    if ( arg.size() != 2 || arg[0] != '-' || i+1 >= argc ) { std::cout << usage(); return 1; }
+    switch ( arg[1] ) {
+      case 's' : frame_bytes = std::stoull( argv[++i] ); break;
+      case 'r' : reps = std::stoi( argv[++i] ); break;
+      case 'f' : ring_frames = static_cast<uint32_t>( std::stoul( argv[++i] ) ); break;
+      case 'N' : numa_node = std::stoi( argv[++i] ); break;
+      case 'd' : hugetlbfs_dir = argv[++i]; break;
+      default:   std::cout << usage(); return 1;
+    }
+  }
+  }
+  catch (...) { std::cout << usage(); return 1; }
+
+  std::cout << "frame_bytes=" << frame_bytes << " reps=" << reps
+            << " numa_node=" << numa_node << "\n"
+            << std::fixed << std::setprecision(2);
+
+  volatile uint64_t sink = 0;
+
+  for ( auto want : { Camera::HugePageMode::None, Camera::HugePageMode::Thp, Camera::HugePageMode::Hugetlbfs } ) {
+    // host buffers: copy one frame to another, then read it back
+    //
+    size_t src_bytes = frame_bytes, dst_bytes = frame_bytes;
+    Camera::HugePageMode got_src, got_dst;
+    char* src = static_cast<char*>( Camera::map_frame_memory( src_bytes, want, got_src ) );
+    char* dst = static_cast<char*>( Camera::map_frame_memory( dst_bytes, want, got_dst ) );
+    if ( !src || !dst ) { std::cerr << "ERROR mapping " << Camera::to_string( want ) << " buffers\n"; return 1; }
+    if ( numa_node >= 0 ) {
+      Camera::bind_to_numa_node( src, src_bytes, numa_node );
+      Camera::bind_to_numa_node( dst, dst_bytes, numa_node );
+    }
+    std::memset( src, 1, frame_bytes );
+    std::memset( dst, 0, frame_bytes );
+
+    auto t0 = std::chrono::steady_clock::now();
+    for ( int r=0; r<reps; ++r ) std::memcpy( dst, src, frame_bytes );
+    const double copy = gbps( frame_bytes * reps, t0 );
+
+    t0 = std::chrono::steady_clock::now();
+    for ( int r=0; r<reps; ++r ) sink = sink + sum_pixels( reinterpret_cast<uint16_t*>( dst ), frame_bytes / 2 );
+    const double process = gbps( frame_bytes * reps, t0 );
+
+    // SHM ring: the copy SharedMemoryWriter::write() makes for every frame
+    //
+    Camera::SharedMemoryWriter shm( "membench_" + std::to_string( getpid() ), frame_bytes, ring_frames );
+    shm.set_backing( want, hugetlbfs_dir, numa_node );
+    double shm_write = 0;
+    if ( shm.open() == NO_ERROR ) {
+      Camera::FrameMetadata meta;
+      meta.width = static_cast<uint32_t>( frame_bytes / 2 );
+      meta.height = 1;
+      meta.bytes_per_pixel = 2;
+      t0 = std::chrono::steady_clock::now();
+      for ( int r=0; r<reps; ++r ) shm.write( src, frame_bytes, meta );
+      shm_write = gbps( frame_bytes * reps, t0 );
+      shm.close();
+    }
+
+    std::cout << "requested=" << std::setw(9) << Camera::to_string( want )
+              << "  host(" << Camera::to_string( got_dst ) << "): copy=" << copy << " GB/s"
+              << " process=" << process << " GB/s"
+              << "  shm write=" << shm_write << " GB/s\n";
+
+    Camera::unmap_frame_memory( src, src_bytes );
+    Camera::unmap_frame_memory( dst, dst_bytes );
+  }
+
+  return 0;
+}
@@ -0,0 +1,118 @@
+//
+// netbench.cpp
+//
+// Measures command-parse throughput of TcpSocket::Read(delim) over a
+// loopback connection: a client thread sends n newline-terminated command
+// lines in bulk and the server side reads them back one line at a time,
+// first with the buffered reader and then with the old byte-at-a-time
+// loop for comparison.
+//
+//   netbench [-n lines] [-l line_bytes] [-p port]   (uses port and port+1)
+//
+
+#include "network.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace {
+
+  constexpr std::string_view usage() {
+    return "usage: netbench [-n lines] [-l line_bytes] [-p port]\n";
+  }
+
+  // the reader TcpSocket::Read(delim) replaced: one read() and one clock check per byte
+  int read_bytewise( Network::TcpSocket &sock, std::string &retstring, char delim ) {
+    std::stringstream bufstream;
+    int nread, bytesread=0;
+    char buf[2] = { 0, 0 };
+    auto tstart = std::chrono::steady_clock::now();
+    while ( ( nread = read( sock.getfd(), buf, 1 ) ) > 0 ) {
+      bytesread++;
+      bufstream << buf;
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - tstart ).count();
+      if ( elapsed > Network::POLLTIMEOUT || buf[0] == delim ) break;
+    }
+    retstring = bufstream.str();
+    return ( nread <= 0 ? nread : bytesread );
+  }
+
+  template <class Reader>
+  bool run( const char* name, int port, const std::string &payload, size_t lines, Reader reader ) {
+    Network::TcpSocket server( port, true, -1, 0 );
+    if ( server.Listen() < 0 ) { std::cerr << "ERROR listening on port " << port << "\n"; return false; }
+
+    std::thread client( [&]() {
+      Network::TcpSocket sock( "127.0.0.1", port );
+      try { sock.Connect(); }
+      catch ( const std::exception &e ) { std::cerr << "ERROR " << e.what() << "\n"; return; }
+      sock.Write( payload );
+    } );
+
+    if ( server.Accept() < 0 ) { client.join(); return false; }
+
+    auto t0 = std::chrono::steady_clock::now();
+    size_t got = 0, bytes = 0;
+    std::string line;
+    while ( got < lines ) {
+      int ret = reader( server, line );
+      if ( ret <= 0 ) break;
+      bytes += line.size();
+      ++got;
+    }
+    const double s = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+    client.join();
+
+    std::cout << std::left << std::setw(10) << name << std::right
+              << std::setw(10) << got << " lines "
+              << std::setw(12) << ( s > 0 ? got / s : 0.0 ) << " lines/s "
+              << std::setw(9) << ( s > 0 ? bytes / s / 1.0e6 : 0.0 ) << " MB/s\n";
+    return got == lines;
+  }
+
+}
+
+int main(int argc, char *argv[]) {
+  size_t lines = 200000;
+  size_t line_bytes = 32;
+  int port = 50777;
+
+  try {
+  for ( int i=1; i<argc; ++i ) {
+    const std::string arg = argv[i];
+    if ( arg.size() != 2 || arg[0] != '-' || i+1 >= argc ) { std::cout << usage(); return 1; }
+    switch ( arg[1] ) {
+      case 'n' : lines = std::stoull( argv[++i] ); break;
+      case 'l' : line_bytes = std::stoull( argv[++i] ); break;
+      case 'p' : port = std::stoi( argv[++i] ); break;
+      default:   std::cout << usage(); return 1;
+    }
+  }
+  }
+  catch (...) { std::cout << usage(); return 1; }
+  if ( line_bytes < 2 ) line_bytes = 2;
+
+  // "status 000001 xxxx...\n" and so on, each line_bytes long
+  //
+  std::string payload;
+  payload.reserve( lines * line_bytes );
+  for ( size_t n=0; n<lines; ++n ) {
+    std::string line = "status " + std::to_string( n );
+    line.resize( line_bytes - 1, 'x' );
+    payload += line;
+    payload += '\n';
+  }
+
+  std::cout << "lines=" << lines << " line_bytes=" << line_bytes << "\n" << std::fixed << std::setprecision(1);
+
+  bool ok = run( "buffered", port, payload, lines,
+                 []( Network::TcpSocket &s, std::string &l ) { return s.Read( l, '\n' ); } );
+  ok = run( "bytewise", port+1, payload, lines,
+            []( Network::TcpSocket &s, std::string &l ) { return read_bytewise( s, l, '\n' ); } ) && ok;
+
+  return ok ? 0 : 1;
+}
@@ -384,6 +384,8 @@ namespace Network {
     this->host = "";
     this->addrs = NULL;
     this->connection_open = false;
+    this->rxhead = 0;
+    this->rxtail = 0;
   };
   /**************** Network::TcpSocket::TcpSocket *****************************/
 
@@ -406,6 +408,8 @@ namespace Network {
     this->fd = -1;
     this->addrs = NULL;
     this->connection_open = false;
+    this->rxhead = 0;
+    this->rxtail = 0;
   }
   /**************** Network::TcpSocket::TcpSocket *****************************/
 
@@ -428,6 +432,8 @@ namespace Network {
     this->host = "";
     this->addrs = NULL;
     this->connection_open = false;
+    this->rxhead = 0;
+    this->rxtail = 0;
   };
   /**************** Network::TcpSocket::TcpSocket *****************************/
 
@@ -450,6 +456,9 @@ namespace Network {
     host = obj.host;
     addrs = obj.addrs;
     connection_open = obj.connection_open;
+    rxbuf = obj.rxbuf;
+    rxhead = obj.rxhead;
+    rxtail = obj.rxtail;
   };
   /**************** Network::TcpSocket::TcpSocket *****************************/
 
@@ -580,10 +589,15 @@ namespace Network {
    * and the other version takes no argument and uses the default timeout that
    * was set for the class object.
    *
+   * Bytes already buffered by Read(delim) count as ready without polling.
+   *
    */
   int TcpSocket::Poll( int timeout ) {   // uses timeout arg
     std::string function = "Network::TcpSocket::Poll";
     std::stringstream message;
+
+    if ( this->rx_pending() > 0 ) return 1;
+
     struct pollfd poll_struct;
     poll_struct.events = POLLIN;
     poll_struct.fd     = this->fd;
@@ -770,6 +784,9 @@ namespace Network {
 
     this->connection_open = false;     // clear the connection_open flag
 
+    this->rxbuf.clear();               // anything buffered belonged to that connection
+    this->rxhead = this->rxtail = 0;
+
 #ifdef LOGLEVEL_DEBUG
     std::stringstream message;
     message << "[DEBUG] closed socket " << this->host << "/" << this->port << " connection to fd " << oldfd;
@@ -819,7 +836,8 @@ namespace Network {
    * If data not immediately available then wait for up to POLLTIMEOUT
    *
    * This function is overloaded; this version accepts a pointer to a
-   * buffer and the number of bytes to read.
+   * buffer and the number of bytes to read. Bytes left over from a
+   * Read(delim) are returned first, without reading the socket.
    *
    */
   int TcpSocket::Read(void* buf, size_t count) {
@@ -827,6 +845,8 @@ namespace Network {
     std::stringstream message;
     int nread;
 
+    if ( this->rx_pending() > 0 ) return static_cast<int>( this->rx_take( buf, count ) );
+
     // get the time now for timeout purposes
     //
     std::chrono::steady_clock::time_point tstart = std::chrono::steady_clock::now();
@@ -855,6 +875,25 @@ namespace Network {
   /**************** Network::TcpSocket::Read **********************************/
 
 
+  /**************** Network::TcpSocket::rx_take *******************************/
+  /**
+   * @fn         rx_take
+   * @brief      hand over up to count bytes from the receive buffer
+   * @param[out] buf, destination
+   * @param[in]  count, most bytes to copy
+   * @return     number of bytes copied
+   *
+   */
+  size_t TcpSocket::rx_take(void* buf, size_t count) {
+    size_t n = std::min( count, this->rx_pending() );
+    std::memcpy( buf, this->rxbuf.data() + this->rxhead, n );
+    this->rxhead += n;
+    if ( this->rxhead == this->rxtail ) this->rxhead = this->rxtail = 0;
+    return n;
+  }
+  /**************** Network::TcpSocket::rx_take *******************************/
+
+
   /**************** Network::TcpSocket::Read **********************************/
   /**
    * @fn         Read
@@ -868,21 +907,58 @@ namespace Network {
    * This function is overloaded; this version accepts a reference to a string
    * and a delimiter char to read until.
    *
+   * The socket is read RXCHUNK bytes at a time into a per-socket buffer and
+   * scanned with memchr; whatever follows the delimiter stays buffered for
+   * the next call, so a client that sends several commands at once costs one
+   * read() rather than one per byte. The POLLTIMEOUT deadline covers the
+   * whole line and is waited out in poll(), not checked per byte.
+   *
    */
   int TcpSocket::Read(std::string &retstring, char delim) {
     std::string function = "Network::TcpSocket::Read[delim]";
     std::stringstream message;
-    std::stringstream bufstream;
-    int nread, bytesread=0;
-    char buf[2];
-    memset(buf,'\0',2);
+    int nread=1;
+    size_t scanned = this->rxhead;       // no delim before here
 
-    // get the time now for timeout purposes
-    //
-    std::chrono::steady_clock::time_point tstart = std::chrono::steady_clock::now();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( POLLTIMEOUT );
 
     while ( 1 ) {
-      nread = read( this->fd, buf, 1 );  // read a byte at a time
+      const char* begin = this->rxbuf.data();
+      const void* found = ( this->rxtail > scanned ? std::memchr( begin + scanned, delim, this->rxtail - scanned ) : nullptr );
+      if ( found ) {
+        size_t len = static_cast<const char*>(found) + 1 - ( begin + this->rxhead );
+        retstring.assign( begin + this->rxhead, len );
+        this->rxhead += len;
+        if ( this->rxhead == this->rxtail ) this->rxhead = this->rxtail = 0;
+        return( static_cast<int>( len ) );
+      }
+
+      // make room for another chunk, sliding the partial line to the front first
+      //
+      if ( this->rxbuf.size() - this->rxtail < RXCHUNK ) {
+        if ( this->rxhead > 0 ) {
+          std::memmove( this->rxbuf.data(), this->rxbuf.data() + this->rxhead, this->rx_pending() );
+          this->rxtail -= this->rxhead;
+          this->rxhead = 0;
+        }
+        if ( this->rxbuf.size() - this->rxtail < RXCHUNK ) this->rxbuf.resize( this->rxtail + RXCHUNK );
+      }
+      scanned = this->rxtail;
+
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>( deadline - std::chrono::steady_clock::now() ).count();
+      struct pollfd pfd{};
+      pfd.fd = this->fd;
+      pfd.events = POLLIN;
+      int pollret = ( remaining > 0 ? poll( &pfd, 1, static_cast<int>( remaining ) ) : 0 );
+      if ( pollret < 0 && errno == EINTR ) continue;
+      if ( pollret == 0 ) {
+        message << "ERROR: timeout waiting for data on fd " << this->fd;
+        logwrite( function, message.str() );
+        break;
+      }
+
+      nread = ( pollret < 0 ? -1 : read( this->fd, this->rxbuf.data() + this->rxtail, this->rxbuf.size() - this->rxtail ) );
+      if ( nread < 0 && ( errno == EINTR || errno == EAGAIN ) ) continue;
       if ( nread<0 ) {
         message << "ERROR reading data on fd " << this->fd << ": " << strerror(errno);
         logwrite( function, message.str() );
@@ -891,28 +967,17 @@ namespace Network {
       if ( nread == 0 ) {
         message << "no data on socket " << this->host << "/" << this->port << " fd " << this->fd << ": closing connection";
         logwrite( function, message.str() );
-        this->Close();
         break;
       }
-      bytesread++;                       // keep count of total bytes read
-      bufstream << buf;                  // build up return string from each byte read
-
-      // get time now and check for timeout
-      //
-      std::chrono::steady_clock::time_point tnow = std::chrono::steady_clock::now();
-
-      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(tnow - tstart).count();
-
-      if ( elapsed > POLLTIMEOUT ) {
-        message << "ERROR: timeout waiting for data on fd " << this->fd;
-        logwrite( function, message.str() );
-        break;
-      }
-
-      if ( strchr(buf, delim) ) break;   // break when the delim character is found
+      this->rxtail += nread;
     }
 
-    retstring = bufstream.str();         // assign the assembled stream to the return string
+    // no delimiter: hand back whatever partial line there is, as before
+    //
+    int bytesread = static_cast<int>( this->rx_pending() );
+    retstring.assign( this->rxbuf.data() + this->rxhead, this->rx_pending() );
+    this->rxhead = this->rxtail = 0;
+    if ( nread == 0 ) this->Close();
 
     if ( nread <= 0 ) return( nread );   // return error
     else return( bytesread );            // or bytes read
@@ -943,6 +1008,18 @@ namespace Network {
     char buf[bufsz+1];
     memset(buf,'\0',bufsz+1);
 
+    // start with anything left over from a Read(delim)
+    //
+    if ( this->rx_pending() > 0 ) {
+      bytesread = static_cast<int>( this->rx_pending() );
+      bufstream.write( this->rxbuf.data() + this->rxhead, this->rx_pending() );
+      this->rxhead = this->rxtail = 0;
+      if ( bufstream.str().find( endstr ) != std::string::npos ) {
+        retstring = bufstream.str();
+        return( bytesread );
+      }
+    }
+
     // get the time now for timeout purposes
     //
     std::chrono::steady_clock::time_point tstart = std::chrono::steady_clock::now();
@@ -995,13 +1072,16 @@ namespace Network {
    * @param[in]  none
    * @return     number of bytes read
    *
+   * Includes bytes already buffered by Read(delim).
+   *
    */
   int TcpSocket::Bytes_ready() {
     int bytesready=-1;
     if ( ioctl(this->fd, FIONREAD, &bytesready) < 0 ) {
       perror("(Network::TcpSocket::Bytes_ready) ioctl error");
+      return(bytesready);
     }
-    return(bytesready);
+    return( bytesready + static_cast<int>( this->rx_pending() ) );
   }
   /**************** Network::TcpSocket::Bytes_ready ***************************/
 
@@ -1014,6 +1094,7 @@ namespace Network {
    *
    */
   bool TcpSocket::is_readable(int timeout_ms) {
+    if ( this->rx_pending() > 0 ) return true;
     struct pollfd pfd{};
     pfd.fd = this->fd;
     pfd.events = POLLIN;
@@ -1071,6 +1152,8 @@ namespace Network {
    *
    */
   void TcpSocket::Flush() {
+    this->rxhead = this->rxtail = 0;  // drop anything buffered by Read(delim)
+
     struct pollfd poll_struct;
     poll_struct.events = POLLIN;
     poll_struct.fd     = this->fd;  // poll the current file descriptor
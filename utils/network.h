@@ -12,11 +12,13 @@
 
 #pragma once
 
+#include <algorithm>
 #include <chrono>                      /// for timing timeouts
 #include <cstdio>
 #include <string>
 #include <cstring>
 #include <iostream>
+#include <vector>
 
 #include <sys/ioctl.h>                 /// for ioctl, FIONREAD
 #include <poll.h>                      /// for pollfd
@@ -41,6 +43,7 @@ namespace Network {
   constexpr const int LISTENQ = 64;             /// listen(3n) backlog
   constexpr const int UDPMSGLEN = 256;          /// UDP message length
   constexpr const int CONNECT_TIMEOUT_SEC = 3;  /// Connect() timeout in seconds
+  constexpr const size_t RXCHUNK = 65536;       /// receive buffer read() size for Read(delim)
 
   /** TcpSocket ***************************************************************/
   /**
@@ -65,6 +68,13 @@ namespace Network {
       struct sockaddr_in cliaddr;        /// socket address structure used for Accept
       socklen_t clilen;                  /// size of the socket address structure
 
+      std::vector<char> rxbuf;           /// bytes received but not yet returned by a Read
+      size_t rxhead;                     /// start of unread bytes in rxbuf
+      size_t rxtail;                     /// end of unread bytes in rxbuf
+
+      size_t rx_pending() const { return this->rxtail - this->rxhead; };
+      size_t rx_take(void* buf, size_t count);  /// hand over up to count buffered bytes
+
     public:
       TcpSocket();                       /// basic class constructor
       TcpSocket(int port_in, bool block_in, int totime_in, int id_in);  /// useful constructor for a server
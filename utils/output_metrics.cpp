@@ -0,0 +1,111 @@
+/**
+ * @file    output_metrics.cpp
+ * @brief   JSON snapshot of the metrics of every configured FrameOutput
+ */
+
+#include "output_metrics.h"
+#include "utilities.h"
+
+#include <cmath>
+#include <tuple>
+
+namespace {
+
+  // counters travel as doubles in OutputMetrics::detail; whole ones are
+  // written back as integers
+  nlohmann::json number(double v) {
+    if (v == std::floor(v) && std::fabs(v) < 9.0e15) return static_cast<int64_t>(v);
+    return v;
+  }
+
+  struct Worst {
+    const Camera::OutputMetrics* link{nullptr};
+    size_t output{0};
+    double dropped{0};            ///< fraction of frames in that were dropped
+    double fill{0};
+    double p99_us{0};
+  };
+
+  // most frames dropped first, then fullest queue, then slowest; sinks
+  // compete with their parent output
+  void consider(const Camera::OutputMetrics &m, size_t output, Worst &worst) {
+    const double dropped = m.frames_in > 0 ? static_cast<double>(m.frames_dropped) / m.frames_in : 0.0;
+    const double fill    = m.queue.fill();
+    const double p99     = m.latency.percentile_us(99);
+    if (!worst.link || std::tie(dropped, fill, p99) > std::tie(worst.dropped, worst.fill, worst.p99_us)) {
+      worst = { &m, output, dropped, fill, p99 };
+    }
+    for (const auto &sink : m.sinks) consider(sink, output, worst);
+  }
+
+}
+
+namespace Camera {
+
+  nlohmann::json to_json(const LatencySnapshot &latency) {
+    nlohmann::json j;
+    j["count"]   = latency.count;
+    j["mean_us"] = latency.mean_us();
+    j["p50_us"]  = latency.percentile_us(50);
+    j["p90_us"]  = latency.percentile_us(90);
+    j["p99_us"]  = latency.percentile_us(99);
+    j["max_us"]  = latency.max_us();
+
+    // bucket i counts latencies below 2^i us; trailing empty buckets are left off
+    size_t used = LatencySnapshot::BUCKETS;
+    while (used > 0 && latency.counts[used - 1] == 0) --used;
+    j["buckets"] = std::vector<uint64_t>(latency.counts.begin(), latency.counts.begin() + used);
+    return j;
+  }
+
+  nlohmann::json to_json(const OutputMetrics &m) {
+    nlohmann::json j;
+    j["kind"]           = m.kind;
+    j["frames_in"]      = m.frames_in;
+    j["frames_written"] = m.frames_written;
+    j["frames_dropped"] = m.frames_dropped;
+    j["frames_failed"]  = m.frames_failed;
+    j["bytes_written"]  = m.bytes_written;
+    if (m.latency.count > 0) j["latency"] = to_json(m.latency);
+    if (m.queue.capacity > 0) {
+      j["queue"] = { {"depth",    m.queue.depth},
+                     {"capacity", m.queue.capacity},
+                     {"fill",     m.queue.fill()},
+                     {"dropped",  m.queue.dropped},
+                     {"blocked",  m.queue.blocked},
+                     {"spilled",  m.queue.spilled} };
+    }
+    for (const auto &[key, value] : m.detail) j["detail"][key] = number(value);
+    for (const auto &sink : m.sinks) j["sinks"].push_back(to_json(sink));
+    return j;
+  }
+
+  nlohmann::json metrics_snapshot(const std::vector<std::unique_ptr<FrameOutput>> &outputs) {
+    nlohmann::json j;
+    j["time"]    = get_timestamp();
+    j["outputs"] = nlohmann::json::array();
+
+    std::vector<std::vector<OutputMetrics>> chains;
+    for (const auto &output : outputs) chains.push_back(chain_metrics(*output));
+
+    Worst worst;
+    for (size_t i = 0; i < chains.size(); ++i) {
+      nlohmann::json chain = nlohmann::json::array();
+      for (const auto &link : chains[i]) {
+        chain.push_back(to_json(link));
+        consider(link, i, worst);
+      }
+      j["outputs"].push_back(chain);
+    }
+
+    if (worst.link) {
+      j["bottleneck"] = { {"output",           worst.output},
+                          {"kind",             worst.link->kind},
+                          {"dropped_fraction", worst.dropped},
+                          {"fill",             worst.fill},
+                          {"p99_us",           worst.p99_us} };
+    }
+    return j;
+  }
+
+}
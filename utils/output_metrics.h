@@ -0,0 +1,30 @@
+/**
+ * @file    output_metrics.h
+ * @brief   JSON snapshot of the metrics of every configured FrameOutput
+ *
+ * Each configured output is reported as its chain, outermost decorator
+ * first, so a gate, its queue and the writer behind them can be told
+ * apart. The snapshot also names the likely bottleneck: the output
+ * dropping the largest share of its frames, else the one with the fullest
+ * queue, else the slowest.
+ */
+#pragma once
+
+#include "frame_output.h"
+
+#include <memory>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace Camera {
+
+  // {"count", "mean_us", "p50_us", "p90_us", "p99_us", "max_us", "buckets"}
+  nlohmann::json to_json(const LatencySnapshot &latency);
+
+  nlohmann::json to_json(const OutputMetrics &metrics);
+
+  // {"time", "outputs": [[<link>, ...], ...], "bottleneck": {...}}
+  nlohmann::json metrics_snapshot(const std::vector<std::unique_ptr<FrameOutput>> &outputs);
+
+}
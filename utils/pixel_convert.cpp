@@ -0,0 +1,175 @@
+/**
+ * @file    pixel_convert.cpp
+ * @brief   vectorized sample conversions and a FrameOutput decorator using them
+ */
+
+#include "pixel_convert.h"
+#include "simd.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace Camera {
+
+  void convert_u32_to_f32(const uint32_t* src, float* dst, size_t n, float scale, float offset) {
+    size_t i = 0;
+    for (; i + Simd::LANES <= n; i += Simd::LANES) {
+      const Simd::f32x8 v = Simd::to_f32(Simd::load<Simd::u32x8>(src + i));
+      Simd::store(dst + i, v * scale + offset);
+    }
+    for (; i < n; ++i) dst[i] = static_cast<float>(src[i]) * scale + offset;
+  }
+
+  void convert_u32_to_i32(const uint32_t* src, int32_t* dst, size_t n) {
+    size_t i = 0;
+    for (; i + Simd::LANES <= n; i += Simd::LANES) {
+      const Simd::u32x8 v = Simd::load<Simd::u32x8>(src + i) ^ 0x80000000u;
+      Simd::store(dst + i, reinterpret_cast<const Simd::i32x8&>(v));
+    }
+    for (; i < n; ++i) dst[i] = static_cast<int32_t>(src[i] ^ 0x80000000u);
+  }
+
+  void convert_u32_to_u16(const uint32_t* src, uint16_t* dst, size_t n, uint32_t shift) {
+    const Simd::u32x8 max16 = Simd::u32x8{} + 0xFFFFu;
+    size_t i = 0;
+    for (; i + Simd::LANES <= n; i += Simd::LANES) {
+      Simd::u32x8 v = Simd::load<Simd::u32x8>(src + i) >> shift;
+      v = (v > max16) ? max16 : v;
+      Simd::store(dst + i, __builtin_convertvector(v, Simd::u16x8));
+    }
+    for (; i < n; ++i) {
+      const uint32_t v = src[i] >> shift;
+      dst[i] = static_cast<uint16_t>(v > 0xFFFFu ? 0xFFFFu : v);
+    }
+  }
+
+  void byteswap16(uint16_t* data, size_t n) {
+    size_t i = 0;
+    for (; i + Simd::LANES <= n; i += Simd::LANES) {
+      const Simd::u16x8 v = Simd::load<Simd::u16x8>(data + i);
+      Simd::store(data + i, Simd::u16x8((v << 8) | (v >> 8)));
+    }
+    for (; i < n; ++i) data[i] = __builtin_bswap16(data[i]);
+  }
+
+  void byteswap32(uint32_t* data, size_t n) {
+    size_t i = 0;
+    for (; i + Simd::LANES <= n; i += Simd::LANES) {
+      const Simd::u32x8 v = Simd::load<Simd::u32x8>(data + i);
+      Simd::store(data + i, Simd::u32x8((v << 24) | ((v & 0xFF00u) << 8) |
+                                        ((v >> 8) & 0xFF00u) | (v >> 24)));
+    }
+    for (; i < n; ++i) data[i] = __builtin_bswap32(data[i]);
+  }
+
+  ConvertMode parse_convert_mode(const std::string &s) {
+    if (s == "none")  return ConvertMode::None;
+    if (s == "float") return ConvertMode::Float;
+    if (s == "int32") return ConvertMode::Int32;
+    if (s == "u16")   return ConvertMode::U16;
+    throw std::invalid_argument("expected none|float|int32|u16");
+  }
+
+  PixelConverter::PixelConverter(std::unique_ptr<FrameOutput> inner, ConvertConfig cfg)
+    : inner_(std::move(inner)),
+      cfg_(cfg) {
+  }
+
+  long PixelConverter::open() {
+    return inner_->open();
+  }
+
+  void PixelConverter::close() {
+    inner_->close();
+  }
+
+  FrameMetadata PixelConverter::output_meta(const FrameMetadata &meta) const {
+    FrameMetadata out = meta;
+    if (pixel_format_of(meta) == PixelFormat::U32) {
+      switch (cfg_.mode) {
+        case ConvertMode::Float: out.pixel_format = PixelFormat::F32; break;
+        case ConvertMode::Int32: out.pixel_format = PixelFormat::I32; break;
+        case ConvertMode::U16:   out.pixel_format = PixelFormat::U16; out.bytes_per_pixel = 2; break;
+        case ConvertMode::None:  break;
+      }
+    }
+    if (cfg_.byteswap && out.bytes_per_pixel > 1) out.big_endian = !meta.big_endian;
+    return out;
+  }
+
+  size_t PixelConverter::convert_row(const char* in, char* out, size_t n, const FrameMetadata &meta) const {
+    size_t sample = meta.bytes_per_pixel;
+    if (pixel_format_of(meta) == PixelFormat::U32 && cfg_.mode != ConvertMode::None) {
+      const auto* src = reinterpret_cast<const uint32_t*>(in);
+      switch (cfg_.mode) {
+        case ConvertMode::Float:
+          convert_u32_to_f32(src, reinterpret_cast<float*>(out), n, cfg_.scale, cfg_.offset);
+          sample = sizeof(float);
+          break;
+        case ConvertMode::Int32:
+          convert_u32_to_i32(src, reinterpret_cast<int32_t*>(out), n);
+          sample = sizeof(int32_t);
+          break;
+        case ConvertMode::U16:
+          convert_u32_to_u16(src, reinterpret_cast<uint16_t*>(out), n, cfg_.shift);
+          sample = sizeof(uint16_t);
+          break;
+        case ConvertMode::None:
+          break;
+      }
+    }
+    else {
+      std::memcpy(out, in, n * sample);
+    }
+
+    // single bytes have no order to swap
+    if (cfg_.byteswap) {
+      if (sample == 2)      byteswap16(reinterpret_cast<uint16_t*>(out), n);
+      else if (sample == 4) byteswap32(reinterpret_cast<uint32_t*>(out), n);
+    }
+    return n * sample;
+  }
+
+  long PixelConverter::write(const char* data, size_t size, const FrameMetadata& meta) {
+    const PixelFormat format = pixel_format_of(meta);
+    n_frames_.fetch_add(1, std::memory_order_relaxed);
+    if (!cfg_.byteswap && (cfg_.mode == ConvertMode::None || format != PixelFormat::U32)) {
+      return inner_->write(data, size, meta);
+    }
+    n_converted_.fetch_add(1, std::memory_order_relaxed);
+    const size_t n = size / meta.bytes_per_pixel;
+    scratch_.resize(n * std::max<size_t>(meta.bytes_per_pixel, sizeof(uint32_t)));
+    const size_t bytes = convert_row(data, scratch_.data(), n, meta);
+    return inner_->write(scratch_.data(), bytes, output_meta(meta));
+  }
+
+  // Converting row by row from the view also does the packing, in one pass
+  long PixelConverter::write_view(const FrameView &view, const FrameMetadata& meta) {
+    const PixelFormat format = pixel_format_of(meta);
+    n_frames_.fetch_add(1, std::memory_order_relaxed);
+    if (!cfg_.byteswap && (cfg_.mode == ConvertMode::None || format != PixelFormat::U32)) {
+      return inner_->write_view(view, meta);
+    }
+    n_converted_.fetch_add(1, std::memory_order_relaxed);
+    scratch_.resize(static_cast<size_t>(view.width) * view.height *
+                    std::max<size_t>(meta.bytes_per_pixel, sizeof(uint32_t)));
+    size_t bytes = 0;
+    for (uint32_t y = 0; y < view.height; ++y) {
+      bytes += convert_row(view.row(y), scratch_.data() + bytes, view.width, meta);
+    }
+    return inner_->write(scratch_.data(), bytes, output_meta(meta));
+  }
+
+  OutputMetrics PixelConverter::metrics() const {
+    OutputMetrics m;
+    m.kind           = "convert";
+    m.frames_in      = n_frames_.load();
+    m.frames_written = m.frames_in;
+    m.detail["converted"] = n_converted_.load();
+    return m;
+  }
+
+}
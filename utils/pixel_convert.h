@@ -0,0 +1,87 @@
+/**
+ * @file    pixel_convert.h
+ * @brief   vectorized sample conversions and a FrameOutput decorator using them
+ *
+ * In 32-bit sample mode (samplemode=1) the Archon delivers uint32 pixels.
+ * A PixelConverter in front of an output turns them into what that output
+ * wants: float32 for analysis consumers, BZERO-offset int32, or uint16
+ * after a right shift with clipping, which halves the bytes written.
+ * Byte swapping to FITS/network order is available on the same pass.
+ */
+#pragma once
+
+#include "frame_output.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Camera {
+
+  // dst[i] = src[i] * scale + offset
+  void convert_u32_to_f32(const uint32_t* src, float* dst, size_t n, float scale, float offset);
+
+  // dst[i] = src[i] - 2^31, the FITS convention for unsigned 32-bit in a signed image
+  void convert_u32_to_i32(const uint32_t* src, int32_t* dst, size_t n);
+
+  // dst[i] = min(src[i] >> shift, 65535)
+  void convert_u32_to_u16(const uint32_t* src, uint16_t* dst, size_t n, uint32_t shift);
+
+  // in-place byte order reversal
+  void byteswap16(uint16_t* data, size_t n);
+  void byteswap32(uint32_t* data, size_t n);
+
+  enum class ConvertMode {
+    None,         ///< pass samples through (byte swap may still apply)
+    Float,        ///< uint32 -> float32 with scale and offset
+    Int32,        ///< uint32 -> int32 with BZERO offset
+    U16           ///< uint32 -> uint16 by right shift and clip
+  };
+
+  struct ConvertConfig {
+    ConvertMode mode{ConvertMode::None};
+    uint32_t    shift{0};       ///< U16 mode right shift
+    float       scale{1.0f};    ///< Float mode
+    float       offset{0.0f};   ///< Float mode
+    bool        byteswap{false};
+  };
+
+  // "none" | "float" | "int32" | "u16"; throws std::invalid_argument
+  ConvertMode parse_convert_mode(const std::string &s);
+
+  /// FrameOutput decorator that converts samples before delegating.
+  /// Frames that are not uint32 are forwarded unconverted.
+  class PixelConverter : public FrameOutput {
+    public:
+      PixelConverter(std::unique_ptr<FrameOutput> inner, ConvertConfig cfg);
+      ~PixelConverter() override = default;
+
+      PixelConverter(const PixelConverter&) = delete;
+      PixelConverter& operator=(const PixelConverter&) = delete;
+
+      long open() override;
+      long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      long write_view(const FrameView &view, const FrameMetadata& meta) override;
+      void close() override;
+      QueueStatus queue_status() const override { return inner_->queue_status(); }
+      FrameOutput* decorated() const override { return inner_.get(); }
+      OutputMetrics metrics() const override;
+
+    private:
+      // converts one row of n samples into out, returns bytes written;
+      // out must hold n * max(meta.bytes_per_pixel, 4) bytes
+      size_t convert_row(const char* in, char* out, size_t n, const FrameMetadata &meta) const;
+      FrameMetadata output_meta(const FrameMetadata &meta) const;
+
+      std::unique_ptr<FrameOutput> inner_;
+      ConvertConfig cfg_;
+
+      std::vector<char> scratch_;   ///< only touched on the producer thread
+      std::atomic<uint64_t> n_frames_{0};
+      std::atomic<uint64_t> n_converted_{0};
+  };
+
+}
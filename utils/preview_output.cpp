@@ -0,0 +1,272 @@
+/**
+ * @file    preview_output.cpp
+ * @brief   FrameOutput that publishes a small 8-bit preview of each frame
+ */
+
+#include "preview_output.h"
+#include "shared_memory_writer.h"
+#include "simd.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <opencv2/imgcodecs.hpp>
+
+namespace {
+
+  constexpr uint32_t HISTOGRAM_BINS = 4096;
+
+  inline Simd::f32x8 widen(const Simd::u16x8 &v) { return Simd::to_f32(v); }
+  inline Simd::f32x8 widen(const Simd::u32x8 &v) { return Simd::to_f32(v); }
+  inline Simd::f32x8 widen(const Simd::f32x8 &v) { return v; }
+
+  /**
+   * Averages factor x factor blocks. Each output row sums factor input
+   * rows into rows[] a vector at a time, then factor columns of that.
+   */
+  template <typename T, typename V>
+  void bin(const char* data, uint32_t width, uint32_t factor, uint32_t out_w, uint32_t out_h,
+           float* rows, float* out) {
+    const T* src = reinterpret_cast<const T*>(data);
+    const size_t used = static_cast<size_t>(out_w) * factor;
+    const float scale = 1.0f / (factor * factor);
+
+    for (uint32_t oy = 0; oy < out_h; ++oy) {
+      std::fill(rows, rows + used, 0.0f);
+      for (uint32_t dy = 0; dy < factor; ++dy) {
+        const T* row = src + (static_cast<size_t>(oy) * factor + dy) * width;
+        size_t x = 0;
+        for (; x + Simd::LANES <= used; x += Simd::LANES) {
+          Simd::store(rows + x, Simd::load<Simd::f32x8>(rows + x) + widen(Simd::load<V>(row + x)));
+        }
+        for (; x < used; ++x) rows[x] += static_cast<float>(row[x]);
+      }
+      float* dst = out + static_cast<size_t>(oy) * out_w;
+      for (uint32_t ox = 0; ox < out_w; ++ox) {
+        float sum = 0;
+        for (uint32_t k = 0; k < factor; ++k) sum += rows[ox * factor + k];
+        dst[ox] = sum * scale;
+      }
+    }
+  }
+
+  template <typename T>
+  void decimate(const char* data, uint32_t width, uint32_t factor, uint32_t out_w, uint32_t out_h, float* out) {
+    const T* src = reinterpret_cast<const T*>(data);
+    for (uint32_t oy = 0; oy < out_h; ++oy) {
+      const T* row = src + static_cast<size_t>(oy) * factor * width;
+      for (uint32_t ox = 0; ox < out_w; ++ox) *out++ = static_cast<float>(row[ox * factor]);
+    }
+  }
+
+}
+
+namespace Camera {
+
+  PreviewMethod parse_preview_method(const std::string &s) {
+    if (s == "bin")      return PreviewMethod::Bin;
+    if (s == "decimate") return PreviewMethod::Decimate;
+    throw std::invalid_argument("expected bin|decimate");
+  }
+
+  PreviewFormat parse_preview_format(const std::string &s) {
+    if (s == "shm")  return PreviewFormat::Shm;
+    if (s == "png")  return PreviewFormat::Png;
+    if (s == "jpeg") return PreviewFormat::Jpeg;
+    throw std::invalid_argument("expected shm|png|jpeg");
+  }
+
+  PreviewOutput::PreviewOutput(PreviewConfig cfg)
+    : cfg_(std::move(cfg)), histogram_(HISTOGRAM_BINS) {
+  }
+
+  PreviewOutput::~PreviewOutput() {
+    this->close();
+  }
+
+  long PreviewOutput::open() {
+    const std::string function("Camera::PreviewOutput::open");
+
+    if (cfg_.max_size == 0 || cfg_.low_pct < 0 || cfg_.high_pct > 100 || cfg_.low_pct >= cfg_.high_pct) {
+      logwrite(function, "ERROR max_size must be > 0 and 0 <= low_pct < high_pct <= 100");
+      return ERROR;
+    }
+    if (cfg_.format == PreviewFormat::Shm) {
+      shm_ = std::make_unique<SharedMemoryWriter>(cfg_.shm_segment,
+                                                  static_cast<size_t>(cfg_.max_size) * cfg_.max_size, 2);
+      if (shm_->open() != NO_ERROR) {
+        shm_.reset();
+        return ERROR;
+      }
+    }
+    opened_ = true;
+    logwrite(function, "preview " + std::to_string(cfg_.max_size) + "px to " +
+             (cfg_.format == PreviewFormat::Shm ? "shm " + cfg_.shm_segment : cfg_.image_path));
+    return NO_ERROR;
+  }
+
+  void PreviewOutput::close() {
+    if (!opened_) return;
+    opened_ = false;
+    shm_.reset();     // closes the segment
+    const Stats s = this->stats();
+    char timing[96];
+    std::snprintf(timing, sizeof(timing), " mean=%.0fus max=%.0fus", s.mean_us, s.max_us);
+    logwrite("Camera::PreviewOutput::close", "previews=" + std::to_string(s.frames) +
+             " unsupported=" + std::to_string(s.unsupported) + timing);
+  }
+
+  long PreviewOutput::write(const char* data, size_t size, const FrameMetadata& meta) {
+    const uint64_t t0 = get_clock_time_nsec();
+
+    const uint32_t factor = std::max<uint32_t>(1, (std::max(meta.width, meta.height) + cfg_.max_size - 1) / cfg_.max_size);
+    width_  = meta.width / factor;
+    height_ = meta.height / factor;
+    const PixelFormat format = pixel_format_of(meta);
+
+    if (width_ == 0 || height_ == 0 || meta.big_endian || format == PixelFormat::U8 ||
+        size < static_cast<size_t>(meta.width) * meta.height * meta.bytes_per_pixel) {
+      n_unsupported_.fetch_add(1, std::memory_order_relaxed);
+      return NO_ERROR;
+    }
+
+    const size_t n = static_cast<size_t>(width_) * height_;
+    reduced_.resize(n);
+    if (cfg_.method == PreviewMethod::Bin) {
+      rows_.resize(static_cast<size_t>(width_) * factor);
+      switch (format) {
+        case PixelFormat::U16: bin<uint16_t, Simd::u16x8>(data, meta.width, factor, width_, height_, rows_.data(), reduced_.data()); break;
+        case PixelFormat::F32: bin<float,    Simd::f32x8>(data, meta.width, factor, width_, height_, rows_.data(), reduced_.data()); break;
+        default:               bin<uint32_t, Simd::u32x8>(data, meta.width, factor, width_, height_, rows_.data(), reduced_.data()); break;
+      }
+    }
+    else {
+      switch (format) {
+        case PixelFormat::U16: decimate<uint16_t>(data, meta.width, factor, width_, height_, reduced_.data()); break;
+        case PixelFormat::F32: decimate<float>   (data, meta.width, factor, width_, height_, reduced_.data()); break;
+        default:               decimate<uint32_t>(data, meta.width, factor, width_, height_, reduced_.data()); break;
+      }
+    }
+
+    // the percentiles come from a histogram between the extremes, which
+    // places them to 1/4096 of the range
+    const auto [pmin, pmax] = std::minmax_element(reduced_.begin(), reduced_.end());
+    const float vmin = *pmin;
+    const float span = std::max(*pmax - vmin, 1.0f);
+    const float to_bin = (HISTOGRAM_BINS - 1) / span;
+
+    std::fill(histogram_.begin(), histogram_.end(), 0u);
+    for (float v : reduced_) histogram_[static_cast<uint32_t>((v - vmin) * to_bin)]++;
+
+    const uint64_t low_count  = static_cast<uint64_t>(cfg_.low_pct  / 100.0 * n);
+    const uint64_t high_count = static_cast<uint64_t>(cfg_.high_pct / 100.0 * n);
+    uint32_t low_bin = 0, high_bin = HISTOGRAM_BINS - 1;
+    uint64_t cumulative = 0;
+    for (uint32_t b = 0; b < HISTOGRAM_BINS; ++b) {
+      const uint64_t before = cumulative;
+      cumulative += histogram_[b];
+      if (before <= low_count && cumulative > low_count) low_bin = b;
+      if (before < high_count && cumulative >= high_count) { high_bin = b; break; }
+    }
+    const float lo = vmin + low_bin / to_bin;
+    const float hi = std::max(vmin + (high_bin + 1) / to_bin, lo + 1.0f);
+
+    // stretch to 8 bits
+    image_.resize(n);
+    const float gain = 255.0f / (hi - lo);
+    const Simd::f32x8 zero{}, top = zero + 255.0f;
+    size_t i = 0;
+    for (; i + Simd::LANES <= n; i += Simd::LANES) {
+      Simd::f32x8 g = (Simd::load<Simd::f32x8>(&reduced_[i]) - lo) * gain + 0.5f;
+      g = g < zero ? zero : g;
+      g = g > top ? top : g;
+      Simd::store(&image_[i], __builtin_convertvector(__builtin_convertvector(g, Simd::i32x8), Simd::u8x8));
+    }
+    for (; i < n; ++i) image_[i] = static_cast<uint8_t>(std::clamp((reduced_[i] - lo) * gain + 0.5f, 0.0f, 255.0f));
+
+    const long ret = this->publish(meta);
+
+    const uint64_t dt = get_clock_time_nsec() - t0;
+    last_ns_.store(dt, std::memory_order_relaxed);
+    sum_ns_.fetch_add(dt, std::memory_order_relaxed);
+    if (dt > max_ns_.load(std::memory_order_relaxed)) max_ns_.store(dt, std::memory_order_relaxed);
+    if (ret == NO_ERROR) {
+      n_frames_.fetch_add(1, std::memory_order_relaxed);
+      n_bytes_.fetch_add(image_.size(), std::memory_order_relaxed);
+      latency_.record_since(meta.host_time_ns);
+    }
+    else {
+      n_failed_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ret;
+  }
+
+  long PreviewOutput::publish(const FrameMetadata& meta) {
+    const std::string function("Camera::PreviewOutput::publish");
+
+    if (cfg_.format == PreviewFormat::Shm) {
+      if (!shm_) return ERROR;
+      FrameMetadata preview = meta;
+      preview.width           = width_;
+      preview.height          = height_;
+      preview.bytes_per_pixel = 1;
+      preview.pixel_format    = PixelFormat::U8;
+      return shm_->write(reinterpret_cast<const char*>(image_.data()), image_.size(), preview);
+    }
+
+    std::vector<unsigned char> encoded;
+    try {
+      const cv::Mat mat(static_cast<int>(height_), static_cast<int>(width_), CV_8UC1, image_.data());
+      const bool jpeg = (cfg_.format == PreviewFormat::Jpeg);
+      const std::vector<int> params = jpeg ? std::vector<int>{cv::IMWRITE_JPEG_QUALITY, cfg_.jpeg_quality}
+                                           : std::vector<int>{cv::IMWRITE_PNG_COMPRESSION, 1};
+      if (!cv::imencode(jpeg ? ".jpg" : ".png", mat, encoded, params)) throw std::runtime_error("imencode failed");
+    }
+    catch (const std::exception &e) {
+      logwrite(function, std::string("ERROR encoding preview: ") + e.what());
+      return ERROR;
+    }
+
+    // readers only ever see a whole image
+    const std::string tmp = cfg_.image_path + ".tmp";
+    FILE* fp = std::fopen(tmp.c_str(), "wb");
+    const bool ok = fp && std::fwrite(encoded.data(), 1, encoded.size(), fp) == encoded.size();
+    if (fp) std::fclose(fp);
+    if (!ok || std::rename(tmp.c_str(), cfg_.image_path.c_str()) != 0) {
+      logwrite(function, "ERROR writing " + cfg_.image_path + ": " + std::strerror(errno));
+      return ERROR;
+    }
+    return NO_ERROR;
+  }
+
+  OutputMetrics PreviewOutput::metrics() const {
+    const Stats s = this->stats();
+    OutputMetrics m;
+    m.kind           = "preview";
+    m.frames_written = s.frames;
+    m.frames_failed  = n_failed_.load();
+    m.frames_in      = s.frames + s.unsupported + m.frames_failed;
+    m.bytes_written  = n_bytes_.load();
+    m.latency = latency_.snapshot();
+    m.detail["unsupported"] = s.unsupported;
+    m.detail["mean_us"]     = s.mean_us;
+    m.detail["max_us"]      = s.max_us;
+    return m;
+  }
+
+  PreviewOutput::Stats PreviewOutput::stats() const {
+    Stats s;
+    s.frames      = n_frames_.load();
+    s.unsupported = n_unsupported_.load();
+    s.last_us     = last_ns_.load() / 1.0e3;
+    s.mean_us     = s.frames > 0 ? sum_ns_.load() / 1.0e3 / s.frames : 0.0;
+    s.max_us      = max_ns_.load() / 1.0e3;
+    return s;
+  }
+
+}
@@ -0,0 +1,90 @@
+/**
+ * @file    preview_output.h
+ * @brief   FrameOutput that publishes a small 8-bit preview of each frame
+ *
+ * Bins or decimates the frame by a whole factor to at most max_size on
+ * its longer side, stretches it to 8 bits between two percentiles of its
+ * histogram, and publishes it to a two-slot SHM ring or as a PNG or JPEG
+ * file replaced atomically. Meant for GUIs that want a few frames a
+ * second: the factory runs it behind a CadenceGate and an AsyncOutput so
+ * the acquisition path pays an enqueue at most, and the time spent on
+ * each preview is kept in stats().
+ */
+#pragma once
+
+#include "frame_output.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Camera {
+
+  enum class PreviewMethod { Bin, Decimate };
+  enum class PreviewFormat { Shm, Png, Jpeg };
+
+  // "bin" | "decimate", "shm" | "png" | "jpeg"; throw std::invalid_argument
+  PreviewMethod parse_preview_method(const std::string &s);
+  PreviewFormat parse_preview_format(const std::string &s);
+
+  struct PreviewConfig {
+    uint32_t      max_size{512};          ///< longer side of the preview, pixels
+    PreviewMethod method{PreviewMethod::Bin};
+    double        low_pct{0.5};           ///< percentile mapped to 0
+    double        high_pct{99.5};         ///< percentile mapped to 255
+    PreviewFormat format{PreviewFormat::Shm};
+    std::string   shm_segment{"camera_preview"};
+    std::string   image_path{"/tmp/camera_preview.jpg"};
+    int           jpeg_quality{80};
+  };
+
+  class PreviewOutput : public FrameOutput {
+    public:
+      explicit PreviewOutput(PreviewConfig cfg);
+      ~PreviewOutput() override;
+
+      PreviewOutput(const PreviewOutput&) = delete;
+      PreviewOutput& operator=(const PreviewOutput&) = delete;
+
+      long open() override;
+      long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      void close() override;
+
+      struct Stats {
+        uint64_t frames{0};               ///< previews published
+        uint64_t unsupported{0};          ///< frames of a sample type or shape it cannot preview
+        double   last_us{0};              ///< time to make and publish the last preview
+        double   mean_us{0};
+        double   max_us{0};
+      };
+      Stats stats() const;
+      OutputMetrics metrics() const override;
+
+    private:
+      long publish(const FrameMetadata& meta);
+
+      PreviewConfig cfg_;
+      std::unique_ptr<FrameOutput> shm_;
+
+      // reused between frames, only touched on the writing thread
+      std::vector<float>    reduced_;
+      std::vector<float>    rows_;
+      std::vector<uint32_t> histogram_;
+      std::vector<uint8_t>  image_;
+      uint32_t width_{0};
+      uint32_t height_{0};
+      bool     opened_{false};
+
+      std::atomic<uint64_t> n_frames_{0};
+      std::atomic<uint64_t> n_unsupported_{0};
+      std::atomic<uint64_t> last_ns_{0};
+      std::atomic<uint64_t> sum_ns_{0};
+      std::atomic<uint64_t> max_ns_{0};
+      std::atomic<uint64_t> n_failed_{0};
+      std::atomic<uint64_t> n_bytes_{0};
+      LatencyHistogram latency_;          ///< frame arrival to preview published
+  };
+
+}
@@ -0,0 +1,127 @@
+//
+// raw2fits.cpp
+//
+// Converts a RawRecorder session to FITS through FitsWriter, so any of its
+// layouts and compressions can be chosen after the burst.
+//
+//   raw2fits [-o dir] [-b basename] [-c file|cube|mef] [-z compression] [-n frames_per_file] [-w workers] session.idx
+//
+
+#include "fits_writer.h"
+#include "raw_format.h"
+#include "common.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+  constexpr std::string_view usage() {
+    return "usage: raw2fits [-o dir] [-b basename] [-c file|cube|mef] [-z none|rice|gzip|gzip2|hcompress]\n"
+           "                [-n frames_per_file] [-w workers] session.idx\n";
+  }
+
+}
+
+int main(int argc, char *argv[]) {
+  Camera::FitsWriterConfig cfg;
+  std::string index_file;
+
+  try {
+  for ( int i=1; i<argc; ++i ) {
+    const std::string arg = argv[i];
+    if ( arg.size() == 2 && arg[0] == '-' && i+1 < argc ) {
+      switch ( arg[1] ) {
+        case 'o' : cfg.output_dir = argv[++i]; break;
+        case 'b' : cfg.basename = argv[++i]; break;
+        case 'c' : cfg.container = Camera::parse_fits_container( argv[++i] ); break;
+        case 'z' : cfg.compression = Camera::parse_fits_compression( argv[++i] ); break;
+        case 'n' : cfg.frames_per_file = static_cast<uint32_t>( std::stoul( argv[++i] ) ); break;
+        case 'w' : cfg.workers = static_cast<uint32_t>( std::stoul( argv[++i] ) ); break;
+        default:   std::cout << usage(); return 1;
+      }
+    } else index_file = arg;
+  }
+  }
+  catch (...) { std::cout << usage(); return 1; }
+
+  if ( index_file.size() < 5 || index_file.compare( index_file.size()-4, 4, ".idx" ) != 0 ) {
+    std::cout << usage(); return 1;
+  }
+  const std::string session = index_file.substr( 0, index_file.size()-4 );
+  const std::filesystem::path session_path( session );
+  if ( cfg.output_dir == Camera::FitsWriterConfig{}.output_dir ) {
+    cfg.output_dir = session_path.has_parent_path() ? session_path.parent_path().string() : ".";
+  }
+  if ( cfg.basename == Camera::FitsWriterConfig{}.basename ) cfg.basename = session_path.filename().string();
+
+  // nothing is arriving in real time, so wait on the workers rather than drop
+  cfg.overflow = Camera::OverflowPolicy::Block;
+  cfg.block_ms = 0;
+
+  FILE* index = std::fopen( index_file.c_str(), "rb" );
+  if ( !index ) { std::cerr << "ERROR opening " << index_file << ": " << std::strerror( errno ) << "\n"; return 1; }
+
+  Camera::RawIndexHeader header;
+  if ( std::fread( &header, sizeof(header), 1, index ) != 1 ||
+       std::memcmp( header.magic, Camera::RAW_INDEX_MAGIC, sizeof(header.magic) ) != 0 ||
+       header.version != Camera::RAW_INDEX_VERSION || header.record_bytes != sizeof(Camera::RawIndexRecord) ) {
+    std::cerr << "ERROR " << index_file << " is not a version " << Camera::RAW_INDEX_VERSION << " raw index\n";
+    return 1;
+  }
+
+  // io_uring and the pwrite threads complete out of order, and records are
+  // appended as they complete, so put them back in the order of the burst
+  std::vector<Camera::RawIndexRecord> records;
+  for ( Camera::RawIndexRecord rec; std::fread( &rec, sizeof(rec), 1, index ) == 1; ) records.push_back( rec );
+  std::fclose( index );
+  Camera::sort_by_submission( records );
+
+  Camera::FitsWriter writer( cfg );
+  if ( writer.open() != NO_ERROR ) return 1;
+
+  std::map<uint32_t, FILE*> data_files;
+  uint64_t converted = 0;
+
+  for ( const auto &rec : records ) {
+    auto it = data_files.find( rec.file_seq );
+    if ( it == data_files.end() ) {
+      const std::string path = Camera::raw_data_file( session, rec.file_seq );
+      it = data_files.emplace( rec.file_seq, std::fopen( path.c_str(), "rb" ) ).first;
+      if ( !it->second ) std::cerr << "ERROR opening " << path << ": " << std::strerror( errno ) << "\n";
+    }
+    if ( !it->second ) continue;
+
+    std::shared_ptr<char[]> pixels( new char[rec.size] );
+    if ( fseeko( it->second, static_cast<off_t>( rec.offset ), SEEK_SET ) != 0 ||
+         std::fread( pixels.get(), 1, rec.size, it->second ) != rec.size ) {
+      std::cerr << "ERROR reading frame " << rec.frame_number << "\n";
+      continue;
+    }
+
+    Camera::FrameMetadata meta;
+    meta.frame_number    = rec.frame_number;
+    meta.timestamp       = rec.timestamp;
+    meta.host_time_ns    = rec.host_time_ns;
+    meta.width           = rec.width;
+    meta.height          = rec.height;
+    meta.bytes_per_pixel = rec.bytes_per_pixel;
+    meta.pixel_format    = static_cast<Camera::PixelFormat>( rec.pixel_format );
+    meta.big_endian      = rec.big_endian != 0;
+
+    if ( writer.write_shared( pixels, rec.size, meta ) == NO_ERROR ) ++converted;
+  }
+
+  writer.close();
+  for ( auto &f : data_files ) if ( f.second ) std::fclose( f.second );
+
+  const auto s = writer.stats();
+  std::cerr << "converted " << converted << " frames, written=" << s.frames_written
+            << " failed=" << s.frames_failed << "\n";
+  return ( s.frames_failed == 0 && s.frames_written == converted ) ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file    raw_format.h
+ * @brief   on-disk layout of RawRecorder sessions
+ *
+ * A session is <name>.idx plus data files <name>_000.raw, <name>_001.raw...
+ * Each frame's pixels are written unchanged at a block-aligned offset in a
+ * data file; the index holds a RawIndexHeader followed by one fixed-size
+ * RawIndexRecord per frame, in the order the writes completed. That need
+ * not be the order they were submitted in; sort_by_submission() restores it.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace Camera {
+
+  constexpr char     RAW_INDEX_MAGIC[8] = { 'C','A','M','R','A','W','I','X' };
+  constexpr uint32_t RAW_INDEX_VERSION  = 1;
+  constexpr size_t   RAW_BLOCK_BYTES    = 4096;     ///< O_DIRECT offset and length alignment
+
+  struct RawIndexHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_bytes;        ///< sizeof(RawIndexRecord) when written
+    uint64_t block_bytes;         ///< frame alignment in the data files
+    uint64_t bytes_per_file;      ///< data file rotation size
+  };
+
+  struct RawIndexRecord {
+    uint64_t frame_number;
+    uint64_t timestamp;
+    uint64_t host_time_ns;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_per_pixel;
+    uint32_t pixel_format;        ///< Camera::PixelFormat
+    uint32_t big_endian;
+    uint32_t file_seq;            ///< data file number
+    uint64_t offset;              ///< byte offset of the frame in the data file
+    uint64_t size;                ///< frame bytes, before block padding
+  };
+
+  inline std::string raw_data_file(const std::string &session, uint32_t seq) {
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "_%03u.raw", seq);
+    return session + suffix;
+  }
+
+  // Frames take space in the data files in the order they are submitted,
+  // so data file then offset orders the records as the frames arrived
+  inline void sort_by_submission(std::vector<RawIndexRecord> &records) {
+    std::sort(records.begin(), records.end(), [](const RawIndexRecord &a, const RawIndexRecord &b) {
+      return std::tie(a.file_seq, a.offset) < std::tie(b.file_seq, b.offset);
+    });
+  }
+
+}
@@ -0,0 +1,598 @@
+/**
+ * @file    raw_recorder.cpp
+ * @brief   FrameOutput that records raw frames to disk for bursts
+ */
+
+#include "raw_recorder.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+  size_t round_up(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+}
+
+namespace Camera {
+
+  RawIoMode parse_raw_io_mode(const std::string &s) {
+    if (s == "uring")   return RawIoMode::Uring;
+    if (s == "threads") return RawIoMode::Threads;
+    throw std::invalid_argument("expected uring|threads");
+  }
+
+  /**
+   * A data file; closed, and trimmed to what was written, once the
+   * recorder has moved on and the last write into it has completed
+   */
+  struct RawRecorder::DataFile {
+    int      fd{-1};
+    uint32_t seq{0};
+    uint64_t used{0};             ///< bytes allocated to frames so far
+    ~DataFile() {
+      if (fd < 0) return;
+      if (ftruncate(fd, static_cast<off_t>(used)) != 0) { /* preallocated tail stays */ }
+      ::close(fd);
+    }
+  };
+
+  /**
+   * Minimal io_uring over the raw system calls: one submitter at a time
+   * (under submit_mtx_) and one reaper thread
+   */
+  struct RawRecorder::Uring {
+    int fd{-1};
+    void*  sq_ring{MAP_FAILED};
+    size_t sq_ring_bytes{0};
+    void*  cq_ring{MAP_FAILED};
+    size_t cq_ring_bytes{0};
+    io_uring_sqe* sqes{static_cast<io_uring_sqe*>(MAP_FAILED)};
+    size_t sqes_bytes{0};
+    unsigned *sq_tail{nullptr}, *sq_mask{nullptr}, *sq_array{nullptr};
+    unsigned *cq_head{nullptr}, *cq_tail{nullptr}, *cq_mask{nullptr};
+    io_uring_cqe* cqes{nullptr};
+
+    bool setup(unsigned entries) {
+      io_uring_params p{};
+      fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+      if (fd < 0) return false;
+
+      sq_ring_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+      cq_ring_bytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+      const bool single = (p.features & IORING_FEAT_SINGLE_MMAP);
+      if (single) sq_ring_bytes = cq_ring_bytes = std::max(sq_ring_bytes, cq_ring_bytes);
+
+      sq_ring = mmap(nullptr, sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+      if (sq_ring == MAP_FAILED) return false;
+      cq_ring = single ? sq_ring
+                       : mmap(nullptr, cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (cq_ring == MAP_FAILED) return false;
+      sqes_bytes = p.sq_entries * sizeof(io_uring_sqe);
+      sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_bytes, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+      if (sqes == MAP_FAILED) return false;
+
+      auto* sq = static_cast<char*>(sq_ring);
+      auto* cq = static_cast<char*>(cq_ring);
+      sq_tail  = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+      sq_mask  = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+      sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+      cq_head  = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+      cq_tail  = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+      cq_mask  = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+      cqes     = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+      return true;
+    }
+
+    // A ring can be set up on kernels that predate IORING_OP_WRITE
+    // (5.6), which also predate the probe, so a failed probe means no
+    bool supports(uint8_t opcode) {
+      constexpr unsigned OPS = 256;
+      std::vector<uint64_t> buffer((sizeof(io_uring_probe) + OPS * sizeof(io_uring_probe_op)) / sizeof(uint64_t) + 1, 0);
+      auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+      if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, OPS) < 0) return false;
+      return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    ~Uring() {
+      if (sqes != MAP_FAILED) munmap(sqes, sqes_bytes);
+      if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_bytes);
+      if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_bytes);
+      if (fd >= 0) ::close(fd);
+    }
+
+    // queues one operation and enters it; 0 or -errno
+    int submit(uint8_t opcode, int file, const void* buf, unsigned len, uint64_t off, uint64_t user_data) {
+      const unsigned tail = *sq_tail;
+      const unsigned idx = tail & *sq_mask;
+      io_uring_sqe* sqe = &sqes[idx];
+      std::memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode    = opcode;
+      sqe->fd        = file;
+      sqe->addr      = reinterpret_cast<uint64_t>(buf);
+      sqe->len       = len;
+      sqe->off       = off;
+      sqe->user_data = user_data;
+      sq_array[idx]  = idx;
+      __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+      while (true) {
+        const long ret = syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0);
+        if (ret >= 0) return 0;
+        if (errno != EINTR && errno != EAGAIN) return -errno;
+      }
+    }
+
+    // blocks for the next completion; false if the ring failed
+    bool wait(io_uring_cqe &cqe) {
+      while (true) {
+        const unsigned head = *cq_head;
+        if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+          cqe = cqes[head & *cq_mask];
+          __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+          return true;
+        }
+        const long ret = syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret < 0 && errno != EINTR) return false;
+      }
+    }
+  };
+
+  RawRecorder::RawRecorder(RawRecorderConfig cfg)
+    : cfg_(std::move(cfg)) {
+  }
+
+  RawRecorder::~RawRecorder() {
+    this->close();
+  }
+
+  long RawRecorder::open() {
+    const std::string function("Camera::RawRecorder::open");
+
+    if (started_.load()) {
+      logwrite(function, "ERROR already opened");
+      return ERROR;
+    }
+    if (cfg_.queue_depth == 0 || cfg_.bytes_per_file < RAW_BLOCK_BYTES) {
+      logwrite(function, "ERROR queue_depth and bytes_per_file must be > 0");
+      return ERROR;
+    }
+    // the buffers are mapped here, never on the thread delivering frames
+    if (cfg_.max_frame_bytes == 0) {
+      logwrite(function, "ERROR max_frame_bytes must be > 0");
+      return ERROR;
+    }
+    std::error_code ec;
+    if (!std::filesystem::is_directory(cfg_.output_dir, ec)) {
+      logwrite(function, "ERROR output_dir does not exist: " + cfg_.output_dir);
+      return ERROR;
+    }
+
+    // each open() is a new session; "x" claims the name exclusively
+    for (int n = 0; !index_ && n < 10000; ++n) {
+      char num[16];
+      std::snprintf(num, sizeof(num), "_%04d", n);
+      session_ = cfg_.output_dir + "/" + cfg_.basename + num;
+      index_ = std::fopen((session_ + ".idx").c_str(), "wbx");
+      if (!index_ && errno != EEXIST) break;
+    }
+    if (!index_) {
+      logwrite(function, "ERROR creating index for " + session_ + ": " + std::strerror(errno));
+      return ERROR;
+    }
+    RawIndexHeader header{};
+    std::memcpy(header.magic, RAW_INDEX_MAGIC, sizeof(header.magic));
+    header.version        = RAW_INDEX_VERSION;
+    header.record_bytes   = sizeof(RawIndexRecord);
+    header.block_bytes    = RAW_BLOCK_BYTES;
+    header.bytes_per_file = cfg_.bytes_per_file;
+    if (std::fwrite(&header, sizeof(header), 1, index_) != 1 || std::fflush(index_) != 0) {
+      logwrite(function, "ERROR writing index header for " + session_ + ": " + std::strerror(errno));
+      std::fclose(index_);
+      index_ = nullptr;
+      std::filesystem::remove(session_ + ".idx", ec);
+      return ERROR;
+    }
+
+    if (cfg_.overflow != OverflowPolicy::DropNewest && cfg_.overflow != OverflowPolicy::Block) {
+      logwrite(function, std::string("NOTICE overflow=") + to_string(cfg_.overflow) +
+               " does not apply to the raw recorder; using drop_newest");
+      cfg_.overflow = OverflowPolicy::DropNewest;
+    }
+
+    if (map_buffers(cfg_.max_frame_bytes) != NO_ERROR) {
+      std::fclose(index_);
+      index_ = nullptr;
+      return ERROR;
+    }
+
+    if (cfg_.io == RawIoMode::Uring) {
+      uring_ = std::make_unique<Uring>();
+      if (!uring_->setup(cfg_.queue_depth + 1)) {
+        logwrite(function, "NOTICE io_uring unavailable (" + std::string(std::strerror(errno)) +
+                 "); using pwrite threads");
+        uring_.reset();
+      }
+      else if (!uring_->supports(IORING_OP_WRITE)) {
+        logwrite(function, "NOTICE io_uring has no IORING_OP_WRITE; using pwrite threads");
+        uring_.reset();
+      }
+    }
+    io_stop_ = false;
+    if (uring_) {
+      reaper_ = std::thread(&RawRecorder::uring_reap_loop, this);
+    }
+    else {
+      for (uint32_t i = 0; i < std::max(1u, cfg_.io_threads); ++i) {
+        io_threads_.emplace_back(&RawRecorder::thread_write_loop, this);
+      }
+    }
+
+    file_seq_ = 0;
+    started_.store(true);
+    logwrite(function, "recording " + session_ + " depth=" + std::to_string(cfg_.queue_depth) +
+             " io=" + (uring_ ? "uring" : "threads") +
+             " overflow=" + to_string(cfg_.overflow) +
+             " bytes_per_file=" + std::to_string(cfg_.bytes_per_file));
+    return NO_ERROR;
+  }
+
+  void RawRecorder::close() {
+    if (!started_.load()) return;
+    const std::string function("Camera::RawRecorder::close");
+
+    this->abandon();
+
+    // let everything in flight land
+    {
+      std::unique_lock lock(slot_mtx_);
+      if (!slot_cv_.wait_for(lock, std::chrono::seconds(30), [this]{ return free_.size() == slots_.size(); })) {
+        logwrite(function, "WARNING writes still in flight after 30 s");
+      }
+    }
+
+    if (uring_) {
+      {
+        std::lock_guard lock(submit_mtx_);
+        uring_->submit(IORING_OP_NOP, -1, nullptr, 0, 0, 0);   // user_data 0 stops the reaper
+      }
+      if (reaper_.joinable()) reaper_.join();
+      uring_.reset();
+    }
+    else {
+      {
+        std::lock_guard lock(submit_mtx_);
+        io_stop_ = true;
+      }
+      io_cv_.notify_all();
+      for (auto &t : io_threads_) {
+        if (t.joinable()) t.join();
+      }
+      io_threads_.clear();
+    }
+
+    file_.reset();
+    {
+      std::lock_guard lock(index_mtx_);
+      // records still buffered are only written out here
+      if (index_ && std::fclose(index_) != 0) {
+        logwrite(function, "ERROR closing index " + session_ + ".idx: " + std::strerror(errno));
+      }
+      index_ = nullptr;
+    }
+    unmap_buffers();
+    started_.store(false);
+
+    const Stats s = this->stats();
+    char rate[32];
+    std::snprintf(rate, sizeof(rate), "%.1f", s.mb_per_s());
+    logwrite(function, "stopped " + session_ + ": received=" + std::to_string(s.frames_received) +
+             " written=" + std::to_string(s.frames_written) +
+             " dropped=" + std::to_string(s.frames_dropped) +
+             " blocked=" + std::to_string(s.frames_blocked) +
+             " failed=" + std::to_string(s.frames_failed) +
+             " bytes=" + std::to_string(s.bytes_written) + " rate=" + rate + "MB/s");
+  }
+
+  RawRecorder::Stats RawRecorder::stats() const {
+    Stats s;
+    s.frames_received = n_received_.load();
+    s.frames_written  = n_written_.load();
+    s.frames_dropped  = n_dropped_.load();
+    s.frames_blocked  = n_blocked_.load();
+    s.frames_failed   = n_failed_.load();
+    s.bytes_written   = n_bytes_.load();
+    const uint64_t t0 = first_submit_ns_.load(), t1 = last_complete_ns_.load();
+    s.elapsed_s = (t1 > t0 && t0 > 0) ? (t1 - t0) / 1.0e9 : 0.0;
+    return s;
+  }
+
+  QueueStatus RawRecorder::queue_status() const {
+    QueueStatus status;
+    status.depth    = in_flight_.load();
+    status.capacity = cfg_.queue_depth;
+    status.dropped  = n_dropped_.load();
+    status.blocked  = n_blocked_.load();
+    status.set_pressure(cfg_.overflow);
+    return status;
+  }
+
+  OutputMetrics RawRecorder::metrics() const {
+    const Stats s = this->stats();
+    OutputMetrics m;
+    m.kind           = "raw";
+    m.frames_in      = s.frames_received;
+    m.frames_written = s.frames_written;
+    m.frames_dropped = s.frames_dropped;
+    m.frames_failed  = s.frames_failed;
+    m.bytes_written  = s.bytes_written;
+    m.latency = latency_.snapshot();
+    m.queue   = this->queue_status();
+    m.detail["blocked"]  = s.frames_blocked;
+    m.detail["mb_per_s"] = s.mb_per_s();
+    return m;
+  }
+
+  long RawRecorder::write(const char* data, size_t size, const FrameMetadata& meta) {
+    if (!started_.load()) return ERROR;
+    n_received_.fetch_add(1, std::memory_order_relaxed);
+
+    if (size > slot_bytes_) {
+      logwrite("Camera::RawRecorder::write", "ERROR frame of " + std::to_string(size) +
+               " bytes exceeds max_frame_bytes=" + std::to_string(cfg_.max_frame_bytes));
+      n_failed_.fetch_add(1, std::memory_order_relaxed);
+      return ERROR;
+    }
+
+    int slot = take_slot();
+    if (slot < 0 && cfg_.overflow == OverflowPolicy::Block) slot = wait_slot();
+    if (slot < 0) {
+      n_dropped_.fetch_add(1, std::memory_order_relaxed);
+      return (cfg_.overflow == OverflowPolicy::Block) ? ERROR : NO_ERROR;
+    }
+    std::memcpy(slots_[slot].buffer, data, size);
+    return submit(slot, size, meta);
+  }
+
+  // Lends a pool buffer so the frame is read straight into DMA-able memory
+  char* RawRecorder::reserve(size_t size) {
+    if (!started_.load()) return nullptr;
+    this->abandon();
+    if (size > slot_bytes_) return nullptr;
+    reserved_ = take_slot();
+    return (reserved_ < 0) ? nullptr : slots_[reserved_].buffer;
+  }
+
+  long RawRecorder::commit(size_t size, const FrameMetadata& meta) {
+    if (!started_.load() || reserved_ < 0 || size > slot_bytes_) return ERROR;
+    n_received_.fetch_add(1, std::memory_order_relaxed);
+    const int slot = reserved_;
+    reserved_ = -1;
+    return submit(slot, size, meta);
+  }
+
+  void RawRecorder::abandon() {
+    if (reserved_ < 0) return;
+    give_slot(reserved_);
+    reserved_ = -1;
+  }
+
+  long RawRecorder::map_buffers(size_t frame_bytes) {
+    const std::string function("Camera::RawRecorder::map_buffers");
+
+    slot_bytes_ = round_up(frame_bytes, std::max(RAW_BLOCK_BYTES, static_cast<size_t>(getpagesize())));
+    pool_bytes_ = slot_bytes_ * cfg_.queue_depth;
+    HugePageMode got;
+    pool_ = static_cast<char*>(map_frame_memory(pool_bytes_, cfg_.huge_pages, got));
+    if (!pool_) {
+      logwrite(function, "ERROR mapping " + std::to_string(pool_bytes_) + " bytes of frame buffers");
+      slot_bytes_ = pool_bytes_ = 0;
+      return ERROR;
+    }
+
+    std::lock_guard lock(slot_mtx_);
+    slots_.assign(cfg_.queue_depth, Slot{});
+    free_.clear();
+    for (uint32_t i = 0; i < cfg_.queue_depth; ++i) {
+      slots_[i].buffer = pool_ + slot_bytes_ * i;
+      free_.push_back(static_cast<int>(i));
+    }
+    logwrite(function, std::to_string(cfg_.queue_depth) + " buffers of " + std::to_string(slot_bytes_) +
+             " bytes, pages=" + to_string(got));
+    return NO_ERROR;
+  }
+
+  void RawRecorder::unmap_buffers() {
+    std::lock_guard lock(slot_mtx_);
+    unmap_frame_memory(pool_, pool_bytes_);
+    pool_ = nullptr;
+    pool_bytes_ = slot_bytes_ = 0;
+    slots_.clear();
+    free_.clear();
+  }
+
+  int RawRecorder::take_slot() {
+    std::lock_guard lock(slot_mtx_);
+    if (free_.empty()) return -1;
+    const int slot = free_.back();
+    free_.pop_back();
+    in_flight_.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+  }
+
+  int RawRecorder::wait_slot() {
+    n_blocked_.fetch_add(1, std::memory_order_relaxed);
+    std::unique_lock lock(slot_mtx_);
+    const auto returned = [this]{ return !free_.empty(); };
+    if (cfg_.block_ms == 0) slot_cv_.wait(lock, returned);
+    else if (!slot_cv_.wait_for(lock, std::chrono::milliseconds(cfg_.block_ms), returned)) return -1;
+    const int slot = free_.back();
+    free_.pop_back();
+    in_flight_.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+  }
+
+  void RawRecorder::give_slot(int slot) {
+    {
+      std::lock_guard lock(slot_mtx_);
+      free_.push_back(slot);
+      in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    slot_cv_.notify_all();
+  }
+
+  long RawRecorder::next_file() {
+    const std::string function("Camera::RawRecorder::next_file");
+
+    const std::string path = raw_data_file(session_, file_seq_);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_DIRECT, 0644);
+    if (fd < 0 && errno == EINVAL) {
+      logwrite(function, "NOTICE O_DIRECT not supported for " + path + "; writing through the page cache");
+      fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) {
+      logwrite(function, "ERROR creating " + path + ": " + std::strerror(errno));
+      return ERROR;
+    }
+
+    // allocate the whole file now so writes never extend it; the tail is
+    // trimmed when the file is finished
+    if (fallocate(fd, 0, 0, static_cast<off_t>(cfg_.bytes_per_file)) != 0) {
+      logwrite(function, "NOTICE could not preallocate " + path + ": " + std::strerror(errno));
+    }
+
+    file_ = std::make_shared<DataFile>();
+    file_->fd = fd;
+    file_->seq = file_seq_++;
+    return NO_ERROR;
+  }
+
+  long RawRecorder::submit(int slot, size_t size, const FrameMetadata &meta) {
+    const std::string function("Camera::RawRecorder::submit");
+    auto &s = slots_[slot];
+
+    s.length = round_up(size, RAW_BLOCK_BYTES);
+    if (s.length > size) std::memset(s.buffer + size, 0, s.length - size);
+
+    if (!file_ || (file_->used > 0 && file_->used + s.length > cfg_.bytes_per_file)) {
+      file_.reset();
+      if (next_file() != NO_ERROR) {
+        give_slot(slot);
+        n_failed_.fetch_add(1, std::memory_order_relaxed);
+        return ERROR;
+      }
+    }
+
+    s.file = file_;
+    s.record = RawIndexRecord{};
+    s.record.frame_number    = meta.frame_number;
+    s.record.timestamp       = meta.timestamp;
+    s.record.host_time_ns    = meta.host_time_ns;
+    s.record.width           = meta.width;
+    s.record.height          = meta.height;
+    s.record.bytes_per_pixel = meta.bytes_per_pixel;
+    s.record.pixel_format    = static_cast<uint32_t>(meta.pixel_format);
+    s.record.big_endian      = meta.big_endian ? 1 : 0;
+    s.record.file_seq        = file_->seq;
+    s.record.offset          = file_->used;
+    s.record.size            = size;
+    file_->used += s.length;
+
+    uint64_t unset = 0;
+    first_submit_ns_.compare_exchange_strong(unset, get_clock_time_nsec());
+
+    std::lock_guard lock(submit_mtx_);
+    if (uring_) {
+      const int ret = uring_->submit(IORING_OP_WRITE, s.file->fd, s.buffer, static_cast<unsigned>(s.length),
+                                     s.record.offset, static_cast<uint64_t>(slot) + 1);
+      if (ret < 0) {
+        logwrite(function, std::string("ERROR io_uring submit: ") + std::strerror(-ret));
+        this->complete(slot, ret);
+        return ERROR;
+      }
+    }
+    else {
+      io_queue_.push_back(slot);
+      io_cv_.notify_one();
+    }
+    return NO_ERROR;
+  }
+
+  void RawRecorder::complete(int slot, long result) {
+    const std::string function("Camera::RawRecorder::complete");
+    auto &s = slots_[slot];
+
+    // a frame on disk that the index does not record is lost to raw2fits
+    bool indexed = false;
+    if (result == static_cast<long>(s.length)) {
+      std::lock_guard lock(index_mtx_);
+      indexed = index_ && std::fwrite(&s.record, sizeof(s.record), 1, index_) == 1;
+    }
+    if (indexed) {
+      n_written_.fetch_add(1, std::memory_order_relaxed);
+      n_bytes_.fetch_add(s.record.size, std::memory_order_relaxed);
+      latency_.record_since(s.record.host_time_ns);
+    }
+    else {
+      n_failed_.fetch_add(1, std::memory_order_relaxed);
+      logwrite(function, "ERROR writing frame " + std::to_string(s.record.frame_number) + ": " +
+               (result == static_cast<long>(s.length) ? "index write failed"
+                : result < 0 ? std::string(std::strerror(static_cast<int>(-result)))
+                             : "short write of " + std::to_string(result) + " bytes"));
+    }
+    last_complete_ns_.store(get_clock_time_nsec(), std::memory_order_relaxed);
+
+    s.file.reset();
+    give_slot(slot);
+  }
+
+  void RawRecorder::uring_reap_loop() {
+    const std::string function("Camera::RawRecorder::uring_reap_loop");
+    io_uring_cqe cqe;
+    while (uring_->wait(cqe)) {
+      if (cqe.user_data == 0) return;
+      this->complete(static_cast<int>(cqe.user_data - 1), cqe.res);
+    }
+    logwrite(function, std::string("ERROR waiting on io_uring: ") + std::strerror(errno));
+  }
+
+  void RawRecorder::thread_write_loop() {
+    while (true) {
+      int slot;
+      {
+        std::unique_lock lock(submit_mtx_);
+        io_cv_.wait(lock, [this]{ return !io_queue_.empty() || io_stop_; });
+        if (io_queue_.empty()) return;
+        slot = io_queue_.front();
+        io_queue_.pop_front();
+      }
+
+      const auto &s = slots_[slot];
+      size_t done = 0;
+      long result = 0;
+      while (done < s.length) {
+        const ssize_t n = pwrite(s.file->fd, s.buffer + done, s.length - done,
+                                 static_cast<off_t>(s.record.offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { result = (n < 0) ? -errno : static_cast<long>(done); break; }
+        done += static_cast<size_t>(n);
+        result = static_cast<long>(done);
+      }
+      this->complete(slot, result);
+    }
+  }
+
+}
@@ -0,0 +1,151 @@
+/**
+ * @file    raw_recorder.h
+ * @brief   FrameOutput that records raw frames to disk for bursts
+ *
+ * Frames are copied into (or read straight into, via reserve/commit) a
+ * fixed pool of page-aligned buffers and written with O_DIRECT, bypassing
+ * the page cache, at block-aligned offsets in preallocated data files.
+ * Writes are submitted asynchronously through io_uring, or handed to a
+ * pool of pwrite threads where io_uring or its write operation is
+ * unavailable; the pool size is the queue depth, and the buffers are
+ * mapped by open() for max_frame_bytes. A frame arriving with every buffer in flight is
+ * dropped, or under the block policy waits a bounded time for one to come
+ * back; writes already submitted cannot be recalled, so there is no
+ * drop-oldest. A binary index records where each frame went (raw_format.h);
+ * raw2fits converts a session to FITS offline.
+ */
+#pragma once
+
+#include "frame_output.h"
+#include "frame_buffer_pool.h"
+#include "raw_format.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Camera {
+
+  enum class RawIoMode { Uring, Threads };
+
+  // "uring" | "threads"; throws std::invalid_argument
+  RawIoMode parse_raw_io_mode(const std::string &s);
+
+  struct RawRecorderConfig {
+    std::string  output_dir{"/tmp/images"};
+    std::string  basename{"burst"};
+    uint32_t     queue_depth{16};               ///< buffers, so writes in flight
+    size_t       max_frame_bytes{0};            ///< buffer size, required; larger frames fail
+    uint64_t     bytes_per_file{4ULL << 30};    ///< data file rotation size
+    RawIoMode    io{RawIoMode::Uring};
+    uint32_t     io_threads{4};                 ///< pwrite threads when io=threads
+    HugePageMode huge_pages{HugePageMode::Thp};
+    OverflowPolicy overflow{OverflowPolicy::DropNewest};  ///< drop_newest or block
+    uint32_t     block_ms{100};                 ///< block: longest a write waits for a buffer, 0 for no limit
+  };
+
+  class RawRecorder : public FrameOutput {
+    public:
+      explicit RawRecorder(RawRecorderConfig cfg);
+      ~RawRecorder() override;
+
+      RawRecorder(const RawRecorder&) = delete;
+      RawRecorder& operator=(const RawRecorder&) = delete;
+
+      long open() override;
+      long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      void close() override;
+
+      char* reserve(size_t size) override;
+      long commit(size_t size, const FrameMetadata& meta) override;
+      void abandon() override;
+
+      struct Stats {
+        uint64_t frames_received{0};
+        uint64_t frames_written{0};
+        uint64_t frames_dropped{0};       ///< every buffer was in flight
+        uint64_t frames_blocked{0};       ///< writes that waited for a buffer
+        uint64_t frames_failed{0};
+        uint64_t bytes_written{0};
+        double   elapsed_s{0};            ///< first submission to last completion
+        double mb_per_s() const { return elapsed_s > 0 ? bytes_written / elapsed_s / 1.0e6 : 0.0; }
+      };
+      Stats stats() const;
+
+      QueueStatus queue_status() const override;
+      OutputMetrics metrics() const override;
+
+      const std::string& session() const { return session_; }
+
+    private:
+      struct DataFile;
+      struct Uring;
+
+      struct Slot {
+        char*    buffer{nullptr};
+        size_t   length{0};               ///< padded to RAW_BLOCK_BYTES
+        std::shared_ptr<DataFile> file;
+        RawIndexRecord record{};
+      };
+
+      long map_buffers(size_t frame_bytes);
+      void unmap_buffers();
+      int  take_slot();
+      int  wait_slot();
+      void give_slot(int slot);
+      long submit(int slot, size_t size, const FrameMetadata &meta);
+      void complete(int slot, long result);
+      long next_file();
+
+      void uring_reap_loop();
+      void thread_write_loop();
+
+      RawRecorderConfig cfg_;
+      std::string session_;               ///< output_dir/basename_NNNN
+      std::FILE*  index_{nullptr};        ///< guarded by index_mtx_
+      std::mutex  index_mtx_;
+
+      // buffer pool
+      char*  pool_{nullptr};
+      size_t pool_bytes_{0};
+      size_t slot_bytes_{0};
+      std::vector<Slot> slots_;
+      std::vector<int>  free_;            ///< guarded by slot_mtx_
+      std::mutex slot_mtx_;
+      std::condition_variable slot_cv_;   ///< a slot came back
+      std::atomic<size_t> in_flight_{0};  ///< slots taken, changed under slot_mtx_
+      int reserved_{-1};
+
+      // current data file, producer thread only
+      std::shared_ptr<DataFile> file_;
+      uint32_t file_seq_{0};
+
+      // io_uring, or the pwrite threads and their queue
+      std::unique_ptr<Uring> uring_;
+      std::mutex submit_mtx_;
+      std::thread reaper_;
+      std::vector<std::thread> io_threads_;
+      std::deque<int> io_queue_;          ///< guarded by submit_mtx_
+      std::condition_variable io_cv_;
+      bool io_stop_{false};
+
+      std::atomic<bool> started_{false};
+      std::atomic<uint64_t> n_received_{0};
+      std::atomic<uint64_t> n_written_{0};
+      std::atomic<uint64_t> n_dropped_{0};
+      std::atomic<uint64_t> n_blocked_{0};
+      std::atomic<uint64_t> n_failed_{0};
+      std::atomic<uint64_t> n_bytes_{0};
+      std::atomic<uint64_t> first_submit_ns_{0};
+      std::atomic<uint64_t> last_complete_ns_{0};
+      LatencyHistogram latency_;            ///< frame arrival to data on disk
+  };
+
+}
@@ -0,0 +1,139 @@
+/**
+ * @file    roi_output.cpp
+ * @brief   FrameOutput that cuts regions of interest out of each frame
+ */
+
+#include "roi_output.h"
+#include "common.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace Camera {
+
+  RoiTable::RoiTable(std::vector<RoiWindow> windows)
+    : windows_(std::move(windows)) {
+    max_pixels_.reserve(windows_.size());
+    for (const auto &w : windows_) {
+      max_pixels_.push_back(static_cast<size_t>(w.width) * w.height);
+    }
+  }
+
+  std::vector<RoiWindow> RoiTable::snapshot() const {
+    std::lock_guard lock(mtx_);
+    return windows_;
+  }
+
+  long RoiTable::set(size_t id, const RoiWindow &window, std::string &errstring) {
+    if (id >= windows_.size()) {
+      errstring = "window " + std::to_string(id) + " not configured";
+      return ERROR;
+    }
+    const size_t npix = static_cast<size_t>(window.width) * window.height;
+    if (npix == 0 || npix > max_pixels_[id]) {
+      errstring = "window " + std::to_string(id) + " must have 1.." +
+                  std::to_string(max_pixels_[id]) + " pixels";
+      return ERROR;
+    }
+    {
+      std::lock_guard lock(mtx_);
+      windows_[id] = window;
+    }
+    generation_.fetch_add(1, std::memory_order_release);
+    return NO_ERROR;
+  }
+
+  RoiOutput::RoiOutput(std::shared_ptr<RoiTable> table,
+                       std::vector<std::vector<std::unique_ptr<FrameOutput>>> sinks)
+    : table_(std::move(table)),
+      sinks_(std::move(sinks)) {
+    sinks_.resize(table_->size());
+  }
+
+  long RoiOutput::open() {
+    long error = NO_ERROR;
+    for (auto &chain : sinks_) {
+      for (auto &sink : chain) {
+        if (sink->open() != NO_ERROR) error = ERROR;
+      }
+    }
+    return error;
+  }
+
+  long RoiOutput::write(const char* data, size_t size, const FrameMetadata& meta) {
+    const uint64_t gen = table_->generation();
+    if (gen != generation_) {
+      windows_ = table_->snapshot();
+      generation_ = gen;
+    }
+
+    n_frames_.fetch_add(1, std::memory_order_relaxed);
+    const FrameView frame = FrameView::full(data, meta);
+    if (frame.size() > size) {
+      n_failed_.fetch_add(1, std::memory_order_relaxed);
+      return ERROR;
+    }
+
+    long error = NO_ERROR;
+    for (size_t id = 0; id < windows_.size(); ++id) {
+      const auto &w = windows_[id];
+      if (sinks_[id].empty()) continue;
+
+      // a window that has been moved partly off the frame is skipped
+      // rather than resized, so consumers always see the geometry they set
+      if (static_cast<uint64_t>(w.x0) + w.width  > meta.width ||
+          static_cast<uint64_t>(w.y0) + w.height > meta.height) {
+        n_clipped_.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+
+      FrameMetadata roi_meta = meta;
+      roi_meta.width  = w.width;
+      roi_meta.height = w.height;
+      roi_meta.roi_id = static_cast<uint32_t>(id);
+      roi_meta.roi_x  = w.x0;
+      roi_meta.roi_y  = w.y0;
+
+      const FrameView view = frame.window(w.x0, w.y0, w.width, w.height);
+      for (auto &sink : sinks_[id]) {
+        if (sink->write_view(view, roi_meta) != NO_ERROR) error = ERROR;
+      }
+    }
+    if (error != NO_ERROR) n_failed_.fetch_add(1, std::memory_order_relaxed);
+    return error;
+  }
+
+  void RoiOutput::close() {
+    for (auto &chain : sinks_) {
+      for (auto &sink : chain) sink->close();
+    }
+  }
+
+  QueueStatus RoiOutput::queue_status() const {
+    QueueStatus status;
+    for (const auto &chain : sinks_) {
+      for (const auto &sink : chain) status.merge(sink->queue_status());
+    }
+    return status;
+  }
+
+  OutputMetrics RoiOutput::metrics() const {
+    OutputMetrics m;
+    m.kind           = "roi";
+    m.frames_in      = n_frames_.load();
+    m.frames_failed  = n_failed_.load();
+    m.frames_written = m.frames_in - std::min(m.frames_in, m.frames_failed);
+    m.detail["windows"] = static_cast<double>(sinks_.size());
+    m.detail["clipped"] = n_clipped_.load();
+    for (size_t id = 0; id < sinks_.size(); ++id) {
+      for (const auto &sink : sinks_[id]) {
+        for (auto &link : chain_metrics(*sink)) {
+          link.detail["window"] = static_cast<double>(id);
+          m.sinks.push_back(std::move(link));
+        }
+      }
+    }
+    return m;
+  }
+
+}
@@ -0,0 +1,83 @@
+/**
+ * @file    roi_output.h
+ * @brief   FrameOutput that cuts regions of interest out of each frame
+ *
+ * Each configured window is handed to its own chain of outputs as a
+ * strided FrameView into the full frame, so nothing larger than a window
+ * is ever copied. Window positions live in a RoiTable shared with the
+ * command path and may be moved while frames are flowing.
+ */
+#pragma once
+
+#include "frame_output.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Camera {
+
+  struct RoiWindow {
+    uint32_t x0{0};
+    uint32_t y0{0};
+    uint32_t width{0};
+    uint32_t height{0};
+  };
+
+  /// Window geometry shared between the ROI output and runtime commands
+  class RoiTable {
+    public:
+      explicit RoiTable(std::vector<RoiWindow> windows);
+
+      size_t size() const { return windows_.size(); }
+      std::vector<RoiWindow> snapshot() const;
+      uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+      // A window may move freely but may not grow beyond the pixel count
+      // it was configured with, since downstream slots are sized from it.
+      long set(size_t id, const RoiWindow &window, std::string &errstring);
+
+    private:
+      mutable std::mutex mtx_;
+      std::vector<RoiWindow> windows_;
+      std::vector<size_t> max_pixels_;
+      std::atomic<uint64_t> generation_{0};
+  };
+
+  class RoiOutput : public FrameOutput {
+    public:
+      // sinks[i] is the output chain for window i of the table
+      RoiOutput(std::shared_ptr<RoiTable> table,
+                std::vector<std::vector<std::unique_ptr<FrameOutput>>> sinks);
+      ~RoiOutput() override = default;
+
+      RoiOutput(const RoiOutput&) = delete;
+      RoiOutput& operator=(const RoiOutput&) = delete;
+
+      long open() override;
+      long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      void close() override;
+      QueueStatus queue_status() const override;   ///< the fullest sink
+      OutputMetrics metrics() const override;
+
+      std::shared_ptr<RoiTable> table() const { return table_; }
+      uint64_t windows_clipped() const { return n_clipped_.load(); }
+
+    private:
+      std::shared_ptr<RoiTable> table_;
+      std::vector<std::vector<std::unique_ptr<FrameOutput>>> sinks_;
+
+      // Local copy of the table, refreshed only when its generation changes.
+      // Only touched on the producer thread.
+      std::vector<RoiWindow> windows_;
+      uint64_t generation_{~0ULL};
+
+      std::atomic<uint64_t> n_frames_{0};
+      std::atomic<uint64_t> n_failed_{0};
+      std::atomic<uint64_t> n_clipped_{0};
+  };
+
+}
@@ -0,0 +1,236 @@
+/**
+ * @file    shared_memory_reader.cpp
+ * @brief   consumer side of the SharedMemoryWriter frame ring
+ */
+
+#include "shared_memory_reader.h"
+#include "common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+namespace Camera {
+
+  SharedMemoryReader::SharedMemoryReader(const std::string &segment_name, Mode mode)
+    : segment_name_(segment_name),
+      mode_(mode) {
+  }
+
+  SharedMemoryReader::~SharedMemoryReader() {
+    this->close();
+  }
+
+  long SharedMemoryReader::open() {
+    const std::string function("Camera::SharedMemoryReader::open");
+
+    // read_write because pins and the waiter count live in the segment
+    try {
+      if (segment_name_.find('/') != std::string::npos) {
+        file_ = std::make_unique<boost::interprocess::file_mapping>(
+          segment_name_.c_str(), boost::interprocess::read_write
+        );
+        region_ = std::make_unique<boost::interprocess::mapped_region>(
+          *file_, boost::interprocess::read_write
+        );
+      }
+      else {
+        shm_ = std::make_unique<boost::interprocess::shared_memory_object>(
+          boost::interprocess::open_only,
+          segment_name_.c_str(),
+          boost::interprocess::read_write
+        );
+        region_ = std::make_unique<boost::interprocess::mapped_region>(
+          *shm_, boost::interprocess::read_write
+        );
+      }
+    } catch (const boost::interprocess::interprocess_exception &e) {
+      logwrite(function, "ERROR opening shared memory \"" + segment_name_ + "\": " + std::string(e.what()));
+      this->close();
+      return ERROR;
+    }
+
+    control_ = static_cast<RingBufferControl*>(region_->get_address());
+
+    if (region_->get_size() < sizeof(RingBufferControl) || !ShmRing::compatible(control_)) {
+      logwrite(function, "ERROR \"" + segment_name_ + "\" is not a version " +
+               std::to_string(SHM_RING_VERSION) + " frame ring");
+      this->close();
+      return ERROR;
+    }
+    if (region_->get_size() < sizeof(RingBufferControl) + control_->frame_slot_size * control_->num_frames) {
+      logwrite(function, "ERROR \"" + segment_name_ + "\" is smaller than its ring");
+      this->close();
+      return ERROR;
+    }
+
+    buffer_.resize(control_->frame_slot_size - sizeof(SharedFrameHeader));
+    cursor_ = control_->write_index.load(std::memory_order_acquire);
+    started_ = false;
+
+    if (mode_ == Mode::Lossless) {
+      consumer_ = ShmRing::attach_consumer(control_, cursor_);
+      if (!consumer_) logwrite(function, "NOTICE \"" + segment_name_ + "\" already has a consumer; not holding the writer back");
+    }
+
+    return NO_ERROR;
+  }
+
+  void SharedMemoryReader::close() {
+    this->release();
+    if (consumer_ && control_) ShmRing::detach_consumer(control_);
+    consumer_ = false;
+    control_ = nullptr;
+    region_.reset();
+    shm_.reset();
+    file_.reset();
+  }
+
+  uint64_t SharedMemoryReader::published() const {
+    return control_ ? control_->write_index.load(std::memory_order_acquire) : 0;
+  }
+
+  long SharedMemoryReader::next(Frame &frame, int timeout_ms) {
+    return this->acquire(frame, timeout_ms, false);
+  }
+
+  long SharedMemoryReader::next_pinned(Frame &frame, int timeout_ms) {
+    return this->acquire(frame, timeout_ms, true);
+  }
+
+  void SharedMemoryReader::release() {
+    if (pinned_ && control_) ShmRing::unpin(control_, pinned_frame_);
+    pinned_ = false;
+    this->consumed();
+  }
+
+  void SharedMemoryReader::consumed() {
+    if (consumer_ && control_) ShmRing::consume(control_, pinned_ ? pinned_frame_ : cursor_);
+  }
+
+  long SharedMemoryReader::acquire(Frame &frame, int timeout_ms, bool pinned) {
+    const std::string function("Camera::SharedMemoryReader::next");
+    using ShmRing::ReadStatus;
+
+    if (!control_) return ERROR;
+    this->release();
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    while (true) {
+      // the doorbell is read first so a frame published after the checks
+      // below changes it and the wait returns at once
+      const uint32_t bell = control_->doorbell.load(std::memory_order_acquire);
+      const uint64_t published = control_->write_index.load(std::memory_order_acquire);
+
+      if (mode_ == Mode::Latest && published > cursor_ + 1) {
+        if (started_) stats_.dropped += published - 1 - cursor_;
+        cursor_ = published - 1;
+      }
+
+      if (cursor_ < published) {
+        const uint64_t want = cursor_;
+        const ReadStatus status = pinned ? ShmRing::pin(control_, want, frame.info)
+                                         : ShmRing::read(control_, want, frame.info, buffer_.data(), buffer_.size());
+        switch (status) {
+          case ReadStatus::Ok: {
+            cursor_ = want + 1;
+            started_ = true;
+            if (pinned) {
+              pinned_ = true;
+              pinned_frame_ = want;
+              frame.data = ShmRing::pixels(ShmRing::slot(control_, want));
+            }
+            else frame.data = buffer_.data();
+            this->consumed();
+
+            const uint64_t now = get_clock_time_nsec();
+            stats_.frames++;
+            stats_.bytes += frame.info.data_size;
+            if (now > frame.info.publish_ns) latency_.record(now - frame.info.publish_ns);
+            if (frame.info.host_time_ns > 0 && now > frame.info.host_time_ns) {
+              age_.record(now - frame.info.host_time_ns);
+            }
+            return NO_ERROR;
+          }
+
+          case ReadStatus::Skipped:
+            cursor_ = want + 1;
+            stats_.skipped++;
+            continue;
+
+          case ReadStatus::Overrun: {
+            // Lapped: resume at the oldest frame the writer is not about to reuse
+            const uint64_t now = control_->write_index.load(std::memory_order_acquire);
+            const uint64_t oldest = (now >= control_->num_frames) ? now - control_->num_frames + 1 : 0;
+            const uint64_t resume = std::max(oldest, want + 1);
+            stats_.overruns++;
+            stats_.dropped += resume - want;
+            cursor_ = resume;
+            continue;
+          }
+
+          case ReadStatus::TooLarge:
+            logwrite(function, "ERROR frame of " + std::to_string(frame.info.data_size) +
+                     " bytes larger than the ring slot");
+            return ERROR;
+
+          case ReadStatus::NotReady:
+            break;                     // still being written, wait for its doorbell
+        }
+      }
+
+      this->consumed();         // positions skipped over are done with too
+
+      struct timespec ts;
+      const struct timespec* timeout = nullptr;
+      if (timeout_ms >= 0) {
+        const auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= std::chrono::nanoseconds::zero()) return TIMEOUT;
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+        ts.tv_sec  = ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+        timeout = &ts;
+      }
+      ShmRing::wait_doorbell(control_, bell, timeout);
+    }
+  }
+
+  SharedMemoryReader::Stats SharedMemoryReader::stats() const {
+    Stats s = stats_;
+    s.latency = latency_.snapshot();
+    s.age     = age_.snapshot();
+    return s;
+  }
+
+  void SharedMemoryReader::clear_stats() {
+    stats_ = Stats{};
+    latency_.clear();
+    age_.clear();
+  }
+
+  std::string SharedMemoryReader::summary(double elapsed_s) const {
+    const Stats s = this->stats();
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1)
+       << "frames=" << s.frames
+       << " rate=" << (elapsed_s > 0 ? s.frames / elapsed_s : 0.0) << "Hz"
+       << " throughput=" << (elapsed_s > 0 ? s.bytes / elapsed_s / 1.0e6 : 0.0) << "MB/s"
+       << " dropped=" << s.dropped
+       << " overruns=" << s.overruns
+       << " skipped=" << s.skipped;
+    if (s.latency.count > 0) {
+      ss << "\n  publish->read latency: p50<=" << s.latency.percentile_us(50)
+         << "us p99<=" << s.latency.percentile_us(99)
+         << "us mean=" << s.latency.mean_us()
+         << "us max=" << s.latency.max_us() << "us";
+    }
+    if (s.age.count > 0) {
+      ss << "\n  host arrival->read:    p50<=" << s.age.percentile_us(50)
+         << "us mean=" << s.age.mean_us() << "us";
+    }
+    return ss.str();
+  }
+
+}
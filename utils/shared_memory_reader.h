@@ -0,0 +1,100 @@
+/**
+ * @file    shared_memory_reader.h
+ * @brief   consumer side of the SharedMemoryWriter frame ring
+ *
+ * Attaches to a ring created by SharedMemoryWriter and hands frames out
+ * in one of two modes:
+ *   Latest    always the newest published frame, skipping any backlog
+ *   Lossless  every frame in order; when the writer laps the reader the
+ *             frames lost are counted and the cursor jumps to the oldest
+ *             frame still in the ring. The first lossless reader attached
+ *             also becomes the ring's consumer, so a writer whose overflow
+ *             policy is drop_newest or block holds back rather than lap it
+ * Frames are copied out under the ring's seqlock, or pinned in place so
+ * the writer leaves the slot alone until release(). A segment name with a
+ * '/' in it is a file path, as for rings placed on hugetlbfs.
+ */
+#pragma once
+
+#include "shm_ring.h"
+#include "latency_histogram.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace Camera {
+
+  class SharedMemoryReader {
+    public:
+      enum class Mode { Latest, Lossless };
+
+      struct Frame {
+        SharedFrameInfo info;
+        const char* data{nullptr};      ///< valid until the next call or release()
+      };
+
+      struct Stats {
+        uint64_t frames{0};             ///< frames delivered
+        uint64_t bytes{0};
+        uint64_t dropped{0};            ///< frames never delivered to this reader
+        uint64_t overruns{0};           ///< times the writer lapped a lossless reader
+        uint64_t skipped{0};            ///< positions the writer skipped or emptied
+        LatencySnapshot latency;        ///< slot published to frame delivered
+        LatencySnapshot age;            ///< frame reached the host to frame delivered
+      };
+
+      explicit SharedMemoryReader(const std::string &segment_name, Mode mode = Mode::Latest);
+      ~SharedMemoryReader();
+
+      SharedMemoryReader(const SharedMemoryReader&) = delete;
+      SharedMemoryReader& operator=(const SharedMemoryReader&) = delete;
+
+      // Attaches to the segment; ERROR if it is missing or another layout
+      long open();
+      void close();
+
+      // Waits up to timeout_ms (negative waits forever) for the next frame
+      // and copies it into an internal buffer. NO_ERROR, TIMEOUT or ERROR.
+      long next(Frame &frame, int timeout_ms);
+
+      // As next(), but pins the slot and points frame.data into shared
+      // memory. The slot stays pinned until release() or the next call.
+      long next_pinned(Frame &frame, int timeout_ms);
+      void release();
+
+      uint64_t published() const;       ///< frames published by the writer so far
+      uint32_t num_frames() const { return control_ ? control_->num_frames : 0; }
+      Stats stats() const;
+      void clear_stats();
+      std::string summary(double elapsed_s) const;
+
+    private:
+      long acquire(Frame &frame, int timeout_ms, bool pinned);
+      void consumed();                  ///< publishes progress when the ring's consumer
+
+      std::string segment_name_;
+      Mode mode_;
+
+      std::unique_ptr<boost::interprocess::shared_memory_object> shm_;
+      std::unique_ptr<boost::interprocess::file_mapping> file_;
+      std::unique_ptr<boost::interprocess::mapped_region> region_;
+      RingBufferControl* control_{nullptr};
+
+      uint64_t cursor_{0};              ///< next position wanted
+      bool started_{false};
+      bool consumer_{false};
+      bool pinned_{false};
+      uint64_t pinned_frame_{0};
+      std::vector<char> buffer_;
+      Stats stats_;                     ///< counters; the latencies are in the histograms
+      LatencyHistogram latency_;
+      LatencyHistogram age_;
+  };
+
+}
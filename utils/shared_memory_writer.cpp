@@ -7,8 +7,16 @@
 #include "shared_memory_writer.h"
 #include "common.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
 
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
 namespace Camera {
 
   SharedMemoryWriter::SharedMemoryWriter(const std::string &segment_name,
@@ -26,36 +34,48 @@ namespace Camera {
   long SharedMemoryWriter::open() {
     const std::string function("Camera::SharedMemoryWriter::open");
 
-    const size_t slot_size = sizeof(SharedFrameHeader) + max_frame_bytes_;
-    const size_t total_size = sizeof(RingBufferControl) + slot_size * num_frames_;
+    const size_t slot_size = ShmRing::slot_size(max_frame_bytes_);
+    const size_t total_size = ShmRing::segment_size(max_frame_bytes_, num_frames_);
 
     try {
-      // Remove any stale segment with the same name
-      boost::interprocess::shared_memory_object::remove(segment_name_.c_str());
-
-      shm_ = std::make_unique<boost::interprocess::shared_memory_object>(
-        boost::interprocess::create_only,
-        segment_name_.c_str(),
-        boost::interprocess::read_write
-      );
-      shm_->truncate(static_cast<boost::interprocess::offset_t>(total_size));
+      const size_t mapped_size = this->map_segment(total_size);
 
-      region_ = std::make_unique<boost::interprocess::mapped_region>(
-        *shm_, boost::interprocess::read_write
-      );
-
-      // Zero the entire segment
+      // Place the pages before first touch, then zero the entire segment
+      if (numa_node_ >= 0 && !bind_to_numa_node(region_->get_address(), mapped_size, numa_node_)) {
+        logwrite(function, "WARNING could not bind segment to NUMA node " + std::to_string(numa_node_));
+      }
       std::memset(region_->get_address(), 0, total_size);
 
-      // Initialize the ring buffer control block
+      // Initialize the ring buffer control block. The magic goes in last
+      // so a reader attaching early never sees a half-initialized ring.
+      {
+      std::lock_guard<std::mutex> lock(control_mtx_);
       control_ = static_cast<RingBufferControl*>(region_->get_address());
+      control_->version = SHM_RING_VERSION;
+      control_->header_size = sizeof(SharedFrameHeader);
       control_->num_frames = num_frames_;
-      control_->frame_slot_size = static_cast<uint32_t>(slot_size);
+      control_->frame_slot_size = slot_size;
       control_->write_index.store(0);
+      control_->doorbell.store(0);
+      control_->waiters.store(0);
+      control_->consumed_index.store(0);
+      control_->consumer_pid.store(0);
+      control_->space.store(0);
+      control_->writer_waiting.store(0);
+      std::atomic_thread_fence(std::memory_order_release);
+      for (uint32_t i = 0; i < num_frames_; ++i) {
+        ShmRing::slot(control_, i)->info.position = SHM_NO_POSITION;
+      }
+      std::atomic_thread_fence(std::memory_order_release);
+      control_->magic = SHM_RING_MAGIC;
+      }
+      next_frame_ = 0;
+      n_pinned_skips_ = 0;
 
-      logwrite(function, "opened segment \"" + segment_name_ + "\" (" +
+      logwrite(function, "opened segment \"" + (file_path_.empty() ? segment_name_ : file_path_) + "\" (" +
                std::to_string(total_size) + " bytes, " +
-               std::to_string(num_frames_) + " slots)");
+               std::to_string(num_frames_) + " slots, layout v" +
+               std::to_string(SHM_RING_VERSION) + ", pages=" + to_string(pages_) + ")");
 
     } catch (const boost::interprocess::interprocess_exception &e) {
       logwrite(function, "ERROR creating shared memory: " + std::string(e.what()));
@@ -65,60 +85,296 @@ namespace Camera {
     return NO_ERROR;
   }
 
+  void SharedMemoryWriter::set_backing(HugePageMode huge_pages, const std::string &hugetlbfs_dir,
+                                       int numa_node) {
+    huge_pages_ = huge_pages;
+    hugetlbfs_dir_ = hugetlbfs_dir;
+    numa_node_ = numa_node;
+  }
+
+  size_t SharedMemoryWriter::map_segment(size_t total_size) {
+    const std::string function("Camera::SharedMemoryWriter::open");
+    namespace bip = boost::interprocess;
+
+    pages_ = huge_pages_;
+    if (pages_ == HugePageMode::Hugetlbfs) {
+      // hugetlbfs files must be sized in whole huge pages
+      struct statfs fs;
+      const std::string path = hugetlbfs_dir_ + "/" + segment_name_;
+      int fd = -1;
+      if (statfs(hugetlbfs_dir_.c_str(), &fs) == 0 && fs.f_type == HUGETLBFS_MAGIC &&
+          (fd = ::open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0660)) >= 0) {
+        const size_t page = static_cast<size_t>(fs.f_bsize);
+        const size_t size = (total_size + page - 1) / page * page;
+        const bool sized = (ftruncate(fd, static_cast<off_t>(size)) == 0);
+        ::close(fd);
+        if (sized) {
+          try {
+            file_ = std::make_unique<bip::file_mapping>(path.c_str(), bip::read_write);
+            region_ = std::make_unique<bip::mapped_region>(*file_, bip::read_write, 0, size);
+            file_path_ = path;
+            return size;
+          }
+          catch (const bip::interprocess_exception &) {
+            file_.reset();
+          }
+        }
+        std::remove(path.c_str());
+      }
+      logwrite(function, "WARNING no hugetlbfs pages at " + hugetlbfs_dir_ + "; using /dev/shm with THP");
+      pages_ = HugePageMode::Thp;
+    }
+
+    // Remove any stale segment with the same name
+    bip::shared_memory_object::remove(segment_name_.c_str());
+
+    shm_ = std::make_unique<bip::shared_memory_object>(
+      bip::create_only,
+      segment_name_.c_str(),
+      bip::read_write
+    );
+    shm_->truncate(static_cast<bip::offset_t>(total_size));
+
+    region_ = std::make_unique<bip::mapped_region>(
+      *shm_, bip::read_write
+    );
+
+    // shmem THP also needs /sys/kernel/mm/transparent_hugepage/shmem_enabled
+    // set to advise (or always)
+    if (pages_ == HugePageMode::Thp && !advise_huge_pages(region_->get_address(), region_->get_size())) {
+      logwrite(function, "WARNING transparent huge pages refused for segment");
+      pages_ = HugePageMode::None;
+    }
+    return region_->get_size();
+  }
+
   long SharedMemoryWriter::write(const char* data, size_t size, const FrameMetadata& meta) {
+    uint64_t frame;
+    SharedFrameHeader* header = this->claim_slot(size, frame);
+    if (!header) return ERROR;
+
+    // Copy pixel data after the header
+    std::memcpy(pixels_of(header), data, size);
+
+    this->publish(header, frame, size, meta);
+
+    return NO_ERROR;
+  }
+
+  long SharedMemoryWriter::write_view(const FrameView &view, const FrameMetadata& meta) {
+    uint64_t frame;
+    SharedFrameHeader* header = this->claim_slot(view.size(), frame);
+    if (!header) return ERROR;
+
+    // Gather the strided rows straight into the slot, no intermediate copy
+    view.copy_to(pixels_of(header));
+
+    this->publish(header, frame, view.size(), meta);
+
+    return NO_ERROR;
+  }
+
+  char* SharedMemoryWriter::reserve(size_t size) {
+    // Not an error: the producer falls back to its own buffer and write()
+    if (!control_ || size > max_frame_bytes_) return nullptr;
+
+    if (reserved_) this->abandon();
+
+    reserved_ = this->claim_slot(size, reserved_frame_);
+    return reserved_ ? pixels_of(reserved_) : nullptr;
+  }
+
+  long SharedMemoryWriter::commit(size_t size, const FrameMetadata& meta) {
+    const std::string function("Camera::SharedMemoryWriter::commit");
+
+    if (!reserved_) {
+      logwrite(function, "ERROR no slot reserved");
+      return ERROR;
+    }
+    if (size > max_frame_bytes_) {
+      logwrite(function, "ERROR frame size " + std::to_string(size) +
+               " exceeds max " + std::to_string(max_frame_bytes_));
+      this->abandon();
+      return ERROR;
+    }
+
+    this->publish(reserved_, reserved_frame_, size, meta);
+    reserved_ = nullptr;
+
+    return NO_ERROR;
+  }
+
+  void SharedMemoryWriter::abandon() {
+    if (!reserved_ || !control_) { reserved_ = nullptr; return; }
+
+    // The slot contents are already clobbered, so it cannot go back to the
+    // frame it held before. Publish it empty so readers skip over it.
+    this->publish(reserved_, reserved_frame_, 0, FrameMetadata{});
+    reserved_ = nullptr;
+  }
+
+  SharedFrameHeader* SharedMemoryWriter::claim_slot(size_t size, uint64_t &frame) {
     const std::string function("Camera::SharedMemoryWriter::write");
 
     if (!control_) {
       logwrite(function, "ERROR shared memory not open");
-      return ERROR;
+      return nullptr;
     }
 
     if (size > max_frame_bytes_) {
       logwrite(function, "ERROR frame size " + std::to_string(size) +
                " exceeds max " + std::to_string(max_frame_bytes_));
-      return ERROR;
+      n_failed_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
     }
 
-    // Advance write index (wraps around the ring buffer)
-    const uint32_t idx = control_->write_index.fetch_add(1) % num_frames_;
-    char* slot = this->slot_ptr(idx);
+    // Advance to the next slot (wraps around the ring buffer) and make its
+    // sequence odd so readers discard anything they copy from it meanwhile.
+    // A slot a reader has pinned is passed over, its position published as
+    // skipped, and the frame goes in the next one.
+    for (uint32_t tries = 0; tries < num_frames_; ++tries) {
+      if (!this->wait_for_room(next_frame_)) {
+        n_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      frame = next_frame_++;
+      SharedFrameHeader* header = ShmRing::slot(control_, frame);
+      if (ShmRing::begin_write(header)) return header;
+      ShmRing::end_write(header);
+      this->advance(frame);
+      n_pinned_skips_.fetch_add(1, std::memory_order_relaxed);
+    }
 
-    // Write the header
-    auto* header = reinterpret_cast<SharedFrameHeader*>(slot);
-    header->ready.store(false);
-    header->frame_number = meta.frame_number;
-    header->timestamp = meta.timestamp;
-    header->width = meta.width;
-    header->height = meta.height;
-    header->bytes_per_pixel = meta.bytes_per_pixel;
-    header->sequence_number = meta.sequence_number;
+    logwrite(function, "ERROR all " + std::to_string(num_frames_) + " slots pinned by readers, frame dropped");
+    n_failed_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
 
-    // Copy pixel data after the header
-    std::memcpy(slot + sizeof(SharedFrameHeader), data, size);
+  void SharedMemoryWriter::set_overflow(OverflowPolicy policy, uint32_t block_ms) {
+    const std::string function("Camera::SharedMemoryWriter::set_overflow");
+    if (policy == OverflowPolicy::Spill) {
+      logwrite(function, "NOTICE overflow=spill does not apply to shared memory; using drop_newest");
+      policy = OverflowPolicy::DropNewest;
+    }
+    overflow_ = policy;
+    block_ms_ = block_ms;
+  }
 
-    // Signal that this slot is ready for consumers
-    header->ready.store(true);
+  bool SharedMemoryWriter::wait_for_room(uint64_t frame) {
+    if (overflow_ == OverflowPolicy::DropOldest || ShmRing::has_room(control_, frame)) return true;
+    if (overflow_ != OverflowPolicy::Block) return false;
 
-    return NO_ERROR;
+    n_blocked_.fetch_add(1, std::memory_order_relaxed);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(block_ms_);
+    while (true) {
+      // read the space word first so a frame consumed in between wakes the wait
+      const uint32_t seen = control_->space.load(std::memory_order_acquire);
+      if (ShmRing::has_room(control_, frame)) return true;
+
+      // without a limit, still look up now and then in case the consumer died
+      auto remaining = std::chrono::nanoseconds(std::chrono::milliseconds(100));
+      if (block_ms_ > 0) {
+        remaining = std::min(remaining, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          deadline - std::chrono::steady_clock::now()));
+        if (remaining <= std::chrono::nanoseconds::zero()) return false;
+      }
+      struct timespec ts;
+      ts.tv_sec  = remaining.count() / 1000000000;
+      ts.tv_nsec = remaining.count() % 1000000000;
+      ShmRing::wait_space(control_, seen, &ts);
+    }
+  }
+
+  QueueStatus SharedMemoryWriter::queue_status() const {
+    QueueStatus status;
+    status.capacity = num_frames_;
+    status.dropped  = n_dropped_.load();
+    status.blocked  = n_blocked_.load();
+    std::lock_guard<std::mutex> lock(control_mtx_);
+    if (control_ && control_->consumer_pid.load(std::memory_order_acquire) != 0) {
+      const uint64_t written  = control_->write_index.load(std::memory_order_acquire);
+      const uint64_t consumed = control_->consumed_index.load(std::memory_order_acquire);
+      status.depth = (written > consumed) ? written - consumed : 0;
+    }
+    status.set_pressure(overflow_);
+    return status;
+  }
+
+  OutputMetrics SharedMemoryWriter::metrics() const {
+    OutputMetrics m;
+    m.kind           = "shm";
+    m.frames_written = n_published_.load();
+    m.frames_dropped = n_dropped_.load();
+    m.frames_failed  = n_failed_.load();
+    m.frames_in      = m.frames_written + m.frames_dropped + m.frames_failed;
+    m.bytes_written  = n_bytes_.load();
+    m.latency = latency_.snapshot();
+    m.queue   = this->queue_status();
+    m.detail["blocked"]      = m.queue.blocked;
+    m.detail["pinned_skips"] = n_pinned_skips_.load();
+    return m;
+  }
+
+  void SharedMemoryWriter::publish(SharedFrameHeader* header, uint64_t frame, size_t size,
+                                   const FrameMetadata& meta) {
+    SharedFrameInfo &info = header->info;
+    info.position = frame;
+    info.frame_number = meta.frame_number;
+    info.timestamp = meta.timestamp;
+    info.sequence_number = meta.sequence_number;
+    info.data_size = size;
+    info.host_time_ns = meta.host_time_ns;
+    info.publish_ns = get_clock_time_nsec();
+    info.width = meta.width;
+    info.height = meta.height;
+    info.bytes_per_pixel = meta.bytes_per_pixel;
+    info.roi_x = meta.roi_x;
+    info.roi_y = meta.roi_y;
+    info.pixel_format = static_cast<uint32_t>(pixel_format_of(meta));
+    info.big_endian = meta.big_endian ? 1 : 0;
+
+    ShmRing::end_write(header);
+    this->advance(frame);
+
+    if (size > 0) {
+      n_published_.fetch_add(1, std::memory_order_relaxed);
+      n_bytes_.fetch_add(size, std::memory_order_relaxed);
+      if (meta.host_time_ns > 0 && info.publish_ns > meta.host_time_ns) {
+        latency_.record(info.publish_ns - meta.host_time_ns);
+      }
+    }
+  }
+
+  void SharedMemoryWriter::advance(uint64_t frame) {
+    // A reservation committed after a later write() must not move it back
+    if (control_->write_index.load(std::memory_order_relaxed) < frame + 1) {
+      control_->write_index.store(frame + 1, std::memory_order_release);
+    }
+    ShmRing::ring_doorbell(control_);
   }
 
   void SharedMemoryWriter::close() {
     const std::string function("Camera::SharedMemoryWriter::close");
 
+    // No reader may be looking at the control block once it is unmapped
+    {
+    std::lock_guard<std::mutex> lock(control_mtx_);
+    control_ = nullptr;
+    }
     region_.reset();
     shm_.reset();
-    control_ = nullptr;
+    file_.reset();
+    reserved_ = nullptr;
 
-    if (!segment_name_.empty()) {
+    if (!file_path_.empty()) {
+      std::remove(file_path_.c_str());
+      logwrite(function, "closed segment \"" + file_path_ + "\"");
+      file_path_.clear();
+    }
+    else if (!segment_name_.empty()) {
       boost::interprocess::shared_memory_object::remove(segment_name_.c_str());
       logwrite(function, "closed segment \"" + segment_name_ + "\"");
     }
   }
 
-  char* SharedMemoryWriter::slot_ptr(uint32_t index) {
-    auto* base = static_cast<char*>(region_->get_address());
-    const size_t slot_size = sizeof(SharedFrameHeader) + max_frame_bytes_;
-    return base + sizeof(RingBufferControl) + slot_size * index;
-  }
-
 }
@@ -6,40 +6,21 @@
 #pragma once
 
 #include "frame_output.h"
+#include "shm_ring.h"
+#include "frame_buffer_pool.h"
 
 #include <atomic>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/file_mapping.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 
 namespace Camera {
 
-  /**
-   * Shared memory layout per frame slot:
-   *   FrameHeader (fixed size) followed by pixel data (variable size)
-   */
-  struct SharedFrameHeader {
-    uint64_t frame_number;
-    uint64_t timestamp;
-    uint32_t width;
-    uint32_t height;
-    uint32_t bytes_per_pixel;
-    uint64_t sequence_number;
-    std::atomic<bool> ready;
-  };
-
-  /**
-   * Ring buffer control block at the start of the shared memory segment.
-   */
-  struct RingBufferControl {
-    uint32_t num_frames;
-    uint32_t frame_slot_size;
-    std::atomic<uint32_t> write_index;
-  };
-
   class SharedMemoryWriter : public FrameOutput {
     public:
       SharedMemoryWriter(const std::string &segment_name,
@@ -49,20 +30,85 @@ namespace Camera {
 
       long open() override;
       long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      long write_view(const FrameView &view, const FrameMetadata& meta) override;
       void close() override;
 
+      // Hands out the pixel area of the next slot so the producer can read
+      // the frame straight into shared memory; nullptr if it does not fit
+      char* reserve(size_t size) override;
+      long commit(size_t size, const FrameMetadata& meta) override;
+      void abandon() override;
+
+      uint64_t pinned_skips() const { return n_pinned_skips_.load(); }
+
+      // What to do when the next slot holds a frame the ring's lossless
+      // consumer has not finished with: drop_oldest overwrites it as if
+      // there were no consumer, drop_newest drops the new frame, block
+      // waits up to block_ms (0 for no limit) before dropping it. Spill
+      // is not offered here and acts as drop_newest.
+      void set_overflow(OverflowPolicy policy, uint32_t block_ms = 100);
+      QueueStatus queue_status() const override;
+      OutputMetrics metrics() const override;
+
+      // Page size and NUMA node for the segment, applied at the next open().
+      // With Hugetlbfs the segment is a file in hugetlbfs_dir, which readers
+      // open by path; it falls back to /dev/shm with THP if that fails.
+      void set_backing(HugePageMode huge_pages, const std::string &hugetlbfs_dir = "/dev/hugepages",
+                       int numa_node = -1);
+
     private:
       std::string segment_name_;
       size_t max_frame_bytes_;
       uint32_t num_frames_;
 
+      HugePageMode huge_pages_{HugePageMode::None};   ///< requested
+      HugePageMode pages_{HugePageMode::None};        ///< obtained at open()
+      std::string hugetlbfs_dir_;
+      int numa_node_{-1};
+      std::string file_path_;      ///< hugetlbfs file backing the segment, if any
+
       std::unique_ptr<boost::interprocess::shared_memory_object> shm_;
+      std::unique_ptr<boost::interprocess::file_mapping> file_;
       std::unique_ptr<boost::interprocess::mapped_region> region_;
 
       RingBufferControl* control_{nullptr};
+      mutable std::mutex control_mtx_;         ///< held to set control_, and by readers off the producer thread
+
+      // Only touched on the producer thread
+      uint64_t next_frame_{0};                 ///< ring position of the next claimed slot
+      SharedFrameHeader* reserved_{nullptr};   ///< slot handed out by reserve()
+      uint64_t reserved_frame_{0};
+      std::atomic<uint64_t> n_pinned_skips_{0};   ///< ring positions passed over for pinned slots
+
+      OverflowPolicy overflow_{OverflowPolicy::DropOldest};
+      uint32_t block_ms_{100};
+      std::atomic<uint64_t> n_dropped_{0};     ///< frames refused for want of room
+      std::atomic<uint64_t> n_blocked_{0};     ///< writes that waited for the consumer
+      std::atomic<uint64_t> n_published_{0};
+      std::atomic<uint64_t> n_failed_{0};      ///< too large, or every slot pinned
+      std::atomic<uint64_t> n_bytes_{0};
+      LatencyHistogram latency_;               ///< frame arrival to published in the ring
+
+      // Creates and maps the segment, huge pages permitting; throws interprocess_exception
+      size_t map_segment(size_t total_size);
+
+      // Claims the next slot and marks it being written; returns its header
+      // or nullptr if the frame does not fit
+      SharedFrameHeader* claim_slot(size_t size, uint64_t &frame);
+
+      // Applies the overflow policy to ring position frame; false if the
+      // frame must be dropped
+      bool wait_for_room(uint64_t frame);
+
+      // Fills the header, marks the slot stable and wakes readers
+      void publish(SharedFrameHeader* header, uint64_t frame, size_t size, const FrameMetadata& meta);
+
+      // Moves write_index past frame and wakes readers
+      void advance(uint64_t frame);
 
-      // Returns pointer to the start of frame slot at given index
-      char* slot_ptr(uint32_t index);
+      static char* pixels_of(SharedFrameHeader* header) {
+        return reinterpret_cast<char*>(header) + sizeof(SharedFrameHeader);
+      }
   };
 
 }
@@ -0,0 +1,305 @@
+/**
+ * @file    shm_ring.h
+ * @brief   shared memory frame ring layout and its seqlock/doorbell protocol
+ *
+ * Segment layout:
+ *   RingBufferControl, then num_frames slots of frame_slot_size bytes, each
+ *   a SharedFrameHeader followed by the pixel data. Headers and slots are
+ *   cache-line aligned.
+ *
+ * Protocol (one writer, any number of readers, in any process):
+ *   - Frame k lives in slot k % num_frames. Each slot has a sequence number
+ *     that the writer makes odd before touching the slot and even again
+ *     once the frame is complete, so the n-th frame written to a slot
+ *     carries seq 2*(n+1) and frame k expects seq 2*(k/num_frames + 1).
+ *   - A reader copies the header and pixels out between two reads of seq
+ *     and keeps the copy only if both are equal to the value expected for
+ *     the frame it wants. Anything else was torn or overwritten.
+ *   - info.position records which frame a slot holds. A slot published
+ *     with a different position, or with no data, is a skipped frame.
+ *   - write_index is the number of frames published. After each frame the
+ *     writer bumps the doorbell word and, if anybody is blocked on it,
+ *     wakes them with a futex so readers need not spin.
+ *   - A reader may pin a slot to work on it in place. The writer never
+ *     writes a pinned slot; it skips that position instead. A reader that
+ *     dies holding a pin keeps the slot out of use until the ring is
+ *     recreated.
+ *   - One lossless reader may attach as the ring's consumer and publish
+ *     consumed_index, the position below which it is finished. A writer
+ *     whose overflow policy is not drop-oldest then treats frames the
+ *     consumer has not reached as occupied, and drops or waits rather than
+ *     overwriting them. Each advance bumps the space word, with a futex
+ *     wake if the writer is blocked on it. A consumer that dies attached
+ *     is noticed by its pid and detached by the writer.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Camera {
+
+  constexpr uint32_t SHM_RING_MAGIC   = 0x474E5241;   ///< "ARNG"
+  constexpr uint32_t SHM_RING_VERSION = 4;            ///< bump on any layout change
+  constexpr size_t   SHM_CACHE_LINE   = 64;
+
+  /**
+   * Per-frame description, copied out by readers as a unit
+   */
+  struct SharedFrameInfo {
+    uint64_t position;         // ring position k of the frame held
+    uint64_t frame_number;
+    uint64_t timestamp;
+    uint64_t sequence_number;
+    uint64_t data_size;        // pixel bytes in this slot, 0 for a dropped frame
+    uint64_t host_time_ns;     // CLOCK_MONOTONIC when the frame reached the host
+    uint64_t publish_ns;       // CLOCK_MONOTONIC when the slot was published
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_per_pixel;
+    uint32_t roi_x;
+    uint32_t roi_y;
+    uint32_t pixel_format;     // Camera::PixelFormat
+    uint32_t big_endian;
+    uint32_t reserved;
+  };
+
+  constexpr uint64_t SHM_NO_POSITION = ~0ULL;
+
+  /**
+   * Shared memory layout per frame slot:
+   *   FrameHeader (fixed size) followed by pixel data (variable size)
+   */
+  struct alignas(SHM_CACHE_LINE) SharedFrameHeader {
+    std::atomic<uint64_t> seq;   // odd while the slot is being written
+    std::atomic<uint32_t> pins;  // readers working on the slot in place
+    uint32_t pad;
+    SharedFrameInfo info;
+  };
+
+  /**
+   * Ring buffer control block at the start of the shared memory segment.
+   * The doorbell sits on its own cache line so readers polling it do not
+   * contend with the static fields, and the consumer's flow control on
+   * another so the writer checking it does not contend with the doorbell.
+   */
+  struct alignas(SHM_CACHE_LINE) RingBufferControl {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;      // sizeof(SharedFrameHeader)
+    uint32_t num_frames;
+    uint64_t frame_slot_size;
+    std::atomic<uint64_t> write_index;
+
+    alignas(SHM_CACHE_LINE) std::atomic<uint32_t> doorbell;
+    std::atomic<uint32_t> waiters;
+
+    alignas(SHM_CACHE_LINE) std::atomic<uint64_t> consumed_index;
+    std::atomic<int32_t>  consumer_pid;      // 0 when no reader holds the writer back
+    std::atomic<uint32_t> space;             // bumped as consumed_index moves
+    std::atomic<uint32_t> writer_waiting;
+  };
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "SHM ring needs lock-free 64-bit atomics");
+  static_assert(sizeof(SharedFrameHeader) % SHM_CACHE_LINE == 0);
+
+  namespace ShmRing {
+
+    inline size_t slot_size(size_t max_frame_bytes) {
+      const size_t n = sizeof(SharedFrameHeader) + max_frame_bytes;
+      return (n + SHM_CACHE_LINE - 1) / SHM_CACHE_LINE * SHM_CACHE_LINE;
+    }
+
+    inline size_t segment_size(size_t max_frame_bytes, uint32_t num_frames) {
+      return sizeof(RingBufferControl) + slot_size(max_frame_bytes) * num_frames;
+    }
+
+    inline SharedFrameHeader* slot(RingBufferControl* control, uint64_t frame) {
+      auto* base = reinterpret_cast<char*>(control) + sizeof(RingBufferControl);
+      return reinterpret_cast<SharedFrameHeader*>(base + control->frame_slot_size * (frame % control->num_frames));
+    }
+
+    inline const char* pixels(const SharedFrameHeader* header) {
+      return reinterpret_cast<const char*>(header) + sizeof(SharedFrameHeader);
+    }
+
+    /// stable sequence number the slot holds once frame k is complete
+    inline uint64_t expected_seq(const RingBufferControl* control, uint64_t frame) {
+      return 2 * (frame / control->num_frames + 1);
+    }
+
+    /// true if the segment was created by a writer speaking this protocol
+    inline bool compatible(const RingBufferControl* control) {
+      return control->magic == SHM_RING_MAGIC && control->version == SHM_RING_VERSION &&
+             control->header_size == sizeof(SharedFrameHeader);
+    }
+
+    // ---- writer side ------------------------------------------------------
+
+    /// Makes the slot's seq odd. Returns false if a reader has it pinned,
+    /// in which case the caller must end_write() without touching it.
+    inline bool begin_write(SharedFrameHeader* header) {
+      // seq_cst pairs with pin(): either the reader sees seq move or we see its pin
+      header->seq.store(header->seq.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+      std::atomic_thread_fence(std::memory_order_release);
+      return header->pins.load(std::memory_order_seq_cst) == 0;
+    }
+
+    inline void end_write(SharedFrameHeader* header) {
+      header->seq.store(header->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    inline void ring_doorbell(RingBufferControl* control) {
+      control->doorbell.fetch_add(1, std::memory_order_release);
+      if (control->waiters.load(std::memory_order_seq_cst) > 0) {
+        syscall(SYS_futex, &control->doorbell, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+      }
+    }
+
+    /// Writer: true if frame k can go in without overwriting a frame the
+    /// consumer has not finished with. Detaches a consumer that has died.
+    inline bool has_room(RingBufferControl* control, uint64_t frame) {
+      int32_t pid = control->consumer_pid.load(std::memory_order_acquire);
+      if (pid == 0) return true;
+      if (frame < control->consumed_index.load(std::memory_order_acquire) + control->num_frames) return true;
+      if (kill(pid, 0) != 0 && errno == ESRCH) {
+        control->consumer_pid.compare_exchange_strong(pid, 0, std::memory_order_acq_rel);
+        return true;
+      }
+      return false;
+    }
+
+    /// Writer: blocks until the space word moves past seen or the timeout
+    /// expires, as wait_doorbell() does for readers
+    inline void wait_space(RingBufferControl* control, uint32_t seen, const struct timespec* timeout) {
+      control->writer_waiting.fetch_add(1, std::memory_order_seq_cst);
+      if (control->space.load(std::memory_order_seq_cst) == seen) {
+        syscall(SYS_futex, &control->space, FUTEX_WAIT, seen, timeout, nullptr, 0);
+      }
+      control->writer_waiting.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    // ---- reader side ------------------------------------------------------
+
+    enum class ReadStatus {
+      Ok,            ///< consistent copy of the requested frame
+      NotReady,      ///< frame not published yet
+      Overrun,       ///< slot already reused for a later frame
+      Skipped,       ///< writer skipped this position or dropped the frame
+      TooLarge       ///< frame does not fit in the caller's buffer
+    };
+
+    /**
+     * Copies frame k out of the ring. On Ok, info describes the frame and
+     * dst holds info.data_size bytes. A copy that races the writer is
+     * retried while the frame is still the one in the slot.
+     */
+    inline ReadStatus read(const RingBufferControl* control, uint64_t frame,
+                           SharedFrameInfo &info, char* dst, size_t capacity) {
+      const auto* header = slot(const_cast<RingBufferControl*>(control), frame);
+      const uint64_t want = expected_seq(control, frame);
+
+      while (true) {
+        const uint64_t s1 = header->seq.load(std::memory_order_acquire);
+        if (s1 > want) return ReadStatus::Overrun;
+        if (s1 < want) return ReadStatus::NotReady;     // older frame, or frame k half written
+
+        std::memcpy(&info, &header->info, sizeof(info));
+        const bool fits = info.data_size <= capacity;
+        if (fits && dst) std::memcpy(dst, pixels(header), info.data_size);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->seq.load(std::memory_order_relaxed) == s1) {
+          if (info.position != frame || info.data_size == 0) return ReadStatus::Skipped;
+          return fits ? ReadStatus::Ok : ReadStatus::TooLarge;
+        }
+      }
+    }
+
+    /**
+     * Pins frame k in place. On Ok the writer leaves the slot alone until
+     * unpin(), so its pixels can be used directly without copying.
+     */
+    inline ReadStatus pin(RingBufferControl* control, uint64_t frame, SharedFrameInfo &info) {
+      auto* header = slot(control, frame);
+      const uint64_t want = expected_seq(control, frame);
+
+      header->pins.fetch_add(1, std::memory_order_seq_cst);
+      const uint64_t s = header->seq.load(std::memory_order_seq_cst);
+
+      ReadStatus status = (s > want) ? ReadStatus::Overrun :
+                          (s < want) ? ReadStatus::NotReady : ReadStatus::Ok;
+      if (status == ReadStatus::Ok) {
+        std::memcpy(&info, &header->info, sizeof(info));
+        if (info.position != frame || info.data_size == 0) status = ReadStatus::Skipped;
+      }
+      if (status != ReadStatus::Ok) header->pins.fetch_sub(1, std::memory_order_release);
+      return status;
+    }
+
+    inline void unpin(RingBufferControl* control, uint64_t frame) {
+      slot(control, frame)->pins.fetch_sub(1, std::memory_order_release);
+    }
+
+    inline void ring_space(RingBufferControl* control) {
+      control->space.fetch_add(1, std::memory_order_release);
+      if (control->writer_waiting.load(std::memory_order_seq_cst) > 0) {
+        syscall(SYS_futex, &control->space, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+      }
+    }
+
+    /**
+     * Makes the calling process the ring's consumer, finished with every
+     * frame below from. False if another live process already is.
+     */
+    inline bool attach_consumer(RingBufferControl* control, uint64_t from) {
+      const int32_t self = static_cast<int32_t>(getpid());
+      int32_t holder = control->consumer_pid.load(std::memory_order_acquire);
+      while (true) {
+        if (holder != 0 && (holder == self || !(kill(holder, 0) != 0 && errno == ESRCH))) return false;
+        if (control->consumer_pid.compare_exchange_weak(holder, self, std::memory_order_acq_rel)) break;
+      }
+      control->consumed_index.store(from, std::memory_order_release);
+      ring_space(control);
+      return true;
+    }
+
+    inline void detach_consumer(RingBufferControl* control) {
+      int32_t self = static_cast<int32_t>(getpid());
+      if (control->consumer_pid.compare_exchange_strong(self, 0, std::memory_order_acq_rel)) ring_space(control);
+    }
+
+    /// Consumer: frames below next are finished with and their slots may be reused
+    inline void consume(RingBufferControl* control, uint64_t next) {
+      uint64_t done = control->consumed_index.load(std::memory_order_relaxed);
+      if (done >= next) return;
+      while (done < next && !control->consumed_index.compare_exchange_weak(done, next, std::memory_order_release,
+                                                                            std::memory_order_relaxed)) { }
+      ring_space(control);
+    }
+
+    /**
+     * Blocks until the doorbell moves past seen or the timeout expires.
+     * Pass the doorbell value read before checking for new frames so a
+     * frame published in between is not slept through.
+     */
+    inline void wait_doorbell(RingBufferControl* control, uint32_t seen, const struct timespec* timeout) {
+      control->waiters.fetch_add(1, std::memory_order_seq_cst);
+      if (control->doorbell.load(std::memory_order_seq_cst) == seen) {
+        syscall(SYS_futex, &control->doorbell, FUTEX_WAIT, seen, timeout, nullptr, 0);
+      }
+      control->waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+  }
+
+}
@@ -0,0 +1,194 @@
+//
+// shmcat.cpp
+//
+// Reads frames from a camerad shared memory ring and reports them, or
+// benchmarks the ring end to end with an in-process writer.
+//
+//   shmcat [-l] [-p] [-q] [-n count] [-i interval] [-o file] segment
+//   shmcat -b [-l] [-p] [-n frames] [-s frame_bytes] [-r slots]
+//
+
+#include "shared_memory_reader.h"
+#include "shared_memory_writer.h"
+#include "common.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+  constexpr int POLL_MS = 200;   // how often a blocked read rechecks for Ctrl-C
+
+  std::atomic<bool> stop{false};
+
+  void on_signal(int) { stop.store(true); }
+
+  constexpr std::string_view usage() {
+    return "usage: shmcat [-l] [-p] [-q] [-n count] [-i interval_s] [-o file] segment\n"
+           "       shmcat -b [-l] [-p] [-n frames] [-s frame_bytes] [-r slots]\n"
+           "  -l  lossless: every frame in order, counting overruns (default latest frame)\n"
+           "  -p  pin each slot and use it in place instead of copying it out\n"
+           "  -q  quiet: statistics only\n"
+           "  -n  stop after this many frames\n"
+           "  -i  print statistics every interval_s seconds\n"
+           "  -o  append the raw pixels of each frame to file (- for stdout)\n"
+           "  -b  benchmark: run a writer in this process and measure the ring\n"
+           "  -s  benchmark frame size in bytes (default 8388608)\n"
+           "  -r  benchmark ring slots (default 8)\n";
+  }
+
+  double seconds_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  }
+
+}
+
+int main(int argc, char *argv[]) {
+  bool lossless = false;
+  bool pinned = false;
+  bool quiet = false;
+  bool bench = false;
+  uint64_t count = 0;
+  double interval = 0;
+  std::string outfile;
+  size_t frame_bytes = 8 << 20;
+  uint32_t slots = 8;
+  std::string segment;
+
+  try {
+  for ( int i=1; i<argc; ++i ) {
+    const std::string arg = argv[i];
+    if ( arg.size() == 2 && arg[0] == '-' ) {
+      switch ( arg[1] ) {
+        case 'l' : lossless = true; break;
+        case 'p' : pinned = true; break;
+        case 'q' : quiet = true; break;
+        case 'b' : bench = true; break;
+        case 'n' : count = std::stoull( argv[++i] ); break;
+        case 'i' : interval = std::stod( argv[++i] ); break;
+        case 'o' : outfile = argv[++i]; break;
+        case 's' : frame_bytes = std::stoull( argv[++i] ); break;
+        case 'r' : slots = static_cast<uint32_t>( std::stoul( argv[++i] ) ); break;
+        default:   std::cout << usage(); return 1;
+      }
+    } else segment = arg;
+  }
+  }
+  catch (...) { std::cout << usage(); return 1; }
+
+  if ( !bench && segment.empty() ) { std::cout << usage(); return 1; }
+  if ( bench ) {
+    segment = "shmcat_bench_" + std::to_string( getpid() );
+    if ( count == 0 ) count = 10000;
+    quiet = true;
+  }
+
+  std::signal( SIGINT, on_signal );
+  std::signal( SIGTERM, on_signal );
+
+  // In benchmark mode the writer runs flat out on its own thread
+  //
+  std::unique_ptr<Camera::SharedMemoryWriter> writer;
+  std::thread writer_thread;
+  double writer_seconds = 0;
+  std::atomic<uint64_t> written{0};
+  std::atomic<bool> writer_done{false};
+  if ( bench ) {
+    writer = std::make_unique<Camera::SharedMemoryWriter>( segment, frame_bytes, slots );
+    if ( writer->open() != NO_ERROR ) {
+      std::cerr << "ERROR creating benchmark segment " << segment << "\n";
+      return 1;
+    }
+  }
+
+  const auto mode = lossless ? Camera::SharedMemoryReader::Mode::Lossless : Camera::SharedMemoryReader::Mode::Latest;
+  Camera::SharedMemoryReader reader( segment, mode );
+  if ( reader.open() != NO_ERROR ) {
+    std::cerr << "ERROR opening " << segment << ": missing or not a version "
+              << Camera::SHM_RING_VERSION << " frame ring\n";
+    return 1;
+  }
+
+  if ( bench ) {
+    writer_thread = std::thread( [&] {
+      std::vector<char> frame( frame_bytes, 1 );
+      Camera::FrameMetadata meta;
+      meta.width = static_cast<uint32_t>( frame_bytes / 2 );
+      meta.height = 1;
+      meta.bytes_per_pixel = 2;
+      const auto t0 = std::chrono::steady_clock::now();
+      for ( uint64_t k=0; k<count && !stop.load(); ++k ) {
+        meta.frame_number = k;
+        meta.host_time_ns = get_clock_time_nsec();
+        if ( writer->write( frame.data(), frame.size(), meta ) == NO_ERROR ) written.fetch_add( 1 );
+      }
+      writer_seconds = seconds_since( t0 );
+      writer_done.store( true );
+    } );
+  }
+
+  FILE* out = nullptr;
+  if ( !outfile.empty() ) {
+    out = ( outfile == "-" ) ? stdout : std::fopen( outfile.c_str(), "ab" );
+    if ( !out ) { std::cerr << "ERROR opening " << outfile << "\n"; return 1; }
+  }
+
+  const auto t0 = std::chrono::steady_clock::now();
+  auto tlast = t0;
+  uint64_t delivered = 0;
+  Camera::SharedMemoryReader::Frame frame;
+
+  while ( !stop.load() && ( count == 0 || delivered < count ) ) {
+    const long ret = pinned ? reader.next_pinned( frame, POLL_MS ) : reader.next( frame, POLL_MS );
+    if ( ret == TIMEOUT ) {
+      // the benchmark is over once the writer is done and nothing is left
+      if ( bench && writer_done.load() ) break;
+      continue;
+    }
+    if ( ret != NO_ERROR ) { std::cerr << "ERROR reading " << segment << "\n"; break; }
+    ++delivered;
+
+    if ( !quiet ) {
+      std::cerr << "frame=" << frame.info.frame_number
+                << " ts=" << frame.info.timestamp
+                << " " << frame.info.width << "x" << frame.info.height << "x" << frame.info.bytes_per_pixel
+                << " bytes=" << frame.info.data_size
+                << " pos=" << frame.info.position << "\n";
+    }
+    if ( out ) std::fwrite( frame.data, 1, frame.info.data_size, out );
+    reader.release();
+
+    if ( interval > 0 && seconds_since( tlast ) >= interval ) {
+      std::cerr << reader.summary( seconds_since( tlast ) ) << "\n";
+      reader.clear_stats();
+      tlast = std::chrono::steady_clock::now();
+    }
+  }
+
+  const double elapsed = seconds_since( tlast );
+
+  if ( bench ) {
+    stop.store( true );
+    writer_thread.join();
+    const uint64_t n = written.load();
+    std::cerr << "writer: frames=" << n << " bytes=" << frame_bytes << " slots=" << slots
+              << " rate=" << ( writer_seconds > 0 ? n / writer_seconds : 0.0 ) << "Hz"
+              << " throughput=" << ( writer_seconds > 0 ? n * frame_bytes / writer_seconds / 1.0e6 : 0.0 ) << "MB/s"
+              << " pinned_skips=" << writer->pinned_skips() << "\n";
+  }
+  std::cerr << "reader: delivered=" << delivered << " " << reader.summary( elapsed ) << "\n";
+
+  reader.close();
+  if ( writer ) writer->close();
+  if ( out && out != stdout ) std::fclose( out );
+
+  return 0;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file    simd.h
+ * @brief   portable fixed-width vector types for pixel loops
+ *
+ * Uses the GCC/Clang vector extensions, which lower to whatever the
+ * -march target provides (AVX2, SSE, NEON) and do not depend on the
+ * optimization level the way auto-vectorization does.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace Simd {
+
+  constexpr int LANES = 8;   ///< pixels processed per vector step
+
+  typedef float    f32x8 __attribute__((vector_size(32)));
+  typedef int32_t  i32x8 __attribute__((vector_size(32)));
+  typedef uint32_t u32x8 __attribute__((vector_size(32)));
+  typedef uint16_t u16x8 __attribute__((vector_size(16)));
+  typedef uint8_t  u8x8  __attribute__((vector_size(8)));
+
+  // Scalars broadcast in mixed expressions, e.g. (v - 1.0f), and the
+  // comparison operators yield lane masks usable as (mask ? a : b).
+
+  /// unaligned load/store; compiles to a single vector move
+  template <typename V>
+  inline V load(const void* p) { V v; std::memcpy(&v, p, sizeof(V)); return v; }
+
+  template <typename V>
+  inline void store(void* p, const V &v) { std::memcpy(p, &v, sizeof(V)); }
+
+  inline f32x8 to_f32(const u16x8 &v) { return __builtin_convertvector(v, f32x8); }
+  inline f32x8 to_f32(const u32x8 &v) { return __builtin_convertvector(v, f32x8); }
+
+  inline float hsum(const f32x8 &v) {
+    float s = 0;
+    for (int i = 0; i < LANES; ++i) s += v[i];
+    return s;
+  }
+
+  inline float hmax(const f32x8 &v) {
+    float m = v[0];
+    for (int i = 1; i < LANES; ++i) m = (v[i] > m) ? v[i] : m;
+    return m;
+  }
+
+}
@@ -0,0 +1,150 @@
+/**
+ * @file    telemetry_format.cpp
+ * @brief   the per-frame telemetry datagram, as JSON or compact binary
+ */
+
+#include "telemetry_format.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+  constexpr size_t HEADER_BYTES = 4 + 2 + 2 + 2 + 2 + 8 * 4 + 4 * 4;   // 60
+  constexpr size_t TAP_BYTES    = 4 * 4;
+  constexpr size_t KIND_BYTES   = 8;
+  constexpr size_t QUEUE_BYTES  = KIND_BYTES + 4 + 4 + 8 + 8;
+
+  // the host is little-endian, as the datagram is
+  template <class T>
+  void put(std::string &out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <class T>
+  T get(const char* &p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+  }
+
+}
+
+namespace Camera {
+
+  TelemetryFormat parse_telemetry_format(const std::string &s) {
+    if (s == "json")   return TelemetryFormat::Json;
+    if (s == "binary") return TelemetryFormat::Binary;
+    throw std::invalid_argument("expected json or binary");
+  }
+
+  nlohmann::json to_json(const TelemetryFrame &frame) {
+    nlohmann::json j;
+    j["messagetype"]     = "telemetry";
+    j["frame"]           = frame.frame_number;
+    j["sequence"]        = frame.sequence_number;
+    j["timestamp"]       = frame.timestamp;
+    j["host_time_ns"]    = frame.host_time_ns;
+    j["width"]           = frame.width;
+    j["height"]          = frame.height;
+    j["latency_us"]      = frame.latency_us;
+    nlohmann::json taps = nlohmann::json::array();
+    for (const auto &t : frame.taps) {
+      nlohmann::json tap;
+      tap["mean"] = t.mean;
+      tap["std"]  = t.stddev;
+      tap["min"]  = t.min;
+      tap["max"]  = t.max;
+      taps.push_back(tap);
+    }
+    j["taps"] = taps;
+    nlohmann::json outputs = nlohmann::json::array();
+    for (const auto &q : frame.outputs) {
+      nlohmann::json output;
+      output["kind"]     = q.kind;
+      output["depth"]    = q.depth;
+      output["capacity"] = q.capacity;
+      output["dropped"]  = q.dropped;
+      output["failed"]   = q.failed;
+      outputs.push_back(output);
+    }
+    j["outputs"] = outputs;
+    return j;
+  }
+
+  std::string encode_telemetry(const TelemetryFrame &frame) {
+    std::string out;
+    out.reserve(HEADER_BYTES + frame.taps.size() * TAP_BYTES + frame.outputs.size() * QUEUE_BYTES);
+
+    out.append(TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC));
+    put<uint16_t>(out, TELEMETRY_VERSION);
+    put<uint16_t>(out, static_cast<uint16_t>(frame.taps.size()));
+    put<uint16_t>(out, static_cast<uint16_t>(frame.outputs.size()));
+    put<uint16_t>(out, 0);
+    put<uint64_t>(out, frame.frame_number);
+    put<uint64_t>(out, frame.sequence_number);
+    put<uint64_t>(out, frame.timestamp);
+    put<uint64_t>(out, frame.host_time_ns);
+    put<uint32_t>(out, frame.width);
+    put<uint32_t>(out, frame.height);
+    put<uint32_t>(out, frame.latency_us);
+    put<uint32_t>(out, 0);
+
+    for (const auto &t : frame.taps) {
+      put<float>(out, t.mean);
+      put<float>(out, t.stddev);
+      put<float>(out, t.min);
+      put<float>(out, t.max);
+    }
+    for (const auto &q : frame.outputs) {
+      char kind[KIND_BYTES] = {};
+      std::memcpy(kind, q.kind.data(), std::min(q.kind.size(), KIND_BYTES));
+      out.append(kind, KIND_BYTES);
+      put<uint32_t>(out, q.depth);
+      put<uint32_t>(out, q.capacity);
+      put<uint64_t>(out, q.dropped);
+      put<uint64_t>(out, q.failed);
+    }
+    return out;
+  }
+
+  bool decode_telemetry(const char* data, size_t size, TelemetryFrame &frame) {
+    if (size < HEADER_BYTES || std::memcmp(data, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC)) != 0) return false;
+    const char* p = data + sizeof(TELEMETRY_MAGIC);
+    if (get<uint16_t>(p) != TELEMETRY_VERSION) return false;
+    const size_t n_taps    = get<uint16_t>(p);
+    const size_t n_outputs = get<uint16_t>(p);
+    get<uint16_t>(p);
+    if (size != HEADER_BYTES + n_taps * TAP_BYTES + n_outputs * QUEUE_BYTES) return false;
+
+    frame.frame_number    = get<uint64_t>(p);
+    frame.sequence_number = get<uint64_t>(p);
+    frame.timestamp       = get<uint64_t>(p);
+    frame.host_time_ns    = get<uint64_t>(p);
+    frame.width           = get<uint32_t>(p);
+    frame.height          = get<uint32_t>(p);
+    frame.latency_us      = get<uint32_t>(p);
+    get<uint32_t>(p);
+
+    frame.taps.resize(n_taps);
+    for (auto &t : frame.taps) {
+      t.mean   = get<float>(p);
+      t.stddev = get<float>(p);
+      t.min    = get<float>(p);
+      t.max    = get<float>(p);
+    }
+    frame.outputs.resize(n_outputs);
+    for (auto &q : frame.outputs) {
+      q.kind.assign(p, strnlen(p, KIND_BYTES));
+      p += KIND_BYTES;
+      q.depth    = get<uint32_t>(p);
+      q.capacity = get<uint32_t>(p);
+      q.dropped  = get<uint64_t>(p);
+      q.failed   = get<uint64_t>(p);
+    }
+    return true;
+  }
+
+}
@@ -0,0 +1,67 @@
+/**
+ * @file    telemetry_format.h
+ * @brief   the per-frame telemetry datagram, as JSON or compact binary
+ *
+ * One datagram describes one frame and the state of the pipeline when it
+ * was seen: frame number, controller timestamp, statistics of each tap
+ * and the queue depth and drop counters of every output. The binary form
+ * is a fixed header, then n_taps TelemetryTap and n_outputs
+ * TelemetryQueue records, all little-endian and packed, so a client can
+ * read it without a JSON parser.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace Camera {
+
+  enum class TelemetryFormat { Json, Binary };
+
+  // "json" | "binary"; throws std::invalid_argument
+  TelemetryFormat parse_telemetry_format(const std::string &s);
+
+  constexpr char     TELEMETRY_MAGIC[4] = { 'C', 'T', 'L', 'M' };
+  constexpr uint16_t TELEMETRY_VERSION  = 1;
+
+  /// statistics of one tap, over the pixels sampled
+  struct TelemetryTap {
+    float mean{0};
+    float stddev{0};
+    float min{0};
+    float max{0};
+  };
+
+  /// queue and counters of one output chain, summed over its decorators
+  struct TelemetryQueue {
+    std::string kind;             ///< the writer at the end of the chain; 8 chars in binary
+    uint32_t depth{0};
+    uint32_t capacity{0};
+    uint64_t dropped{0};
+    uint64_t failed{0};
+  };
+
+  struct TelemetryFrame {
+    uint64_t frame_number{0};
+    uint64_t sequence_number{0};
+    uint64_t timestamp{0};        ///< controller timestamp of the frame
+    uint64_t host_time_ns{0};     ///< CLOCK_MONOTONIC when the frame arrived
+    uint32_t width{0};
+    uint32_t height{0};
+    uint32_t latency_us{0};       ///< arrival to these statistics being taken
+    std::vector<TelemetryTap>   taps;
+    std::vector<TelemetryQueue> outputs;
+  };
+
+  nlohmann::json to_json(const TelemetryFrame &frame);
+
+  std::string encode_telemetry(const TelemetryFrame &frame);
+
+  /// false unless data is a whole binary datagram of a known version
+  bool decode_telemetry(const char* data, size_t size, TelemetryFrame &frame);
+
+}
@@ -0,0 +1,188 @@
+/**
+ * @file    telemetry_output.cpp
+ * @brief   FrameOutput that multicasts per-frame telemetry over UDP
+ */
+
+#include "telemetry_output.h"
+#include "network.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace {
+
+  template <typename T>
+  inline double sample_at(const char* row, uint32_t x) {
+    T p;
+    std::memcpy(&p, row + static_cast<size_t>(x) * sizeof(T), sizeof(T));
+    return static_cast<double>(p);
+  }
+
+  /// one tap is the columns [x0, x1) of every sample-th row
+  template <typename T>
+  Camera::TelemetryTap strip_statistics(const Camera::FrameView &view, uint32_t x0, uint32_t x1,
+                                        uint32_t sample, double offset) {
+    double sum = 0, sumsq = 0;
+    double lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+    uint64_t n = 0;
+    for (uint32_t y = 0; y < view.height; y += sample) {
+      const char* row = view.row(y);
+      for (uint32_t x = x0; x < x1; x += sample) {
+        const double v = sample_at<T>(row, x) + offset;
+        sum   += v;
+        sumsq += v * v;
+        lo = std::min(lo, v);
+        hi = std::max(hi, v);
+        ++n;
+      }
+    }
+    Camera::TelemetryTap tap;
+    if (n == 0) return tap;
+    const double mean = sum / n;
+    tap.mean   = static_cast<float>(mean);
+    tap.stddev = static_cast<float>(std::sqrt(std::max(0.0, sumsq / n - mean * mean)));
+    tap.min    = static_cast<float>(lo);
+    tap.max    = static_cast<float>(hi);
+    return tap;
+  }
+
+  template <typename T>
+  std::vector<Camera::TelemetryTap> taps_of(const Camera::FrameView &view, uint32_t taps,
+                                            uint32_t sample, double offset = 0) {
+    std::vector<Camera::TelemetryTap> out(taps);
+    for (uint32_t t = 0; t < taps; ++t) {
+      const uint32_t x0 = static_cast<uint32_t>(static_cast<uint64_t>(view.width) * t / taps);
+      const uint32_t x1 = static_cast<uint32_t>(static_cast<uint64_t>(view.width) * (t + 1) / taps);
+      out[t] = strip_statistics<T>(view, x0, x1, sample, offset);
+    }
+    return out;
+  }
+
+}
+
+namespace Camera {
+
+  std::vector<TelemetryTap> tap_statistics(const char* data, const FrameMetadata &meta,
+                                           uint32_t taps, uint32_t sample) {
+    if (meta.big_endian || meta.width == 0 || meta.height == 0) return {};
+    taps   = std::clamp<uint32_t>(taps, 1, meta.width);
+    sample = std::max<uint32_t>(sample, 1);
+    const FrameView view = FrameView::full(data, meta);
+    switch (pixel_format_of(meta)) {
+      case PixelFormat::U8:  return taps_of<uint8_t> (view, taps, sample);
+      case PixelFormat::U16: return taps_of<uint16_t>(view, taps, sample);
+      case PixelFormat::U32: return taps_of<uint32_t>(view, taps, sample);
+      case PixelFormat::I32: return taps_of<int32_t> (view, taps, sample, 2147483648.0);
+      case PixelFormat::F32: return taps_of<float>   (view, taps, sample);
+      default:               return {};
+    }
+  }
+
+  TelemetryOutput::TelemetryOutput(TelemetryConfig cfg)
+    : cfg_(std::move(cfg)) {
+  }
+
+  TelemetryOutput::~TelemetryOutput() {
+    this->close();
+  }
+
+  long TelemetryOutput::open() {
+    const std::string function("Camera::TelemetryOutput::open");
+
+    udp_ = std::make_unique<Network::UdpSocket>(cfg_.udp_port, cfg_.udp_group);
+    if (udp_->Create() < 0) {
+      logwrite(function, "ERROR creating UDP socket for " + cfg_.udp_group +
+               ":" + std::to_string(cfg_.udp_port));
+      udp_.reset();
+      return ERROR;
+    }
+
+    logwrite(function, "udp=" + cfg_.udp_group + ":" + std::to_string(cfg_.udp_port) +
+             " format=" + (cfg_.format == TelemetryFormat::Binary ? "binary" : "json") +
+             " taps=" + std::to_string(cfg_.taps) +
+             " sample=" + std::to_string(cfg_.sample));
+    return NO_ERROR;
+  }
+
+  void TelemetryOutput::watch(std::vector<const FrameOutput*> outputs) {
+    watched_ = std::move(outputs);
+  }
+
+  long TelemetryOutput::write(const char* data, size_t size, const FrameMetadata& meta) {
+    n_frames_.fetch_add(1, std::memory_order_relaxed);
+    if (!udp_ || FrameView::full(data, meta).size() > size) {
+      n_failed_.fetch_add(1, std::memory_order_relaxed);
+      return ERROR;
+    }
+
+    TelemetryFrame frame;
+    frame.frame_number    = meta.frame_number;
+    frame.sequence_number = meta.sequence_number;
+    frame.timestamp       = meta.timestamp;
+    frame.host_time_ns    = meta.host_time_ns;
+    frame.width           = meta.width;
+    frame.height          = meta.height;
+    frame.taps            = tap_statistics(data, meta, cfg_.taps, cfg_.sample);
+    frame.outputs         = this->queues();
+
+    uint64_t latency_ns = 0;
+    if (meta.host_time_ns > 0) {
+      latency_ns = get_clock_time_nsec() - meta.host_time_ns;
+      frame.latency_us = static_cast<uint32_t>(std::min<uint64_t>(latency_ns / 1000, UINT32_MAX));
+    }
+
+    const std::string msg = (cfg_.format == TelemetryFormat::Binary) ? encode_telemetry(frame)
+                                                                     : to_json(frame).dump();
+    if (udp_->Send(msg) != 0) {
+      n_failed_.fetch_add(1, std::memory_order_relaxed);
+      return ERROR;
+    }
+    n_bytes_.fetch_add(msg.size(), std::memory_order_relaxed);
+    if (latency_ns > 0) latency_.record(latency_ns);
+    return NO_ERROR;
+  }
+
+  // One entry per watched chain: the queues of all its links merged, the
+  // counters summed, and named after the writer at its end
+  std::vector<TelemetryQueue> TelemetryOutput::queues() const {
+    std::vector<TelemetryQueue> out;
+    out.reserve(watched_.size());
+    for (const FrameOutput* output : watched_) {
+      QueueStatus queue;
+      TelemetryQueue q;
+      for (const auto &m : chain_metrics(*output)) {
+        queue.merge(m.queue);
+        if (queue.depth == 0) queue.capacity = std::max(queue.capacity, m.queue.capacity);   // empty queues still show their size
+        q.dropped += m.frames_dropped;
+        q.failed  += m.frames_failed;
+        q.kind     = m.kind;
+      }
+      q.depth    = static_cast<uint32_t>(queue.depth);
+      q.capacity = static_cast<uint32_t>(queue.capacity);
+      q.dropped  = std::max(q.dropped, queue.dropped);
+      out.push_back(std::move(q));
+    }
+    return out;
+  }
+
+  OutputMetrics TelemetryOutput::metrics() const {
+    OutputMetrics m;
+    m.kind           = "telemetry";
+    m.frames_in      = n_frames_.load();
+    m.frames_failed  = n_failed_.load();
+    m.frames_written = m.frames_in - std::min(m.frames_in, m.frames_failed);
+    m.bytes_written  = n_bytes_.load();
+    m.latency = latency_.snapshot();
+    m.detail["watched"] = static_cast<double>(watched_.size());
+    return m;
+  }
+
+  void TelemetryOutput::close() {
+    if (udp_) udp_->Close();
+    udp_.reset();
+  }
+
+}
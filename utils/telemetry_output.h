@@ -0,0 +1,72 @@
+/**
+ * @file    telemetry_output.h
+ * @brief   FrameOutput that multicasts per-frame telemetry over UDP
+ *
+ * For each frame it is given this sends one datagram (see
+ * telemetry_format.h) with the frame number, Archon timestamp, the mean,
+ * standard deviation and range of each tap, and the queue depth and drop
+ * counters of every output it has been told to watch, so the health of
+ * the pipeline can be followed from any machine with the listener. The
+ * factory runs it behind a CadenceGate and a one-slot AsyncOutput, so the
+ * rate is bounded and the acquisition path pays an enqueue at most.
+ */
+#pragma once
+
+#include "frame_output.h"
+#include "telemetry_format.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Network { class UdpSocket; }
+
+namespace Camera {
+
+  struct TelemetryConfig {
+    std::string     udp_group{"239.1.1.234"};   ///< multicast group
+    int             udp_port{1301};
+    TelemetryFormat format{TelemetryFormat::Json};
+    uint32_t        taps{1};             ///< equal column strips the frame is read out as
+    uint32_t        sample{4};           ///< every Nth pixel of every Nth row enters the statistics
+  };
+
+  /// Statistics of taps equal column strips of frame, from every sample-th
+  /// pixel of every sample-th row; empty for a byte-swapped frame
+  std::vector<TelemetryTap> tap_statistics(const char* data, const FrameMetadata &meta,
+                                           uint32_t taps, uint32_t sample);
+
+  class TelemetryOutput : public FrameOutput {
+    public:
+      explicit TelemetryOutput(TelemetryConfig cfg);
+      ~TelemetryOutput() override;
+
+      TelemetryOutput(const TelemetryOutput&) = delete;
+      TelemetryOutput& operator=(const TelemetryOutput&) = delete;
+
+      long open() override;
+      long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      void close() override;
+
+      /// Outputs whose queues are reported with each frame. They must
+      /// outlive this output; each is read from the writing thread.
+      void watch(std::vector<const FrameOutput*> outputs);
+
+      OutputMetrics metrics() const override;
+
+    private:
+      std::vector<TelemetryQueue> queues() const;
+
+      TelemetryConfig cfg_;
+      std::unique_ptr<Network::UdpSocket> udp_;
+      std::vector<const FrameOutput*> watched_;
+
+      std::atomic<uint64_t> n_frames_{0};
+      std::atomic<uint64_t> n_failed_{0};
+      std::atomic<uint64_t> n_bytes_{0};
+      LatencyHistogram latency_;
+  };
+
+}
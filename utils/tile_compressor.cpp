@@ -0,0 +1,145 @@
+/**
+ * @file    tile_compressor.cpp
+ * @brief   compresses the tiles of one frame in parallel
+ */
+
+#include "tile_compressor.h"
+#include "common.h"
+
+#include <fitsio.h>
+
+#include <algorithm>
+
+namespace Camera {
+
+  TileCompressor::TileCompressor(unsigned threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; ++i) threads_.emplace_back(&TileCompressor::thread_loop, this);
+  }
+
+  TileCompressor::~TileCompressor() {
+    {
+      std::lock_guard lock(mtx_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &t : threads_) {
+      if (t.joinable()) t.join();
+    }
+  }
+
+  long TileCompressor::compress_rice(const char* data, const FrameMetadata &meta,
+                                     uint32_t tile_width, uint32_t tile_height,
+                                     std::vector<Tile> &tiles) {
+    const std::string function("Camera::TileCompressor::compress_rice");
+
+    const PixelFormat format = pixel_format_of(meta);
+    if (format == PixelFormat::F32) {
+      logwrite(function, "ERROR float samples need quantizing before Rice coding");
+      return ERROR;
+    }
+
+    const uint32_t tw = (tile_width == 0 || tile_width > meta.width) ? meta.width : tile_width;
+    const uint32_t th = (tile_height == 0 || tile_height > meta.height) ? meta.height : tile_height;
+    const uint32_t ncols = (meta.width + tw - 1) / tw;
+    const uint32_t nrows = (meta.height + th - 1) / th;
+    const size_t stride = static_cast<size_t>(meta.width);
+
+    tiles.resize(static_cast<size_t>(ncols) * nrows);
+
+    const std::function<bool(size_t)> compress_tile = [&](size_t t) {
+      const uint32_t x0 = static_cast<uint32_t>(t % ncols) * tw;
+      const uint32_t y0 = static_cast<uint32_t>(t / ncols) * th;
+      const uint32_t w = std::min(tw, meta.width - x0);
+      const uint32_t h = std::min(th, meta.height - y0);
+      const int nx = static_cast<int>(w * h);
+
+      // worst case: every block stored raw plus its code id, and the first sample
+      const int bytepix = (format == PixelFormat::U16) ? 2 : 4;
+      auto &out = tiles[t];
+      out.resize(static_cast<size_t>(nx) * bytepix + nx / RICE_BLOCKSIZE + 16);
+
+      int nbytes;
+      if (format == PixelFormat::U16) {
+        thread_local std::vector<short> pix;
+        pix.resize(nx);
+        const auto* src = reinterpret_cast<const uint16_t*>(data);
+        for (uint32_t y = 0, k = 0; y < h; ++y) {
+          const uint16_t* row = src + (y0 + y) * stride + x0;
+          for (uint32_t x = 0; x < w; ++x) pix[k++] = static_cast<short>(row[x] ^ 0x8000);
+        }
+        nbytes = fits_rcomp_short(pix.data(), nx, out.data(), static_cast<int>(out.size()), RICE_BLOCKSIZE);
+      }
+      else {
+        thread_local std::vector<int> pix;
+        pix.resize(nx);
+        const uint32_t flip = (format == PixelFormat::I32) ? 0 : 0x80000000u;
+        const auto* src = reinterpret_cast<const uint32_t*>(data);
+        for (uint32_t y = 0, k = 0; y < h; ++y) {
+          const uint32_t* row = src + (y0 + y) * stride + x0;
+          for (uint32_t x = 0; x < w; ++x) pix[k++] = static_cast<int>(row[x] ^ flip);
+        }
+        nbytes = fits_rcomp(pix.data(), nx, out.data(), static_cast<int>(out.size()), RICE_BLOCKSIZE);
+      }
+      if (nbytes < 0) return false;
+      out.resize(nbytes);
+      return true;
+    };
+
+    if (!parallel_for(tiles.size(), compress_tile)) {
+      logwrite(function, "ERROR Rice compression failed");
+      return ERROR;
+    }
+    return NO_ERROR;
+  }
+
+  bool TileCompressor::parallel_for(size_t n, const std::function<bool(size_t)> &fn) {
+    auto job = std::make_shared<Job>();
+    job->fn = &fn;
+    job->n = n;
+    {
+      std::lock_guard lock(mtx_);
+      jobs_.push_back(job);
+    }
+    cv_.notify_all();
+
+    this->run(*job);
+
+    std::unique_lock lock(mtx_);
+    done_cv_.wait(lock, [&]{ return job->done.load() == n; });
+    for (auto it = jobs_.begin(); it != jobs_.end(); ++it) {
+      if (*it == job) { jobs_.erase(it); break; }
+    }
+    return !job->failed.load();
+  }
+
+  void TileCompressor::run(Job &job) {
+    size_t i;
+    while ((i = job.next.fetch_add(1)) < job.n) {
+      if (!(*job.fn)(i)) job.failed.store(true);
+      if (job.done.fetch_add(1) + 1 == job.n) {
+        std::lock_guard lock(mtx_);
+        done_cv_.notify_all();
+      }
+    }
+  }
+
+  void TileCompressor::thread_loop() {
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock lock(mtx_);
+        cv_.wait(lock, [this]{
+          if (stop_) return true;
+          // drop jobs whose tiles are all handed out; their owners finish them
+          while (!jobs_.empty() && jobs_.front()->next.load() >= jobs_.front()->n) jobs_.pop_front();
+          return !jobs_.empty();
+        });
+        if (stop_) return;
+        job = jobs_.front();
+      }
+      this->run(*job);
+    }
+  }
+
+}
@@ -0,0 +1,82 @@
+/**
+ * @file    tile_compressor.h
+ * @brief   compresses the tiles of one frame in parallel
+ *
+ * cfitsio compresses a tiled image one tile after another on the calling
+ * thread. TileCompressor splits a frame into the same tiles and Rice
+ * compresses them on a pool of threads, producing the byte streams that
+ * go in the COMPRESSED_DATA column of a FITS tiled-image table, so the
+ * file reads back with funpack or cfitsio like any fpack output.
+ */
+#pragma once
+
+#include "frame_output.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Camera {
+
+  /// Rice block size used for every tile (fpack's default)
+  constexpr int RICE_BLOCKSIZE = 32;
+
+  class TileCompressor {
+    public:
+      using Tile = std::vector<unsigned char>;
+
+      // threads=0 uses one per hardware thread
+      explicit TileCompressor(unsigned threads = 0);
+      ~TileCompressor();
+
+      TileCompressor(const TileCompressor&) = delete;
+      TileCompressor& operator=(const TileCompressor&) = delete;
+
+      /**
+       * Rice compresses a frame in tile_width x tile_height tiles, row-major
+       * from the first pixel, edge tiles being smaller. Unsigned samples are
+       * offset to signed first, as stored under BZERO. Safe to call from
+       * several threads at once; the calling thread helps with its own tiles.
+       * ERROR if the sample type cannot be Rice coded (float) or a tile fails.
+       */
+      long compress_rice(const char* data, const FrameMetadata &meta,
+                         uint32_t tile_width, uint32_t tile_height,
+                         std::vector<Tile> &tiles);
+
+      unsigned threads() const { return static_cast<unsigned>(threads_.size()); }
+
+      /**
+       * Runs fn(i) for every i in [0,n) across the pool, the calling thread
+       * included; false if any call was. Also lends the pool to other
+       * per-frame work such as checksums.
+       */
+      bool parallel_for(size_t n, const std::function<bool(size_t)> &fn);
+
+    private:
+      struct Job {
+        const std::function<bool(size_t)>* fn{nullptr};
+        size_t n{0};
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::atomic<bool>   failed{false};
+      };
+
+      void run(Job &job);
+      void thread_loop();
+
+      std::vector<std::thread> threads_;
+      std::mutex mtx_;
+      std::condition_variable cv_;        ///< work queued or stopping
+      std::condition_variable done_cv_;   ///< a job finished
+      std::deque<std::shared_ptr<Job>> jobs_;
+      bool stop_{false};
+  };
+
+}
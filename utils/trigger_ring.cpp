@@ -0,0 +1,342 @@
+/**
+ * @file    trigger_ring.cpp
+ * @brief   FrameOutput that keeps the last few seconds of frames in RAM
+ */
+
+#include "trigger_ring.h"
+#include "utilities.h"
+#include "common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <unistd.h>
+
+namespace {
+
+  // samples averaged per frame by the frame-mean trigger
+  constexpr size_t TRIGGER_SAMPLES = 4096;
+
+  // a dump waiting for post-trigger frames gives up after this long without one
+  constexpr auto POST_FRAME_TIMEOUT = std::chrono::seconds(5);
+
+  template <typename T>
+  double sampled_mean(const char* data, size_t n_pixels) {
+    const T* px = reinterpret_cast<const T*>(data);
+    const size_t step = std::max<size_t>(1, n_pixels / TRIGGER_SAMPLES);
+    double sum = 0;
+    size_t n = 0;
+    for (size_t i = step / 2; i < n_pixels; i += step, ++n) sum += static_cast<double>(px[i]);
+    return n > 0 ? sum / n : 0.0;
+  }
+
+}
+
+namespace Camera {
+
+  TriggerDump parse_trigger_dump(const std::string &s) {
+    if (s == "fits") return TriggerDump::Fits;
+    if (s == "raw")  return TriggerDump::Raw;
+    throw std::invalid_argument("expected fits|raw");
+  }
+
+  TriggerRing::TriggerRing(TriggerRingConfig cfg) : cfg_(std::move(cfg)) {
+  }
+
+  TriggerRing::~TriggerRing() {
+    this->close();
+  }
+
+  long TriggerRing::open() {
+    const std::string function("Camera::TriggerRing::open");
+
+    if (cfg_.max_frame_bytes == 0) {
+      logwrite(function, "ERROR max_frame_bytes must be > 0");
+      return ERROR;
+    }
+    const size_t page = static_cast<size_t>(getpagesize());
+    stride_  = (cfg_.max_frame_bytes + page - 1) / page * page;
+    n_slots_ = static_cast<uint32_t>(std::min<size_t>(cfg_.budget_bytes / stride_, UINT32_MAX));
+    if (n_slots_ < 2) {
+      logwrite(function, "ERROR budget of " + std::to_string(cfg_.budget_bytes) +
+               " bytes holds fewer than 2 frames of " + std::to_string(cfg_.max_frame_bytes));
+      return ERROR;
+    }
+
+    mapped_bytes_ = stride_ * n_slots_;
+    HugePageMode got = HugePageMode::None;
+    base_ = static_cast<char*>(map_frame_memory(mapped_bytes_, cfg_.huge_pages, got));
+    if (!base_) {
+      logwrite(function, "ERROR mapping " + std::to_string(mapped_bytes_) + " bytes");
+      return ERROR;
+    }
+    // fault every page in now rather than on the first lap of frames
+    std::memset(base_, 0, mapped_bytes_);
+
+    slots_ = std::make_unique<Slot[]>(n_slots_);
+    head_.store(0);
+    stopping_.store(false);
+
+    char window[64];
+    std::snprintf(window, sizeof(window), " %.1fs + %u frames", cfg_.seconds, cfg_.post_frames);
+    logwrite(function, "ring of " + std::to_string(n_slots_) + " frames x " + std::to_string(stride_) +
+             " bytes, " + to_string(got) + " pages; dumps " +
+             (cfg_.dump == TriggerDump::Fits ? "fits" : "raw") + window);
+    return NO_ERROR;
+  }
+
+  void TriggerRing::close() {
+    {
+      std::lock_guard<std::mutex> lock(dump_mutex_);
+      if (!base_) return;
+      stopping_.store(true);
+    }
+    if (dump_thread_.joinable()) dump_thread_.join();
+
+    const Stats s = this->stats();
+    logwrite("Camera::TriggerRing::close", "recorded=" + std::to_string(s.frames_recorded) +
+             " dumps=" + std::to_string(s.dumps) + " triggers=" + std::to_string(s.triggers) +
+             " dumped=" + std::to_string(s.frames_dumped) + " lost=" + std::to_string(s.frames_lost) +
+             " too_large=" + std::to_string(s.frames_too_large));
+
+    std::lock_guard<std::mutex> lock(dump_mutex_);
+    unmap_frame_memory(base_, mapped_bytes_);
+    base_ = nullptr;
+    slots_.reset();
+  }
+
+  /**
+   * The only writer. Marks the slot odd, copies, marks it even with the
+   * new position, then advances head_; a reader that sees the same even
+   * sequence before and after its copy has the whole frame.
+   */
+  long TriggerRing::write(const char* data, size_t size, const FrameMetadata& meta) {
+    if (!base_) return ERROR;
+    if (size > cfg_.max_frame_bytes) {
+      n_too_large_.fetch_add(1, std::memory_order_relaxed);
+      return NO_ERROR;
+    }
+
+    const uint64_t pos = head_.load(std::memory_order_relaxed);
+    Slot &slot = slots_[pos % n_slots_];
+    slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(base_ + (pos % n_slots_) * stride_, data, size);
+    slot.size = size;
+    slot.meta = meta;
+    slot.seq.store(2 * pos + 2, std::memory_order_release);
+    head_.store(pos + 1, std::memory_order_release);
+
+    if (cfg_.trigger_sigma > 0 && this->check_trigger(data, size, meta) && !dumping_.load()) {
+      n_triggers_.fetch_add(1, std::memory_order_relaxed);
+      char reason[96];
+      std::snprintf(reason, sizeof(reason), "frame %llu mean outside %g sigma",
+                    static_cast<unsigned long long>(meta.frame_number), cfg_.trigger_sigma);
+      std::string name;
+      this->dump(reason, name);
+    }
+    return NO_ERROR;
+  }
+
+  /**
+   * Compares a sampled frame mean with its running average and variance.
+   * Frames that fire are left out of the average, which then starts over
+   * so a lasting change of level fires once rather than on every frame.
+   */
+  bool TriggerRing::check_trigger(const char* data, size_t size, const FrameMetadata& meta) {
+    const PixelFormat format = pixel_format_of(meta);
+    const size_t bpp = meta.bytes_per_pixel > 0 ? meta.bytes_per_pixel : 2;
+    const size_t n_pixels = size / bpp;
+    if (n_pixels == 0 || meta.big_endian) return false;
+
+    double m = 0;
+    switch (format) {
+      case PixelFormat::U8:  m = sampled_mean<uint8_t>(data, n_pixels);  break;
+      case PixelFormat::U16: m = sampled_mean<uint16_t>(data, n_pixels); break;
+      case PixelFormat::F32: m = sampled_mean<float>(data, n_pixels);    break;
+      default:               m = sampled_mean<uint32_t>(data, n_pixels); break;
+    }
+
+    const uint32_t warmup = std::max<uint32_t>(cfg_.trigger_warmup, 2);
+    if (mean_n_ >= warmup) {
+      const double sd = std::sqrt(mean_var_);
+      if (sd > 0 && std::fabs(m - mean_avg_) > cfg_.trigger_sigma * sd) {
+        mean_n_ = 0;
+        return true;
+      }
+    }
+
+    // running average over the warmup, then exponential with the same span
+    mean_n_++;
+    const double alpha = 1.0 / std::min<uint64_t>(mean_n_, warmup);
+    const double d = m - mean_avg_;
+    mean_avg_ += alpha * d;
+    mean_var_ = (mean_n_ == 1) ? 0.0 : (1 - alpha) * (mean_var_ + alpha * d * d);
+    return false;
+  }
+
+  long TriggerRing::dump(const std::string &reason, std::string &name) {
+    const std::string function("Camera::TriggerRing::dump");
+    std::lock_guard<std::mutex> lock(dump_mutex_);
+
+    if (!base_ || stopping_.load()) {
+      logwrite(function, "ERROR ring is not open");
+      return ERROR;
+    }
+    if (dumping_.load()) {
+      logwrite(function, "ERROR previous dump still running; " + reason + " ignored");
+      return ERROR;
+    }
+    if (dump_thread_.joinable()) dump_thread_.join();
+
+    const uint64_t head  = head_.load(std::memory_order_acquire);
+    const uint64_t first = head - std::min<uint64_t>(head, n_slots_);
+
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "_trig%04u", ++dump_count_);
+    name = (cfg_.dump == TriggerDump::Fits ? cfg_.fits.basename : cfg_.raw.basename) + suffix;
+
+    logwrite(function, name + ": " + reason + "; frames " + std::to_string(first) + " to " +
+             std::to_string(head + cfg_.post_frames));
+    dumping_.store(true);
+    n_dumps_.fetch_add(1, std::memory_order_relaxed);
+    dump_thread_ = std::thread(&TriggerRing::run_dump, this, first, head, name);
+    return NO_ERROR;
+  }
+
+  std::unique_ptr<FrameOutput> TriggerRing::make_writer(const std::string &name) const {
+    // a dump is off the acquisition path, so it waits for its writer
+    // rather than dropping frames
+    if (cfg_.dump == TriggerDump::Raw) {
+      RawRecorderConfig raw = cfg_.raw;
+      raw.basename        = name;
+      raw.max_frame_bytes = cfg_.max_frame_bytes;
+      raw.overflow        = OverflowPolicy::Block;
+      raw.block_ms        = 0;
+      return std::make_unique<RawRecorder>(raw);
+    }
+    FitsWriterConfig fits = cfg_.fits;
+    fits.basename = name;
+    fits.overflow = OverflowPolicy::Block;
+    fits.block_ms = 0;
+    return std::make_unique<FitsWriter>(fits);
+  }
+
+  bool TriggerRing::copy_out(uint64_t pos, std::shared_ptr<char[]> &data, size_t &size, FrameMetadata &meta) const {
+    const Slot &slot = slots_[pos % n_slots_];
+    const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != 2 * pos + 2) return false;
+
+    size = slot.size;
+    meta = slot.meta;
+    if (size > cfg_.max_frame_bytes) return false;
+    data.reset(new char[size]);
+    std::memcpy(data.get(), base_ + (pos % n_slots_) * stride_, size);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq.load(std::memory_order_relaxed) == seq;
+  }
+
+  /**
+   * Dump thread. Walks from the oldest frame held to trigger_pos plus
+   * post_frames, waiting for the frames after the trigger as they arrive.
+   * Frames older than `seconds` before the trigger are passed over.
+   */
+  void TriggerRing::run_dump(uint64_t first, uint64_t trigger_pos, std::string name) {
+    const std::string function("Camera::TriggerRing::run_dump");
+    const uint64_t trigger_ns = get_clock_time_nsec();
+    const uint64_t window_ns  = static_cast<uint64_t>(cfg_.seconds * 1.0e9);
+    const uint64_t last       = trigger_pos + cfg_.post_frames;
+    uint64_t dumped = 0, lost = 0, older = 0;
+
+    auto writer = this->make_writer(name);
+    if (writer->open() != NO_ERROR) {
+      logwrite(function, "ERROR opening writer for " + name);
+      dumping_.store(false);
+      return;
+    }
+
+    for (uint64_t pos = first; pos < last; ++pos) {
+      auto waited_since = std::chrono::steady_clock::now();
+      while (head_.load(std::memory_order_acquire) <= pos && !stopping_.load()) {
+        if (std::chrono::steady_clock::now() - waited_since > POST_FRAME_TIMEOUT) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      if (head_.load(std::memory_order_acquire) <= pos) break;   // acquisition stopped
+
+      std::shared_ptr<char[]> data;
+      size_t size = 0;
+      FrameMetadata meta;
+      if (!this->copy_out(pos, data, size, meta)) { lost++; continue; }
+
+      if (pos < trigger_pos && window_ns > 0 && meta.host_time_ns > 0 &&
+          meta.host_time_ns + window_ns < trigger_ns) {
+        older++;
+        continue;
+      }
+      if (writer->write_shared(std::move(data), size, meta) == NO_ERROR) dumped++;
+      else lost++;
+    }
+    writer->close();
+
+    n_dumped_.fetch_add(dumped, std::memory_order_relaxed);
+    n_lost_.fetch_add(lost, std::memory_order_relaxed);
+    logwrite(function, name + ": dumped=" + std::to_string(dumped) + " lost=" + std::to_string(lost) +
+             " older=" + std::to_string(older));
+    dumping_.store(false);
+  }
+
+  OutputMetrics TriggerRing::metrics() const {
+    const Stats s = this->stats();
+    OutputMetrics m;
+    m.kind           = "trigger";
+    m.frames_in      = s.frames_recorded + s.frames_too_large;
+    m.frames_written = s.frames_recorded;
+    m.frames_failed  = s.frames_too_large;
+    m.detail["slots"]         = s.slots;
+    m.detail["seconds_held"]  = s.seconds_held;
+    m.detail["dumping"]       = dumping_.load() ? 1 : 0;
+    m.detail["dumps"]         = s.dumps;
+    m.detail["triggers"]      = s.triggers;
+    m.detail["frames_dumped"] = s.frames_dumped;
+    m.detail["frames_lost"]   = s.frames_lost;
+    return m;
+  }
+
+  TriggerRing::Stats TriggerRing::stats() const {
+    Stats s;
+    s.frames_recorded  = head_.load();
+    s.frames_too_large = n_too_large_.load();
+    s.frames_dumped    = n_dumped_.load();
+    s.frames_lost      = n_lost_.load();
+    s.dumps            = n_dumps_.load();
+    s.triggers         = n_triggers_.load();
+
+    // newest and oldest host times, read the same way a dump reads a slot;
+    // close() unmaps the slots under the lock
+    std::lock_guard<std::mutex> lock(dump_mutex_);
+    s.slots = n_slots_;
+    if (slots_ && s.frames_recorded > 0) {
+      auto host_time = [this](uint64_t pos, uint64_t &ns) {
+        const Slot &slot = slots_[pos % n_slots_];
+        const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        ns = slot.meta.host_time_ns;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return seq == 2 * pos + 2 && slot.seq.load(std::memory_order_relaxed) == seq;
+      };
+      const uint64_t newest = s.frames_recorded - 1;
+      const uint64_t oldest = s.frames_recorded - std::min<uint64_t>(s.frames_recorded, n_slots_) + 1;
+      uint64_t t_new = 0, t_old = 0;
+      if (newest >= oldest && host_time(newest, t_new) && host_time(oldest, t_old) && t_new > t_old) {
+        s.seconds_held = (t_new - t_old) / 1.0e9;
+      }
+    }
+    return s;
+  }
+
+}
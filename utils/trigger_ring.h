@@ -0,0 +1,121 @@
+/**
+ * @file    trigger_ring.h
+ * @brief   FrameOutput that keeps the last few seconds of frames in RAM
+ *
+ * Frames are copied into slots of one mapping sized by a fixed memory
+ * budget, so recording never allocates and the oldest frame is simply
+ * overwritten. Each slot carries a sequence word, odd while it is being
+ * written, so the writer never waits for a reader. dump() hands the frames
+ * of the last `seconds` plus post_frames more to a FITS writer or raw
+ * recorder on a thread of its own; a frame overwritten before the dump
+ * reached it is counted as lost rather than holding up acquisition.
+ *
+ * A dump is started by the trigger command or, with trigger_sigma set,
+ * when the mean of a frame departs from its running average by more than
+ * that many standard deviations.
+ */
+#pragma once
+
+#include "frame_output.h"
+#include "fits_writer.h"
+#include "raw_recorder.h"
+#include "frame_buffer_pool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace Camera {
+
+  enum class TriggerDump { Fits, Raw };
+
+  // "fits" | "raw"; throws std::invalid_argument
+  TriggerDump parse_trigger_dump(const std::string &s);
+
+  struct TriggerRingConfig {
+    size_t       budget_bytes{1ULL << 30};     ///< memory for the whole ring
+    size_t       max_frame_bytes{0};           ///< slot size, required
+    double       seconds{10};                  ///< dumped history, 0 for all the ring holds
+    uint32_t     post_frames{0};               ///< frames after the trigger that go in the dump too
+    HugePageMode huge_pages{HugePageMode::Thp};
+    TriggerDump  dump{TriggerDump::Fits};
+    FitsWriterConfig  fits;                    ///< basename gets a "_trig<N>" suffix per dump
+    RawRecorderConfig raw;
+    double       trigger_sigma{0};             ///< frame-mean trigger, 0 for none
+    uint32_t     trigger_warmup{16};           ///< frames averaged before the trigger is armed
+  };
+
+  class TriggerRing : public FrameOutput {
+    public:
+      explicit TriggerRing(TriggerRingConfig cfg);
+      ~TriggerRing() override;
+
+      TriggerRing(const TriggerRing&) = delete;
+      TriggerRing& operator=(const TriggerRing&) = delete;
+
+      long open() override;
+      long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      void close() override;
+
+      /**
+       * Starts dumping the ring in the background. ERROR while a dump is
+       * still running or before open(); name is the dump's basename.
+       */
+      long dump(const std::string &reason, std::string &name);
+      bool dumping() const { return dumping_.load(); }
+
+      struct Stats {
+        uint64_t frames_recorded{0};
+        uint64_t frames_too_large{0};          ///< larger than a slot, not recorded
+        uint64_t frames_dumped{0};
+        uint64_t frames_lost{0};               ///< overwritten before a dump reached them
+        uint64_t dumps{0};
+        uint64_t triggers{0};                  ///< dumps started by the frame-mean trigger
+        uint32_t slots{0};
+        double   seconds_held{0};              ///< span of the frames now in the ring
+      };
+      Stats stats() const;
+      OutputMetrics metrics() const override;
+
+    private:
+      struct Slot {
+        std::atomic<uint64_t> seq{0};          ///< 2*pos+1 while writing frame pos, 2*pos+2 after
+        size_t        size{0};
+        FrameMetadata meta;
+      };
+
+      bool check_trigger(const char* data, size_t size, const FrameMetadata& meta);
+      void run_dump(uint64_t first, uint64_t trigger_pos, std::string name);
+      bool copy_out(uint64_t pos, std::shared_ptr<char[]> &data, size_t &size, FrameMetadata &meta) const;
+      std::unique_ptr<FrameOutput> make_writer(const std::string &name) const;
+
+      TriggerRingConfig cfg_;
+      char*  base_{nullptr};
+      size_t mapped_bytes_{0};
+      size_t stride_{0};
+      uint32_t n_slots_{0};
+      std::unique_ptr<Slot[]> slots_;
+
+      std::atomic<uint64_t> head_{0};          ///< frames written so far
+      std::atomic<bool>     dumping_{false};
+      std::atomic<bool>     stopping_{false};
+      mutable std::mutex dump_mutex_;          ///< serialises starting a dump and reading slots against close()
+      std::thread dump_thread_;
+      uint32_t    dump_count_{0};
+
+      // frame-mean trigger, writing thread only
+      double   mean_avg_{0};
+      double   mean_var_{0};
+      uint64_t mean_n_{0};
+
+      std::atomic<uint64_t> n_too_large_{0};
+      std::atomic<uint64_t> n_dumped_{0};
+      std::atomic<uint64_t> n_lost_{0};
+      std::atomic<uint64_t> n_dumps_{0};
+      std::atomic<uint64_t> n_triggers_{0};
+  };
+
+}
@@ -146,6 +146,11 @@ std::string generate_temp_filename(const std::string &prefix);
 
 void rtrim(std::string &s);
 
+/// true for a config value of yes, true or 1, in either case
+inline bool parse_bool(const std::string &v) {
+  return v == "yes" || v == "YES" || v == "true" || v == "TRUE" || v == "1";
+}
+
 inline bool caseCompareChar(char a, char b) { return (std::toupper(a) == std::toupper(b)); }
 
 inline bool caseCompareString(const std::string &s1, const std::string &s2) {
@@ -0,0 +1,46 @@
+/**
+ * @file    zmq_frame_format.h
+ * @brief   wire layout of frames published by ZmqPublisher
+ *
+ * Each frame is one ZeroMQ multipart message, delivered whole or not at all:
+ *   topic           PUB sockets only, for subscription filtering
+ *   ZmqFrameHeader  the frame metadata
+ *   pixels          num_chunks parts of chunk_bytes, the last one shorter
+ * Fields are in the publisher's native byte order. publish_seq counts
+ * every frame offered to the publisher, so a subscriber can tell frames
+ * it missed, wherever they were dropped, from gaps in the sequence.
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace Camera {
+
+  constexpr uint32_t ZMQ_FRAME_MAGIC   = 0x4D52465A;   ///< "ZFRM"
+  constexpr uint32_t ZMQ_FRAME_VERSION = 1;
+
+  enum class ZmqPattern { Pub, Push };
+
+  struct ZmqFrameHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t publish_seq;         ///< publisher's frame count, gaps are lost frames
+    uint64_t publish_ns;          ///< CLOCK_REALTIME when the frame was sent
+    uint64_t frame_number;
+    uint64_t timestamp;
+    uint64_t sequence_number;
+    uint64_t host_time_ns;        ///< CLOCK_MONOTONIC on the camera host
+    uint64_t data_size;           ///< pixel bytes over all chunks
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_per_pixel;
+    uint32_t pixel_format;        ///< Camera::PixelFormat
+    uint32_t big_endian;
+    uint32_t roi_id;
+    uint32_t roi_x;
+    uint32_t roi_y;
+    uint32_t chunk_bytes;
+    uint32_t num_chunks;
+  };
+
+}
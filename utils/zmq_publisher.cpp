@@ -0,0 +1,314 @@
+/**
+ * @file    zmq_publisher.cpp
+ * @brief   FrameOutput that publishes frames over ZeroMQ
+ */
+
+#include "zmq_publisher.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <zmq.h>
+
+namespace {
+
+  uint64_t realtime_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch()).count());
+  }
+
+}
+
+namespace Camera {
+
+  ZmqPattern parse_zmq_pattern(const std::string &s) {
+    if (s == "pub")  return ZmqPattern::Pub;
+    if (s == "push") return ZmqPattern::Push;
+    throw std::invalid_argument("expected pub|push");
+  }
+
+  /**
+   * Keeps a frame's buffer alive until ZeroMQ has released every pixel
+   * part that points into it
+   */
+  struct ZmqPublisher::Hold {
+    std::shared_ptr<const char[]> data;
+    std::atomic<uint32_t> parts;
+    ZmqPublisher* owner;
+  };
+
+  // called by ZeroMQ, on its I/O thread, once per pixel part
+  void ZmqPublisher::release_part(void* /*data*/, void* hint) {
+    auto* hold = static_cast<Hold*>(hint);
+    if (hold->parts.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      hold->owner->in_flight_.fetch_sub(1, std::memory_order_relaxed);
+      delete hold;
+    }
+  }
+
+  ZmqPublisher::ZmqPublisher(ZmqPublisherConfig cfg)
+    : cfg_(std::move(cfg)) {
+  }
+
+  ZmqPublisher::~ZmqPublisher() {
+    this->close();
+  }
+
+  long ZmqPublisher::open() {
+    const std::string function("Camera::ZmqPublisher::open");
+
+    if (context_) {
+      logwrite(function, "ERROR already opened");
+      return ERROR;
+    }
+    if (cfg_.chunk_bytes == 0 || cfg_.chunk_bytes > UINT32_MAX || cfg_.hwm < 0) {
+      logwrite(function, "ERROR chunk_bytes must be 1 to 4294967295 and hwm >= 0");
+      return ERROR;
+    }
+    if (cfg_.overflow != OverflowPolicy::DropNewest && cfg_.overflow != OverflowPolicy::Block) {
+      logwrite(function, std::string("NOTICE overflow=") + to_string(cfg_.overflow) +
+               " does not apply to ZeroMQ; using drop_newest");
+      cfg_.overflow = OverflowPolicy::DropNewest;
+    }
+
+    context_ = zmq_ctx_new();
+    if (!context_) {
+      logwrite(function, std::string("ERROR creating ZeroMQ context: ") + zmq_strerror(zmq_errno()));
+      return ERROR;
+    }
+    zmq_ctx_set(context_, ZMQ_IO_THREADS, std::max(1, cfg_.io_threads));
+
+    if (this->make_socket() != NO_ERROR) {
+      zmq_ctx_term(context_);
+      context_ = nullptr;
+      return ERROR;
+    }
+
+    publish_seq_ = 0;
+    logwrite(function, "publishing on " + cfg_.endpoint +
+             " pattern=" + (cfg_.pattern == ZmqPattern::Pub ? "pub topic=" + cfg_.topic : std::string("push")) +
+             " chunk_bytes=" + std::to_string(cfg_.chunk_bytes) +
+             " hwm=" + std::to_string(cfg_.hwm) +
+             " overflow=" + to_string(cfg_.overflow));
+    return NO_ERROR;
+  }
+
+  long ZmqPublisher::make_socket() {
+    const std::string function("Camera::ZmqPublisher::make_socket");
+
+    socket_ = zmq_socket(context_, cfg_.pattern == ZmqPattern::Pub ? ZMQ_PUB : ZMQ_PUSH);
+
+    // a blocking send waits at most block_ms; only a PUB set to block
+    // reports a full subscriber instead of skipping it
+    const int block = (cfg_.block_ms == 0) ? -1 : static_cast<int>(cfg_.block_ms);
+    const int nodrop = 1;
+    bool ok = socket_ != nullptr &&
+              zmq_setsockopt(socket_, ZMQ_SNDHWM, &cfg_.hwm, sizeof(int)) == 0 &&
+              zmq_setsockopt(socket_, ZMQ_LINGER, &cfg_.linger_ms, sizeof(int)) == 0 &&
+              zmq_setsockopt(socket_, ZMQ_SNDTIMEO, &block, sizeof(int)) == 0;
+    if (ok && cfg_.pattern == ZmqPattern::Pub && cfg_.overflow == OverflowPolicy::Block) {
+      ok = zmq_setsockopt(socket_, ZMQ_XPUB_NODROP, &nodrop, sizeof(int)) == 0;
+    }
+    // a socket just closed gives up its endpoint on the I/O thread, shortly
+    for (int tries = 0; ok; ++tries) {
+      if (zmq_bind(socket_, cfg_.endpoint.c_str()) == 0) break;
+      ok = (zmq_errno() == EADDRINUSE && tries < 50);
+      if (ok) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    if (!ok) {
+      logwrite(function, "ERROR binding " + cfg_.endpoint + ": " + zmq_strerror(zmq_errno()));
+      if (socket_) zmq_close(socket_);
+      socket_ = nullptr;
+      return ERROR;
+    }
+    return NO_ERROR;
+  }
+
+  /**
+   * A multipart message cannot be withdrawn once its first part is queued,
+   * and the next frame's parts would be appended to it, so a frame that
+   * fails part way replaces the socket. What the old one had queued is
+   * lost; subscribers reconnect on their own and see a sequence gap.
+   */
+  void ZmqPublisher::replace_socket() {
+    const std::string function("Camera::ZmqPublisher::replace_socket");
+    const int linger = 0;
+    zmq_setsockopt(socket_, ZMQ_LINGER, &linger, sizeof(int));
+    zmq_close(socket_);
+    socket_ = nullptr;
+    if (this->make_socket() == NO_ERROR) {
+      logwrite(function, "NOTICE frame abandoned part way; socket on " + cfg_.endpoint + " replaced");
+    }
+  }
+
+  void ZmqPublisher::close() {
+    if (!context_) return;
+    const std::string function("Camera::ZmqPublisher::close");
+
+    // waits up to linger_ms for queued frames, then releases their buffers
+    if (socket_) zmq_close(socket_);
+    while (zmq_ctx_term(context_) != 0 && zmq_errno() == EINTR) { }
+    socket_ = context_ = nullptr;
+
+    const Stats s = this->stats();
+    char rate[32];
+    std::snprintf(rate, sizeof(rate), "%.1f", s.mb_per_s());
+    logwrite(function, "stopped " + cfg_.endpoint + ": sent=" + std::to_string(s.frames_sent) +
+             " dropped=" + std::to_string(s.frames_dropped) +
+             " blocked=" + std::to_string(s.frames_blocked) +
+             " failed=" + std::to_string(s.frames_failed) +
+             " bytes=" + std::to_string(s.bytes_sent) + " rate=" + rate + "MB/s");
+  }
+
+  long ZmqPublisher::write(const char* data, size_t size, const FrameMetadata& meta) {
+    if (!socket_) return ERROR;
+
+    // the one memcpy, into a buffer the pixel parts can own
+    std::shared_ptr<char[]> copy(new char[size]);
+    std::memcpy(copy.get(), data, size);
+    return this->write_shared(std::move(copy), size, meta);
+  }
+
+  long ZmqPublisher::write_shared(std::shared_ptr<const char[]> data, size_t size, const FrameMetadata& meta) {
+    const std::string function("Camera::ZmqPublisher::write_shared");
+    if (!socket_) return ERROR;
+
+    const uint32_t num_chunks = static_cast<uint32_t>((size + cfg_.chunk_bytes - 1) / cfg_.chunk_bytes);
+
+    ZmqFrameHeader header{};
+    header.magic           = ZMQ_FRAME_MAGIC;
+    header.version         = ZMQ_FRAME_VERSION;
+    header.publish_seq     = publish_seq_++;
+    header.publish_ns      = realtime_ns();
+    header.frame_number    = meta.frame_number;
+    header.timestamp       = meta.timestamp;
+    header.sequence_number = meta.sequence_number;
+    header.host_time_ns    = meta.host_time_ns;
+    header.data_size       = size;
+    header.width           = meta.width;
+    header.height          = meta.height;
+    header.bytes_per_pixel = meta.bytes_per_pixel;
+    header.pixel_format    = static_cast<uint32_t>(pixel_format_of(meta));
+    header.big_endian      = meta.big_endian ? 1 : 0;
+    header.roi_id          = meta.roi_id;
+    header.roi_x           = meta.roi_x;
+    header.roi_y           = meta.roi_y;
+    header.chunk_bytes     = static_cast<uint32_t>(cfg_.chunk_bytes);
+    header.num_chunks      = num_chunks;
+
+    // Whether the frame goes at all is settled by its first part; the
+    // high-water mark counts whole messages, so the rest is never refused
+    const bool pub = (cfg_.pattern == ZmqPattern::Pub);
+    const void* first   = pub ? static_cast<const void*>(cfg_.topic.data()) : &header;
+    const size_t first_size = pub ? cfg_.topic.size() : sizeof(header);
+    const int first_more = (pub || num_chunks > 0) ? ZMQ_SNDMORE : 0;
+
+    int err = this->send_part(first, first_size, first_more | ZMQ_DONTWAIT);
+    if (err == EAGAIN && cfg_.overflow == OverflowPolicy::Block) {
+      n_blocked_.fetch_add(1, std::memory_order_relaxed);
+      err = this->send_part(first, first_size, first_more);
+    }
+    if (err == EAGAIN) {
+      n_dropped_.fetch_add(1, std::memory_order_relaxed);
+      return (cfg_.overflow == OverflowPolicy::Block) ? ERROR : NO_ERROR;
+    }
+    if (err != 0) {
+      logwrite(function, std::string("ERROR sending frame: ") + zmq_strerror(err));
+      n_failed_.fetch_add(1, std::memory_order_relaxed);
+      return ERROR;
+    }
+    if (pub && (err = this->send_part(&header, sizeof(header), num_chunks > 0 ? ZMQ_SNDMORE : 0)) != 0) {
+      logwrite(function, std::string("ERROR sending frame: ") + zmq_strerror(err));
+      n_failed_.fetch_add(1, std::memory_order_relaxed);
+      this->replace_socket();
+      return ERROR;
+    }
+
+    // pixel parts point into the frame buffer; the last one released frees it
+    if (num_chunks > 0) {
+      auto* hold = new Hold{ std::move(data), {num_chunks}, this };
+      in_flight_.fetch_add(1, std::memory_order_relaxed);
+      char* pixels = const_cast<char*>(hold->data.get());
+
+      for (uint32_t i = 0; i < num_chunks; ++i) {
+        const size_t offset = static_cast<size_t>(i) * cfg_.chunk_bytes;
+        zmq_msg_t part;
+        zmq_msg_init_data(&part, pixels + offset, std::min(cfg_.chunk_bytes, size - offset), &ZmqPublisher::release_part, hold);
+        int rc;
+        while ((rc = zmq_msg_send(&part, socket_, i + 1 < num_chunks ? ZMQ_SNDMORE : 0)) < 0 && zmq_errno() == EINTR) { }
+        if (rc < 0) {
+          logwrite(function, std::string("ERROR sending frame: ") + zmq_strerror(zmq_errno()));
+          zmq_msg_close(&part);
+          for (uint32_t j = i + 1; j < num_chunks; ++j) release_part(nullptr, hold);
+          n_failed_.fetch_add(1, std::memory_order_relaxed);
+          this->replace_socket();
+          return ERROR;
+        }
+      }
+    }
+
+    const uint64_t t = get_clock_time_nsec();
+    uint64_t unset = 0;
+    first_send_ns_.compare_exchange_strong(unset, t);
+    last_send_ns_.store(t, std::memory_order_relaxed);
+    n_sent_.fetch_add(1, std::memory_order_relaxed);
+    n_bytes_.fetch_add(size, std::memory_order_relaxed);
+    latency_.record_since(meta.host_time_ns);
+    return NO_ERROR;
+  }
+
+  // 0, or the ZeroMQ error number
+  int ZmqPublisher::send_part(const void* data, size_t size, int flags) {
+    while (zmq_send(socket_, data, size, flags) < 0) {
+      const int err = zmq_errno();
+      if (err != EINTR) return err;
+    }
+    return 0;
+  }
+
+  ZmqPublisher::Stats ZmqPublisher::stats() const {
+    Stats s;
+    s.frames_sent    = n_sent_.load();
+    s.frames_dropped = n_dropped_.load();
+    s.frames_blocked = n_blocked_.load();
+    s.frames_failed  = n_failed_.load();
+    s.bytes_sent     = n_bytes_.load();
+    const uint64_t t0 = first_send_ns_.load(), t1 = last_send_ns_.load();
+    s.elapsed_s = (t1 > t0 && t0 > 0) ? (t1 - t0) / 1.0e9 : 0.0;
+    return s;
+  }
+
+  QueueStatus ZmqPublisher::queue_status() const {
+    QueueStatus status;
+    status.depth    = in_flight_.load();
+    status.capacity = static_cast<size_t>(cfg_.hwm);
+    status.dropped  = n_dropped_.load();
+    status.blocked  = n_blocked_.load();
+    status.set_pressure(cfg_.overflow);
+    return status;
+  }
+
+  OutputMetrics ZmqPublisher::metrics() const {
+    const Stats s = this->stats();
+    OutputMetrics m;
+    m.kind           = "zmq";
+    m.frames_in      = s.frames_sent + s.frames_dropped + s.frames_failed;
+    m.frames_written = s.frames_sent;
+    m.frames_dropped = s.frames_dropped;
+    m.frames_failed  = s.frames_failed;
+    m.bytes_written  = s.bytes_sent;
+    m.latency = latency_.snapshot();
+    m.queue   = this->queue_status();
+    m.detail["blocked"]  = s.frames_blocked;
+    m.detail["mb_per_s"] = s.mb_per_s();
+    return m;
+  }
+
+}
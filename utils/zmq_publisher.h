@@ -0,0 +1,97 @@
+/**
+ * @file    zmq_publisher.h
+ * @brief   FrameOutput that publishes frames over ZeroMQ
+ *
+ * Frames go out on a PUB or PUSH socket in the layout of
+ * zmq_frame_format.h. The pixel parts reference the producer's buffer
+ * (write_shared) and hold it until ZeroMQ has sent them, so a frame is
+ * never copied into the socket; write() copies it once into a buffer the
+ * parts can own.
+ *
+ * The send high-water mark counts whole frames. Past it a PUB socket
+ * skips each slow subscriber on its own, which only the subscribers see
+ * as sequence gaps, unless the overflow policy is block: then the frame
+ * waits up to block_ms for every subscriber to have room and is dropped
+ * for all of them if one still has none. A PUSH socket at the mark, or
+ * with no peer connected, drops the frame or, under block, waits.
+ * Queued frames cannot be recalled, so drop_oldest and spill do not apply.
+ */
+#pragma once
+
+#include "frame_output.h"
+#include "zmq_frame_format.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Camera {
+
+  // "pub" | "push"; throws std::invalid_argument
+  ZmqPattern parse_zmq_pattern(const std::string &s);
+
+  struct ZmqPublisherConfig {
+    std::string endpoint{"tcp://*:5560"};   ///< bind address, e.g. ipc:///tmp/camera.frames
+    ZmqPattern  pattern{ZmqPattern::Pub};
+    std::string topic{"frame"};             ///< PUB: first part of every frame
+    size_t      chunk_bytes{1 << 20};       ///< pixel bytes per message part
+    int         hwm{8};                     ///< frames queued per peer
+    OverflowPolicy overflow{OverflowPolicy::DropNewest};  ///< drop_newest or block
+    uint32_t    block_ms{100};              ///< block: longest a send waits, 0 for no limit
+    int         io_threads{1};
+    int         linger_ms{1000};            ///< close() waits this long for queued frames
+  };
+
+  class ZmqPublisher : public FrameOutput {
+    public:
+      explicit ZmqPublisher(ZmqPublisherConfig cfg);
+      ~ZmqPublisher() override;
+
+      ZmqPublisher(const ZmqPublisher&) = delete;
+      ZmqPublisher& operator=(const ZmqPublisher&) = delete;
+
+      long open() override;
+      long write(const char* data, size_t size, const FrameMetadata& meta) override;
+      long write_shared(std::shared_ptr<const char[]> data, size_t size, const FrameMetadata& meta) override;
+      void close() override;
+
+      struct Stats {
+        uint64_t frames_sent{0};
+        uint64_t frames_dropped{0};       ///< refused at the high-water mark
+        uint64_t frames_blocked{0};       ///< waited for room
+        uint64_t frames_failed{0};
+        uint64_t bytes_sent{0};
+        double   elapsed_s{0};            ///< first to last frame sent
+        double mb_per_s() const { return elapsed_s > 0 ? bytes_sent / elapsed_s / 1.0e6 : 0.0; }
+      };
+      Stats stats() const;
+
+      QueueStatus queue_status() const override;
+      OutputMetrics metrics() const override;
+
+    private:
+      struct Hold;
+      static void release_part(void* data, void* hint);
+
+      long make_socket();
+      void replace_socket();
+      int send_part(const void* data, size_t size, int flags);
+
+      ZmqPublisherConfig cfg_;
+      void* context_{nullptr};
+      void* socket_{nullptr};
+      uint64_t publish_seq_{0};           ///< only touched on the producer thread
+
+      std::atomic<size_t>   in_flight_{0};  ///< frames whose parts ZeroMQ still holds
+      std::atomic<uint64_t> n_sent_{0};
+      std::atomic<uint64_t> n_dropped_{0};
+      std::atomic<uint64_t> n_blocked_{0};
+      std::atomic<uint64_t> n_failed_{0};
+      std::atomic<uint64_t> n_bytes_{0};
+      std::atomic<uint64_t> first_send_ns_{0};
+      std::atomic<uint64_t> last_send_ns_{0};
+      LatencyHistogram latency_;          ///< frame arrival to handed to ZeroMQ
+  };
+
+}
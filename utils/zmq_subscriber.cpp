@@ -0,0 +1,189 @@
+/**
+ * @file    zmq_subscriber.cpp
+ * @brief   receiving side of ZmqPublisher
+ */
+
+#include "zmq_subscriber.h"
+#include "common.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include <zmq.h>
+
+namespace Camera {
+
+  ZmqSubscriber::ZmqSubscriber(const std::string &endpoint, ZmqPattern pattern,
+                               const std::string &topic, int rcvhwm)
+    : endpoint_(endpoint), pattern_(pattern), topic_(topic), rcvhwm_(rcvhwm) {
+  }
+
+  ZmqSubscriber::~ZmqSubscriber() {
+    this->close();
+  }
+
+  long ZmqSubscriber::open() {
+    const std::string function("Camera::ZmqSubscriber::open");
+
+    if (socket_) return NO_ERROR;
+
+    context_ = zmq_ctx_new();
+    if (!context_) {
+      logwrite(function, std::string("ERROR creating ZeroMQ context: ") + zmq_strerror(zmq_errno()));
+      return ERROR;
+    }
+    socket_ = zmq_socket(context_, pattern_ == ZmqPattern::Pub ? ZMQ_SUB : ZMQ_PULL);
+
+    const int linger = 0;
+    bool ok = socket_ != nullptr &&
+              zmq_setsockopt(socket_, ZMQ_RCVHWM, &rcvhwm_, sizeof(int)) == 0 &&
+              zmq_setsockopt(socket_, ZMQ_LINGER, &linger, sizeof(int)) == 0;
+    if (ok && pattern_ == ZmqPattern::Pub) {
+      ok = zmq_setsockopt(socket_, ZMQ_SUBSCRIBE, topic_.data(), topic_.size()) == 0;
+    }
+    if (ok) ok = zmq_connect(socket_, endpoint_.c_str()) == 0;
+
+    if (!ok) {
+      logwrite(function, "ERROR connecting to " + endpoint_ + ": " + zmq_strerror(zmq_errno()));
+      this->close();
+      return ERROR;
+    }
+    started_ = false;
+    return NO_ERROR;
+  }
+
+  void ZmqSubscriber::close() {
+    if (socket_) zmq_close(socket_);
+    if (context_) zmq_ctx_term(context_);
+    socket_ = context_ = nullptr;
+  }
+
+  long ZmqSubscriber::next(Frame &frame, int timeout_ms) {
+    if (!socket_) return ERROR;
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true) {
+      int wait_ms = timeout_ms;
+      if (timeout_ms >= 0) {
+        wait_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count());
+        if (wait_ms < 0) wait_ms = 0;
+      }
+
+      zmq_pollitem_t item{ socket_, 0, ZMQ_POLLIN, 0 };
+      const int n = zmq_poll(&item, 1, wait_ms);
+      if (n < 0 && zmq_errno() != EINTR) return ERROR;
+      if (n <= 0) {
+        if (timeout_ms >= 0 && wait_ms == 0) return TIMEOUT;
+        continue;
+      }
+
+      // a malformed message is counted and skipped
+      const long ret = this->receive(frame);
+      if (ret != TIMEOUT) return ret;
+    }
+  }
+
+  long ZmqSubscriber::receive(Frame &frame) {
+    const std::string function("Camera::ZmqSubscriber::receive");
+
+    // ZeroMQ delivers all parts of a message or none, so once the first
+    // part is here the rest are too
+    ZmqFrameHeader header{};
+    const int header_part = (pattern_ == ZmqPattern::Pub) ? 1 : 0;
+    int part = 0;
+    bool valid = true;
+    size_t filled = 0;
+    bool more = true;
+
+    while (more) {
+      zmq_msg_t msg;
+      zmq_msg_init(&msg);
+      if (zmq_msg_recv(&msg, socket_, 0) < 0) {
+        const int err = zmq_errno();
+        zmq_msg_close(&msg);
+        if (err == EINTR) continue;
+        logwrite(function, "ERROR receiving from " + endpoint_ + ": " + zmq_strerror(err));
+        return ERROR;
+      }
+      more = zmq_msg_more(&msg) != 0;
+      const size_t size = zmq_msg_size(&msg);
+      const char* bytes = static_cast<const char*>(zmq_msg_data(&msg));
+      const int index = part++ - header_part;
+
+      if (index == 0) {
+        if (size == sizeof(header)) std::memcpy(&header, bytes, sizeof(header));
+        valid = size == sizeof(header) &&
+                header.magic == ZMQ_FRAME_MAGIC && header.version == ZMQ_FRAME_VERSION &&
+                header.chunk_bytes > 0 &&
+                header.num_chunks == (header.data_size + header.chunk_bytes - 1) / header.chunk_bytes;
+        if (valid) buffer_.resize(header.data_size);
+      }
+      else if (index > 0 && valid) {
+        const size_t offset = static_cast<size_t>(index - 1) * header.chunk_bytes;
+        if (static_cast<uint32_t>(index) > header.num_chunks || size > header.chunk_bytes ||
+            offset + size > header.data_size) {
+          valid = false;
+        }
+        else {
+          std::memcpy(buffer_.data() + offset, bytes, size);
+          filled += size;
+        }
+      }
+      zmq_msg_close(&msg);
+    }
+
+    if (!valid || part - header_part != static_cast<int>(header.num_chunks) + 1 || filled != header.data_size) {
+      stats_.malformed++;
+      return TIMEOUT;
+    }
+
+    // a sequence that went backwards is a restarted publisher
+    if (started_ && header.publish_seq > next_seq_) stats_.dropped += header.publish_seq - next_seq_;
+    next_seq_ = header.publish_seq + 1;
+    started_ = true;
+
+    const auto now_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::system_clock::now().time_since_epoch()).count());
+    if (now_ns > header.publish_ns) latency_.record(now_ns - header.publish_ns);
+
+    stats_.frames++;
+    stats_.bytes += header.data_size;
+    frame.info = header;
+    frame.data = buffer_.data();
+    return NO_ERROR;
+  }
+
+  ZmqSubscriber::Stats ZmqSubscriber::stats() const {
+    Stats s = stats_;
+    s.latency = latency_.snapshot();
+    return s;
+  }
+
+  void ZmqSubscriber::clear_stats() {
+    stats_ = Stats{};
+    latency_.clear();
+  }
+
+  std::string ZmqSubscriber::summary(double elapsed_s) const {
+    const Stats s = this->stats();
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1)
+       << "frames=" << s.frames
+       << " rate=" << (elapsed_s > 0 ? s.frames / elapsed_s : 0.0) << "Hz"
+       << " throughput=" << (elapsed_s > 0 ? s.bytes / elapsed_s / 1.0e6 : 0.0) << "MB/s"
+       << " dropped=" << s.dropped
+       << " malformed=" << s.malformed;
+    if (s.latency.count > 0) {
+      ss << "\n  publish->reassembled latency: p50<=" << s.latency.percentile_us(50)
+         << "us p99<=" << s.latency.percentile_us(99)
+         << "us mean=" << s.latency.mean_us()
+         << "us max=" << s.latency.max_us() << "us";
+    }
+    return ss.str();
+  }
+
+}
@@ -0,0 +1,73 @@
+/**
+ * @file    zmq_subscriber.h
+ * @brief   receiving side of ZmqPublisher
+ *
+ * Connects a SUB or PULL socket to a ZmqPublisher, reassembles each
+ * multipart message into one contiguous frame and checks it against its
+ * header. Frames the publisher or the network dropped show up as gaps in
+ * publish_seq and are counted.
+ */
+#pragma once
+
+#include "zmq_frame_format.h"
+#include "latency_histogram.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Camera {
+
+  class ZmqSubscriber {
+    public:
+      struct Frame {
+        ZmqFrameHeader info;
+        const char* data{nullptr};      ///< valid until the next call
+      };
+
+      struct Stats {
+        uint64_t frames{0};             ///< frames delivered
+        uint64_t bytes{0};
+        uint64_t dropped{0};            ///< gaps in publish_seq
+        uint64_t malformed{0};          ///< messages that did not match their header
+        LatencySnapshot latency;        ///< published to reassembled, across hosts needs synced clocks
+      };
+
+      // endpoint to connect to, e.g. tcp://camerahost:5560; a PUB topic of
+      // "" takes every topic
+      ZmqSubscriber(const std::string &endpoint, ZmqPattern pattern = ZmqPattern::Pub,
+                    const std::string &topic = "frame", int rcvhwm = 8);
+      ~ZmqSubscriber();
+
+      ZmqSubscriber(const ZmqSubscriber&) = delete;
+      ZmqSubscriber& operator=(const ZmqSubscriber&) = delete;
+
+      long open();
+      void close();
+
+      // Waits up to timeout_ms (negative waits forever) for the next whole
+      // frame. NO_ERROR, TIMEOUT or ERROR.
+      long next(Frame &frame, int timeout_ms);
+
+      Stats stats() const;
+      void clear_stats();
+      std::string summary(double elapsed_s) const;
+
+    private:
+      long receive(Frame &frame);       ///< NO_ERROR, ERROR, or TIMEOUT for a malformed message
+
+      std::string endpoint_;
+      ZmqPattern pattern_;
+      std::string topic_;
+      int rcvhwm_;
+
+      void* context_{nullptr};
+      void* socket_{nullptr};
+      bool started_{false};
+      uint64_t next_seq_{0};
+      std::vector<char> buffer_;
+      Stats stats_;
+      LatencyHistogram latency_;
+  };
+
+}
@@ -0,0 +1,209 @@
+//
+// zmqsub.cpp
+//
+// Receives frames from a camerad ZeroMQ publisher and reports them, or
+// benchmarks the transport end to end with an in-process publisher.
+//
+//   zmqsub [-u] [-t topic] [-q] [-n count] [-i interval] [-o file] endpoint
+//   zmqsub -b [-u] [-n frames] [-s frame_bytes] [-c chunk_bytes] [endpoint]
+//
+
+#include "zmq_publisher.h"
+#include "zmq_subscriber.h"
+#include "common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+
+  constexpr int POLL_MS = 200;   // how often a blocked read rechecks for Ctrl-C
+
+  std::atomic<bool> stop{false};
+
+  void on_signal(int) { stop.store(true); }
+
+  constexpr std::string_view usage() {
+    return "usage: zmqsub [-u] [-t topic] [-q] [-n count] [-i interval_s] [-o file] endpoint\n"
+           "       zmqsub -b [-u] [-n frames] [-s frame_bytes] [-c chunk_bytes] [endpoint]\n"
+           "  -u  pull from a push publisher (default subscribe to a pub publisher)\n"
+           "  -t  topic to subscribe to (default frame)\n"
+           "  -q  quiet: statistics only\n"
+           "  -n  stop after this many frames\n"
+           "  -i  print statistics every interval_s seconds\n"
+           "  -o  append the raw pixels of each frame to file (- for stdout)\n"
+           "  -b  benchmark: run a publisher in this process and measure the transport,\n"
+           "      over ipc unless an endpoint such as tcp://127.0.0.1:5560 is given\n"
+           "  -s  benchmark frame size in bytes (default 8388608)\n"
+           "  -c  benchmark chunk size in bytes (default 1048576)\n";
+  }
+
+  double seconds_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  }
+
+}
+
+int main(int argc, char *argv[]) {
+  Camera::ZmqPattern pattern = Camera::ZmqPattern::Pub;
+  std::string topic = "frame";
+  bool quiet = false;
+  bool bench = false;
+  uint64_t count = 0;
+  double interval = 0;
+  std::string outfile;
+  size_t frame_bytes = 8 << 20;
+  size_t chunk_bytes = 1 << 20;
+  std::string endpoint;
+
+  try {
+  for ( int i=1; i<argc; ++i ) {
+    const std::string arg = argv[i];
+    if ( arg.size() == 2 && arg[0] == '-' ) {
+      switch ( arg[1] ) {
+        case 'u' : pattern = Camera::ZmqPattern::Push; break;
+        case 'q' : quiet = true; break;
+        case 'b' : bench = true; break;
+        case 't' : topic = argv[++i]; break;
+        case 'n' : count = std::stoull( argv[++i] ); break;
+        case 'i' : interval = std::stod( argv[++i] ); break;
+        case 'o' : outfile = argv[++i]; break;
+        case 's' : frame_bytes = std::stoull( argv[++i] ); break;
+        case 'c' : chunk_bytes = std::stoull( argv[++i] ); break;
+        default:   std::cout << usage(); return 1;
+      }
+    } else endpoint = arg;
+  }
+  }
+  catch (...) { std::cout << usage(); return 1; }
+
+  if ( !bench && endpoint.empty() ) { std::cout << usage(); return 1; }
+  if ( bench ) {
+    if ( endpoint.empty() ) endpoint = "ipc:///tmp/zmqsub_bench_" + std::to_string( getpid() );
+    if ( count == 0 ) count = 1000;
+    quiet = true;
+  }
+
+  std::signal( SIGINT, on_signal );
+  std::signal( SIGTERM, on_signal );
+
+  // In benchmark mode the publisher binds the endpoint and, blocking
+  // rather than dropping, runs flat out on its own thread. The bound on
+  // the block lets it finish if the subscriber is stopped first.
+  //
+  std::unique_ptr<Camera::ZmqPublisher> publisher;
+  std::thread publisher_thread;
+  double publisher_seconds = 0;
+  std::atomic<bool> publisher_done{false};
+  if ( bench ) {
+    Camera::ZmqPublisherConfig cfg;
+    cfg.endpoint = endpoint;
+    cfg.pattern = pattern;
+    cfg.topic = topic;
+    cfg.chunk_bytes = chunk_bytes;
+    cfg.overflow = Camera::OverflowPolicy::Block;
+    cfg.block_ms = 1000;
+    cfg.linger_ms = 0;
+    publisher = std::make_unique<Camera::ZmqPublisher>( cfg );
+    if ( publisher->open() != NO_ERROR ) {
+      std::cerr << "ERROR binding benchmark endpoint " << endpoint << "\n";
+      return 1;
+    }
+  }
+
+  Camera::ZmqSubscriber subscriber( endpoint, pattern, topic );
+  if ( subscriber.open() != NO_ERROR ) {
+    std::cerr << "ERROR connecting to " << endpoint << "\n";
+    return 1;
+  }
+
+  if ( bench ) {
+    publisher_thread = std::thread( [&] {
+      // a PUB socket sends nothing to a subscriber it has not yet seen
+      std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+      std::shared_ptr<char[]> frame( new char[frame_bytes] );
+      std::fill_n( frame.get(), frame_bytes, 1 );
+      Camera::FrameMetadata meta;
+      meta.width = static_cast<uint32_t>( frame_bytes / 2 );
+      meta.height = 1;
+      meta.bytes_per_pixel = 2;
+      const auto t0 = std::chrono::steady_clock::now();
+      for ( uint64_t k=0; k<count && !stop.load(); ++k ) {
+        meta.frame_number = k;
+        meta.host_time_ns = get_clock_time_nsec();
+        publisher->write_shared( frame, frame_bytes, meta );
+      }
+      publisher_seconds = seconds_since( t0 );
+      publisher_done.store( true );
+    } );
+  }
+
+  FILE* out = nullptr;
+  if ( !outfile.empty() ) {
+    out = ( outfile == "-" ) ? stdout : std::fopen( outfile.c_str(), "ab" );
+    if ( !out ) { std::cerr << "ERROR opening " << outfile << "\n"; return 1; }
+  }
+
+  auto tlast = std::chrono::steady_clock::now();
+  bool started = false;
+  uint64_t delivered = 0;
+  Camera::ZmqSubscriber::Frame frame;
+
+  while ( !stop.load() && ( count == 0 || delivered < count ) ) {
+    const long ret = subscriber.next( frame, POLL_MS );
+    if ( ret == TIMEOUT ) {
+      // the benchmark is over once the publisher is done and nothing is left
+      if ( bench && publisher_done.load() ) break;
+      continue;
+    }
+    if ( ret != NO_ERROR ) { std::cerr << "ERROR reading " << endpoint << "\n"; break; }
+    ++delivered;
+
+    // rates are timed from the first frame, not from the connect
+    if ( !started ) { started = true; tlast = std::chrono::steady_clock::now(); }
+
+    if ( !quiet ) {
+      std::cerr << "frame=" << frame.info.frame_number
+                << " ts=" << frame.info.timestamp
+                << " " << frame.info.width << "x" << frame.info.height << "x" << frame.info.bytes_per_pixel
+                << " bytes=" << frame.info.data_size
+                << " seq=" << frame.info.publish_seq
+                << " chunks=" << frame.info.num_chunks << "\n";
+    }
+    if ( out ) std::fwrite( frame.data, 1, frame.info.data_size, out );
+
+    if ( interval > 0 && seconds_since( tlast ) >= interval ) {
+      std::cerr << subscriber.summary( seconds_since( tlast ) ) << "\n";
+      subscriber.clear_stats();
+      tlast = std::chrono::steady_clock::now();
+    }
+  }
+
+  const double elapsed = seconds_since( tlast );
+
+  if ( bench ) {
+    stop.store( true );
+    publisher_thread.join();
+    const auto s = publisher->stats();
+    std::cerr << "publisher: frames=" << s.frames_sent << " bytes=" << frame_bytes << " chunk=" << chunk_bytes
+              << " rate=" << ( publisher_seconds > 0 ? s.frames_sent / publisher_seconds : 0.0 ) << "Hz"
+              << " throughput=" << ( publisher_seconds > 0 ? s.bytes_sent / publisher_seconds / 1.0e6 : 0.0 ) << "MB/s"
+              << " blocked=" << s.frames_blocked << " dropped=" << s.frames_dropped << "\n";
+  }
+  std::cerr << "subscriber: " << subscriber.summary( elapsed ) << "\n";
+
+  subscriber.close();
+  if ( publisher ) publisher->close();
+  if ( out && out != stdout ) std::fclose( out );
+
+  return 0;
+}